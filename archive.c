@@ -0,0 +1,702 @@
+#define _GNU_SOURCE
+#include "archive.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ARCHIVE_DATABASE "database.db"
+#define PARTITION_PREFIX "messages-"
+#define PARTITION_NAME_LEN 20 // "messages-YYYYMMDD.db"
+#define PARTITION_PATH_SIZE 64
+#define DAY_SECONDS 86400L
+
+// Expressions lisant l'ancienne table messages, dont la date est un texte
+#define LEGACY_DAY "strftime('%Y%m%d', COALESCE(timestamp, 'now'))"
+#define LEGACY_TIME "CAST(strftime('%s', COALESCE(timestamp, 'now')) AS INTEGER)"
+
+// Règle de rétention d'un salon
+typedef struct
+{
+    sqlite3_int64 id;
+    int max_age_days;
+    long max_count;
+    uint64_t seq_cutoff; // Les messages jusqu'à ce numéro sont en trop, 0 si aucun
+} retention_rule_t;
+
+static int global_retention_days = 0;
+static unsigned long batches_written = 0; // Écrit et lu par le thread principal
+
+// Partagé avec le thread de compactage
+static pthread_mutex_t archive_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t compact_wakeup = PTHREAD_COND_INITIALIZER;
+static bool compact_requested = true; // Une première passe au démarrage
+static bool orphans_requested = true;
+static unsigned long compact_passes = 0;
+static unsigned long messages_deleted = 0;
+static unsigned long partitions_dropped = 0;
+
+static sqlite3 *open_database(const char *path, int flags)
+{
+    sqlite3 *db;
+    if (sqlite3_open_v2(path, &db, flags, NULL) != SQLITE_OK)
+    {
+        sqlite3_close(db);
+        return NULL;
+    }
+    sqlite3_busy_timeout(db, 1000);
+    return db;
+}
+
+static void partition_name(time_t when, char *name, size_t size)
+{
+    struct tm day;
+    gmtime_r(&when, &day);
+    snprintf(name, size, PARTITION_PREFIX "%04d%02d%02d.db", day.tm_year + 1900, day.tm_mon + 1, day.tm_mday);
+}
+
+// Fin (exclue) de la journée d'une partition
+static time_t partition_end(const char *name)
+{
+    struct tm day = {0};
+    if (sscanf(name, PARTITION_PREFIX "%4d%2d%2d", &day.tm_year, &day.tm_mon, &day.tm_mday) != 3)
+    {
+        return 0;
+    }
+    day.tm_year -= 1900;
+    day.tm_mon -= 1;
+    return timegm(&day) + DAY_SECONDS;
+}
+
+static int is_partition(const struct dirent *entry)
+{
+    return strlen(entry->d_name) == PARTITION_NAME_LEN && strncmp(entry->d_name, PARTITION_PREFIX, strlen(PARTITION_PREFIX)) == 0 &&
+           strcmp(entry->d_name + PARTITION_NAME_LEN - 3, ".db") == 0;
+}
+
+// Partitions de la plus ancienne à la plus récente (le nom contient la date)
+static int list_partitions(struct dirent ***list)
+{
+    return scandir(ARCHIVE_DIR, list, is_partition, alphasort);
+}
+
+static void free_partitions(struct dirent **list, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        free(list[i]);
+    }
+    free(list);
+}
+
+static void drop_partition(const char *name)
+{
+    // Une partition entière disparaît avec ses fichiers, sans DELETE
+    char path[PARTITION_PATH_SIZE];
+    const char *suffixes[] = {"", "-wal", "-shm"};
+    for (int i = 0; i < 3; i++)
+    {
+        snprintf(path, sizeof(path), ARCHIVE_DIR "/%s%s", name, suffixes[i]);
+        unlink(path);
+    }
+    pthread_mutex_lock(&archive_lock);
+    partitions_dropped++;
+    pthread_mutex_unlock(&archive_lock);
+}
+
+// Attache une partition, créée si nécessaire, sous le nom "part"
+static int attach_partition(sqlite3 *db, const char *name)
+{
+    char sql[512];
+    snprintf(sql, sizeof(sql), "ATTACH DATABASE '" ARCHIVE_DIR "/%s' AS part;", name);
+    if (sqlite3_exec(db, sql, 0, 0, 0) != SQLITE_OK)
+    {
+        fprintf(stderr, "Erreur lors de l'ouverture de la partition %s : %s\n", name, sqlite3_errmsg(db));
+        return -1;
+    }
+    // Les lectures de l'historique ne bloquent pas l'écriture des lots (WAL)
+    sqlite3_exec(db, "PRAGMA part.journal_mode=WAL;", 0, 0, 0);
+    if (sqlite3_exec(db,
+                     "CREATE TABLE IF NOT EXISTS part.messages (salon_id INTEGER NOT NULL, username TEXT NOT NULL, "
+                     "message TEXT NOT NULL, seq INTEGER NOT NULL, timestamp INTEGER NOT NULL);"
+                     "CREATE INDEX IF NOT EXISTS part.messages_salon_seq ON messages (salon_id, seq);",
+                     0, 0, 0) != SQLITE_OK)
+    {
+        fprintf(stderr, "Erreur lors de la création de la partition %s : %s\n", name, sqlite3_errmsg(db));
+        sqlite3_exec(db, "DETACH DATABASE part;", 0, 0, 0);
+        return -1;
+    }
+    return 0;
+}
+
+static sqlite3_int64 channel_id(const char *channel)
+{
+    sqlite3 *db = open_database(ARCHIVE_DATABASE, SQLITE_OPEN_READONLY);
+    sqlite3_stmt *stmt;
+    sqlite3_int64 id = -1;
+    if (db == NULL)
+    {
+        return -1;
+    }
+    if (sqlite3_prepare_v2(db, "SELECT id FROM salons WHERE name = ?;", -1, &stmt, 0) == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, channel, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            id = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return id;
+}
+
+// Valeur d'une requête sur les messages d'un salon dans une partition ; 0 si elle est NULL
+static int query_seq(const char *name, const char *sql, sqlite3_int64 id, uint64_t *value)
+{
+    char path[PARTITION_PATH_SIZE];
+    snprintf(path, sizeof(path), ARCHIVE_DIR "/%s", name);
+    sqlite3 *db = open_database(path, SQLITE_OPEN_READONLY);
+    sqlite3_stmt *stmt;
+    int found = 0;
+    if (db == NULL)
+    {
+        return 0;
+    }
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) == SQLITE_OK)
+    {
+        sqlite3_bind_int64(stmt, 1, id);
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+        {
+            *value = (uint64_t)sqlite3_column_int64(stmt, 0);
+            found = 1;
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return found;
+}
+
+static uint64_t last_seq(struct dirent **list, int count, sqlite3_int64 id)
+{
+    // De la partition la plus récente vers les plus anciennes : la première qui a un message du salon a le dernier
+    uint64_t seq = 0;
+    for (int i = count - 1; i >= 0; i--)
+    {
+        if (query_seq(list[i]->d_name, "SELECT MAX(seq) FROM messages WHERE salon_id = ?;", id, &seq))
+        {
+            break;
+        }
+    }
+    return seq;
+}
+
+static void migrate_legacy(sqlite3 *db)
+{
+    // Jours des messages de l'ancienne table, s'il en reste une
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT DISTINCT " LEGACY_DAY " FROM messages;", -1, &stmt, 0) != SQLITE_OK)
+    {
+        return;
+    }
+    char (*days)[16] = NULL;
+    int day_count = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        void *grown = realloc(days, (day_count + 1) * sizeof(*days));
+        if (grown == NULL)
+        {
+            break;
+        }
+        days = grown;
+        snprintf(days[day_count++], sizeof(*days), "%s", (const char *)sqlite3_column_text(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+
+    // Chaque jour est déplacé dans sa partition en une transaction : une interruption ne duplique rien
+    long moved = 0;
+    for (int i = 0; i < day_count; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), PARTITION_PREFIX "%.8s.db", days[i]);
+        if (attach_partition(db, name) < 0)
+        {
+            continue;
+        }
+        sqlite3_exec(db, "BEGIN;", 0, 0, 0);
+        const char *copy = "INSERT INTO part.messages (salon_id, username, message, seq, timestamp) "
+                           "SELECT salon_id, username, message, COALESCE(seq, 0), " LEGACY_TIME " FROM main.messages WHERE " LEGACY_DAY " = ?1;"
+                           "DELETE FROM main.messages WHERE " LEGACY_DAY " = ?1;";
+        const char *next = copy;
+        int ok = 1;
+        while (ok && *next != '\0' && sqlite3_prepare_v2(db, next, -1, &stmt, &next) == SQLITE_OK && stmt != NULL)
+        {
+            sqlite3_bind_text(stmt, 1, days[i], -1, SQLITE_STATIC);
+            ok = sqlite3_step(stmt) == SQLITE_DONE;
+            if (ok && strncmp(sqlite3_sql(stmt), "INSERT", 6) == 0)
+            {
+                moved += sqlite3_changes(db);
+            }
+            sqlite3_finalize(stmt);
+        }
+        sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", 0, 0, 0);
+        sqlite3_exec(db, "DETACH DATABASE part;", 0, 0, 0);
+    }
+    free(days);
+
+    // Toutes les lignes sont parties : la table n'est plus utilisée
+    int remaining = -1;
+    if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM main.messages;", -1, &stmt, 0) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            remaining = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (remaining == 0)
+    {
+        sqlite3_exec(db, "DROP TABLE main.messages;", 0, 0, 0);
+    }
+    if (moved > 0)
+    {
+        printf("Archive : %ld messages déplacés de " ARCHIVE_DATABASE " vers les partitions.\n", moved);
+    }
+}
+
+// Supprime par morceaux les messages désignés par une requête "... LIMIT ?" dont le dernier paramètre est la taille du morceau
+static long delete_chunks(sqlite3 *db, const char *sql, sqlite3_int64 id, sqlite3_int64 bound)
+{
+    sqlite3_stmt *stmt;
+    long deleted = 0;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    {
+        return 0;
+    }
+    int params = sqlite3_bind_parameter_count(stmt);
+    while (1)
+    {
+        if (params >= 3)
+        {
+            sqlite3_bind_int64(stmt, 1, id);
+            sqlite3_bind_int64(stmt, 2, bound);
+        }
+        sqlite3_bind_int(stmt, params, ARCHIVE_COMPACT_CHUNK);
+        int done = sqlite3_step(stmt) == SQLITE_DONE;
+        int changes = sqlite3_changes(db);
+        sqlite3_reset(stmt);
+        deleted += done ? changes : 0;
+        if (!done || changes < ARCHIVE_COMPACT_CHUNK)
+        {
+            break;
+        }
+        usleep(ARCHIVE_COMPACT_PAUSE_MS * 1000); // Laisser passer l'écriture des lots
+    }
+    sqlite3_finalize(stmt);
+    return deleted;
+}
+
+static int load_rules(retention_rule_t **rules)
+{
+    storage_retention_t *registry;
+    int count = storage_load_retention(&registry);
+    *rules = calloc(count > 0 ? count : 1, sizeof(retention_rule_t));
+    if (*rules == NULL)
+    {
+        free(registry);
+        return 0;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        (*rules)[i].id = registry[i].id;
+        (*rules)[i].max_age_days = registry[i].max_age_days;
+        (*rules)[i].max_count = registry[i].max_count;
+    }
+    free(registry);
+    return count;
+}
+
+static long compact_partition(const char *name, retention_rule_t *rules, int rule_count, time_t now, bool orphans, bool *empty)
+{
+    char path[PARTITION_PATH_SIZE];
+    snprintf(path, sizeof(path), ARCHIVE_DIR "/%s", name);
+    sqlite3 *db = open_database(path, SQLITE_OPEN_READWRITE);
+    long deleted = 0;
+    *empty = false;
+    if (db == NULL)
+    {
+        return 0;
+    }
+
+    time_t end = partition_end(name);
+    for (int r = 0; r < rule_count; r++)
+    {
+        retention_rule_t *rule = &rules[r];
+        if (rule->max_age_days > 0)
+        {
+            time_t cutoff = now - rule->max_age_days * DAY_SECONDS;
+            if (end <= cutoff)
+            {
+                // Journée entièrement périmée pour ce salon : tous ses messages de la partition
+                deleted += delete_chunks(db, "DELETE FROM messages WHERE rowid IN (SELECT rowid FROM messages WHERE salon_id = ? AND ? >= 0 LIMIT ?);", rule->id, 0);
+            }
+            else if (end - DAY_SECONDS < cutoff)
+            {
+                deleted += delete_chunks(db, "DELETE FROM messages WHERE rowid IN (SELECT rowid FROM messages WHERE salon_id = ? AND timestamp < ? LIMIT ?);", rule->id, cutoff);
+            }
+        }
+        if (rule->seq_cutoff > 0)
+        {
+            deleted += delete_chunks(db, "DELETE FROM messages WHERE rowid IN (SELECT rowid FROM messages WHERE salon_id = ? AND seq <= ? LIMIT ?);", rule->id, (sqlite3_int64)rule->seq_cutoff);
+        }
+    }
+
+    // Messages des salons supprimés (leur identifiant n'est jamais réutilisé)
+    if (orphans && sqlite3_exec(db, "ATTACH DATABASE '" ARCHIVE_DATABASE "' AS registry;", 0, 0, 0) == SQLITE_OK)
+    {
+        deleted += delete_chunks(db, "DELETE FROM messages WHERE rowid IN (SELECT rowid FROM messages WHERE salon_id NOT IN (SELECT id FROM registry.salons) LIMIT ?);", 0, 0);
+        sqlite3_exec(db, "DETACH DATABASE registry;", 0, 0, 0);
+    }
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT 1 FROM messages LIMIT 1;", -1, &stmt, 0) == SQLITE_OK)
+    {
+        *empty = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return deleted;
+}
+
+static void compact_pass(bool orphans)
+{
+    time_t now = time(NULL);
+    char current[32];
+    partition_name(now, current, sizeof(current));
+
+    struct dirent **list;
+    int count = list_partitions(&list);
+    if (count < 0)
+    {
+        return;
+    }
+
+    // Rétention globale : les partitions trop anciennes sont supprimées d'un coup
+    int first = 0;
+    while (global_retention_days > 0 && first < count && partition_end(list[first]->d_name) <= now - global_retention_days * DAY_SECONDS)
+    {
+        drop_partition(list[first++]->d_name);
+    }
+
+    // Rétention des salons : numéro limite des salons limités en nombre de messages
+    retention_rule_t *rules;
+    int rule_count = load_rules(&rules);
+    for (int r = 0; r < rule_count; r++)
+    {
+        uint64_t last = rules[r].max_count > 0 ? last_seq(list + first, count - first, rules[r].id) : 0;
+        rules[r].seq_cutoff = last > (uint64_t)rules[r].max_count ? last - rules[r].max_count : 0;
+    }
+
+    long deleted = 0;
+    for (int i = first; i < count; i++)
+    {
+        bool empty;
+        deleted += compact_partition(list[i]->d_name, rules, rule_count, now, orphans, &empty);
+        if (empty && strcmp(list[i]->d_name, current) != 0)
+        {
+            drop_partition(list[i]->d_name); // Partition vidée : ses fichiers disparaissent
+        }
+    }
+    free(rules);
+    free_partitions(list, count);
+
+    pthread_mutex_lock(&archive_lock);
+    compact_passes++;
+    messages_deleted += deleted;
+    pthread_mutex_unlock(&archive_lock);
+}
+
+static void *compactor(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&archive_lock);
+    while (1)
+    {
+        if (!compact_requested)
+        {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += ARCHIVE_COMPACT_INTERVAL_MS / 1000;
+            pthread_cond_timedwait(&compact_wakeup, &archive_lock, &deadline);
+        }
+        bool orphans = orphans_requested;
+        compact_requested = false;
+        orphans_requested = false;
+        pthread_mutex_unlock(&archive_lock);
+
+        compact_pass(orphans);
+
+        pthread_mutex_lock(&archive_lock);
+    }
+    return NULL;
+}
+
+int archive_init(int retention_days)
+{
+    global_retention_days = retention_days;
+    if (mkdir(ARCHIVE_DIR, 0700) < 0 && errno != EEXIST)
+    {
+        perror("Erreur lors de la création du dossier " ARCHIVE_DIR);
+        return -1;
+    }
+
+    sqlite3 *db = open_database(ARCHIVE_DATABASE, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    if (db == NULL)
+    {
+        fprintf(stderr, "Erreur lors de l'ouverture de la base de données.\n");
+        return -1;
+    }
+    migrate_legacy(db);
+    sqlite3_close(db);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, compactor, NULL) != 0)
+    {
+        fprintf(stderr, "Erreur lors du démarrage du compactage de l'archive.\n");
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+int archive_write(const storage_message_t *messages, int count)
+{
+    char name[32];
+    partition_name(time(NULL), name, sizeof(name));
+
+    sqlite3 *db = open_database(ARCHIVE_DATABASE, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    if (db == NULL)
+    {
+        fprintf(stderr, "Erreur lors de l'ouverture de la base de données.\n");
+        return -1;
+    }
+    if (attach_partition(db, name) < 0)
+    {
+        sqlite3_close(db);
+        return -1;
+    }
+
+    // Un message d'un salon supprimé entre-temps n'est pas écrit
+    sqlite3_stmt *stmt;
+    const char *sql = "INSERT INTO part.messages (salon_id, username, message, seq, timestamp) SELECT id, ?, ?, ?, ? FROM salons WHERE name = ?;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    {
+        fprintf(stderr, "Erreur lors de la préparation de la requête SQL : %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return -1;
+    }
+
+    int status = 0;
+    sqlite3_exec(db, "BEGIN;", 0, 0, 0);
+    for (int i = 0; i < count; i++)
+    {
+        sqlite3_bind_text(stmt, 1, messages[i].username, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, messages[i].text != NULL ? messages[i].text : messages[i].message, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 3, (sqlite3_int64)messages[i].seq);
+        sqlite3_bind_int64(stmt, 4, (sqlite3_int64)messages[i].timestamp);
+        sqlite3_bind_text(stmt, 5, messages[i].channel, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE)
+        {
+            fprintf(stderr, "Erreur lors de l'insertion du message : %s\n", sqlite3_errmsg(db));
+            status = -1;
+        }
+        sqlite3_reset(stmt);
+    }
+    if (sqlite3_exec(db, "COMMIT;", 0, 0, 0) != SQLITE_OK)
+    {
+        fprintf(stderr, "Erreur lors de l'écriture des messages : %s\n", sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK;", 0, 0, 0);
+        status = -1;
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    batches_written++;
+    return status;
+}
+
+uint64_t archive_last_seq(const char *channel)
+{
+    sqlite3_int64 id = channel_id(channel);
+    struct dirent **list;
+    int count = id >= 0 ? list_partitions(&list) : -1;
+    if (count < 0)
+    {
+        return 0;
+    }
+    uint64_t seq = last_seq(list, count, id);
+    free_partitions(list, count);
+    return seq;
+}
+
+int archive_replay(const char *channel, uint64_t after, history_emit_fn emit, void *context)
+{
+    sqlite3_int64 id = channel_id(channel);
+    struct dirent **list;
+    int count = id >= 0 ? list_partitions(&list) : -1;
+    if (count < 0)
+    {
+        return 0;
+    }
+
+    // Remonter jusqu'à la partition qui contient le premier message manqué
+    int first = count - 1;
+    uint64_t oldest;
+    while (first > 0 && !(query_seq(list[first]->d_name, "SELECT MIN(seq) FROM messages WHERE salon_id = ?;", id, &oldest) && oldest <= after + 1))
+    {
+        first--;
+    }
+
+    // Puis les lire dans l'ordre jusqu'à la plus récente
+    int sent = 0;
+    for (int i = first; i < count; i++)
+    {
+        char path[PATH_MAX]; // Nom lu dans le dossier : sa longueur n'est pas celle d'une partition
+        snprintf(path, sizeof(path), ARCHIVE_DIR "/%s", list[i]->d_name);
+        sqlite3 *db = open_database(path, SQLITE_OPEN_READONLY);
+        sqlite3_stmt *stmt;
+        if (db == NULL)
+        {
+            continue;
+        }
+        if (sqlite3_prepare_v2(db, "SELECT seq, message FROM messages WHERE salon_id = ? AND seq > ? ORDER BY seq;", -1, &stmt, 0) == SQLITE_OK)
+        {
+            sqlite3_bind_int64(stmt, 1, id);
+            sqlite3_bind_int64(stmt, 2, (sqlite3_int64)after);
+            while (sqlite3_step(stmt) == SQLITE_ROW)
+            {
+                const char *message = (const char *)sqlite3_column_text(stmt, 1);
+                emit(context, (uint64_t)sqlite3_column_int64(stmt, 0), message, sqlite3_column_bytes(stmt, 1));
+                sent++;
+            }
+            sqlite3_finalize(stmt);
+        }
+        sqlite3_close(db);
+    }
+    free_partitions(list, count);
+    return sent;
+}
+
+int archive_search(const char *channel, const char *pattern, int max, history_emit_fn emit, void *context)
+{
+    sqlite3_int64 id = channel_id(channel);
+    struct dirent **list;
+    int count = id >= 0 ? list_partitions(&list) : -1;
+    if (count < 0)
+    {
+        return 0;
+    }
+
+    // Motif LIKE : le texte entre deux %, avec ses caractères spéciaux échappés
+    char like[512];
+    size_t len = 0;
+    like[len++] = '%';
+    for (const char *p = pattern; *p != '\0' && len < sizeof(like) - 3; p++)
+    {
+        if (*p == '%' || *p == '_' || *p == '\\')
+        {
+            like[len++] = '\\';
+        }
+        like[len++] = *p;
+    }
+    like[len++] = '%';
+    like[len] = '\0';
+
+    // Des partitions les plus récentes vers les plus anciennes, jusqu'à max messages
+    int sent = 0;
+    for (int i = count - 1; i >= 0 && sent < max; i--)
+    {
+        char path[PATH_MAX]; // Nom lu dans le dossier : sa longueur n'est pas celle d'une partition
+        snprintf(path, sizeof(path), ARCHIVE_DIR "/%s", list[i]->d_name);
+        sqlite3 *db = open_database(path, SQLITE_OPEN_READONLY);
+        sqlite3_stmt *stmt;
+        if (db == NULL)
+        {
+            continue;
+        }
+        if (sqlite3_prepare_v2(db, "SELECT seq, message FROM messages WHERE salon_id = ? AND message LIKE ? ESCAPE '\\' ORDER BY seq DESC LIMIT ?;",
+                               -1, &stmt, 0) == SQLITE_OK)
+        {
+            sqlite3_bind_int64(stmt, 1, id);
+            sqlite3_bind_text(stmt, 2, like, -1, SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 3, max - sent);
+            while (sqlite3_step(stmt) == SQLITE_ROW)
+            {
+                const char *message = (const char *)sqlite3_column_text(stmt, 1);
+                emit(context, (uint64_t)sqlite3_column_int64(stmt, 0), message, sqlite3_column_bytes(stmt, 1));
+                sent++;
+            }
+            sqlite3_finalize(stmt);
+        }
+        sqlite3_close(db);
+    }
+    free_partitions(list, count);
+    return sent;
+}
+
+void archive_apply_retention(void)
+{
+    pthread_mutex_lock(&archive_lock);
+    compact_requested = true;
+    pthread_cond_signal(&compact_wakeup);
+    pthread_mutex_unlock(&archive_lock);
+}
+
+void archive_compact_now(void)
+{
+    pthread_mutex_lock(&archive_lock);
+    compact_requested = true;
+    orphans_requested = true;
+    pthread_cond_signal(&compact_wakeup);
+    pthread_mutex_unlock(&archive_lock);
+}
+
+void archive_clear(void)
+{
+    struct dirent **list;
+    int count = list_partitions(&list);
+    for (int i = 0; i < count; i++)
+    {
+        drop_partition(list[i]->d_name);
+    }
+    if (count >= 0)
+    {
+        free_partitions(list, count);
+    }
+}
+
+void archive_format_stats(char *buffer, size_t size)
+{
+    struct dirent **list;
+    int count = list_partitions(&list);
+    if (count >= 0)
+    {
+        free_partitions(list, count);
+    }
+    pthread_mutex_lock(&archive_lock);
+    snprintf(buffer, size, "Archive : %d partitions, %lu lots écrits, %lu passes de compactage, %lu messages supprimés, %lu partitions supprimées",
+             count > 0 ? count : 0, batches_written, compact_passes, messages_deleted, partitions_dropped);
+    pthread_mutex_unlock(&archive_lock);
+    if (global_retention_days > 0)
+    {
+        snprintf(buffer + strlen(buffer), size - strlen(buffer), ", rétention %d jours", global_retention_days);
+    }
+    snprintf(buffer + strlen(buffer), size - strlen(buffer), "\n");
+}
@@ -0,0 +1,118 @@
+/**
+ * @file archive.h
+ * @brief SQLite storage engine: message archive split into daily partitions.
+ *
+ * The messages of the channels are stored in one SQLite file per day,
+ * `archive/messages-YYYYMMDD.db`, instead of a single table of database.db.
+ * A batch of messages is written to the partition of the current day, in
+ * one transaction; history reads go through the partitions from the newest
+ * one and stop as soon as the requested messages are found, so their cost
+ * does not grow with the size of the archive.
+ *
+ * Old messages are removed by a background thread, one pass every
+ * ARCHIVE_COMPACT_INTERVAL_MS milliseconds:
+ *
+ * - partitions older than the global retention (`--retention-days`) are
+ *   dropped by removing their file, without any DELETE;
+ * - the messages beyond the retention of a channel (maximum age or number
+ *   of messages, see storage_set_retention()) and the messages of deleted
+ *   channels are deleted ARCHIVE_COMPACT_CHUNK at a time, each chunk in its
+ *   own short transaction, so the writer never waits long;
+ * - partitions left empty are dropped.
+ *
+ * Messages refer to their channel by its identifier in database.db, which
+ * is never reused: a deleted channel can be created again at once, its old
+ * messages are not visible anymore and are removed by the next pass.
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "storage.h"
+
+#define ARCHIVE_DIR "archive"                 /**< Directory of the partitions */
+#define ARCHIVE_COMPACT_INTERVAL_MS 60000     /**< Delay between two compaction passes */
+#define ARCHIVE_COMPACT_CHUNK 500             /**< Messages deleted per transaction by the compaction */
+#define ARCHIVE_COMPACT_PAUSE_MS 10           /**< Pause between two chunks, left to the writer */
+
+/**
+ * @brief Opens the archive and starts the compaction thread.
+ *
+ * The messages of the former `messages` table of database.db, if any, are
+ * moved to the partitions of their day first.
+ *
+ * @param[in] retention_days Age in days after which a partition is dropped, 0 to keep the messages forever.
+ * @return 0 on success, -1 on error.
+ */
+int archive_init(int retention_days);
+
+/**
+ * @brief Writes a batch of messages to the partition of the day, in one transaction.
+ *
+ * @param[in] messages The messages.
+ * @param[in] count The number of messages.
+ * @return 0 on success, -1 on error.
+ */
+int archive_write(const storage_message_t *messages, int count);
+
+/**
+ * @brief Returns the last sequence number of a channel stored in the archive.
+ *
+ * @param[in] channel The channel.
+ * @return The number of its last message, 0 if it has none.
+ */
+uint64_t archive_last_seq(const char *channel);
+
+/**
+ * @brief Sends the archived messages of a channel that follow a sequence number, in order.
+ *
+ * @param[in] channel The channel.
+ * @param[in] after The last number seen by the client.
+ * @param[in] emit The function receiving each message.
+ * @param[in] context The argument given to emit.
+ * @return The number of messages sent.
+ */
+int archive_replay(const char *channel, uint64_t after, history_emit_fn emit, void *context);
+
+/**
+ * @brief Sends the most recent archived messages of a channel that contain a text, from the most recent.
+ *
+ * The text is searched without regard to the case of ASCII letters, in the
+ * message with its "username: " prefix.
+ *
+ * @param[in] channel The channel.
+ * @param[in] pattern The text searched.
+ * @param[in] max The largest number of messages sent.
+ * @param[in] emit The function receiving each message.
+ * @param[in] context The argument given to emit.
+ * @return The number of messages sent.
+ */
+int archive_search(const char *channel, const char *pattern, int max, history_emit_fn emit, void *context);
+
+/**
+ * @brief Starts a compaction pass without waiting for the next one (a retention changed).
+ */
+void archive_apply_retention(void);
+
+/**
+ * @brief Starts a compaction pass without waiting for the next one (a channel was deleted).
+ */
+void archive_compact_now(void);
+
+/**
+ * @brief Removes all the archived messages.
+ */
+void archive_clear(void);
+
+/**
+ * @brief Writes the statistics of the archive.
+ *
+ * @param[out] buffer The buffer receiving the text (one line).
+ * @param[in] size The size of the buffer.
+ */
+void archive_format_stats(char *buffer, size_t size);
+
+#endif
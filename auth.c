@@ -0,0 +1,139 @@
+#include "auth.h"
+#include "workpool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+
+#define SALT_SIZE 16 // Taille du sel en octets
+#define KEY_SIZE 32  // Taille de l'empreinte en octets
+
+typedef struct
+{
+    int socket;
+    char username[50];
+    char password[50];
+} auth_job_t;
+
+static auth_verify_fn verify_credentials;
+static workpool_t pool;
+
+static int scrypt_derive(const char *password, const unsigned char *salt, int log_n, int r, int p, unsigned char *key)
+{
+    uint64_t n = (uint64_t)1 << log_n;
+    uint64_t max_mem = 128 * n * r * p + 1024 * 1024; // Mémoire exigée par scrypt, plus une marge
+    return EVP_PBE_scrypt(password, strlen(password), salt, SALT_SIZE, n, r, p, max_mem, key, KEY_SIZE) == 1 ? 0 : -1;
+}
+
+int password_hash(const char *password, char *out, size_t out_size)
+{
+    unsigned char salt[SALT_SIZE];
+    unsigned char key[KEY_SIZE];
+
+    if (RAND_bytes(salt, sizeof(salt)) != 1 ||
+        scrypt_derive(password, salt, AUTH_SCRYPT_LOG_N, AUTH_SCRYPT_R, AUTH_SCRYPT_P, key) < 0)
+    {
+        return -1;
+    }
+
+    char salt_b64[4 * ((SALT_SIZE + 2) / 3) + 1];
+    char key_b64[4 * ((KEY_SIZE + 2) / 3) + 1];
+    EVP_EncodeBlock((unsigned char *)salt_b64, salt, sizeof(salt));
+    EVP_EncodeBlock((unsigned char *)key_b64, key, sizeof(key));
+    OPENSSL_cleanse(key, sizeof(key));
+
+    int written = snprintf(out, out_size, "$scrypt$ln=%d,r=%d,p=%d$%s$%s",
+                           AUTH_SCRYPT_LOG_N, AUTH_SCRYPT_R, AUTH_SCRYPT_P, salt_b64, key_b64);
+    return written > 0 && (size_t)written < out_size ? 0 : -1;
+}
+
+int password_verify(const char *password, const char *stored, bool *needs_rehash)
+{
+    int log_n, r, p;
+    char salt_b64[64], key_b64[64];
+
+    *needs_rehash = false;
+
+    if (strncmp(stored, "$scrypt$", 8) != 0)
+    {
+        // Ancien mot de passe en clair : comparaison en temps constant, puis rehachage
+        size_t len = strlen(stored);
+        int match = len == strlen(password) && CRYPTO_memcmp(stored, password, len) == 0;
+        *needs_rehash = match;
+        return match;
+    }
+
+    if (sscanf(stored, "$scrypt$ln=%d,r=%d,p=%d$%63[^$]$%63s", &log_n, &r, &p, salt_b64, key_b64) != 5 ||
+        log_n < 1 || log_n > 24 || r < 1 || p < 1)
+    {
+        return 0;
+    }
+
+    unsigned char salt[64], expected[64], key[KEY_SIZE];
+    if (EVP_DecodeBlock(salt, (unsigned char *)salt_b64, strlen(salt_b64)) < SALT_SIZE ||
+        EVP_DecodeBlock(expected, (unsigned char *)key_b64, strlen(key_b64)) < KEY_SIZE ||
+        scrypt_derive(password, salt, log_n, r, p, key) < 0)
+    {
+        return 0;
+    }
+
+    int match = CRYPTO_memcmp(key, expected, KEY_SIZE) == 0;
+    OPENSSL_cleanse(key, sizeof(key));
+
+    // Les paramètres ont changé depuis le hachage : on profite de la connexion pour rehacher
+    if (match && (log_n != AUTH_SCRYPT_LOG_N || r != AUTH_SCRYPT_R || p != AUTH_SCRYPT_P))
+    {
+        *needs_rehash = true;
+    }
+    return match;
+}
+
+// Vérifie un mot de passe dans un thread du pool ; la copie de la demande est effacée par le pool
+static void run_verification(void *job, unsigned int ticket, void *result)
+{
+    auth_job_t *request = job;
+    auth_result_t *verified = result;
+    verified->socket = request->socket;
+    verified->ticket = ticket;
+    strcpy(verified->username, request->username);
+    verified->authenticated = verify_credentials(request->username, request->password, &verified->is_admin);
+}
+
+int auth_pool_start(auth_verify_fn verify, int workers, int capacity)
+{
+    verify_credentials = verify;
+
+    // Priorité réduite : le hachage ne doit pas priver la boucle d'événements de CPU
+    return workpool_start(&pool, "Authentification", run_verification, sizeof(auth_job_t), sizeof(auth_result_t), workers,
+                          capacity, 10);
+}
+
+int auth_pool_submit(int socket, const char *username, const char *password, unsigned int *ticket)
+{
+    auth_job_t job = {socket, "", ""};
+    snprintf(job.username, sizeof(job.username), "%s", username);
+    snprintf(job.password, sizeof(job.password), "%s", password);
+    int status = workpool_submit(&pool, &job, ticket);
+    OPENSSL_cleanse(job.password, sizeof(job.password));
+    return status;
+}
+
+int auth_pool_collect(auth_result_t *results, int max)
+{
+    return workpool_collect(&pool, results, max);
+}
+
+void auth_pool_stats(char *buffer, size_t size)
+{
+    pthread_mutex_lock(&pool.lock);
+    snprintf(buffer, size,
+             "Authentification : file %d/%d (max %d), threads occupés %d/%d, vérifiées %lu, refusées (file pleine) %lu, coût moyen %.1f ms\n",
+             pool.jobs_count, pool.capacity, pool.max_queued, pool.busy, pool.workers,
+             pool.done, pool.rejected, pool.done > 0 ? pool.total_ms / pool.done : 0.0);
+    pthread_mutex_unlock(&pool.lock);
+}
@@ -0,0 +1,114 @@
+/**
+ * @file auth.h
+ * @brief Password hashing and the authentication worker pool of the server.
+ *
+ * Passwords are stored as salted scrypt hashes. Because a strong hash is
+ * expensive to compute, logins are verified by a small pool of worker
+ * threads (workpool.h): the event loop submits a request and is woken up through an
+ * eventfd when the result is ready, so a login storm never blocks the
+ * delivery of chat messages.
+ */
+
+#ifndef AUTH_H
+#define AUTH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define AUTH_HASH_SIZE 160      /**< Maximum length of an encoded password hash */
+#define AUTH_WORKERS 2          /**< Default number of verification threads */
+#define AUTH_QUEUE_CAPACITY 64  /**< Default maximum number of pending verifications */
+#define AUTH_SCRYPT_LOG_N 14    /**< scrypt cost parameter (N = 2^14) */
+#define AUTH_SCRYPT_R 8         /**< scrypt block size parameter */
+#define AUTH_SCRYPT_P 1         /**< scrypt parallelization parameter */
+
+/**
+ * @brief Structure representing the result of a login verification.
+ */
+typedef struct
+{
+    int socket;           /**< Socket of the client that sent the credentials */
+    unsigned int ticket;  /**< Ticket returned by auth_pool_submit() */
+    char username[50];    /**< Username that was checked */
+    int authenticated;    /**< 1 if the password is correct, 0 otherwise */
+    int is_admin;         /**< 1 if the user is an admin, 0 otherwise */
+} auth_result_t;
+
+/**
+ * @brief Function called by the workers to check a username and a password.
+ *
+ * @param[in] username The username to check.
+ * @param[in] password The password to check.
+ * @param[out] is_admin Set to 1 if the user is an admin.
+ * @return 1 if the credentials are valid, 0 otherwise.
+ */
+typedef int (*auth_verify_fn)(const char *username, const char *password, int *is_admin);
+
+/**
+ * @brief Hashes a password with a random salt.
+ *
+ * The result has the form `$scrypt$ln=14,r=8,p=1$<salt>$<hash>`, with the
+ * salt and the hash encoded in base64.
+ *
+ * @param[in] password The password to hash.
+ * @param[out] out The buffer receiving the encoded hash.
+ * @param[in] out_size The size of the buffer, at least AUTH_HASH_SIZE.
+ * @return 0 on success, -1 on error.
+ */
+int password_hash(const char *password, char *out, size_t out_size);
+
+/**
+ * @brief Verifies a password against a stored hash.
+ *
+ * Passwords stored in clear text by older versions are still accepted, so
+ * that they can be rehashed on the next successful login.
+ *
+ * @param[in] password The password to check.
+ * @param[in] stored The value stored in the database.
+ * @param[out] needs_rehash Set to true if the stored value should be replaced by a new hash.
+ * @return 1 if the password matches, 0 otherwise.
+ */
+int password_verify(const char *password, const char *stored, bool *needs_rehash);
+
+/**
+ * @brief Starts the authentication worker threads.
+ *
+ * @param[in] verify The function used to check the credentials.
+ * @param[in] workers The number of verification threads.
+ * @param[in] capacity The maximum number of pending verifications; more are refused.
+ * @return The eventfd to watch for results, or -1 on error.
+ */
+int auth_pool_start(auth_verify_fn verify, int workers, int capacity);
+
+/**
+ * @brief Queues a login verification.
+ *
+ * @param[in] socket The socket of the client.
+ * @param[in] username The username to check.
+ * @param[in] password The password to check.
+ * @param[out] ticket The ticket identifying the request.
+ * @return 0 on success, -1 if the queue is full.
+ */
+int auth_pool_submit(int socket, const char *username, const char *password, unsigned int *ticket);
+
+/**
+ * @brief Collects the finished verifications.
+ *
+ * This function must be called when the eventfd returned by auth_pool_start()
+ * is readable.
+ *
+ * @param[out] results The array receiving the results.
+ * @param[in] max The size of the array.
+ * @return The number of results written.
+ */
+int auth_pool_collect(auth_result_t *results, int max);
+
+/**
+ * @brief Formats the statistics of the worker pool.
+ *
+ * @param[out] buffer The buffer receiving the statistics.
+ * @param[in] size The size of the buffer.
+ */
+void auth_pool_stats(char *buffer, size_t size);
+
+#endif
@@ -0,0 +1,195 @@
+#include "checksum.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CHECKSUM_X86 1
+#endif
+
+#define CRC32C_POLY 0x82f63b78 // Polynôme de Castagnoli, bits inversés
+#define CHECKSUM_CHUNK 65536
+
+// tables[k][b] : reste de l'octet b suivi de k octets nuls
+static uint32_t tables[8][256];
+
+static uint32_t crc32c_tables(uint32_t crc, const unsigned char *p, size_t len)
+{
+    while (len > 0 && ((uintptr_t)p & 7) != 0)
+    {
+        crc = tables[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+    // Huit octets par tour, une table par octet
+    while (len >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        word ^= crc;
+        crc = tables[7][word & 0xff] ^ tables[6][(word >> 8) & 0xff] ^
+              tables[5][(word >> 16) & 0xff] ^ tables[4][(word >> 24) & 0xff] ^
+              tables[3][(word >> 32) & 0xff] ^ tables[2][(word >> 40) & 0xff] ^
+              tables[1][(word >> 48) & 0xff] ^ tables[0][word >> 56];
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0)
+    {
+        crc = tables[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef CHECKSUM_X86
+__attribute__((target("sse4.2"))) static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *p, size_t len)
+{
+    while (len > 0 && ((uintptr_t)p & 7) != 0)
+    {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+    uint64_t crc64 = crc;
+    while (len >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+    while (len-- > 0)
+    {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+typedef uint32_t (*crc32c_impl_t)(uint32_t crc, const unsigned char *p, size_t len);
+
+// Choisie au premier appel, que le serveur fait au démarrage avant de lancer ses threads
+static crc32c_impl_t impl = NULL;
+static const char *impl_name = "tables";
+
+static crc32c_impl_t get_impl(void)
+{
+    if (impl != NULL)
+    {
+        return impl;
+    }
+    for (uint32_t b = 0; b < 256; b++)
+    {
+        uint32_t crc = b;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        tables[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++)
+    {
+        for (int k = 1; k < 8; k++)
+        {
+            tables[k][b] = tables[0][tables[k - 1][b] & 0xff] ^ (tables[k - 1][b] >> 8);
+        }
+    }
+#ifdef CHECKSUM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        impl_name = "sse4.2";
+        impl = crc32c_sse42;
+        return impl;
+    }
+#endif
+    impl = crc32c_tables;
+    return impl;
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len)
+{
+    return ~get_impl()(~crc, data, len);
+}
+
+// Produit d'une matrice 32x32 sur GF(2) par un vecteur
+static uint32_t gf2_times(const uint32_t *matrix, uint32_t vector)
+{
+    uint32_t sum = 0;
+    for (; vector != 0; vector >>= 1, matrix++)
+    {
+        sum ^= vector & 1 ? *matrix : 0;
+    }
+    return sum;
+}
+
+static void gf2_square(uint32_t *square, const uint32_t *matrix)
+{
+    for (int n = 0; n < 32; n++)
+    {
+        square[n] = gf2_times(matrix, matrix[n]);
+    }
+}
+
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, long len2)
+{
+    if (len2 <= 0)
+    {
+        return crc1;
+    }
+
+    // Faire avancer crc1 de len2 octets nuls, par puissances de deux (même méthode que crc32_combine de zlib)
+    uint32_t even[32], odd[32];
+    odd[0] = CRC32C_POLY;
+    for (int n = 1; n < 32; n++)
+    {
+        odd[n] = 1u << (n - 1);
+    }
+    gf2_square(even, odd); // Deux bits nuls
+    gf2_square(odd, even); // Quatre bits nuls
+    do
+    {
+        gf2_square(even, odd);
+        if (len2 & 1)
+        {
+            crc1 = gf2_times(even, crc1);
+        }
+        len2 >>= 1;
+        if (len2 == 0)
+        {
+            break;
+        }
+        gf2_square(odd, even);
+        if (len2 & 1)
+        {
+            crc1 = gf2_times(odd, crc1);
+        }
+        len2 >>= 1;
+    } while (len2 != 0);
+    return crc1 ^ crc2;
+}
+
+int crc32c_file(int fd, long size, uint32_t *crc)
+{
+    unsigned char chunk[CHECKSUM_CHUNK];
+    *crc = 0;
+    for (off_t offset = 0; offset < size;)
+    {
+        size_t to_read = size - offset < (long)sizeof(chunk) ? (size_t)(size - offset) : sizeof(chunk);
+        ssize_t n = pread(fd, chunk, to_read, offset);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        *crc = crc32c(*crc, chunk, n);
+        offset += n;
+    }
+    return 0;
+}
+
+const char *crc32c_backend(void)
+{
+    get_impl();
+    return impl_name;
+}
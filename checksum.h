@@ -0,0 +1,66 @@
+/**
+ * @file checksum.h
+ * @brief CRC-32C checksums of the transferred files, shared by the client and the server.
+ *
+ * The checksum is negotiated with the compression: the client adds `crc32c`
+ * to its `@CAPS` line. Once accepted, every file transfer is followed by a
+ * trailer line `@CRC32C <8 hexadecimal digits>` giving the CRC-32C
+ * (Castagnoli) of the file, as it is once decompressed:
+ *
+ * - upload: the server computes the checksum while it writes the received
+ *   bytes and removes the file if the trailer differs, or if the line that
+ *   follows the file is not a trailer (bytes and commands out of sync);
+ * - download: the server sends the checksum stored with the file (see
+ *   zcache.h) and the client checks it while it writes the file. `@CRC32C -`
+ *   means that the checksum of the file is not known yet.
+ *
+ * The checksum is computed with the SSE4.2 `crc32` instruction when the
+ * processor has it, and with tables (8 bytes per step) otherwise.
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHECKSUM_CAPS "crc32c"     /**< Capability announced by the client and accepted by the server */
+
+/**
+ * @brief Updates a CRC-32C with more bytes.
+ *
+ * @param[in] crc The checksum of the previous bytes (0 for the first call).
+ * @param[in] data The bytes.
+ * @param[in] len The number of bytes.
+ * @return The checksum of the previous bytes followed by these ones.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+/**
+ * @brief Combines the checksums of two consecutive blocks.
+ *
+ * @param[in] crc1 The checksum of the first block.
+ * @param[in] crc2 The checksum of the second block.
+ * @param[in] len2 The length of the second block.
+ * @return The checksum of the first block followed by the second one.
+ */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, long len2);
+
+/**
+ * @brief Computes the CRC-32C of a file.
+ *
+ * @param[in] fd The file, read from its beginning with pread (its position does not change).
+ * @param[in] size The number of bytes to read.
+ * @param[out] crc The checksum.
+ * @return 0 on success, -1 on a read error or if the file is shorter than size.
+ */
+int crc32c_file(int fd, long size, uint32_t *crc);
+
+/**
+ * @brief Returns the implementation in use ("sse4.2" or "tables").
+ *
+ * @return The name of the implementation.
+ */
+const char *crc32c_backend(void);
+
+#endif
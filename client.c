@@ -9,67 +9,427 @@ void clean_input(char *str)
     }
 }
 
-void print_message(const char *message, const char *current_input)
+void show_text(const char *message)
 {
-    printf("\r\033[K");      // Effacer la ligne actuelle
-    printf("%s\n", message); // Afficher le message reçu du serveur
+    pthread_mutex_lock(&inbound.lock);
+    if (!inbound.started)
+    {
+        pthread_mutex_unlock(&inbound.lock);
+        printf("%s\n", message);
+        return;
+    }
 
-    if (strlen(current_input) > 0)
+    // File pleine : l'affichage ne suit plus, la plus ancienne ligne est abandonnée
+    if (inbound.count == INBOUND_MAX_LINES)
     {
-        printf("> %s", current_input); // Réafficher l'entrée utilisateur sauvegardée
+        free(inbound.lines[inbound.head]);
+        inbound.head = (inbound.head + 1) % INBOUND_MAX_LINES;
+        inbound.count--;
+        inbound.skipped++;
     }
-    else
+    char *line = strdup(message);
+    if (line != NULL)
+    {
+        inbound.lines[(inbound.head + inbound.count) % INBOUND_MAX_LINES] = line;
+        inbound.count++;
+    }
+    pthread_cond_signal(&inbound.ready);
+    pthread_mutex_unlock(&inbound.lock);
+}
+
+void inbound_close(void)
+{
+    pthread_mutex_lock(&inbound.lock);
+    inbound.closed = true;
+    pthread_cond_signal(&inbound.ready);
+    pthread_mutex_unlock(&inbound.lock);
+}
+
+void *render_thread(void *arg)
+{
+    (void)arg;
+    char *lines[INBOUND_MAX_LINES];
+    while (1)
+    {
+        // Prendre d'un coup toutes les lignes arrivées depuis le dernier affichage
+        pthread_mutex_lock(&inbound.lock);
+        while (inbound.count == 0 && inbound.skipped == 0 && !inbound.closed)
+        {
+            pthread_cond_wait(&inbound.ready, &inbound.lock);
+        }
+        int count = inbound.count;
+        for (int i = 0; i < count; i++)
+        {
+            lines[i] = inbound.lines[(inbound.head + i) % INBOUND_MAX_LINES];
+        }
+        unsigned long skipped = inbound.skipped;
+        bool closed = inbound.closed;
+        inbound.head = inbound.count = 0;
+        inbound.skipped = 0;
+        pthread_mutex_unlock(&inbound.lock);
+        uint64_t frame_start = monotonic_ms();
+
+        // Au-delà d'un écran par affichage, seules les dernières lignes sont montrées
+        int first = count > RENDER_FRAME_LINES ? count - RENDER_FRAME_LINES : 0;
+        skipped += first;
+        size_t size = 128;
+        for (int i = first; i < count; i++)
+        {
+            size += strlen(lines[i]) + 1;
+        }
+        char *frame = malloc(size);
+        if (frame != NULL)
+        {
+            // Effacer le prompt, écrire les lignes, puis réafficher le prompt, en une seule écriture
+            size_t len = snprintf(frame, size, "\r\033[K");
+            if (skipped > 0)
+            {
+                len += snprintf(frame + len, size - len, "[%lu messages ignorés : affichage trop lent]\n", skipped);
+            }
+            for (int i = first; i < count; i++)
+            {
+                size_t line_len = strlen(lines[i]);
+                memcpy(frame + len, lines[i], line_len);
+                frame[len + line_len] = '\n';
+                len += line_len + 1;
+            }
+            if (!closed)
+            {
+                len += snprintf(frame + len, size - len, "> ");
+            }
+            flockfile(stdout);
+            fwrite(frame, 1, len, stdout);
+            fflush(stdout);
+            funlockfile(stdout);
+            free(frame);
+        }
+        for (int i = 0; i < count; i++)
+        {
+            free(lines[i]);
+        }
+
+        if (closed)
+        {
+            return NULL; // Tout est affiché : le thread réseau peut terminer le programme
+        }
+
+        // Les messages qui arrivent d'ici là seront affichés ensemble au prochain tour
+        uint64_t elapsed = monotonic_ms() - frame_start;
+        if (elapsed < RENDER_FRAME_MS)
+        {
+            usleep((RENDER_FRAME_MS - elapsed) * 1000);
+        }
+    }
+    return NULL;
+}
+
+unsigned long long *channel_seq(const char *channel, bool create)
+{
+    static int next_slot = 0;
+    for (int i = 0; i < CLIENT_CHANNELS; i++)
+    {
+        if (strcmp(seen_channels[i].channel, channel) == 0)
+        {
+            return &seen_channels[i].last_seq;
+        }
+    }
+    if (!create)
+    {
+        return NULL;
+    }
+
+    // Remplacer les entrées à tour de rôle quand la table est pleine
+    channel_seq_t *entry = &seen_channels[next_slot];
+    next_slot = (next_slot + 1) % CLIENT_CHANNELS;
+    snprintf(entry->channel, sizeof(entry->channel), "%s", channel);
+    entry->last_seq = 0;
+    return &entry->last_seq;
+}
+
+// Retient le numéro d'un message du salon ; faux s'il a déjà été affiché
+static bool first_seen(const char *channel, unsigned long long seq)
+{
+    unsigned long long *last = channel_seq(channel, true);
+    if (seq <= *last)
+    {
+        return false;
+    }
+    *last = seq;
+    return true;
+}
+
+const char *sequenced_text(const char *line)
+{
+    char channel[50];
+    unsigned long long seq;
+    int offset = 0;
+
+    if (sscanf(line, "@SEQ %49s %llu", channel, &seq) == 2)
+    {
+        snprintf(current_channel, sizeof(current_channel), "%s", channel); // Salon rejoint, ou dans lequel un admin l'a déplacé
+        unsigned long long *last = channel_seq(channel, true);
+        if (*last > seq)
+        {
+            *last = seq; // Salon recréé : la numérotation est repartie de zéro
+        }
+        return NULL;
+    }
+    if (sscanf(line, "@MSG %49s %llu %n", channel, &seq, &offset) < 2 || offset == 0)
+    {
+        return NULL;
+    }
+    return first_seen(channel, seq) ? line + offset : NULL;
+}
+
+const char *presence_text(const char *line, char *text, size_t size)
+{
+    char channel[50] = "";
+    int offset = 0;
+    bool typing = sscanf(line, "@TYPING %49s %n", channel, &offset) == 1 && offset > 0;
+    if (!typing && strncmp(line, "@PRESENCE", 9) != 0)
+    {
+        return NULL;
+    }
+    const char *events = typing ? line + offset : line + 9;
+
+    // "@PRESENCE user1=online user2=away" ; "@TYPING <salon> +user1 -user2" (seuls les débuts sont affichés)
+    size_t len = 0;
+    text[0] = '\0';
+    char event[64];
+    int used = 0;
+    while (sscanf(events, " %63s%n", event, &used) == 1 && len < size)
+    {
+        events += used;
+        char *status = strchr(event, '=');
+        const char *description = NULL;
+        if (typing && event[0] == '+')
+        {
+            memmove(event, event + 1, strlen(event));
+            description = "écrit...";
+        }
+        else if (!typing && status != NULL)
+        {
+            *status++ = '\0';
+            description = strcmp(status, "online") == 0 ? "est en ligne" : strcmp(status, "away") == 0 ? "est absent" : "est hors ligne";
+        }
+        if (description != NULL)
+        {
+            len += snprintf(text + len, size - len, "%s%s %s", len > 0 ? ", " : "", event, description);
+        }
+    }
+    return len > 0 ? text : NULL;
+}
+
+int fill_received(int client_fd)
+{
+    int bytes_received = transport_recv(client_fd, received + received_len, sizeof(received) - received_len);
+    if (bytes_received > 0)
+    {
+        received_len += bytes_received;
+    }
+    return bytes_received;
+}
+
+int next_line(char *line, size_t size)
+{
+    char *end = memchr(received, '\n', received_len);
+    if (end == NULL && received_len < sizeof(received))
     {
-        printf("> "); // Réafficher le prompt si aucune entrée utilisateur
+        return 0; // Ligne incomplète : attendre la suite
     }
 
-    fflush(stdout); // S'assurer que le tampon est vidé
+    // Une ligne trop longue est rendue telle quelle
+    size_t line_len = end != NULL ? (size_t)(end - received) : received_len;
+    size_t consumed = end != NULL ? line_len + 1 : line_len;
+    if (line_len >= size)
+    {
+        line_len = size - 1;
+    }
+    memcpy(line, received, line_len);
+    line[line_len] = '\0';
+
+    memmove(received, received + consumed, received_len - consumed);
+    received_len -= consumed;
+    return 1;
+}
+
+bool server_closing(const char *line)
+{
+    if (strncmp(line, "@BYE", 4) != 0)
+    {
+        return false;
+    }
+
+    // Le serveur ferme la connexion exprès : la fermeture qui suit n'est pas une panne
+    reconnect.quitting = true;
+    show_text(strcmp(line, "@BYE idle") == 0 ? "Déconnecté par le serveur après une longue inactivité." : "Déconnecté par le serveur.");
+    return true;
+}
+
+int wait_reply(int client_fd, char *line, size_t size)
+{
+    while (1)
+    {
+        while (next_line(line, size))
+        {
+            if (strcmp(line, "@PING") == 0)
+            {
+                transport_send(client_fd, "@PONG\n", 6); // Le serveur vérifie que le client est toujours là
+            }
+            else if (server_closing(line))
+            {
+                continue;
+            }
+            else if (strncmp(line, "@MSG ", 5) == 0 || strncmp(line, "@SEQ ", 5) == 0)
+            {
+                const char *text = sequenced_text(line); // Message arrivé avant la réponse
+                if (text != NULL)
+                {
+                    show_text(text);
+                }
+            }
+            else if (strncmp(line, "@LONG ", 6) == 0)
+            {
+                char *text = receive_long_message(client_fd, line);
+                if (text != NULL)
+                {
+                    show_text(text);
+                    free(text);
+                }
+            }
+            else if (strncmp(line, "@PRESENCE", 9) == 0 || strncmp(line, "@TYPING ", 8) == 0)
+            {
+                char text[BUFFER_SIZE];
+                if (presence_text(line, text, sizeof(text)) != NULL)
+                {
+                    show_text(text); // Événement de présence arrivé avant la réponse
+                }
+            }
+            else if (line[0] == '@')
+            {
+                return 0; // Réponse du serveur à la commande
+            }
+            else
+            {
+                show_text(line); // Message arrivé avant la réponse
+            }
+        }
+
+        if (fill_received(client_fd) <= 0)
+        {
+            return -1;
+        }
+    }
 }
 
 void receive_file_from_server(int client_socket, const char *filename)
 {
-    // Réception de la taille du fichier
-    char buffer[BUFFER_SIZE];
-    int bytes_received = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
-    if (bytes_received <= 0)
+    // Attendre l'annonce du fichier et de sa taille
+    char line[BUFFER_SIZE];
+    if (wait_reply(client_socket, line, sizeof(line)) < 0)
     {
         perror("Erreur lors de la réception de la taille du fichier");
         return;
     }
-    buffer[bytes_received] = '\0';
-    long file_size = atol(buffer); // Convertir la taille en nombre
-
-    // Envoyer la confirmation pour démarrer le transfert
-    send(client_socket, "OK", 2, 0);
+    // "@FILE <taille>", ou "@FILEZ <taille compressée> <taille>" pour un fichier compressé
+    long file_size, compressed_size = -1;
+    if (sscanf(line, "@FILEZ %ld %ld", &compressed_size, &file_size) != 2 && sscanf(line, "@FILE %ld", &file_size) != 1)
+    {
+        printf("%s\n", strncmp(line, "@ERR ", 5) == 0 ? line + 5 : line); // Le serveur a refusé la demande
+        return;
+    }
 
     // Ouvrir le fichier pour l'écriture
     FILE *file = fopen(filename, "wb");
     if (file == NULL)
     {
         perror("Erreur lors de la création du fichier");
-        return;
     }
 
-    // Recevoir les bits du fichier un par un
-    char byte;
-    long received_bytes = 0;
-    while (received_bytes < file_size)
+    // Un fichier compressé est décompressé au fil de la réception (écrit sans passer par le tampon de file)
+    inflater_t *inflater = NULL;
+    int inflate_failed = 0;
+    if (compressed_size >= 0)
+    {
+        inflater = inflater_new(file != NULL ? fileno(file) : -1, file_size);
+        inflate_failed = inflater == NULL;
+    }
+    long expected = compressed_size >= 0 ? compressed_size : file_size; // Octets qui suivent l'annonce
+    uint32_t crc = 0;
+
+    // Le début du fichier a pu arriver avec l'annonce
+    long received_bytes = received_len < (size_t)expected ? (long)received_len : expected;
+    if (inflater != NULL)
+    {
+        inflate_failed |= inflater_write(inflater, received, received_bytes) < 0;
+    }
+    else if (compressed_size < 0)
+    {
+        crc = crc32c(crc, received, received_bytes);
+        if (file != NULL)
+        {
+            fwrite(received, 1, received_bytes, file);
+        }
+    }
+    memmove(received, received + received_bytes, received_len - received_bytes);
+    received_len -= received_bytes;
+
+    // Recevoir le reste par blocs, sans dépasser la taille annoncée
+    char chunk[TRANSPORT_CHUNK_SIZE];
+    while (received_bytes < expected)
     {
-        int byte_received = recv(client_socket, &byte, 1, 0);
-        if (byte_received <= 0)
+        size_t to_read = expected - received_bytes < (long)sizeof(chunk) ? (size_t)(expected - received_bytes) : sizeof(chunk);
+        int chunk_received = transport_recv(client_socket, chunk, to_read);
+        if (chunk_received <= 0)
         {
             perror("Erreur lors de la réception du fichier");
             break;
         }
 
-        // Écrire le byte dans le fichier
-        fwrite(&byte, 1, 1, file);
-        received_bytes++;
+        // Écrire le bloc dans le fichier (les octets sont lus même sans fichier, pour rester synchronisé)
+        if (inflater != NULL && !inflate_failed)
+        {
+            inflate_failed = inflater_write(inflater, chunk, chunk_received) < 0;
+        }
+        else if (compressed_size < 0)
+        {
+            crc = crc32c(crc, chunk, chunk_received); // Calculée sur le bloc encore en cache
+            if (file != NULL)
+            {
+                fwrite(chunk, 1, chunk_received, file);
+            }
+        }
+        received_bytes += chunk_received;
+    }
+
+    int complete = received_bytes == expected;
+    if (inflater != NULL)
+    {
+        complete = complete && !inflate_failed && inflater_complete(inflater, file_size);
+        crc = inflater_checksum(inflater);
+        inflater_free(inflater);
     }
 
+    // La somme de contrôle suit le fichier : la lire même sans fichier local, pour rester synchronisé
+    char trailer[BUFFER_SIZE] = "";
+    if (server_checksum && complete && wait_reply(client_socket, trailer, sizeof(trailer)) < 0)
+    {
+        trailer[0] = '\0';
+    }
+    unsigned int expected_crc;
+    bool corrupted = sscanf(trailer, "@CRC32C %8x", &expected_crc) == 1 && expected_crc != crc; // "-" : somme inconnue
+    if (file == NULL)
+    {
+        return;
+    }
     fclose(file);
 
-    if (received_bytes == file_size)
+    if (corrupted)
+    {
+        unlink(filename);
+        printf("Erreur : fichier '%s' corrompu (somme de contrôle incorrecte), supprimé.\n", filename);
+    }
+    else if (complete)
     {
         printf("Fichier '%s' reçu avec succès.\n", filename);
     }
@@ -79,191 +439,1475 @@ void receive_file_from_server(int client_socket, const char *filename)
     }
 }
 
-void send_file_to_server(int client_socket, const char *filename)
+int open_data_connection(void)
 {
-    FILE *file = fopen(filename, "rb");
-    if (file == NULL)
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
     {
-        perror("Erreur lors de l'ouverture du fichier");
-        return;
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&server_address, sizeof(server_address)) < 0 || transport_connect(fd, server_host) < 0)
+    {
+        close(fd);
+        return -1;
     }
+    return fd;
+}
 
-    // Obtenir la taille du fichier
-    fseek(file, 0L, SEEK_END);
-    long file_size = ftell(file);
-    rewind(file);
+int send_file_parallel(int client_socket, const char *filename, int file_fd, long file_size)
+{
+    // Somme de contrôle du fichier entier, comparée par le serveur à celle des parties reçues
+    uint32_t crc;
+    if (crc32c_file(file_fd, file_size, &crc) < 0)
+    {
+        perror("Erreur lors de la lecture du fichier");
+        return -1;
+    }
 
-    // Envoyer la taille du fichier au serveur
-    char size_str[20];
-    snprintf(size_str, sizeof(size_str), "%ld", file_size); // écrire chaîne de caractère dans un buffer pour éviter débordement de mémoire
-    send(client_socket, size_str, strlen(size_str), 0);
+    const char *name = strrchr(filename, '/') != NULL ? strrchr(filename, '/') + 1 : filename;
+    char line[BUFFER_SIZE];
+    snprintf(line, sizeof(line), "psend %s %ld\n", name, file_size);
+    transport_send(client_socket, line, strlen(line));
 
-    // Attendre la confirmation du serveur pour commencer le transfert
-    char buffer[BUFFER_SIZE];
-    recv(client_socket, buffer, sizeof(buffer), 0);
+    // Le serveur répond par le jeton qui authentifie les connexions de données
+    char token[64];
+    if (wait_reply(client_socket, line, sizeof(line)) < 0 || sscanf(line, "@TOKEN %63s", token) != 1)
+    {
+        printf("%s\n", strncmp(line, "@ERR ", 5) == 0 ? line + 5 : "Le serveur a refusé le fichier.");
+        return -1;
+    }
 
-    // Envoyer le fichier bit par bit
-    char byte;
-    while (fread(&byte, 1, 1, file) == 1)
+    // Une partie contiguë du fichier par connexion, envoyée sans copie
+    int count = parallel_streams < PARALLEL_MAX_STREAMS ? parallel_streams : PARALLEL_MAX_STREAMS;
+    long part_size = (file_size + count - 1) / count;
+    struct
     {
-        if (send(client_socket, &byte, 1, 0) < 0)
+        int fd;
+        outqueue_t out;
+        char reply[64];
+        size_t reply_len;
+        int done; // 1 : "@OK" reçu, -1 : échec
+    } streams[PARALLEL_MAX_STREAMS];
+    int failed = 0, lost = 0, remaining = 0;
+    for (int i = 0; i < count; i++)
+    {
+        long offset = i * part_size;
+        long length = offset + part_size <= file_size ? part_size : file_size - offset;
+        streams[i].fd = -1;
+        outqueue_init(&streams[i].out);
+        streams[i].reply_len = 0;
+        streams[i].done = 1;
+        if (length <= 0 || failed)
         {
-            perror("Erreur lors de l'envoi du fichier");
-            break;
+            continue;
+        }
+
+        streams[i].fd = open_data_connection();
+        if (streams[i].fd < 0)
+        {
+            perror("Erreur lors de l'ouverture d'une connexion de données");
+            failed = 1;
+            continue;
+        }
+        char header[128];
+        snprintf(header, sizeof(header), "@DATA %s %ld %ld\n", token, offset, length);
+        if (outqueue_push(&streams[i].out, header, strlen(header)) < 0 ||
+            outqueue_push_file(&streams[i].out, dup(file_fd), offset, length) < 0)
+        {
+            failed = 1;
+            continue;
         }
+        fcntl(streams[i].fd, F_SETFL, fcntl(streams[i].fd, F_GETFL) | O_NONBLOCK);
+        streams[i].done = 0;
+        remaining++;
     }
 
-    fclose(file);
-    printf("Fichier '%s' envoyé au serveur.\n", filename);
-}
+    // Envoyer toutes les parties en même temps ; la connexion principale continue d'afficher les messages
+    while (remaining > 0 && !failed)
+    {
+        struct pollfd fds[PARALLEL_MAX_STREAMS + 1];
+        int timeout = -1;
+        for (int i = 0; i < count; i++)
+        {
+            fds[i].fd = streams[i].done == 0 ? streams[i].fd : -1;
+            fds[i].events = POLLIN | (outqueue_empty(&streams[i].out) ? 0 : POLLOUT);
+            fds[i].revents = 0;
+            timeout = streams[i].done == 0 && transport_pending(streams[i].fd) ? 0 : timeout;
+        }
+        fds[count].fd = client_socket;
+        fds[count].events = POLLIN;
+        fds[count].revents = 0;
+        if (poll(fds, count + 1, timeout) < 0 && errno != EINTR)
+        {
+            perror("poll() failed");
+            failed = 1;
+            break;
+        }
 
-void handle_receive(int client_fd, char *current_input)
-{
-    char buffer[BUFFER_SIZE];
-    int bytes_received = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-    if (bytes_received > 0)
+        for (int i = 0; i < count; i++)
+        {
+            if (streams[i].done != 0)
+            {
+                continue;
+            }
+            if (fds[i].revents & POLLOUT && outqueue_flush(&streams[i].out, streams[i].fd) < 0)
+            {
+                streams[i].done = -1;
+            }
+            else if (fds[i].revents & (POLLIN | POLLHUP | POLLERR) || transport_pending(streams[i].fd))
+            {
+                // Réponse du serveur une fois la partie écrite : "@OK"
+                ssize_t n = transport_recv(streams[i].fd, streams[i].reply + streams[i].reply_len,
+                                           sizeof(streams[i].reply) - 1 - streams[i].reply_len);
+                if (n > 0)
+                {
+                    streams[i].reply_len += n;
+                    streams[i].reply[streams[i].reply_len] = '\0';
+                    if (strchr(streams[i].reply, '\n') != NULL)
+                    {
+                        streams[i].done = strncmp(streams[i].reply, "@OK\n", 4) == 0 ? 1 : -1;
+                    }
+                }
+                else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                {
+                    streams[i].done = -1; // Connexion refusée ou coupée par le serveur
+                }
+            }
+            if (streams[i].done != 0)
+            {
+                failed |= streams[i].done < 0;
+                remaining--;
+            }
+        }
+
+        if (fds[count].revents & (POLLIN | POLLHUP))
+        {
+            if (fill_received(client_socket) <= 0)
+            {
+                lost = 1; // Le thread réseau constatera la fermeture et se reconnectera
+                failed = 1;
+                break;
+            }
+            process_received(client_socket);
+        }
+    }
+
+    for (int i = 0; i < count; i++)
     {
-        buffer[bytes_received] = '\0';
-        if (strcmp(buffer, current_input) != 0) // Ne pas réafficher l'entrée utilisateur
+        outqueue_clear(&streams[i].out);
+        if (streams[i].fd >= 0)
         {
-            print_message(buffer, current_input);
+            transport_close(streams[i].fd);
         }
     }
-    else if (bytes_received == 0)
+    if (lost)
     {
-        printf("Le serveur a fermé la connexion.\n");
-        exit(0);
+        printf("Envoi du fichier '%s' interrompu : connexion au serveur perdue.\n", filename);
+        return -1;
     }
-    else
+
+    // Le serveur vérifie que les parties couvrent tout le fichier et que la somme de contrôle correspond
+    snprintf(line, sizeof(line), "pdone %s %08x\n", token, crc);
+    transport_send(client_socket, line, strlen(line));
+    if (wait_reply(client_socket, line, sizeof(line)) < 0 || strcmp(line, "@OK") != 0 || failed)
     {
-        perror("Erreur lors de la réception des données");
+        printf("Erreur lors de l'envoi du fichier '%s' : %s\n", filename, strncmp(line, "@ERR ", 5) == 0 ? line + 5 : "connexion de données interrompue.");
+        return -1;
     }
+    printf("Fichier '%s' envoyé au serveur (%d connexions).\n", filename, count);
+    return 0;
 }
 
-void handle_send(int client_fd, char *current_input)
+int open_upload(const char *filename, char *command, size_t size, long *send_size, uint32_t *crc)
 {
-    char buffer[BUFFER_SIZE];
-    printf("> ");
-    fflush(stdout);
-    fgets(buffer, BUFFER_SIZE, stdin);
-    clean_input(buffer);
-
-    // Envoi du message
-    if (send(client_fd, buffer, strlen(buffer), 0) < 0)
+    int file_fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0)
     {
-        perror("Erreur lors de l'envoi du message");
+        perror("Erreur lors de l'ouverture du fichier");
+        return -1;
     }
 
-    if (strncmp(buffer, "receive ", 8) == 0)
+    // Obtenir la taille du fichier
+    struct stat st;
+    fstat(file_fd, &st);
+    long file_size = st.st_size;
+
+    // Si le serveur l'accepte, envoyer une copie compressée du fichier quand elle est nettement plus petite
+    *send_size = file_size;
+    *crc = 0;
+    bool summed = false;
+    FILE *compressed = NULL;
+    if (server_compress && file_size >= COMPRESS_MIN_SIZE && (compressed = tmpfile()) != NULL)
     {
-        char *filename = buffer + 8;
-        receive_file_from_server(client_fd, filename);
+        long compressed_size;
+        summed = compress_file(file_fd, fileno(compressed), &compressed_size, crc) == 0;
+        if (summed && compress_worthwhile(file_size, compressed_size))
+        {
+            close(file_fd);
+            file_fd = dup(fileno(compressed));
+            *send_size = compressed_size;
+        }
+        fclose(compressed); // Le fichier temporaire disparaît à la fermeture du dernier descripteur
     }
 
-    else if (strncmp(buffer, "send ", 5) == 0)
+    // Somme de contrôle du fichier original, envoyée après lui (la compression l'a déjà calculée)
+    if (server_checksum && !summed && crc32c_file(file_fd, file_size, crc) < 0)
     {
-        char *filename = buffer + 5;
-        send_file_to_server(client_fd, filename);
+        perror("Erreur lors de la lecture du fichier");
+        close(file_fd);
+        return -1;
     }
 
-    else if (strcmp(buffer, "help") == 0)
+    // Annoncer le nom (sans le chemin local) et la taille du fichier au serveur
+    const char *name = strrchr(filename, '/') != NULL ? strrchr(filename, '/') + 1 : filename;
+    if (*send_size != file_size)
     {
-        printf("\nLister tous les salons\t\t\t\t\t\tUsage : list\n");
-        printf("\nLister tous les utilisateurs connectés dans le salon\t\tUsage : list_users\n");
-        printf("\nLister tous les utilisateurs connectés dans tous les salons\tUsage : list_admin\n");
-        printf("\nAfficher le salon actuel\t\t\t\t\tUsage : current\n");
-        printf("\nCréer un salon\t\t\t\t\t\t\tUsage : create <nom_du_salon>\n");
-        printf("\nSuprimer un salon\t\t\t\t\t\tUsage : delete <nom_du_salon>\n");
-        printf("\nRejoindre un salon\t\t\t\t\t\tUsage : join <nom_du_salon>\n");
-        printf("\nQuitter le salon\t\t\t\t\t\tUsage : leave\n");
-        printf("\nEnvoyer un fichier au salon actuel.\t\t\t\tUsage : send <nom_du_fichier>\n");
-        printf("\nRecevoir un fichier du salon actuel.\t\t\t\tUsage : receive <nom_du_fichier>\n");
-        printf("\nSe déconnecter du serveur.\t\t\t\t\tUsage : disconnect\n");
-        printf("\n");
+        snprintf(command, size, "sendz %s %ld %ld\n", name, *send_size, file_size);
     }
-
-    // Sauvegarde de l'entrée utilisateur
-    strncpy(current_input, buffer, sizeof(current_input) - 1);
-
-    // Effacer l'entrée utilisateur après l'envoi
-    memset(current_input, 0, sizeof(current_input));
+    else
+    {
+        snprintf(command, size, "send %s %ld\n", name, file_size); // écrire chaîne de caractère dans un buffer pour éviter débordement de mémoire
+    }
+    return file_fd;
 }
 
-int main()
+void send_file_to_server(int client_socket, const char *filename)
 {
-    int client_fd;
-    struct sockaddr_in server_addr;
-    char username[50], password[50];
-    char current_input[BUFFER_SIZE] = ""; // Pour sauvegarder l'entrée utilisateur
-
-    client_fd = socket(AF_INET, SOCK_STREAM, 0); // sock_stream - TCP
-    if (client_fd < 0)
+    // Un gros fichier part en plusieurs parties, sur plusieurs connexions
+    struct stat st;
+    if (parallel_streams > 1 && stat(filename, &st) == 0 && st.st_size >= PARALLEL_MIN_SIZE)
     {
-        perror("socket() failed");
-        exit(EXIT_FAILURE);
+        int file_fd = open(filename, O_RDONLY | O_CLOEXEC);
+        if (file_fd < 0)
+        {
+            perror("Erreur lors de l'ouverture du fichier");
+            return;
+        }
+        send_file_parallel(client_socket, filename, file_fd, st.st_size);
+        close(file_fd);
+        return;
     }
 
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(8080);
-    inet_pton(AF_INET, "127.0.0.1", &server_addr.sin_addr);
-
-    if (connect(client_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+    char command[BUFFER_SIZE];
+    long send_size;
+    uint32_t crc;
+    int file_fd = open_upload(filename, command, sizeof(command), &send_size, &crc);
+    if (file_fd < 0)
     {
-        perror("connect() failed");
-        close(client_fd);
-        exit(EXIT_FAILURE);
+        return;
     }
+    transport_send(client_socket, command, strlen(command));
 
-    // Authentification
-    printf("Login: ");
-    fgets(username, sizeof(username), stdin);
+    // Attendre la confirmation du serveur pour commencer le transfert
+    char line[BUFFER_SIZE];
+    if (wait_reply(client_socket, line, sizeof(line)) < 0 || strcmp(line, "@OK") != 0)
+    {
+        // Le serveur a refusé le fichier : afficher la raison
+        printf("%s\n", strncmp(line, "@ERR ", 5) == 0 ? line + 5 : "Le serveur a refusé le fichier.");
+        close(file_fd);
+        return;
+    }
 
-    // Dans client.c, après avoir reçu le mot de passe
-    printf("Password: ");
-    fgets(password, sizeof(password), stdin);
+    // Envoyer le fichier sans copie (sendfile, ou kTLS si le socket est chiffré)
+    if (transport_sendfile(client_socket, file_fd, 0, send_size) != send_size)
+    {
+        perror("Erreur lors de l'envoi du fichier");
+    }
 
-    // Ensuite, lors de l'envoi
-    char auth_info[100];
-    snprintf(auth_info, sizeof(auth_info), "%s %s", username, password);
+    // Le serveur ne garde le fichier que si sa somme de contrôle correspond
+    if (server_checksum)
+    {
+        char trailer[32];
+        snprintf(trailer, sizeof(trailer), "@CRC32C %08x\n", crc);
+        transport_send(client_socket, trailer, strlen(trailer));
+    }
 
-    // S'assurer d'envoyer uniquement la longueur correcte
-    send(client_fd, auth_info, strlen(auth_info), 0);
+    close(file_fd);
+    printf("Fichier '%s' envoyé au serveur.\n", filename);
+}
 
-    // Attendre la réponse d'authentification
-    char auth_response[BUFFER_SIZE];
-    int bytes_received = recv(client_fd, auth_response, sizeof(auth_response) - 1, 0);
-    auth_response[bytes_received] = '\0';
-    printf("%s\n", auth_response); // Afficher le message d'authentification
+void negotiate_capabilities(int client_fd, bool compress, bool presence)
+{
+    char caps[64];
+    snprintf(caps, sizeof(caps), "@CAPS%s %s%s\n", compress ? " " COMPRESS_CAPS : "", CHECKSUM_CAPS, presence ? " " PRESENCE_CAPS : "");
+    transport_send(client_fd, caps, strlen(caps));
 
-    // Utiliser `poll` pour gérer à la fois les entrées utilisateur et les messages du serveur
-    struct pollfd fds[2];
-    fds[0].fd = STDIN_FILENO; // Entrée utilisateur (stdin)
-    fds[0].events = POLLIN;   // Surveiller les entrées disponibles
-    fds[1].fd = client_fd;    // Socket client
-    fds[1].events = POLLIN;   // Surveiller les messages du serveur
+    // La réponse donne les capacités acceptées par le serveur
+    char line[BUFFER_SIZE];
+    if (wait_reply(client_fd, line, sizeof(line)) == 0 && strncmp(line, "@CAPS", 5) == 0)
+    {
+        server_compress = strstr(line + 5, COMPRESS_CAPS) != NULL;
+        server_checksum = strstr(line + 5, CHECKSUM_CAPS) != NULL;
+    }
+}
 
-    while (1)
+void process_received(int client_fd)
+{
+    // Chaque message complet part dans la file d'affichage
+    char line[sizeof(received) + 1];
+    while (next_line(line, sizeof(line)))
     {
-        int poll_count = poll(fds, 2, -1); // Attendre indéfiniment (-1) un événement sur stdin ou le socket client (2)
-        if (poll_count < 0)                // valeur négative, erreur
+        if (strcmp(line, "@PING") == 0)
         {
-            perror("poll() failed");
-            break;
+            transport_send(client_fd, "@PONG\n", 6); // Le serveur vérifie que le client est toujours là
+            continue;
         }
-
-        // Vérifier si l'utilisateur a entré une commande
-        if (fds[0].revents & POLLIN) // après l'appel à poll pour indiquer ce qu'il s'est réellement passé
+        if (server_closing(line))
         {
-            handle_send(client_fd, current_input); // Gérer l'entrée utilisateur et envoyer le message
+            continue;
+        }
+        if (strncmp(line, "@LONG ", 6) == 0)
+        {
+            // Message long ou de plusieurs lignes : ses octets suivent la ligne
+            char *long_text = receive_long_message(client_fd, line);
+            if (long_text != NULL)
+            {
+                show_text(long_text);
+                free(long_text);
+            }
+            continue;
+        }
+        const char *text = line;
+        char presence[sizeof(received) + 1];
+        if (strncmp(line, "@MSG ", 5) == 0 || strncmp(line, "@SEQ ", 5) == 0)
+        {
+            text = sequenced_text(line); // Message numéroté d'un salon
+        }
+        else if (strncmp(line, "@PRESENCE", 9) == 0 || strncmp(line, "@TYPING ", 8) == 0)
+        {
+            text = presence_text(line, presence, sizeof(presence)); // Lot d'événements de présence
+        }
+        else if (line[0] == '@')
+        {
+            continue; // Réponse de contrôle inattendue
+        }
+        if (text != NULL)
+        {
+            show_text(text);
+        }
+    }
+}
+
+char *receive_long_message(int client_fd, const char *line)
+{
+    char channel[50];
+    unsigned long long seq;
+    size_t len;
+    if (sscanf(line, "@LONG %49s %llu %zu", channel, &seq, &len) != 3)
+    {
+        return NULL;
+    }
+
+    // Un message trop grand pour la mémoire est quand même lu, pour retrouver les lignes qui le suivent
+    char *text = len <= LONG_MESSAGE_MAX ? malloc(len + 1) : NULL;
+    char discard[TRANSPORT_CHUNK_SIZE];
+    size_t got = 0;
+
+    // D'abord les octets déjà reçus avec la ligne
+    size_t buffered = received_len < len ? received_len : len;
+    if (text != NULL)
+    {
+        memcpy(text, received, buffered);
+    }
+    memmove(received, received + buffered, received_len - buffered);
+    received_len -= buffered;
+    got = buffered;
+
+    // Puis une lecture dispersée : la suite du message, et ce qui arrive après dans le tampon de réception
+    while (got < len)
+    {
+        struct iovec iov[2];
+        iov[0].iov_base = text != NULL ? text + got : discard;
+        iov[0].iov_len = text != NULL ? len - got : (len - got < sizeof(discard) ? len - got : sizeof(discard));
+        iov[1].iov_base = received + received_len;
+        iov[1].iov_len = sizeof(received) - received_len;
+        ssize_t n = transport_recvv(client_fd, iov, iov[1].iov_len > 0 ? 2 : 1);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            free(text);
+            return NULL; // La prochaine lecture signalera la fermeture
+        }
+        size_t body = (size_t)n < iov[0].iov_len ? (size_t)n : iov[0].iov_len;
+        got += body;
+        received_len += (size_t)n - body;
+    }
+
+    if (text == NULL || !first_seen(channel, seq))
+    {
+        free(text);
+        return NULL;
+    }
+    if (len > 0 && text[len - 1] == '\n')
+    {
+        len--; // Le retour à la ligne final est ajouté par l'affichage
+    }
+    text[len] = '\0';
+    return text;
+}
+
+int send_long_message(int client_fd, const char *text, size_t len)
+{
+    char header[64];
+    int header_len = snprintf(header, sizeof(header), "@LONG %zu\n", len);
+    struct iovec iov[2] = {{header, (size_t)header_len}, {(void *)text, len}};
+    int index = 0;
+    while (index < 2)
+    {
+        ssize_t sent = transport_sendv(client_fd, iov + index, 2 - index);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        // Envoi partiel : reprendre là où le socket s'est arrêté
+        while (index < 2 && (size_t)sent >= iov[index].iov_len)
+        {
+            sent -= iov[index].iov_len;
+            index++;
+        }
+        if (index < 2)
+        {
+            iov[index].iov_base = (char *)iov[index].iov_base + sent;
+            iov[index].iov_len -= sent;
+        }
+    }
+    return 0;
+}
+
+char *read_paste(size_t *len)
+{
+    printf("Collez le message, puis une ligne avec un seul point pour l'envoyer.\n");
+    char *text = NULL;
+    size_t used = 0;
+    bool too_long = false;
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t line_len;
+    while ((line_len = getline(&line, &capacity, stdin)) > 0)
+    {
+        if (strcmp(line, ".\n") == 0 || strcmp(line, ".\r\n") == 0 || strcmp(line, ".") == 0)
+        {
+            break;
+        }
+        if (too_long || used + line_len > LONG_MESSAGE_MAX)
+        {
+            too_long = true; // Lire quand même jusqu'au point, qui n'est pas une commande
+            continue;
+        }
+        char *grown = realloc(text, used + line_len + 1);
+        if (grown == NULL)
+        {
+            too_long = true;
+            continue;
+        }
+        text = grown;
+        memcpy(text + used, line, line_len);
+        used += line_len;
+    }
+    free(line);
+
+    if (too_long)
+    {
+        printf("Message trop long : %d octets au plus.\n", LONG_MESSAGE_MAX);
+    }
+    if (too_long || used == 0)
+    {
+        free(text);
+        return NULL;
+    }
+    if (text[used - 1] == '\n')
+    {
+        used--; // Le serveur termine le message comme une ligne
+    }
+    text[used] = '\0';
+    *len = used;
+    return text;
+}
+
+int handle_receive(int client_fd)
+{
+    // Lignes laissées dans le tampon par le thread principal (reçues pendant un transfert)
+    process_received(client_fd);
+
+    // Vider le socket : tant que des données attendent, sans bloquer
+    struct pollfd pfd = {.fd = client_fd, .events = POLLIN};
+    for (int reads = 0; reads < NETWORK_DRAIN_READS && (transport_pending(client_fd) || poll(&pfd, 1, 0) > 0); reads++)
+    {
+        int bytes_received = fill_received(client_fd);
+        if (bytes_received == 0)
+        {
+            show_text("Le serveur a fermé la connexion.");
+            return -1;
+        }
+        if (bytes_received < 0)
+        {
+            perror("Erreur lors de la réception des données");
+            return -1;
+        }
+        process_received(client_fd);
+    }
+    return 0;
+}
+
+void *network_thread(void *arg)
+{
+    pthread_t *render = arg;
+    struct pollfd fds[2];
+    fds[0].events = POLLIN;      // Messages du serveur
+    fds[1].fd = network_wake[0]; // Le thread principal a rendu le socket
+    fds[1].events = POLLIN;
+
+    while (1)
+    {
+        int client_fd = connection_fd;
+        fds[0].fd = client_fd;
+        if (poll(fds, 2, -1) < 0 && errno != EINTR)
+        {
+            perror("poll() failed");
+            break;
         }
-
-        // Vérifier si des données sont reçues du serveur
         if (fds[1].revents & POLLIN)
         {
-            handle_receive(client_fd, current_input); // Gérer la réception des messages du serveur
+            char wake[64];
+            read(network_wake[0], wake, sizeof(wake));
+        }
+
+        pthread_mutex_lock(&socket_lock);
+        int status = handle_receive(client_fd);
+        if (status < 0)
+        {
+            // Les commandes tapées d'ici la reconnexion sont refusées
+            transport_close(client_fd);
+            connection_fd = -1;
+            received_len = 0;
+        }
+        // Copiés sous le verrou : le thread principal peut les changer (disconnect, @SESSION)
+        bool quitting = reconnect.quitting;
+        bool has_token = reconnect.token[0] != '\0';
+        pthread_mutex_unlock(&socket_lock);
+        if (status < 0)
+        {
+            if (quitting || !has_token)
+            {
+                break; // Déconnexion demandée, ou pas de jeton pour revenir sans mot de passe
+            }
+            reconnect_to_server();
+            if (connection_fd < 0)
+            {
+                break;
+            }
         }
     }
+    // Plus de connexion, ni de reconnexion possible : fin du programme une fois tout affiché
+    inbound_close();
+    pthread_join(*render, NULL);
+    exit(0);
+}
+
+// Délai des envois et réceptions bloquants du socket, connect() compris ; 0 pour attendre sans limite
+static void set_socket_timeout(int fd, int timeout_ms)
+{
+    struct timeval timeout = {.tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+int connect_to_server(int timeout_ms)
+{
+    int client_fd = socket(AF_INET, SOCK_STREAM, 0); // sock_stream - TCP
+    if (client_fd < 0)
+    {
+        perror("socket() failed");
+        return -1;
+    }
+    if (timeout_ms > 0)
+    {
+        set_socket_timeout(client_fd, timeout_ms);
+    }
+    if (connect(client_fd, (struct sockaddr *)&server_address, sizeof(server_address)) < 0)
+    {
+        close(client_fd);
+        return -1;
+    }
+
+    // Négociation TLS si elle est activée
+    if (transport_connect(client_fd, server_host) < 0)
+    {
+        close(client_fd);
+        return -1;
+    }
+    return client_fd;
+}
+
+void request_session(int client_fd)
+{
+    transport_send(client_fd, "@SESSION\n", 9);
+
+    // "@SESSION <jeton> <durée>", ou "@SESSION -" si le serveur n'a pas pu en créer
+    char line[BUFFER_SIZE];
+    char token[SESSION_TOKEN_SIZE];
+    if (wait_reply(client_fd, line, sizeof(line)) == 0 && sscanf(line, "@SESSION %48s", token) == 1 && strcmp(token, "-") != 0)
+    {
+        pthread_mutex_lock(&socket_lock); // Lu par le thread réseau pour décider de se reconnecter
+        snprintf(reconnect.token, sizeof(reconnect.token), "%s", token);
+        pthread_mutex_unlock(&socket_lock);
+    }
+}
+
+int resume_connection(void)
+{
+    // Le thread principal ne touche pas au socket tant que connection_fd vaut -1 : seuls le jeton et
+    // l'utilisateur sont lus sous le verrou, la connexion se fait sans le tenir
+    char resume[128];
+    pthread_mutex_lock(&socket_lock);
+    snprintf(resume, sizeof(resume), "@RESUME %s %s\n", reconnect.username, reconnect.token);
+    pthread_mutex_unlock(&socket_lock);
+
+    // Un serveur injoignable, ou qui accepte sans répondre, ne bloque pas au-delà de RECONNECT_TIMEOUT_MS
+    int client_fd = connect_to_server(RECONNECT_TIMEOUT_MS);
+    if (client_fd < 0)
+    {
+        return 0; // Serveur pas encore revenu
+    }
+
+    // Le jeton remplace le mot de passe
+    received_len = 0;
+    char response[BUFFER_SIZE] = "";
+    if (transport_send(client_fd, resume, strlen(resume)) < 0)
+    {
+        transport_close(client_fd);
+        return 0;
+    }
+    while (!next_line(response, sizeof(response)))
+    {
+        if (fill_received(client_fd) <= 0)
+        {
+            transport_close(client_fd);
+            return 0;
+        }
+    }
+    if (strcmp(response, "Authentification réussie") != 0)
+    {
+        transport_close(client_fd);
+        return -1; // Jeton expiré ou révoqué : le mot de passe est nécessaire
+    }
+    negotiate_capabilities(client_fd, reconnect.compress, true);
+
+    // Revenir dans le salon, en demandant les messages manqués depuis le dernier affiché
+    if (current_channel[0] != '\0')
+    {
+        char join[BUFFER_SIZE];
+        snprintf(join, sizeof(join), "join %s", current_channel);
+        append_last_seq(join, sizeof(join) - 1);
+        strcat(join, "\n");
+        transport_send(client_fd, join, strlen(join));
+    }
+    set_socket_timeout(client_fd, 0); // Le thread réseau attend ensuite avec poll()
+    return client_fd;
+}
+
+void reconnect_to_server(void)
+{
+    for (int attempt = 0;; attempt++)
+    {
+        // Attente exponentielle, tirée au hasard dans sa seconde moitié : les clients d'un même serveur
+        // ne reviennent pas tous au même instant
+        long delay = RECONNECT_BASE_MS << (attempt < 16 ? attempt : 16);
+        if (delay > RECONNECT_MAX_MS)
+        {
+            delay = RECONNECT_MAX_MS;
+        }
+        delay = delay / 2 + rand() % (delay / 2 + 1);
+        char text[128];
+        snprintf(text, sizeof(text), "Connexion perdue, nouvelle tentative dans %.1f s...", delay / 1000.0);
+        show_text(text);
+        usleep(delay * 1000);
+
+        // Les commandes tapées pendant la tentative sont refusées au lieu d'attendre le verrou
+        int client_fd = resume_connection();
+        if (client_fd > 0)
+        {
+            pthread_mutex_lock(&socket_lock);
+            connection_fd = client_fd;
+            pthread_mutex_unlock(&socket_lock);
+        }
+
+        if (client_fd > 0)
+        {
+            show_text("Reconnecté au serveur.");
+            return;
+        }
+        if (client_fd < 0)
+        {
+            show_text("Session expirée : relancez le client pour vous reconnecter.");
+            return;
+        }
+    }
+}
+
+void append_last_seq(char *command, size_t size)
+{
+    char channel[50];
+    char extra;
+    if (sscanf(command, "join %49s %c", channel, &extra) == 1 && channel_seq(channel, false) != NULL)
+    {
+        snprintf(command + strlen(command), size - strlen(command), " %llu", *channel_seq(channel, false));
+    }
+}
+
+void handle_send(char *current_input)
+{
+    char buffer[BUFFER_SIZE];
+    printf("> ");
+    fflush(stdout);
+    char *input = NULL;
+    size_t capacity = 0;
+    if (getline(&input, &capacity, stdin) < 0)
+    {
+        exit(0); // Fin de l'entrée standard
+    }
+    clean_input(input);
+
+    // Une ligne trop longue pour une commande part comme un message long, de même qu'un texte collé
+    char *long_text = NULL;
+    size_t long_len = strlen(input);
+    if (long_len >= BUFFER_SIZE - 1)
+    {
+        long_text = input;
+        input = NULL;
+    }
+    else if (strcmp(input, "paste") == 0)
+    {
+        long_text = read_paste(&long_len);
+    }
+    snprintf(buffer, sizeof(buffer), "%s", long_text != NULL ? "" : input);
+    free(input);
+
+    // Le thread réseau ne lit plus le socket jusqu'à la fin de la commande (réponse, fichier transféré)
+    pthread_mutex_lock(&socket_lock);
+    int client_fd = connection_fd;
+    if (client_fd < 0)
+    {
+        pthread_mutex_unlock(&socket_lock);
+        if (strlen(buffer) > 0 || long_text != NULL)
+        {
+            show_text("Pas de connexion au serveur : reconnexion en cours, réessayez dans un instant.");
+        }
+        free(long_text);
+        return;
+    }
+    if (strcmp(buffer, "disconnect") == 0)
+    {
+        reconnect.quitting = true; // La fermeture par le serveur est alors attendue
+    }
+    else if (strcmp(buffer, "leave") == 0)
+    {
+        current_channel[0] = '\0'; // Plus de salon à rejoindre après une reconnexion
+    }
+
+    if (long_text != NULL)
+    {
+        if (send_long_message(client_fd, long_text, long_len) < 0)
+        {
+            perror("Erreur lors de l'envoi du message");
+        }
+        free(long_text);
+    }
+    else if (strncmp(buffer, "send ", 5) == 0)
+    {
+        // La commande est envoyée avec la taille du fichier
+        char *filename = buffer + 5;
+        send_file_to_server(client_fd, filename);
+    }
+    else if (strlen(buffer) > 0)
+    {
+        // En revenant dans un salon déjà vu, demander les messages manqués depuis le dernier affiché
+        append_last_seq(buffer, BUFFER_SIZE - 1);
+
+        // Envoi du message, terminé par un retour à la ligne
+        size_t len = strlen(buffer);
+        buffer[len] = '\n';
+        if (transport_send(client_fd, buffer, len + 1) < 0)
+        {
+            perror("Erreur lors de l'envoi du message");
+        }
+        buffer[len] = '\0';
+    }
+
+    if (strncmp(buffer, "receive ", 8) == 0)
+    {
+        char *filename = buffer + 8;
+        receive_file_from_server(client_fd, filename);
+    }
+
+    else if (strcmp(buffer, "help") == 0)
+    {
+        printf("\nLister tous les salons\t\t\t\t\t\tUsage : list\n");
+        printf("\nLister tous les utilisateurs connectés dans le salon\t\tUsage : list_users\n");
+        printf("\nLister tous les utilisateurs connectés dans tous les salons\tUsage : list_admin\n");
+        printf("\nAfficher les statistiques du serveur\t\t\t\tUsage : stats\n");
+        printf("\nAfficher le salon actuel\t\t\t\t\tUsage : current\n");
+        printf("\nCréer un salon\t\t\t\t\t\t\tUsage : create <nom_du_salon>\n");
+        printf("\nSuprimer un salon\t\t\t\t\t\tUsage : delete <nom_du_salon>\n");
+        printf("\nCréer ou supprimer plusieurs salons\t\t\t\tUsage : create_many, delete_many <salon> <salon>...\n");
+        printf("\nExpulser des utilisateurs\t\t\t\t\tUsage : kick <utilisateur> <utilisateur>...\n");
+        printf("\nDéplacer des utilisateurs dans un salon\t\t\t\tUsage : move <salon> <utilisateur>...\n");
+        printf("\nRejoindre un salon\t\t\t\t\t\tUsage : join <nom_du_salon>\n");
+        printf("\nQuitter le salon\t\t\t\t\t\tUsage : leave\n");
+        printf("\nEnvoyer un message privé à un utilisateur\t\t\tUsage : msg <utilisateur> <message>\n");
+        printf("\nEnvoyer un message de plusieurs lignes (fin : une ligne \".\")\tUsage : paste\n");
+        printf("\nChercher un texte dans les messages du salon\t\t\tUsage : search <texte>\n");
+        printf("\nSe signaler absent, puis de retour\t\t\t\tUsage : away, back\n");
+        printf("\nEnvoyer un fichier au salon actuel.\t\t\t\tUsage : send <nom_du_fichier>\n");
+        printf("\nRecevoir un fichier du salon actuel.\t\t\t\tUsage : receive <nom_du_fichier>\n");
+        printf("\nSe déconnecter du serveur.\t\t\t\t\tUsage : disconnect\n");
+        printf("\n");
+    }
+
+    // Rendre le socket au thread réseau, qui affiche ce qui est arrivé entre-temps
+    pthread_mutex_unlock(&socket_lock);
+    write(network_wake[1], "", 1);
+
+    // Sauvegarde de l'entrée utilisateur
+    strncpy(current_input, buffer, sizeof(current_input) - 1);
+
+    // Effacer l'entrée utilisateur après l'envoi
+    memset(current_input, 0, sizeof(current_input));
+}
+
+int batch_fill_input(batch_t *batch)
+{
+    ssize_t n = read(batch->input_fd, batch->input + batch->input_len, sizeof(batch->input) - batch->input_len);
+    if (n > 0)
+    {
+        batch->input_len += n;
+    }
+    else if (n == 0 || errno != EINTR)
+    {
+        batch->input_done = true; // Fin du fichier de commandes (ou erreur de lecture)
+    }
+    return n;
+}
+
+int batch_next_line(batch_t *batch, char *line, size_t size)
+{
+    char *end = memchr(batch->input, '\n', batch->input_len);
+    if (end == NULL && batch->input_len < sizeof(batch->input) && (!batch->input_done || batch->input_len == 0))
+    {
+        return 0; // Ligne incomplète : attendre la suite
+    }
+
+    // La dernière ligne peut ne pas se terminer par un retour à la ligne ; une ligne trop longue est coupée
+    size_t line_len = end != NULL ? (size_t)(end - batch->input) : batch->input_len;
+    size_t consumed = end != NULL ? line_len + 1 : line_len;
+    if (line_len >= size)
+    {
+        line_len = size - 1;
+    }
+    memcpy(line, batch->input, line_len);
+    line[line_len] = '\0';
+
+    memmove(batch->input, batch->input + consumed, batch->input_len - consumed);
+    batch->input_len -= consumed;
+    return 1;
+}
+
+// Commande en attente de réponse, la plus ancienne en premier
+static batch_command_t *batch_push(batch_t *batch, int type, const char *name)
+{
+    batch_command_t *command = &batch->pending[(batch->pending_head + batch->pending_count) % BATCH_MAX_PENDING];
+    batch->pending_count++;
+    command->type = type;
+    snprintf(command->name, sizeof(command->name), "%s", name);
+    command->file_fd = -1;
+    command->send_size = 0;
+    command->crc = 0;
+    return command;
+}
+
+static batch_command_t *batch_pop(batch_t *batch, int type)
+{
+    if (batch->pending_count == 0 || batch->pending[batch->pending_head].type != type)
+    {
+        return NULL; // Réponse inattendue
+    }
+    batch_command_t *command = &batch->pending[batch->pending_head];
+    batch->pending_head = (batch->pending_head + 1) % BATCH_MAX_PENDING;
+    batch->pending_count--;
+    return command;
+}
+
+static void batch_queue(batch_t *batch, const char *data, size_t len)
+{
+    if (outqueue_push(&batch->out, data, len) < 0)
+    {
+        fprintf(stderr, "Mémoire insuffisante.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void batch_command(batch_t *batch, char *command)
+{
+    clean_input(command);
+    if (command[0] == '\0' || command[0] == '#' || strcmp(command, "help") == 0)
+    {
+        return;
+    }
+    if (strcmp(command, "disconnect") == 0)
+    {
+        batch->input_done = true; // Terminer une fois les réponses reçues
+        batch->input_len = 0;
+        return;
+    }
+
+    if (strncmp(command, "send ", 5) == 0)
+    {
+        // Le fichier ne part qu'après le "@OK" du serveur : rien d'autre ne doit être envoyé d'ici là
+        char line[BUFFER_SIZE];
+        long send_size;
+        uint32_t crc;
+        int file_fd = open_upload(command + 5, line, sizeof(line), &send_size, &crc);
+        if (file_fd < 0)
+        {
+            batch->failures++;
+            return;
+        }
+        batch_queue(batch, line, strlen(line));
+        batch_command_t *upload = batch_push(batch, BATCH_SEND, command + 5);
+        upload->file_fd = file_fd;
+        upload->send_size = send_size;
+        upload->crc = crc;
+        batch->upload_waiting = true;
+        return;
+    }
+    if (strncmp(command, "receive ", 8) == 0)
+    {
+        batch_push(batch, BATCH_RECEIVE, command + 8);
+    }
+
+    append_last_seq(command, BUFFER_SIZE - 1);
+    size_t len = strlen(command);
+    command[len] = '\n';
+    batch_queue(batch, command, len + 1);
+    command[len] = '\0';
+}
+
+// Fin d'un téléchargement : vérifier la taille (et le flux compressé) puis fermer le fichier
+static void batch_finish_download(batch_t *batch)
+{
+    bool complete = batch->download_remaining == 0 && !batch->download_failed;
+    if (batch->download_inflater != NULL)
+    {
+        complete = complete && inflater_complete(batch->download_inflater, batch->download_size);
+        batch->download_crc = inflater_checksum(batch->download_inflater);
+        inflater_free(batch->download_inflater);
+        batch->download_inflater = NULL;
+    }
+    if (batch->download_fd >= 0)
+    {
+        close(batch->download_fd);
+    }
+    batch->download_fd = -1;
+    batch->download_remaining = -1;
+
+    // Le résultat attend la somme de contrôle qui suit le fichier
+    if (complete && server_checksum)
+    {
+        batch->download_verifying = true;
+        return;
+    }
+    if (complete)
+    {
+        printf("Fichier '%s' reçu avec succès.\n", batch->download_name);
+    }
+    else
+    {
+        printf("Erreur : fichier '%s' incomplet reçu.\n", batch->download_name);
+        batch->failures++;
+    }
+}
+
+static void batch_start_download(batch_t *batch, const char *line)
+{
+    batch_command_t *download = batch_pop(batch, BATCH_RECEIVE);
+    long file_size, compressed_size = -1;
+    if (sscanf(line, "@FILEZ %ld %ld", &compressed_size, &file_size) != 2 && sscanf(line, "@FILE %ld", &file_size) != 1)
+    {
+        return;
+    }
+
+    snprintf(batch->download_name, sizeof(batch->download_name), "%s", download != NULL ? download->name : "?");
+    batch->download_fd = download != NULL ? open(download->name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1;
+    batch->download_failed = batch->download_fd < 0;
+    if (batch->download_fd < 0)
+    {
+        perror("Erreur lors de la création du fichier"); // Les octets seront lus quand même, pour rester synchronisé
+    }
+    batch->download_size = file_size;
+    batch->download_crc = 0;
+    batch->download_remaining = compressed_size >= 0 ? compressed_size : file_size;
+    batch->download_inflater = compressed_size >= 0 ? inflater_new(batch->download_fd, file_size) : NULL;
+    batch->download_failed |= compressed_size >= 0 && batch->download_inflater == NULL;
+    if (batch->download_remaining == 0)
+    {
+        batch_finish_download(batch);
+    }
+}
+
+// Octets du fichier en cours de téléchargement au début du tampon de réception
+static void batch_download_data(batch_t *batch)
+{
+    size_t len = received_len < (size_t)batch->download_remaining ? received_len : (size_t)batch->download_remaining;
+    if (!batch->download_failed)
+    {
+        if (batch->download_inflater != NULL)
+        {
+            batch->download_failed = inflater_write(batch->download_inflater, received, len) < 0;
+        }
+        else
+        {
+            batch->download_crc = crc32c(batch->download_crc, received, len);
+            for (size_t written = 0; written < len && !batch->download_failed;)
+            {
+                ssize_t n = write(batch->download_fd, received + written, len - written);
+                batch->download_failed = n < 0;
+                written += n > 0 ? n : 0;
+            }
+        }
+    }
+    memmove(received, received + len, received_len - len);
+    received_len -= len;
+    batch->download_remaining -= len;
+    if (batch->download_remaining == 0)
+    {
+        batch_finish_download(batch);
+    }
+}
+
+static void batch_answer(batch_t *batch, const char *line)
+{
+    if (strcmp(line, "@PING") == 0)
+    {
+        // Pendant l'attente d'un "@OK", la réponse passerait pour le début du fichier
+        if (batch->upload_waiting)
+        {
+            batch->pong_due = true;
+        }
+        else
+        {
+            batch_queue(batch, "@PONG\n", 6);
+        }
+    }
+    else if (strncmp(line, "@MSG ", 5) == 0 || strncmp(line, "@SEQ ", 5) == 0)
+    {
+        const char *text = sequenced_text(line);
+        if (text != NULL)
+        {
+            printf("%s\n", text);
+        }
+    }
+    else if (strncmp(line, "@LONG ", 6) == 0)
+    {
+        // Le message suit la ligne : il est écrit au fur et à mesure de sa réception
+        char channel[50];
+        unsigned long long seq;
+        if (sscanf(line, "@LONG %49s %llu %zu", channel, &seq, &batch->long_remaining) == 3)
+        {
+            batch->long_shown = first_seen(channel, seq);
+        }
+    }
+    else if (strncmp(line, "@FILE", 5) == 0)
+    {
+        batch_start_download(batch, line);
+    }
+    else if (strncmp(line, "@CRC32C ", 8) == 0 && batch->download_verifying)
+    {
+        // "-" : le serveur ne connaît pas encore la somme du fichier
+        unsigned int crc;
+        batch->download_verifying = false;
+        if (sscanf(line, "@CRC32C %8x", &crc) == 1 && crc != batch->download_crc)
+        {
+            unlink(batch->download_name);
+            printf("Erreur : fichier '%s' corrompu (somme de contrôle incorrecte), supprimé.\n", batch->download_name);
+            batch->failures++;
+        }
+        else
+        {
+            printf("Fichier '%s' reçu avec succès.\n", batch->download_name);
+        }
+    }
+    else if (strcmp(line, "@OK") == 0 || (strncmp(line, "@ERR", 4) == 0 && batch->pending_count > 0 &&
+                                          batch->pending[batch->pending_head].type == BATCH_SEND))
+    {
+        batch_command_t *upload = batch_pop(batch, BATCH_SEND);
+        if (upload == NULL)
+        {
+            return;
+        }
+        if (line[1] == 'O')
+        {
+            // Le fichier part sans copie quand le socket est prêt, suivi des commandes lues ensuite
+            if (outqueue_push_file(&batch->out, upload->file_fd, 0, upload->send_size) < 0)
+            {
+                fprintf(stderr, "Mémoire insuffisante.\n");
+                exit(EXIT_FAILURE);
+            }
+            if (server_checksum)
+            {
+                char trailer[32];
+                snprintf(trailer, sizeof(trailer), "@CRC32C %08x\n", upload->crc);
+                batch_queue(batch, trailer, strlen(trailer));
+            }
+            printf("Envoi du fichier '%s' au serveur.\n", upload->name);
+        }
+        else
+        {
+            close(upload->file_fd);
+            printf("Fichier '%s' refusé : %s\n", upload->name, line[4] == ' ' ? line + 5 : "erreur du serveur.");
+            batch->failures++;
+        }
+        batch->upload_waiting = false;
+        if (batch->pong_due)
+        {
+            batch_queue(batch, "@PONG\n", 6);
+            batch->pong_due = false;
+        }
+    }
+    else if (strncmp(line, "@ERR", 4) == 0)
+    {
+        batch_command_t *download = batch_pop(batch, BATCH_RECEIVE);
+        printf("Fichier '%s' non reçu : %s\n", download != NULL ? download->name : "?", line[4] == ' ' ? line + 5 : "erreur du serveur.");
+        batch->failures++;
+    }
+    else if (strcmp(line, "@SYNC") == 0)
+    {
+        batch_pop(batch, BATCH_SYNC);
+    }
+    else if (line[0] != '@')
+    {
+        printf("%s\n", line);
+    }
+}
+
+void batch_process_received(batch_t *batch)
+{
+    char line[sizeof(received) + 1];
+    while (received_len > 0)
+    {
+        if (batch->download_remaining > 0)
+        {
+            batch_download_data(batch);
+            continue;
+        }
+        if (batch->long_remaining > 0)
+        {
+            size_t len = received_len < batch->long_remaining ? received_len : batch->long_remaining;
+            if (batch->long_shown)
+            {
+                fwrite(received, 1, len, stdout);
+            }
+            memmove(received, received + len, received_len - len);
+            received_len -= len;
+            batch->long_remaining -= len;
+            continue;
+        }
+        if (!next_line(line, sizeof(line)))
+        {
+            break; // Ligne incomplète : attendre la suite
+        }
+        batch_answer(batch, line);
+    }
+}
+
+int run_batch(int client_fd, batch_t *batch)
+{
+    outqueue_init(&batch->out);
+    batch->download_fd = -1;
+    batch->download_remaining = -1;
+    fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL) | O_NONBLOCK);
+
+    // Réponses et messages arrivés pendant la connexion
+    batch_process_received(batch);
+
+    while (1)
+    {
+        // Envoyer les commandes sans attendre les réponses, sauf pendant l'attente d'un "@OK"
+        char command[BUFFER_SIZE];
+        while (!batch->upload_waiting && batch->pending_count < BATCH_MAX_PENDING - 1 && batch_next_line(batch, command, sizeof(command)))
+        {
+            batch_command(batch, command);
+        }
+
+        // Après la dernière commande, "@SYNC" : sa réponse arrive après toutes les autres
+        if (batch->input_done && batch->input_len == 0 && !batch->upload_waiting && !batch->sync_sent)
+        {
+            batch_queue(batch, "@SYNC\n", 6);
+            batch_push(batch, BATCH_SYNC, "");
+            batch->sync_sent = true;
+        }
+        if (batch->sync_sent && batch->pending_count == 0 && outqueue_empty(&batch->out))
+        {
+            break;
+        }
+
+        if (outqueue_flush(&batch->out, client_fd) < 0)
+        {
+            perror("Erreur lors de l'envoi des commandes");
+            batch->failures++;
+            break;
+        }
+        fflush(stdout);
+
+        // Lire les commandes seulement si elles peuvent être envoyées
+        struct pollfd fds[2];
+        fds[0].fd = client_fd;
+        fds[0].events = POLLIN | (outqueue_empty(&batch->out) ? 0 : POLLOUT);
+        fds[1].fd = batch->input_done || batch->upload_waiting || batch->pending_count >= BATCH_MAX_PENDING - 1 ? -1 : batch->input_fd;
+        fds[1].events = POLLIN;
+        int timeout = transport_pending(client_fd) ? 0 : -1;
+        if (poll(fds, 2, timeout) < 0 && errno != EINTR)
+        {
+            perror("poll() failed");
+            batch->failures++;
+            break;
+        }
+
+        if (fds[1].revents & (POLLIN | POLLHUP))
+        {
+            batch_fill_input(batch);
+        }
+
+        // Traiter tout ce qui est arrivé, pas seulement une lecture par réveil
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR) || transport_pending(client_fd))
+        {
+            int n;
+            while ((n = fill_received(client_fd)) > 0)
+            {
+                batch_process_received(batch);
+            }
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+                printf("Le serveur a fermé la connexion.\n");
+                batch->failures++;
+                break;
+            }
+        }
+    }
+
+    fflush(stdout);
+    outqueue_clear(&batch->out);
+    for (; batch->pending_count > 0; batch->pending_count--)
+    {
+        batch_command_t *command = &batch->pending[batch->pending_head];
+        if (command->file_fd >= 0)
+        {
+            close(command->file_fd);
+        }
+        batch->pending_head = (batch->pending_head + 1) % BATCH_MAX_PENDING;
+    }
+    return batch->failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    int client_fd;
+    struct sockaddr_in server_addr;
+    char username[50], password[50];
+    char current_input[BUFFER_SIZE] = ""; // Pour sauvegarder l'entrée utilisateur
+
+    bool use_tls = false;
+    bool use_compression = true;
+    const char *batch_file = NULL;
+    const char *tls_ca = NULL;
+    const char *tls_session = NULL;
+    int port = SERVER_PORT;
+
+    // Options de la ligne de commande
+    static struct option long_options[] = {
+        {"tls", no_argument, 0, 't'},
+        {"tls-ca", required_argument, 0, 'a'},
+        {"tls-session", required_argument, 0, 's'},
+        {"port", required_argument, 0, 'p'},
+        {"host", required_argument, 0, 'H'},
+        {"no-compress", no_argument, 0, 'n'},
+        {"batch", required_argument, 0, 'b'},
+        {"streams", required_argument, 0, 'j'},
+        {0, 0, 0, 0}};
+    int opt;
+    while ((opt = getopt_long(argc, argv, "ta:s:p:H:nb:j:", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            use_tls = true;
+            break;
+        case 'a':
+            use_tls = true;
+            tls_ca = optarg;
+            break;
+        case 's':
+            use_tls = true;
+            tls_session = optarg;
+            break;
+        case 'p':
+            port = atoi(optarg); // Un autre nœud de la grappe
+            break;
+        case 'H':
+            server_host = optarg; // Nom ou adresse IPv4 du serveur
+            break;
+        case 'n':
+            use_compression = false; // Fichiers toujours transférés tels quels
+            break;
+        case 'b':
+            batch_file = optarg; // Commandes lues dans un fichier ("-" : entrée standard), sans interface
+            break;
+        case 'j':
+            parallel_streams = atoi(optarg); // Connexions des envois parallèles, 1 pour les désactiver
+            break;
+        default:
+            fprintf(stderr, "Usage : %s [--host hôte] [--port port] [--tls] [--tls-ca fichier.crt] [--tls-session fichier.pem] [--no-compress] [--batch fichier|-] [--streams n]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // En mode batch, l'identifiant et le mot de passe sont les deux premières lignes des commandes
+    static batch_t batch;
+    if (batch_file != NULL)
+    {
+        batch.input_fd = strcmp(batch_file, "-") == 0 ? STDIN_FILENO : open(batch_file, O_RDONLY | O_CLOEXEC);
+        if (batch.input_fd < 0)
+        {
+            perror("Erreur lors de l'ouverture du fichier de commandes");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (use_tls && transport_client_init(tls_ca, tls_session) < 0)
+    {
+        exit(EXIT_FAILURE);
+    }
+    if (!use_tls && batch_file == NULL)
+    {
+        printf("Attention : connexion non chiffrée, le mot de passe circule en clair.\n");
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    // Le nom du serveur est résolu une fois : les reconnexions et les envois parallèles réutilisent l'adresse
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *resolved;
+    int error = getaddrinfo(server_host, NULL, &hints, &resolved);
+    if (error != 0)
+    {
+        fprintf(stderr, "Serveur %s introuvable : %s\n", server_host, gai_strerror(error));
+        exit(EXIT_FAILURE);
+    }
+    server_addr = *(struct sockaddr_in *)resolved->ai_addr;
+    server_addr.sin_port = htons(port);
+    freeaddrinfo(resolved);
+    server_address = server_addr;
+
+    client_fd = connect_to_server(0);
+    if (client_fd < 0)
+    {
+        perror("connect() failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Authentification
+    if (batch_file != NULL)
+    {
+        username[0] = password[0] = '\0';
+        while (!batch_next_line(&batch, username, sizeof(username)) && batch_fill_input(&batch) > 0)
+        {
+        }
+        while (!batch_next_line(&batch, password, sizeof(password)) && batch_fill_input(&batch) > 0)
+        {
+        }
+    }
+    else
+    {
+        printf("Login: ");
+        fgets(username, sizeof(username), stdin);
+
+        // Dans client.c, après avoir reçu le mot de passe
+        printf("Password: ");
+        fgets(password, sizeof(password), stdin);
+    }
+    clean_input(username);
+    clean_input(password);
+
+    // Ensuite, lors de l'envoi, sur une seule ligne
+    char auth_info[110];
+    snprintf(auth_info, sizeof(auth_info), "%s %s\n", username, password);
+
+    // S'assurer d'envoyer uniquement la longueur correcte
+    transport_send(client_fd, auth_info, strlen(auth_info));
+    memset(auth_info, 0, sizeof(auth_info));
+    memset(password, 0, sizeof(password));
+
+    // Attendre la réponse d'authentification
+    char auth_response[BUFFER_SIZE];
+    while (!next_line(auth_response, sizeof(auth_response)))
+    {
+        if (fill_received(client_fd) <= 0)
+        {
+            printf("Le serveur a fermé la connexion.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    printf("%s\n", auth_response); // Afficher le message d'authentification
+
+    // Proposer la compression et les sommes de contrôle des fichiers une fois connecté
+    bool logged_in = strcmp(auth_response, "Authentification réussie") == 0;
+    if (logged_in)
+    {
+        negotiate_capabilities(client_fd, use_compression, batch_file == NULL); // Pas d'événements de présence en mode batch
+    }
+
+    // Mode batch : toutes les commandes, puis fin du programme
+    if (batch_file != NULL)
+    {
+        int status = logged_in ? run_batch(client_fd, &batch) : EXIT_FAILURE;
+        transport_close(client_fd);
+        return status;
+    }
+
+    // Un jeton de session permet de revenir sans mot de passe si la connexion est perdue
+    if (logged_in)
+    {
+        snprintf(reconnect.username, sizeof(reconnect.username), "%s", username);
+        reconnect.compress = use_compression;
+        request_session(client_fd);
+    }
+    srand(time(NULL) ^ getpid()); // Délais de reconnexion différents d'un client à l'autre
+    connection_fd = client_fd;
+
+    // Le thread réseau lit le socket dès que des données arrivent, le thread d'affichage redessine le terminal
+    // au plus RENDER_FRAME_MS ; le thread principal lit les commandes et les transferts de fichiers
+    pthread_t network, render;
+    inbound.started = true;
+    if (pipe(network_wake) < 0 || fcntl(network_wake[0], F_SETFL, O_NONBLOCK) < 0 || fcntl(network_wake[1], F_SETFL, O_NONBLOCK) < 0 ||
+        pthread_create(&render, NULL, render_thread, NULL) != 0 ||
+        pthread_create(&network, NULL, network_thread, &render) != 0)
+    {
+        perror("Erreur lors du démarrage des threads");
+        exit(EXIT_FAILURE);
+    }
+
+    while (1)
+    {
+        handle_send(current_input); // Gérer l'entrée utilisateur et envoyer le message
+    }
 
-    close(client_fd);
+    transport_close(client_fd);
     return 0;
 }
\ No newline at end of file
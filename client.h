@@ -13,20 +13,203 @@
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netdb.h>
 #include <sqlite3.h>
 #include <stdbool.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <poll.h>
+#include <getopt.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include "transport.h"
+#include "compress.h"
+#include "checksum.h"
+#include "presence.h"
+#include "outqueue.h"
+#include "session.h"
+#include "util.h"
 
 #define BUFFER_SIZE 1024  /**< Buffer size for sending/receiving data */
+#define SERVER_PORT 8080  /**< Default port of the server */
+#define SERVER_HOST "127.0.0.1" /**< Default address of the server */
+#define CLIENT_CHANNELS 16 /**< Channels whose last sequence number is remembered */
+#define BATCH_MAX_PENDING 64 /**< Commands of the batch mode waiting for an answer of the server */
+#define PARALLEL_MIN_SIZE (8L * 1024 * 1024) /**< Files from this size are uploaded over several connections */
+#define PARALLEL_STREAMS 4   /**< Default number of data connections of a parallel upload */
+#define PARALLEL_MAX_STREAMS 8 /**< Maximum number of data connections of a parallel upload */
+#define INBOUND_MAX_LINES 1024 /**< Lines received and not displayed yet; the oldest are skipped beyond */
+#define RENDER_FRAME_MS 33     /**< Shortest delay between two redraws of the terminal (about 30 per second) */
+#define RENDER_FRAME_LINES 200 /**< Most lines displayed by one redraw; the older ones are skipped */
+#define NETWORK_DRAIN_READS 64 /**< Reads of the socket before the network thread lets the main thread use it */
+#define RECONNECT_BASE_MS 500    /**< Delay before the first reconnection attempt, doubled at each failure */
+#define RECONNECT_MAX_MS 30000   /**< Longest delay between two reconnection attempts */
+#define RECONNECT_TIMEOUT_MS 10000 /**< Longest wait for the server during a reconnection attempt (connection, handshake, reply) */
+#define LONG_MESSAGE_MAX (2 * 1024 * 1024) /**< Largest message pasted or received; the server may accept less (`max-message-bytes`) */
+
+#define BATCH_SEND 1     /**< Upload waiting for `@OK` */
+#define BATCH_RECEIVE 2  /**< Download waiting for `@FILE` */
+#define BATCH_SYNC 3     /**< End of the batch waiting for `@SYNC` */
+
+/**
+ * @brief Structure representing the last message seen in a channel.
+ */
+typedef struct
+{
+    char channel[50];             /**< Name of the channel, empty if the entry is free */
+    unsigned long long last_seq;  /**< Sequence number of the last message displayed */
+} channel_seq_t;
+
+/**
+ * @brief Structure representing a command of the batch mode waiting for an answer.
+ */
+typedef struct
+{
+    int type;        /**< BATCH_SEND, BATCH_RECEIVE or BATCH_SYNC */
+    char name[256];  /**< Local name of the file */
+    int file_fd;     /**< Bytes to upload (the file or its compressed copy), or -1 */
+    long send_size;  /**< Number of bytes to upload */
+    uint32_t crc;    /**< CRC-32C of the file to upload */
+} batch_command_t;
+
+/**
+ * @brief Structure representing the state of the batch mode.
+ * 
+ * The commands are sent as soon as they are read, without waiting for the 
+ * previous answers; the answers of the server come in the same order and 
+ * are matched with the commands waiting in `pending`. Only an upload stops 
+ * the reading of the commands, until the server accepts or refuses the 
+ * file: the bytes that follow the `send` command belong to the file.
+ */
+typedef struct
+{
+    int input_fd;                                /**< Descriptor of the commands */
+    char input[BUFFER_SIZE];                     /**< Bytes of the commands not processed yet */
+    size_t input_len;                            /**< Number of bytes in input */
+    bool input_done;                             /**< End of the commands reached */
+    bool sync_sent;                              /**< `@SYNC` sent after the last command */
+    outqueue_t out;                              /**< Commands and files waiting for the socket */
+    batch_command_t pending[BATCH_MAX_PENDING];  /**< Commands waiting for an answer, in order */
+    int pending_head;                            /**< Index of the oldest command */
+    int pending_count;                           /**< Number of commands waiting */
+    bool upload_waiting;                         /**< An upload waits for `@OK` : nothing else may be sent */
+    bool pong_due;                               /**< A ping arrived while an upload was waiting */
+    char download_name[256];                     /**< Local name of the file being downloaded */
+    int download_fd;                             /**< File being downloaded, or -1 to discard the bytes */
+    inflater_t *download_inflater;               /**< Decompression of a compressed download, or NULL */
+    long download_size;                          /**< Size of the file being downloaded */
+    long download_remaining;                     /**< Bytes of the download not received yet, or -1 */
+    bool download_failed;                        /**< Write or decompression error during the download */
+    uint32_t download_crc;                       /**< CRC-32C of the raw bytes downloaded so far */
+    bool download_verifying;                     /**< The download waits for its `@CRC32C` trailer */
+    size_t long_remaining;                       /**< Bytes of the long message (`@LONG`) being received */
+    bool long_shown;                             /**< The long message being received is printed (not a replay already seen) */
+    int failures;                                /**< Refused or incomplete transfers */
+} batch_t;
+
+/**
+ * @brief Structure representing the lines received and waiting to be displayed.
+ * 
+ * The network thread adds the lines as they arrive; the render thread takes 
+ * all of them at most every RENDER_FRAME_MS milliseconds and displays them 
+ * with a single redraw. When the terminal cannot keep up, the oldest lines 
+ * are dropped and counted instead of slowing down the reading of the socket.
+ */
+typedef struct
+{
+    char *lines[INBOUND_MAX_LINES]; /**< Lines waiting, allocated with strdup() */
+    int head;                       /**< Index of the oldest line */
+    int count;                      /**< Number of lines waiting */
+    unsigned long skipped;          /**< Lines dropped since the last redraw */
+    bool closed;                    /**< The connection is closed: display the rest, then stop */
+    bool started;                   /**< The render thread is running */
+    pthread_mutex_t lock;           /**< Protects the queue */
+    pthread_cond_t ready;           /**< Signaled when a line is added */
+} inbound_queue_t;
+
+/**
+ * @brief What the client needs to reconnect without the password (interactive mode).
+ */
+typedef struct
+{
+    char username[50];                /**< User logged in */
+    char token[SESSION_TOKEN_SIZE];   /**< Session token given by the server, empty if none */
+    bool compress;                    /**< Compression offered again after a reconnection */
+    bool quitting;                    /**< The user typed `disconnect`: the closing is expected */
+} reconnect_state_t;
 
 /** 
  * @brief Stores the current chat channel. 
  */
 char current_channel[50] = ""; 
 
+/** 
+ * @brief Last message seen in each channel, sent back when joining it again. 
+ */
+channel_seq_t seen_channels[CLIENT_CHANNELS];
+
+/** 
+ * @brief Bytes received from the server and not processed yet. 
+ */
+char received[TRANSPORT_CHUNK_SIZE];
+
+/** 
+ * @brief Number of bytes in received. 
+ */
+size_t received_len = 0;
+
+/** 
+ * @brief true if the server accepted the compression of the files (see compress.h). 
+ */
+bool server_compress = false;
+
+/** 
+ * @brief true if the server accepted the checksum trailers of the files (see checksum.h). 
+ */
+bool server_checksum = false;
+
+/** 
+ * @brief Lines received by the network thread for the render thread (interactive mode). 
+ */
+inbound_queue_t inbound = {.lock = PTHREAD_MUTEX_INITIALIZER, .ready = PTHREAD_COND_INITIALIZER};
+
+/** 
+ * @brief Held while a thread reads or writes the socket and the receive buffer (interactive mode). 
+ */
+pthread_mutex_t socket_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** 
+ * @brief Pipe waking up the network thread when the main thread releases the socket. 
+ */
+int network_wake[2] = {-1, -1};
+
+/** 
+ * @brief Socket connected to the server in interactive mode, -1 while reconnecting (protected by socket_lock). 
+ */
+int connection_fd = -1;
+
+/** 
+ * @brief Session of the user, used to reconnect after the connection is lost (protected by socket_lock). 
+ */
+reconnect_state_t reconnect;
+
+/** 
+ * @brief Name or address of the server given with `--host`, also checked against its TLS certificate. 
+ */
+const char *server_host = SERVER_HOST;
+
+/** 
+ * @brief Address of the server, used again to open the data connections of a parallel upload. 
+ */
+struct sockaddr_in server_address;
+
+/** 
+ * @brief Number of data connections of a parallel upload (1 to disable parallel uploads). 
+ */
+int parallel_streams = PARALLEL_STREAMS;
+
 /**
  * @brief Cleans the input by removing newline or carriage return characters.
  * 
@@ -38,22 +221,217 @@ char current_channel[50] = "";
 void clean_input(char *str);
 
 /**
- * @brief Displays a message from the server, preserving the current user input.
+ * @brief Displays a message from the server.
+ * 
+ * Once the render thread is running, the message is added to the inbound 
+ * queue and displayed by its next redraw; before that (login, batch mode), 
+ * it is printed directly.
+ * 
+ * @param[in] message The message received from the server, without its line feed.
+ */
+void show_text(const char *message);
+
+/**
+ * @brief Marks the inbound queue closed: the render thread displays the remaining lines, then stops.
+ */
+void inbound_close(void);
+
+/**
+ * @brief Body of the render thread: redraws the terminal with the queued lines, at most every RENDER_FRAME_MS.
+ * 
+ * Each redraw clears the prompt line, writes the lines (preceded by the 
+ * number of lines skipped, if any) and the prompt again, in a single write. 
+ * The thread stops once the queue is closed and empty.
+ * 
+ * @param[in] arg Unused.
+ * @return NULL.
+ */
+void *render_thread(void *arg);
+
+/**
+ * @brief Body of the network thread: reads the socket as soon as data arrives and queues the messages.
+ * 
+ * The thread holds `socket_lock` while it reads, and waits for the lock while 
+ * the main thread sends a command or transfers a file. When the connection 
+ * is lost, it reconnects with the session token (reconnect_to_server()), 
+ * unless the user asked to disconnect. It is the only thread that ends the 
+ * program, once the connection is lost for good and the render thread has 
+ * displayed everything.
+ * 
+ * @param[in] arg The render thread (pthread_t *); the socket is connection_fd.
+ * @return Never returns.
+ */
+void *network_thread(void *arg);
+
+/**
+ * @brief Opens a connection to server_address (TCP, then TLS if enabled).
+ * 
+ * @param[in] timeout_ms The longest wait of each blocking operation of the socket (connection, handshake, 
+ *                       reads and writes), kept on the socket; 0 to wait without limit.
+ * @return The socket, or -1 on error.
+ */
+int connect_to_server(int timeout_ms);
+
+/**
+ * @brief Asks the server for a session token after the login, and keeps it in reconnect.
+ * 
+ * The token is stored with `socket_lock` held, which the caller must not hold.
+ * 
+ * @param[in] client_fd The socket connected to the server.
+ */
+void request_session(int client_fd);
+
+/**
+ * @brief Opens a new connection and resumes the session with its token.
  * 
- * This function clears the current line and displays a message received from 
- * the server. It then re-displays the user's current input or a prompt.
+ * On success the capabilities are negotiated again and the current channel 
+ * is joined again with its last sequence number, so the messages sent in 
+ * the meantime are replayed. The caller does not hold `socket_lock`: 
+ * connection_fd is -1, so the main thread leaves the socket buffers alone, 
+ * and each blocking step gives up after RECONNECT_TIMEOUT_MS. 
  * 
- * @param[in] message The message received from the server.
- * @param[in] current_input The user's current input string.
+ * @return The new socket, 0 if the server cannot be reached (try again), -1 if the session is refused.
  */
-void print_message(const char *message, const char *current_input);
+int resume_connection(void);
+
+/**
+ * @brief Reconnects after the connection is lost, with an exponential backoff.
+ * 
+ * The delay starts at RECONNECT_BASE_MS, doubles after each failure up to 
+ * RECONNECT_MAX_MS, and is drawn at random in its second half, so that the 
+ * clients of a restarted server do not all come back at once. `socket_lock` 
+ * is only taken to publish the new socket in connection_fd, which is still 
+ * -1 on return if the session was refused.
+ */
+void reconnect_to_server(void);
+
+/**
+ * @brief Returns the last sequence number seen in a channel.
+ * 
+ * @param[in] channel The channel.
+ * @param[in] create true to add the channel if it is not known (the oldest entry is reused when the table is full).
+ * @return A pointer to the last sequence number, or NULL if the channel is not known.
+ */
+unsigned long long *channel_seq(const char *channel, bool create);
+
+/**
+ * @brief Handles a numbered line of the server: "@MSG <channel> <seq> <message>" or "@SEQ <channel> <last>".
+ * 
+ * Messages already displayed (replayed twice) are dropped. "@SEQ" gives the 
+ * last number of a channel when joining it; a smaller number than the one 
+ * remembered means the channel was deleted and created again.
+ * 
+ * @param[in] line The line, without its line feed.
+ * @return The message to display, or NULL if there is nothing to display.
+ */
+const char *sequenced_text(const char *line);
+
+/**
+ * @brief Turns a line of presence events into text: "@PRESENCE <user>=<status> ..." or "@TYPING <channel> +<user> -<user> ...".
+ * 
+ * @param[in] line The line, without its line feed.
+ * @param[out] text The buffer receiving the text.
+ * @param[in] size The size of the buffer.
+ * @return text, or NULL if there is nothing to display (a user who stopped typing).
+ */
+const char *presence_text(const char *line, char *text, size_t size);
+
+/**
+ * @brief Reads the socket once and appends the data to the receive buffer.
+ * 
+ * @param[in] client_fd The file descriptor of the client socket.
+ * @return The number of bytes read, 0 if the server closed the connection, or -1 on error.
+ */
+int fill_received(int client_fd);
+
+/**
+ * @brief Extracts the next complete line from the receive buffer.
+ * 
+ * @param[out] line The buffer receiving the line, without its line feed.
+ * @param[in] size The size of the buffer.
+ * @return 1 if a line was extracted, 0 if no complete line is buffered.
+ */
+int next_line(char *line, size_t size);
+
+/**
+ * @brief Recognizes the `@BYE <reason>` line sent before the server closes the connection on purpose.
+ * 
+ * The reason is displayed and reconnect.quitting is set, so the network 
+ * thread does not reconnect when the connection closes. The caller holds 
+ * `socket_lock`.
+ * 
+ * @param[in] line The line received, without its line feed.
+ * @return true if the line was `@BYE`, false otherwise.
+ */
+bool server_closing(const char *line);
+
+/**
+ * @brief Waits for the answer of the server to a file transfer command.
+ * 
+ * The messages received in the meantime are displayed and the pings of the 
+ * server are answered.
+ * 
+ * @param[in] client_fd The file descriptor of the client socket.
+ * @param[out] line The buffer receiving the `@` line of the answer.
+ * @param[in] size The size of the buffer.
+ * @return 0 on success, -1 if the connection was lost.
+ */
+int wait_reply(int client_fd, char *line, size_t size);
+
+/**
+ * @brief Displays the complete lines of the receive buffer and answers the pings.
+ * 
+ * @param[in] client_fd The file descriptor of the client socket.
+ */
+void process_received(int client_fd);
+
+/**
+ * @brief Receives the message announced by a line "@LONG <channel> <seq> <bytes>".
+ * 
+ * The bytes already in the receive buffer are taken first; the rest is read 
+ * with a scatter read into the message and the free space of the receive 
+ * buffer, so the lines that follow the message arrive in the same read. A 
+ * message already displayed (replayed twice) is read and dropped.
+ * 
+ * @param[in] client_fd The file descriptor of the client socket.
+ * @param[in] line The `@LONG` line, without its line feed.
+ * @return The message to display (to be freed), or NULL if there is nothing to display.
+ */
+char *receive_long_message(int client_fd, const char *line);
+
+/**
+ * @brief Sends a message too long for a line, or made of several lines: "@LONG <bytes>" then the message.
+ * 
+ * The line and the message leave in a gather write (transport_sendv()), 
+ * continued until everything is sent.
+ * 
+ * @param[in] client_fd The file descriptor of the client socket.
+ * @param[in] text The message.
+ * @param[in] len The length of the message.
+ * @return 0 on success, -1 on error.
+ */
+int send_long_message(int client_fd, const char *text, size_t len);
+
+/**
+ * @brief Reads a pasted message from the standard input, until a line with a single dot.
+ * 
+ * A terminal does not accept lines longer than 4096 bytes: the `paste` 
+ * command sends several lines, or a long text, as one message.
+ * 
+ * @param[out] len The length of the message, without the last line feed.
+ * @return The message (to be freed), or NULL if it is empty or longer than LONG_MESSAGE_MAX.
+ */
+char *read_paste(size_t *len);
 
 /**
  * @brief Receives a file from the server and saves it locally.
  * 
- * This function handles the reception of a file from the server. It first 
- * receives the file size, sends a confirmation, and then writes the incoming 
- * file data to a local file.
+ * This function handles the reception of a file from the server. It waits 
+ * for the `@FILE <size>` line announcing the file, and then writes the 
+ * incoming file data to a local file. A file announced by 
+ * `@FILEZ <compressed size> <size>` is decompressed while it is received. 
+ * If the server accepted the checksums, the file is removed when its 
+ * CRC-32C differs from the `@CRC32C` trailer that follows it.
  * 
  * @param[in] client_socket The socket connected to the server.
  * @param[in] filename The name of the file to save locally.
@@ -64,33 +442,151 @@ void receive_file_from_server(int client_socket, const char *filename);
  * @brief Sends a file from the client to the server.
  * 
  * This function handles the transfer of a file from the client to the server. 
- * It first sends the file size, waits for confirmation, and then sends the 
- * file bit by bit.
+ * It sends the `send <name> <size>` command, waits for the `@OK` 
+ * confirmation, and then sends the file with sendfile. If the server accepted 
+ * compression and the file compresses well, a compressed copy is sent instead 
+ * with `sendz <name> <compressed size> <size>`. If the server accepted the 
+ * checksums, the file is followed by its `@CRC32C` trailer. Files of 
+ * PARALLEL_MIN_SIZE bytes or more are sent with send_file_parallel().
  * 
  * @param[in] client_socket The socket connected to the server.
  * @param[in] filename The name of the file to be sent to the server.
  */
 void send_file_to_server(int client_socket, const char *filename);
 
+/**
+ * @brief Opens a data connection to the server (TLS if enabled).
+ * 
+ * @return The socket, or -1 on error.
+ */
+int open_data_connection(void);
+
+/**
+ * @brief Uploads a large file split over several data connections (see parallel.h).
+ * 
+ * The client asks for a token with `psend <name> <size>`, sends one part of 
+ * the file on each data connection after `@DATA <token> <offset> <length>`, 
+ * then sends `pdone <token> <crc32c>` once every part is acknowledged. The 
+ * messages received on the main connection in the meantime are displayed 
+ * and its pings answered. If the main connection is closed during the 
+ * transfer, the upload is abandoned and the network thread reconnects once 
+ * the socket is given back.
+ * 
+ * @param[in] client_socket The socket connected to the server.
+ * @param[in] filename The name of the file to send.
+ * @param[in] file_fd The opened file.
+ * @param[in] file_size The size of the file.
+ * @return 0 if the server kept the file, -1 on error.
+ */
+int send_file_parallel(int client_socket, const char *filename, int file_fd, long file_size);
+
+/**
+ * @brief Opens a file to upload and writes the command announcing it.
+ * 
+ * The file is compressed in a temporary file if the server accepted 
+ * compression and the file compresses well.
+ * 
+ * @param[in] filename The local path of the file.
+ * @param[out] command The buffer receiving the `send` or `sendz` command, with its line feed.
+ * @param[in] size The size of the buffer.
+ * @param[out] send_size The number of bytes to send after the `@OK` of the server.
+ * @param[out] crc The CRC-32C of the file, computed only if the server accepted the checksums.
+ * @return The descriptor of the bytes to send, or -1 if the file cannot be opened.
+ */
+int open_upload(const char *filename, char *command, size_t size, long *send_size, uint32_t *crc);
+
+/**
+ * @brief Adds the last sequence number seen in a channel to a `join` command.
+ * 
+ * @param[in,out] command The command, without its line feed.
+ * @param[in] size The size of the buffer of the command.
+ */
+void append_last_seq(char *command, size_t size);
+
+/**
+ * @brief Offers the compression and the checksums of the files, and subscribes to the presence events, after the login.
+ * 
+ * This function sends `@CAPS deflate crc32c presence` and sets server_compress and 
+ * server_checksum from the answer of the server.
+ * 
+ * @param[in] client_fd The socket connected to the server.
+ * @param[in] compress false to offer only the checksums (`--no-compress`).
+ * @param[in] presence true to receive the presence events (interactive mode).
+ */
+void negotiate_capabilities(int client_fd, bool compress, bool presence);
+
 /**
  * @brief Handles the reception of data from the server.
  * 
- * This function monitors the socket for incoming messages from the server. It 
- * displays the message if it differs from the user's current input.
+ * This function reads everything available on the socket, up to 
+ * NETWORK_DRAIN_READS reads, and queues the messages for display. The pings 
+ * of the server are answered without being displayed. The caller holds 
+ * `socket_lock`.
  * 
  * @param[in] client_fd The file descriptor of the client socket.
- * @param[in] current_input The current input entered by the user.
+ * @return 0 on success, -1 if the connection is closed.
  */
-void handle_receive(int client_fd, char *current_input);
+int handle_receive(int client_fd);
 
 /**
  * @brief Handles the sending of data from the client to the server.
  * 
  * This function reads user input, sends it to the server, and processes 
  * specific commands such as sending or receiving files, or displaying help 
- * information.
+ * information. The socket (connection_fd) is used with `socket_lock` held, 
+ * so the network thread does not read the answers of the command; the 
+ * commands are refused while reconnecting.
  * 
- * @param[in] client_fd The file descriptor of the client socket.
  * @param[in] current_input The current input entered by the user.
  */
-void handle_send(int client_fd, char *current_input);
+void handle_send(char *current_input);
+
+/**
+ * @brief Reads the commands of the batch mode once.
+ * 
+ * @param[in,out] batch The batch mode.
+ * @return The number of bytes read, 0 at the end of the commands, or -1 on error.
+ */
+int batch_fill_input(batch_t *batch);
+
+/**
+ * @brief Reads the next line of the commands of the batch mode.
+ * 
+ * @param[in,out] batch The batch mode.
+ * @param[out] line The buffer receiving the line, without its line feed.
+ * @param[in] size The size of the buffer.
+ * @return 1 if a line was extracted, 0 if no complete line is buffered.
+ */
+int batch_next_line(batch_t *batch, char *line, size_t size);
+
+/**
+ * @brief Queues a command of the batch mode.
+ * 
+ * `send` opens the file and waits for the answer of the server before the 
+ * next command; `receive` is matched later with its `@FILE` answer. Empty 
+ * lines and lines starting with `#` are ignored.
+ * 
+ * @param[in,out] batch The batch mode.
+ * @param[in] command The command, without its line feed.
+ */
+void batch_command(batch_t *batch, char *command);
+
+/**
+ * @brief Processes everything received from the server: messages, answers and downloaded bytes.
+ * 
+ * @param[in,out] batch The batch mode.
+ */
+void batch_process_received(batch_t *batch);
+
+/**
+ * @brief Runs the commands of a file or of the standard input without waiting for each answer.
+ * 
+ * The socket is made non-blocking: the commands and the uploaded files are 
+ * written as the socket accepts them while the messages and downloaded files 
+ * are read, all the data available being processed at each wake-up.
+ * 
+ * @param[in] client_fd The socket connected and logged in.
+ * @param[in,out] batch The batch mode, with its input.
+ * @return EXIT_SUCCESS if every transfer succeeded, EXIT_FAILURE otherwise.
+ */
+int run_batch(int client_fd, batch_t *batch);
@@ -0,0 +1,775 @@
+#define _GNU_SOURCE
+#include "cluster.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "util.h"
+
+#define LINK_CONNECTING 1 // Connexion non bloquante en cours
+#define LINK_HELLO 2      // En attente du HELLO du pair
+#define LINK_UP 3         // Lien établi
+
+typedef struct
+{
+    char name[CLUSTER_CHANNEL_SIZE];
+    int count;
+} channel_count_t;
+
+typedef struct
+{
+    int fd;                                 // -1 si l'emplacement est libre
+    int state;
+    int broken;                             // Lien à fermer à la fin du tour
+    int peer;                               // Pair configuré qui a été appelé, -1 pour un lien accepté
+    uint64_t tag;                           // Étiquette des événements du lien
+    uint32_t node_id;                       // Connu après le HELLO
+    uint64_t since_ms;
+    char inbuf[CLUSTER_INBUF_SIZE];
+    size_t inlen;
+    char *long_body;                        // Corps d'un message long en cours de réception, ou NULL
+    size_t long_len;
+    size_t long_received;
+    char long_channel[CLUSTER_CHANNEL_SIZE];
+    outqueue_t out;
+    char (*channels)[CLUSTER_CHANNEL_SIZE]; // Salons où le pair a des membres
+    int channel_count;
+    int channel_capacity;
+} cluster_link_t;
+
+typedef struct
+{
+    char address[64];
+    struct sockaddr_in addr;
+    int link;         // Lien en cours ou établi vers ce pair, -1 sinon
+    uint32_t node_id; // Appris au premier HELLO, 0 avant
+} cluster_peer_t;
+
+static bool enabled = false;
+static uint32_t local_id = 0;
+static int listen_socket = -1;
+static uint64_t tag_base;          // Étiquette des événements de la grappe
+static uint32_t link_generation = 0;
+static cluster_deliver_fn deliver_message;
+static timer_wheel_t *timers;
+static wheel_timer_t retry_timer;
+
+static cluster_peer_t peers[CLUSTER_MAX_PEERS];
+static int peer_count = 0;
+static cluster_link_t links[CLUSTER_MAX_LINKS];
+
+// Nombre de membres locaux de chaque salon (tenu à jour même hors grappe)
+static channel_count_t *local_channels = NULL;
+static int local_channel_count = 0;
+static int local_channel_capacity = 0;
+
+static unsigned long forwarded_messages = 0;
+static unsigned long received_messages = 0;
+static unsigned long lost_links = 0;
+
+static void link_send(int i, const void *data, size_t len)
+{
+    cluster_link_t *link = &links[i];
+    if (link->broken)
+    {
+        return;
+    }
+
+    // Un pair qui ne lit plus est déconnecté plutôt que de retenir de la mémoire sans fin
+    if (link->out.buffered + len > CLUSTER_OUTQUEUE_MAX || outqueue_push(&link->out, data, len) < 0)
+    {
+        printf("Nœud %u trop lent, lien fermé.\n", link->node_id);
+        link->broken = 1;
+        return;
+    }
+
+    // Envoyer tout de suite : la latence entre nœuds s'ajoute à celle des clients
+    if (link->state != LINK_CONNECTING && outqueue_flush(&link->out, link->fd) < 0)
+    {
+        link->broken = 1;
+    }
+}
+
+static void link_printf(int i, const char *format, ...)
+{
+    char line[128];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (len > 0 && (size_t)len < sizeof(line))
+    {
+        link_send(i, line, len);
+    }
+}
+
+static int link_open(int fd, int state, int peer)
+{
+    for (int i = 0; i < CLUSTER_MAX_LINKS; i++)
+    {
+        if (links[i].fd < 0)
+        {
+            cluster_link_t *link = &links[i];
+            link->tag = tag_base | (uint64_t)++link_generation << 16 | (i + 1);
+            if (poller_add(fd, state == LINK_CONNECTING ? POLLOUT : POLLIN, link->tag) < 0)
+            {
+                return -1;
+            }
+            link->fd = fd;
+            link->state = state;
+            link->broken = 0;
+            link->peer = peer;
+            link->node_id = 0;
+            link->since_ms = monotonic_ms();
+            link->inlen = 0;
+            link->long_body = NULL;
+            outqueue_init(&link->out);
+            link->channels = NULL;
+            link->channel_count = 0;
+            link->channel_capacity = 0;
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool node_linked(uint32_t node_id);
+
+static void link_close(int i)
+{
+    cluster_link_t *link = &links[i];
+    link->broken = 1;
+
+    // Un doublon fermé pendant qu'un autre lien vers le même nœud reste établi n'est pas une perte
+    if (link->state == LINK_UP && !node_linked(link->node_id))
+    {
+        printf("Lien avec le nœud %u perdu.\n", link->node_id);
+        lost_links++;
+    }
+    if (link->peer >= 0)
+    {
+        peers[link->peer].link = -1; // Il sera rappelé au prochain essai
+    }
+    outqueue_clear(&link->out);
+    free(link->long_body);
+    link->long_body = NULL;
+    free(link->channels);
+    link->channels = NULL;
+    poller_remove(link->fd);
+    close(link->fd);
+    link->fd = -1;
+}
+
+static void reap_links(void)
+{
+    for (int i = 0; i < CLUSTER_MAX_LINKS; i++)
+    {
+        if (links[i].fd >= 0 && links[i].broken)
+        {
+            link_close(i);
+        }
+    }
+}
+
+static int find_channel(char (*channels)[CLUSTER_CHANNEL_SIZE], int count, const char *channel)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(channels[i], channel) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void link_subscribe(cluster_link_t *link, const char *channel)
+{
+    if (find_channel(link->channels, link->channel_count, channel) >= 0)
+    {
+        return;
+    }
+    if (link->channel_count == link->channel_capacity)
+    {
+        int capacity = link->channel_capacity > 0 ? link->channel_capacity * 2 : 8;
+        void *channels = realloc(link->channels, capacity * CLUSTER_CHANNEL_SIZE);
+        if (channels == NULL)
+        {
+            return;
+        }
+        link->channels = channels;
+        link->channel_capacity = capacity;
+    }
+    snprintf(link->channels[link->channel_count++], CLUSTER_CHANNEL_SIZE, "%s", channel);
+}
+
+static void link_unsubscribe(cluster_link_t *link, const char *channel)
+{
+    int index = find_channel(link->channels, link->channel_count, channel);
+    if (index >= 0)
+    {
+        // L'ordre n'a pas d'importance : le dernier prend la place libérée
+        memcpy(link->channels[index], link->channels[--link->channel_count], CLUSTER_CHANNEL_SIZE);
+    }
+}
+
+static void dial_peer(int p)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+
+    if (connect(fd, (struct sockaddr *)&peers[p].addr, sizeof(peers[p].addr)) < 0 && errno != EINPROGRESS)
+    {
+        close(fd);
+        return;
+    }
+
+    int i = link_open(fd, LINK_CONNECTING, p);
+    if (i < 0)
+    {
+        close(fd);
+        return;
+    }
+    peers[p].link = i;
+}
+
+static bool node_linked(uint32_t node_id)
+{
+    for (int i = 0; i < CLUSTER_MAX_LINKS; i++)
+    {
+        if (links[i].fd >= 0 && !links[i].broken && links[i].state == LINK_UP && links[i].node_id == node_id)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void retry_expired(wheel_timer_t *timer)
+{
+    uint64_t now = monotonic_ms();
+
+    // Abandonner les connexions qui n'aboutissent pas
+    for (int i = 0; i < CLUSTER_MAX_LINKS; i++)
+    {
+        if (links[i].fd >= 0 && links[i].state != LINK_UP && now - links[i].since_ms > CLUSTER_CONNECT_TIMEOUT_MS)
+        {
+            links[i].broken = 1;
+        }
+    }
+    reap_links();
+
+    // Rappeler les pairs injoignables, sauf ceux qui nous ont appelés eux-mêmes
+    for (int p = 0; p < peer_count; p++)
+    {
+        if (peers[p].link < 0 && (peers[p].node_id == 0 || !node_linked(peers[p].node_id)))
+        {
+            dial_peer(p);
+        }
+    }
+
+    timer_schedule(timers, timer, now + CLUSTER_RETRY_MS);
+}
+
+static void start_link(int i)
+{
+    links[i].state = LINK_HELLO;
+    links[i].since_ms = monotonic_ms();
+    link_printf(i, "HELLO %u\n", local_id);
+}
+
+static void handle_hello(int i, uint32_t node_id)
+{
+    cluster_link_t *link = &links[i];
+    if (node_id == 0 || node_id == local_id)
+    {
+        link->broken = 1; // Lien vers soi-même
+        return;
+    }
+    link->node_id = node_id;
+    if (link->peer >= 0)
+    {
+        peers[link->peer].node_id = node_id;
+    }
+
+    // Deux nœuds qui s'appellent mutuellement ont deux liens : les deux gardent celui
+    // appelé par le plus petit identifiant, et ferment donc le même
+    bool duplicate = false;
+    for (int j = 0; j < CLUSTER_MAX_LINKS; j++)
+    {
+        if (j == i || links[j].fd < 0 || links[j].broken || links[j].state != LINK_UP || links[j].node_id != node_id)
+        {
+            continue;
+        }
+        uint32_t winner = local_id < node_id ? local_id : node_id;
+        uint32_t dialer = link->peer >= 0 ? local_id : node_id;
+        uint32_t other_dialer = links[j].peer >= 0 ? local_id : node_id;
+        if (dialer == winner && other_dialer != winner)
+        {
+            links[j].broken = 1;
+            duplicate = true;
+        }
+        else
+        {
+            link->broken = 1;
+            return;
+        }
+    }
+
+    link->state = LINK_UP;
+    if (!duplicate)
+    {
+        printf("Nœud %u connecté.\n", node_id);
+    }
+
+    // Annoncer les salons qui ont des membres ici
+    for (int c = 0; c < local_channel_count; c++)
+    {
+        if (local_channels[c].count > 0)
+        {
+            link_printf(i, "SUB %s\n", local_channels[c].name);
+        }
+    }
+}
+
+// Traite une trame complète ; renvoie sa taille, 0 si elle est incomplète, -1 si elle est invalide
+static long handle_frame(int i)
+{
+    cluster_link_t *link = &links[i];
+    char *end = memchr(link->inbuf, '\n', link->inlen);
+    if (end == NULL)
+    {
+        return link->inlen == sizeof(link->inbuf) ? -1 : 0;
+    }
+    *end = '\0';
+    size_t header = end - link->inbuf + 1;
+    char channel[CLUSTER_CHANNEL_SIZE];
+    unsigned long value;
+
+    if (sscanf(link->inbuf, "HELLO %lu", &value) == 1 && link->state == LINK_HELLO)
+    {
+        handle_hello(i, (uint32_t)value);
+        return header;
+    }
+    if (link->state != LINK_UP)
+    {
+        return -1; // Rien n'est accepté avant le HELLO
+    }
+    if (sscanf(link->inbuf, "SUB %49s", channel) == 1)
+    {
+        link_subscribe(link, channel);
+        return header;
+    }
+    if (sscanf(link->inbuf, "UNSUB %49s", channel) == 1)
+    {
+        link_unsubscribe(link, channel);
+        return header;
+    }
+    if (sscanf(link->inbuf, "MSG %49s %lu", channel, &value) == 2 && value <= CLUSTER_MESSAGE_MAX)
+    {
+        if (link->inlen < header + value)
+        {
+            *end = '\n'; // Le message n'est pas encore arrivé en entier
+            return 0;
+        }
+        received_messages++;
+        deliver_message(channel, link->inbuf + header, value);
+        return header + value;
+    }
+    if (sscanf(link->inbuf, "MSG %49s %lu", channel, &value) == 2 && value <= CLUSTER_LONG_MAX)
+    {
+        // Message long : son corps est reçu dans un tampon de sa taille, pas dans inbuf
+        link->long_body = malloc(value);
+        if (link->long_body == NULL)
+        {
+            return -1;
+        }
+        link->long_len = value;
+        link->long_received = 0;
+        snprintf(link->long_channel, sizeof(link->long_channel), "%s", channel);
+        return header;
+    }
+    return -1;
+}
+
+// Complète le corps du message long en cours avec les octets de inbuf ; true s'il est complet et délivré
+static bool take_long_body(cluster_link_t *link)
+{
+    size_t taken = link->long_len - link->long_received < link->inlen ? link->long_len - link->long_received : link->inlen;
+    memcpy(link->long_body + link->long_received, link->inbuf, taken);
+    link->long_received += taken;
+    link->inlen -= taken;
+    memmove(link->inbuf, link->inbuf + taken, link->inlen);
+    if (link->long_received < link->long_len)
+    {
+        return false;
+    }
+    received_messages++;
+    deliver_message(link->long_channel, link->long_body, link->long_len);
+    free(link->long_body);
+    link->long_body = NULL;
+    return true;
+}
+
+static void link_read(int i)
+{
+    cluster_link_t *link = &links[i];
+
+    // Le corps d'un message long est lu directement dans son tampon (inbuf est alors vide)
+    char *target = link->long_body != NULL ? link->long_body + link->long_received : link->inbuf + link->inlen;
+    size_t room = link->long_body != NULL ? link->long_len - link->long_received : sizeof(link->inbuf) - link->inlen;
+    ssize_t received = recv(link->fd, target, room, 0);
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return;
+    }
+    if (received <= 0)
+    {
+        link->broken = 1;
+        return;
+    }
+    if (link->long_body != NULL)
+    {
+        link->long_received += received;
+    }
+    else
+    {
+        link->inlen += received;
+    }
+
+    long consumed = 0;
+    while (!link->broken)
+    {
+        if (link->long_body != NULL && !take_long_body(link))
+        {
+            break;
+        }
+        if ((consumed = handle_frame(i)) <= 0)
+        {
+            break;
+        }
+        link->inlen -= consumed;
+        memmove(link->inbuf, link->inbuf + consumed, link->inlen);
+    }
+    if (consumed < 0)
+    {
+        fprintf(stderr, "Trame invalide du nœud %u, lien fermé.\n", link->node_id);
+        link->broken = 1;
+    }
+}
+
+static void accept_link(int fd)
+{
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    int i = link_open(fd, LINK_HELLO, -1);
+    if (i < 0)
+    {
+        close(fd);
+        return;
+    }
+    start_link(i);
+}
+
+int cluster_init(uint32_t node_id, int port, int listen_fd, cluster_deliver_fn deliver, timer_wheel_t *wheel, uint64_t tag)
+{
+    for (int i = 0; i < CLUSTER_MAX_LINKS; i++)
+    {
+        links[i].fd = -1;
+    }
+
+    if (listen_fd < 0)
+    {
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0)
+        {
+            perror("cluster socket failed");
+            return -1;
+        }
+        int reuse = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(port);
+        if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, CLUSTER_MAX_PEERS) < 0)
+        {
+            perror("cluster bind failed");
+            close(listen_fd);
+            return -1;
+        }
+    }
+
+    // Le poller accepte les connexions des autres nœuds
+    if (poller_add(listen_fd, POLLER_ACCEPT, tag) < 0)
+    {
+        perror("cluster poller failed");
+        close(listen_fd);
+        return -1;
+    }
+
+    local_id = node_id;
+    tag_base = tag;
+    listen_socket = listen_fd;
+    deliver_message = deliver;
+    timers = wheel;
+    timer_init(&retry_timer, retry_expired, NULL);
+    timer_schedule(timers, &retry_timer, monotonic_ms() + CLUSTER_RETRY_MS);
+    enabled = true;
+    return 0;
+}
+
+int cluster_add_peer(const char *address)
+{
+    if (peer_count == CLUSTER_MAX_PEERS)
+    {
+        return -1;
+    }
+
+    // "hôte:port", résolu une seule fois au démarrage
+    cluster_peer_t *peer = &peers[peer_count];
+    snprintf(peer->address, sizeof(peer->address), "%s", address);
+    char *colon = strrchr(peer->address, ':');
+    if (colon == NULL)
+    {
+        return -1;
+    }
+    *colon = '\0';
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *result;
+    if (getaddrinfo(peer->address, colon + 1, &hints, &result) != 0)
+    {
+        return -1;
+    }
+    memcpy(&peer->addr, result->ai_addr, sizeof(peer->addr));
+    freeaddrinfo(result);
+    *colon = ':';
+
+    peer->link = -1;
+    peer->node_id = 0;
+    dial_peer(peer_count++);
+    return 0;
+}
+
+bool cluster_enabled(void)
+{
+    return enabled;
+}
+
+int cluster_listener(void)
+{
+    return listen_socket;
+}
+
+void cluster_update_events(void)
+{
+    if (!enabled)
+    {
+        return;
+    }
+    reap_links();
+
+    for (int i = 0; i < CLUSTER_MAX_LINKS; i++)
+    {
+        if (links[i].fd < 0)
+        {
+            continue;
+        }
+        uint32_t events = links[i].state == LINK_CONNECTING ? POLLOUT : POLLIN;
+        if (!outqueue_empty(&links[i].out))
+        {
+            events |= POLLOUT;
+        }
+        poller_modify(links[i].fd, events);
+    }
+}
+
+void cluster_handle_event(const poller_event_t *event)
+{
+    if (event->revents & POLLER_ACCEPT)
+    {
+        accept_link(event->fd);
+        return;
+    }
+
+    // Le lien a pu être fermé, et son emplacement réutilisé, plus tôt dans ce tour
+    int i = (int)(event->tag & 0xffff) - 1;
+    if (i < 0 || i >= CLUSTER_MAX_LINKS || links[i].fd < 0 || links[i].tag != event->tag || links[i].broken)
+    {
+        return;
+    }
+
+    if (links[i].state == LINK_CONNECTING)
+    {
+        // La connexion a abouti ou échoué
+        int error = 0;
+        socklen_t len = sizeof(error);
+        getsockopt(links[i].fd, SOL_SOCKET, SO_ERROR, &error, &len);
+        if (error != 0)
+        {
+            links[i].broken = 1;
+            return;
+        }
+        start_link(i);
+        if (!outqueue_empty(&links[i].out) && outqueue_flush(&links[i].out, links[i].fd) < 0)
+        {
+            links[i].broken = 1;
+        }
+        return;
+    }
+
+    if (event->revents & (POLLIN | POLLHUP | POLLERR))
+    {
+        link_read(i);
+    }
+    if (!links[i].broken && event->revents & POLLOUT && outqueue_flush(&links[i].out, links[i].fd) < 0)
+    {
+        links[i].broken = 1;
+    }
+}
+void cluster_join(const char *channel)
+{
+    int index = -1;
+    for (int c = 0; c < local_channel_count; c++)
+    {
+        if (strcmp(local_channels[c].name, channel) == 0)
+        {
+            index = c;
+            break;
+        }
+    }
+    if (index < 0)
+    {
+        if (local_channel_count == local_channel_capacity)
+        {
+            int capacity = local_channel_capacity > 0 ? local_channel_capacity * 2 : 16;
+            channel_count_t *channels = realloc(local_channels, capacity * sizeof(channel_count_t));
+            if (channels == NULL)
+            {
+                return;
+            }
+            local_channels = channels;
+            local_channel_capacity = capacity;
+        }
+        index = local_channel_count++;
+        snprintf(local_channels[index].name, CLUSTER_CHANNEL_SIZE, "%s", channel);
+        local_channels[index].count = 0;
+    }
+
+    // Premier membre local : les autres nœuds doivent maintenant nous transmettre ce salon
+    if (local_channels[index].count++ == 0 && enabled)
+    {
+        for (int i = 0; i < CLUSTER_MAX_LINKS; i++)
+        {
+            if (links[i].fd >= 0 && links[i].state == LINK_UP)
+            {
+                link_printf(i, "SUB %s\n", channel);
+            }
+        }
+    }
+}
+
+void cluster_leave(const char *channel)
+{
+    for (int c = 0; c < local_channel_count; c++)
+    {
+        if (strcmp(local_channels[c].name, channel) != 0 || local_channels[c].count == 0)
+        {
+            continue;
+        }
+
+        // Dernier membre local parti : plus besoin de recevoir ce salon
+        if (--local_channels[c].count == 0 && enabled)
+        {
+            for (int i = 0; i < CLUSTER_MAX_LINKS; i++)
+            {
+                if (links[i].fd >= 0 && links[i].state == LINK_UP)
+                {
+                    link_printf(i, "UNSUB %s\n", channel);
+                }
+            }
+        }
+        return;
+    }
+}
+
+void cluster_publish(const char *channel, const char *message, size_t len)
+{
+    if (!enabled || len > CLUSTER_LONG_MAX)
+    {
+        return;
+    }
+
+    // L'en-tête et un message court partent ensemble, dans un seul segment ; un message long le suit
+    char frame[CLUSTER_CHANNEL_SIZE + 32 + CLUSTER_MESSAGE_MAX];
+    int header_len = snprintf(frame, CLUSTER_CHANNEL_SIZE + 32, "MSG %s %zu\n", channel, len);
+    bool inline_body = len <= CLUSTER_MESSAGE_MAX;
+    if (inline_body)
+    {
+        memcpy(frame + header_len, message, len);
+    }
+    for (int i = 0; i < CLUSTER_MAX_LINKS; i++)
+    {
+        cluster_link_t *link = &links[i];
+        if (link->fd < 0 || link->state != LINK_UP || find_channel(link->channels, link->channel_count, channel) < 0)
+        {
+            continue; // Aucun membre de ce salon sur ce nœud
+        }
+        link_send(i, frame, header_len + (inline_body ? len : 0));
+        if (!inline_body)
+        {
+            link_send(i, message, len);
+        }
+        forwarded_messages++;
+    }
+}
+
+bool cluster_has_subscriber(const char *channel)
+{
+    for (int i = 0; enabled && i < CLUSTER_MAX_LINKS; i++)
+    {
+        cluster_link_t *link = &links[i];
+        if (link->fd >= 0 && link->state == LINK_UP && find_channel(link->channels, link->channel_count, channel) >= 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void cluster_format_stats(char *buffer, size_t size)
+{
+    if (!enabled)
+    {
+        snprintf(buffer, size, "Grappe : désactivée\n");
+        return;
+    }
+    int up = 0;
+    for (int i = 0; i < CLUSTER_MAX_LINKS; i++)
+    {
+        if (links[i].fd >= 0 && links[i].state == LINK_UP)
+        {
+            up++;
+        }
+    }
+    snprintf(buffer, size, "Grappe : nœud %u, %d nœud(s) connecté(s), messages transmis %lu, reçus %lu, liens perdus %lu\n",
+             local_id, up, forwarded_messages, received_messages, lost_links);
+}
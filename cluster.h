@@ -0,0 +1,140 @@
+/**
+ * @file cluster.h
+ * @brief Links several server nodes so that a channel spans all of them.
+ *
+ * Each node listens for the other nodes on a cluster port and dials the
+ * peers given on its command line. Nodes exchange line-based frames over
+ * plain TCP (the cluster network is trusted):
+ *
+ * - `HELLO <node_id>`: first frame on a link, used to drop duplicate links;
+ * - `SUB <channel>` / `UNSUB <channel>`: the node has its first local member
+ *   in a channel, or no longer has any;
+ * - `MSG <channel> <length>` followed by the message: a broadcast. A message
+ *   longer than CLUSTER_MESSAGE_MAX (a long message, see longmsg.h) is
+ *   received into a buffer of its own size instead of the input buffer of
+ *   the link, up to CLUSTER_LONG_MAX bytes.
+ *
+ * Membership is announced to every peer when it changes and again when a link
+ * comes up, so each node knows which peers have subscribers in each channel
+ * and forwards a broadcast only to them. A forwarded message is delivered to
+ * the local members only, it is never forwarded again (full mesh).
+ */
+
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "outqueue.h"
+#include "poller.h"
+#include "timer_wheel.h"
+
+#define CLUSTER_MAX_PEERS 16                   /**< Maximum number of nodes linked to this one */
+#define CLUSTER_MAX_LINKS (2 * CLUSTER_MAX_PEERS) /**< Links, including the duplicates not dropped yet */
+#define CLUSTER_CHANNEL_SIZE 50                /**< Size of a channel name, as in client_t */
+#define CLUSTER_INBUF_SIZE 8192                /**< Bytes of incomplete frames kept per link */
+#define CLUSTER_MESSAGE_MAX 4096               /**< Largest message received in the input buffer of a link */
+#define CLUSTER_LONG_MAX (2 * 1024 * 1024)     /**< Largest message forwarded between nodes (upper bound of `max-message-bytes`) */
+#define CLUSTER_OUTQUEUE_MAX (4 * 1024 * 1024) /**< Bytes waiting for a slow peer before the link is dropped */
+#define CLUSTER_RETRY_MS 1000                  /**< Delay before dialing a peer again */
+#define CLUSTER_CONNECT_TIMEOUT_MS 3000        /**< Delay to connect to a peer and receive its HELLO */
+
+/**
+ * @brief Function delivering a message received from another node to the local members of a channel.
+ */
+typedef void (*cluster_deliver_fn)(const char *channel, const char *message, size_t len);
+
+/**
+ * @brief Starts the cluster mode.
+ *
+ * @param[in] node_id The identifier of this node, unique in the cluster (not 0).
+ * @param[in] port The port on which the other nodes connect.
+ * @param[in] listen_fd A listening socket inherited from a previous process, or -1 to create it.
+ * @param[in] deliver The function delivering forwarded messages.
+ * @param[in] wheel The timing wheel of the event loop (used to dial the peers again).
+ * @param[in] tag The tag of the cluster events in the poller; its 48 low bits must be 0.
+ * @return 0 on success, -1 on error.
+ */
+int cluster_init(uint32_t node_id, int port, int listen_fd, cluster_deliver_fn deliver, timer_wheel_t *wheel, uint64_t tag);
+
+/**
+ * @brief Adds a peer to dial, and dials it.
+ *
+ * @param[in] address The address of the peer, "host:port".
+ * @return 0 on success, -1 if the address is invalid or there are too many peers.
+ */
+int cluster_add_peer(const char *address);
+
+/**
+ * @brief Checks if the cluster mode is active.
+ *
+ * @return true if cluster_init() succeeded.
+ */
+bool cluster_enabled(void);
+
+/**
+ * @brief Returns the listening socket of the cluster, for a hot restart.
+ *
+ * @return The listening socket, or -1 if the cluster mode is not active.
+ */
+int cluster_listener(void);
+
+/**
+ * @brief Closes the broken links and updates the events the links wait for.
+ *
+ * Called by the event loop before waiting.
+ */
+void cluster_update_events(void);
+
+/**
+ * @brief Handles an event of the poller whose tag belongs to the cluster.
+ *
+ * @param[in] event The event.
+ */
+void cluster_handle_event(const poller_event_t *event);
+
+/**
+ * @brief Records that a local client joined a channel.
+ *
+ * The peers are told when the channel gets its first local member.
+ *
+ * @param[in] channel The channel.
+ */
+void cluster_join(const char *channel);
+
+/**
+ * @brief Records that a local client left a channel.
+ *
+ * The peers are told when the channel has no local member any more.
+ *
+ * @param[in] channel The channel.
+ */
+void cluster_leave(const char *channel);
+
+/**
+ * @brief Forwards a broadcast to the peers that have members in the channel.
+ *
+ * @param[in] channel The channel.
+ * @param[in] message The message.
+ * @param[in] len The length of the message.
+ */
+void cluster_publish(const char *channel, const char *message, size_t len);
+
+/**
+ * @brief Checks if another node has members in a channel.
+ *
+ * @param[in] channel The channel, or "@user" for the connections of a user.
+ * @return true if at least one linked node subscribed to the channel.
+ */
+bool cluster_has_subscriber(const char *channel);
+
+/**
+ * @brief Writes the cluster statistics.
+ *
+ * @param[out] buffer The buffer receiving the text (one line).
+ * @param[in] size The size of the buffer.
+ */
+void cluster_format_stats(char *buffer, size_t size);
+
+#endif
@@ -0,0 +1,262 @@
+/*
+ * Mesure la latence de diffusion d'un message entre deux nœuds d'une grappe.
+ *
+ * user1 envoie des messages horodatés sur le nœud A ; user3 les reçoit sur le
+ * même nœud (diffusion locale) et user2 sur le nœud B (diffusion transmise par
+ * le lien de la grappe). Les trois utilisateurs rejoignent le même salon.
+ *
+ * Usage : cluster_bench.exe [--count n] [--interval ms] [--channel salon] port_A port_B
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define LINE_SIZE 4096
+
+typedef struct
+{
+    const char *name;
+    int fd;
+    char buffer[LINE_SIZE];
+    size_t len;
+    uint64_t *latencies; // Latence de chaque message reçu, en nanosecondes
+    int received;
+    int capacity;
+} bench_client_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void send_line(bench_client_t *client, const char *line)
+{
+    if (send(client->fd, line, strlen(line), MSG_NOSIGNAL) < 0)
+    {
+        perror("send");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Lit une ligne ; renvoie 1 si une ligne est disponible, 0 si le délai est écoulé
+static int read_line(bench_client_t *client, char *line, int timeout_ms)
+{
+    while (1)
+    {
+        char *end = memchr(client->buffer, '\n', client->len);
+        if (end != NULL)
+        {
+            size_t len = end - client->buffer;
+            memcpy(line, client->buffer, len);
+            line[len] = '\0';
+            client->len -= len + 1;
+            memmove(client->buffer, end + 1, client->len);
+
+            // Le client de test répond aux pings comme le vrai client
+            if (strcmp(line, "@PING") == 0)
+            {
+                send_line(client, "@PONG\n");
+                continue;
+            }
+            return 1;
+        }
+
+        struct pollfd pfd = {.fd = client->fd, .events = POLLIN};
+        if (poll(&pfd, 1, timeout_ms) <= 0)
+        {
+            return 0;
+        }
+        ssize_t received = recv(client->fd, client->buffer + client->len, sizeof(client->buffer) - client->len, 0);
+        if (received <= 0)
+        {
+            fprintf(stderr, "%s : connexion fermée par le serveur.\n", client->name);
+            exit(EXIT_FAILURE);
+        }
+        client->len += received;
+    }
+}
+
+// Attend une ligne qui contient le texte attendu
+static void expect(bench_client_t *client, const char *text)
+{
+    char line[LINE_SIZE];
+    while (read_line(client, line, 5000))
+    {
+        if (strstr(line, text) != NULL)
+        {
+            return;
+        }
+    }
+    fprintf(stderr, "%s : \"%s\" non reçu.\n", client->name, text);
+    exit(EXIT_FAILURE);
+}
+
+static void connect_client(bench_client_t *client, const char *name, const char *password, int port, const char *channel)
+{
+    client->name = name;
+    client->len = 0;
+    client->received = 0;
+    client->capacity = 0;
+    client->fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(client->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        perror("connect");
+        exit(EXIT_FAILURE);
+    }
+
+    char line[LINE_SIZE];
+    snprintf(line, sizeof(line), "%s %s\n", name, password);
+    send_line(client, line);
+    expect(client, "Authentification réussie");
+    snprintf(line, sizeof(line), "join %s\n", channel);
+    send_line(client, line);
+    expect(client, "Vous avez rejoint");
+}
+
+// Lit les messages de test arrivés sur un client
+static void collect(bench_client_t *client, int timeout_ms)
+{
+    char line[LINE_SIZE];
+    while (read_line(client, line, timeout_ms))
+    {
+        int index;
+        unsigned long long sent;
+        int offset = 0;
+        sscanf(line, "@MSG %*s %*u %n", &offset); // Les diffusions sont numérotées : "@MSG <salon> <numéro> <message>"
+        if (sscanf(line + offset, "user1: bench %d %llu", &index, &sent) == 2 && client->received < client->capacity)
+        {
+            client->latencies[client->received++] = now_ns() - sent;
+        }
+        timeout_ms = 0;
+    }
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char *label, bench_client_t *client, int count)
+{
+    if (client->received == 0)
+    {
+        printf("%-22s aucun message reçu sur %d\n", label, count);
+        return;
+    }
+    qsort(client->latencies, client->received, sizeof(uint64_t), compare_u64);
+    int n = client->received;
+    printf("%-22s %d/%d reçus  min %7.1f us  p50 %7.1f us  p99 %7.1f us  max %7.1f us\n", label, n, count,
+           client->latencies[0] / 1e3, client->latencies[n / 2] / 1e3,
+           client->latencies[(n * 99) / 100 < n ? (n * 99) / 100 : n - 1] / 1e3, client->latencies[n - 1] / 1e3);
+}
+
+int main(int argc, char *argv[])
+{
+    int count = 50;
+    int interval_ms = 200; // Sous la limite de débit par connexion (5 messages par seconde)
+    const char *channel = "test";
+
+    static struct option long_options[] = {
+        {"count", required_argument, 0, 'n'},
+        {"interval", required_argument, 0, 'i'},
+        {"channel", required_argument, 0, 'c'},
+        {0, 0, 0, 0}};
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:i:c:", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'i':
+            interval_ms = atoi(optarg);
+            break;
+        case 'c':
+            channel = optarg;
+            break;
+        default:
+            optind = argc + 1;
+        }
+    }
+    if (argc - optind != 2 || count <= 0)
+    {
+        fprintf(stderr, "Usage : %s [--count n] [--interval ms] [--channel salon] port_A port_B\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int port_a = atoi(argv[optind]);
+    int port_b = atoi(argv[optind + 1]);
+
+    bench_client_t sender, local, remote;
+    connect_client(&sender, "user1", "pass1", port_a, channel);
+    connect_client(&local, "user3", "pass3", port_a, channel);
+    connect_client(&remote, "user2", "pass2", port_b, channel);
+    local.latencies = calloc(count, sizeof(uint64_t));
+    remote.latencies = calloc(count, sizeof(uint64_t));
+    local.capacity = remote.capacity = count;
+
+    // Laisser le temps à l'abonnement de B d'arriver sur A
+    usleep(300000);
+    collect(&local, 0);
+    collect(&remote, 0);
+
+    for (int i = 0; i < count; i++)
+    {
+        char line[128];
+        snprintf(line, sizeof(line), "bench %d %llu\n", i, (unsigned long long)now_ns());
+        send_line(&sender, line);
+
+        // Lire les deux destinataires dès qu'un message arrive, jusqu'au prochain envoi
+        uint64_t next = now_ns() + (uint64_t)interval_ms * 1000000;
+        uint64_t now;
+        while ((now = now_ns()) < next)
+        {
+            struct pollfd pfds[2] = {{.fd = local.fd, .events = POLLIN}, {.fd = remote.fd, .events = POLLIN}};
+            poll(pfds, 2, (next - now) / 1000000 + 1);
+            if (pfds[0].revents)
+            {
+                collect(&local, 0);
+            }
+            if (pfds[1].revents)
+            {
+                collect(&remote, 0);
+            }
+        }
+    }
+    collect(&local, 1000);
+    collect(&remote, 1000);
+
+    printf("Diffusion de %d messages dans le salon %s :\n", count, channel);
+    report("même nœud (A -> A)", &local, count);
+    report("autre nœud (A -> B)", &remote, count);
+
+    send_line(&sender, "disconnect\n");
+    send_line(&local, "disconnect\n");
+    send_line(&remote, "disconnect\n");
+    free(local.latencies);
+    free(remote.latencies);
+    return 0;
+}
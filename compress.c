@@ -0,0 +1,190 @@
+#include "compress.h"
+#include "checksum.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define COMPRESS_CHUNK 65536
+
+struct inflater
+{
+    z_stream stream;
+    int out_fd;
+    long max_size;
+    long produced;
+    uint32_t crc;
+    int finished;
+};
+
+// Écrit tout le bloc, même si write s'arrête en chemin
+static int write_all(int fd, const unsigned char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int compress_file(int in_fd, int out_fd, long *compressed_size, uint32_t *crc)
+{
+    z_stream stream = {0};
+    if (deflateInit(&stream, COMPRESS_LEVEL) != Z_OK)
+    {
+        return -1;
+    }
+
+    unsigned char *in = malloc(COMPRESS_CHUNK);
+    unsigned char *out = malloc(COMPRESS_CHUNK);
+    int result = in != NULL && out != NULL ? 0 : -1;
+    long total = 0;
+    off_t offset = 0;
+    int flush = Z_NO_FLUSH;
+    uint32_t checksum = 0;
+
+    // pread : la position du fichier reste au début, pour un éventuel envoi du fichier original
+    while (result == 0 && flush != Z_FINISH)
+    {
+        ssize_t n = pread(in_fd, in, COMPRESS_CHUNK, offset);
+        if (n < 0)
+        {
+            result = -1;
+            break;
+        }
+        offset += n;
+        checksum = crc != NULL ? crc32c(checksum, in, n) : 0; // Pendant que le bloc est en cache
+        flush = n == 0 ? Z_FINISH : Z_NO_FLUSH;
+        stream.next_in = in;
+        stream.avail_in = n;
+
+        // Vider la sortie jusqu'à ce que tout le bloc lu soit consommé
+        do
+        {
+            stream.next_out = out;
+            stream.avail_out = COMPRESS_CHUNK;
+            if (deflate(&stream, flush) == Z_STREAM_ERROR)
+            {
+                result = -1;
+                break;
+            }
+            size_t produced = COMPRESS_CHUNK - stream.avail_out;
+            if (write_all(out_fd, out, produced) < 0)
+            {
+                result = -1;
+                break;
+            }
+            total += produced;
+        } while (stream.avail_out == 0);
+    }
+
+    deflateEnd(&stream);
+    free(in);
+    free(out);
+    *compressed_size = total;
+    if (crc != NULL)
+    {
+        *crc = checksum;
+    }
+    return result;
+}
+
+bool compress_worthwhile(long size, long compressed_size)
+{
+    return size >= COMPRESS_MIN_SIZE && compressed_size * 100 < size * COMPRESS_MAX_RATIO;
+}
+
+inflater_t *inflater_new(int out_fd, long max_size)
+{
+    inflater_t *inflater = calloc(1, sizeof(inflater_t));
+    if (inflater == NULL)
+    {
+        return NULL;
+    }
+    if (inflateInit(&inflater->stream) != Z_OK)
+    {
+        free(inflater);
+        return NULL;
+    }
+    inflater->out_fd = out_fd;
+    inflater->max_size = max_size;
+    return inflater;
+}
+
+int inflater_write(inflater_t *inflater, const void *data, size_t len)
+{
+    if (inflater->finished)
+    {
+        return len > 0 ? -1 : 1; // Des octets après la fin du flux compressé
+    }
+
+    unsigned char out[COMPRESS_CHUNK];
+    inflater->stream.next_in = (unsigned char *)data;
+    inflater->stream.avail_in = len;
+    // Continuer tant qu'il reste des octets à lire ou que la sortie a rempli le tampon
+    do
+    {
+        inflater->stream.next_out = out;
+        inflater->stream.avail_out = sizeof(out);
+        int status = inflate(&inflater->stream, Z_NO_FLUSH);
+        if (status == Z_BUF_ERROR)
+        {
+            break; // Plus rien à produire sans nouveaux octets
+        }
+        if (status != Z_OK && status != Z_STREAM_END)
+        {
+            return -1;
+        }
+        inflater->finished = status == Z_STREAM_END;
+
+        // Ne jamais écrire plus que la taille annoncée (flux forgé pour remplir le disque)
+        size_t produced = sizeof(out) - inflater->stream.avail_out;
+        inflater->produced += produced;
+        if (inflater->produced > inflater->max_size)
+        {
+            return -1;
+        }
+        if (inflater->out_fd >= 0 && write_all(inflater->out_fd, out, produced) < 0)
+        {
+            return -1;
+        }
+        inflater->crc = crc32c(inflater->crc, out, produced);
+    } while ((inflater->stream.avail_in > 0 || inflater->stream.avail_out == 0) && !inflater->finished);
+
+    if (inflater->finished)
+    {
+        return inflater->stream.avail_in > 0 ? -1 : 1;
+    }
+    return 0;
+}
+
+bool inflater_complete(const inflater_t *inflater, long size)
+{
+    return inflater->finished && inflater->produced == size;
+}
+
+uint32_t inflater_checksum(const inflater_t *inflater)
+{
+    return inflater->crc;
+}
+
+void inflater_free(inflater_t *inflater)
+{
+    if (inflater == NULL)
+    {
+        return;
+    }
+    inflateEnd(&inflater->stream);
+    free(inflater);
+}
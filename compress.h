@@ -0,0 +1,100 @@
+/**
+ * @file compress.h
+ * @brief Deflate compression of the transferred files, shared by the client and the server.
+ *
+ * Compression is negotiated after the login: the client sends
+ * `@CAPS deflate` and the server answers with the capabilities it accepts.
+ * Once deflate is accepted, both sides may send a file compressed with zlib
+ * (RFC 1950) instead of raw bytes:
+ *
+ * - download: `@FILEZ <compressed size> <size>` replaces `@FILE <size>`;
+ * - upload: `sendz <name> <compressed size> <size>` replaces `send <name> <size>`.
+ *
+ * The receiver inflates the bytes while they arrive and checks the size of
+ * the result. Small files, and files that do not shrink by at least
+ * (100 - COMPRESS_MAX_RATIO) %, are sent raw. Chat lines are never
+ * compressed: they are short and the protocol is framed by lines.
+ */
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define COMPRESS_CAPS "deflate"    /**< Capabilities announced by the client and accepted by the server */
+#define COMPRESS_LEVEL 6           /**< zlib compression level */
+#define COMPRESS_MIN_SIZE 4096     /**< Files smaller than this are always sent raw */
+#define COMPRESS_MAX_RATIO 90      /**< Compressed size (% of the original) above which a file is sent raw */
+
+/**
+ * @brief Streaming decompression of a file being received.
+ */
+typedef struct inflater inflater_t;
+
+/**
+ * @brief Compresses a whole file into another one.
+ *
+ * @param[in] in_fd The file to compress, read from its beginning.
+ * @param[in] out_fd The file receiving the compressed bytes, written at its current position.
+ * @param[out] compressed_size The number of compressed bytes written.
+ * @param[out] crc The CRC-32C of the original file, computed while it is read (see checksum.h), or NULL.
+ * @return 0 on success, -1 on error.
+ */
+int compress_file(int in_fd, int out_fd, long *compressed_size, uint32_t *crc);
+
+/**
+ * @brief Checks if a compressed file is worth sending instead of the original.
+ *
+ * @param[in] size The size of the original file.
+ * @param[in] compressed_size The size of the compressed file.
+ * @return true if the compressed file should be sent.
+ */
+bool compress_worthwhile(long size, long compressed_size);
+
+/**
+ * @brief Starts the decompression of a file.
+ *
+ * @param[in] out_fd The file receiving the decompressed bytes, or -1 to discard them.
+ * @param[in] max_size The announced size of the file: producing more is an error.
+ * @return The inflater, or NULL if memory is exhausted.
+ */
+inflater_t *inflater_new(int out_fd, long max_size);
+
+/**
+ * @brief Decompresses received bytes and writes the result.
+ *
+ * @param[in] inflater The inflater.
+ * @param[in] data The compressed bytes.
+ * @param[in] len The number of compressed bytes.
+ * @return 0 if more bytes are expected, 1 at the end of the compressed stream, -1 on error
+ * (corrupted stream, output larger than announced, write error, bytes after the end).
+ */
+int inflater_write(inflater_t *inflater, const void *data, size_t len);
+
+/**
+ * @brief Checks that the whole file was decompressed.
+ *
+ * @param[in] inflater The inflater.
+ * @param[in] size The announced size of the file.
+ * @return true if the compressed stream is complete and produced exactly size bytes.
+ */
+bool inflater_complete(const inflater_t *inflater, long size);
+
+/**
+ * @brief Returns the CRC-32C of the bytes decompressed so far (see checksum.h).
+ *
+ * @param[in] inflater The inflater.
+ * @return The checksum of the decompressed bytes.
+ */
+uint32_t inflater_checksum(const inflater_t *inflater);
+
+/**
+ * @brief Releases an inflater.
+ *
+ * @param[in] inflater The inflater, or NULL.
+ */
+void inflater_free(inflater_t *inflater);
+
+#endif
@@ -0,0 +1,278 @@
+#include "config.h"
+#include "longmsg.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CONFIG_INT 0    // Entier entre min et max
+#define CONFIG_LONG 1   // Taille en octets, avec un suffixe k, m ou g possible
+#define CONFIG_PATH 2   // Chemin de fichier
+#define CONFIG_CHOICE 3 // Un des mots de choices, dont l'indice est la valeur
+
+typedef struct
+{
+    const char *name;
+    int type;
+    size_t offset;
+    long min, max;
+    const char *choices; // Mots séparés par '|' (CONFIG_CHOICE)
+    const char *help;
+} config_entry_t;
+
+#define FIELD(field) offsetof(server_config_t, field)
+
+static const config_entry_t entries[] = {
+    {"port", CONFIG_INT, FIELD(port), 1, 65535, NULL, "port d'écoute des clients"},
+    {"backlog", CONFIG_INT, FIELD(backlog), 1, 65535, NULL, "connexions en attente d'acceptation"},
+    {"max-clients", CONFIG_INT, FIELD(max_clients), 1, 65535, NULL, "clients connectés en même temps"},
+    {"socket-buffer", CONFIG_LONG, FIELD(socket_buffer), 0, 64L * 1024 * 1024, NULL, "tampons d'envoi et de réception d'un client, 0 pour ceux du système"},
+    {"data-dir", CONFIG_PATH, FIELD(data_dir), 0, 0, NULL, "dossier de database.db, des fichiers des salons et des journaux"},
+    {"tls-cert", CONFIG_PATH, FIELD(tls_cert), 0, 0, NULL, "certificat TLS"},
+    {"tls-key", CONFIG_PATH, FIELD(tls_key), 0, 0, NULL, "clé privée TLS"},
+    {"io", CONFIG_CHOICE, FIELD(io), 0, 0, "auto|epoll|io_uring", "boucle d'événements"},
+    {"storage", CONFIG_CHOICE, FIELD(storage), 0, 0, "sqlite|log", "moteur de stockage des messages"},
+    {"retention-days", CONFIG_INT, FIELD(retention_days), 0, 100000, NULL, "âge des messages supprimés, 0 pour tout garder"},
+    {"auth-workers", CONFIG_INT, FIELD(auth_workers), 1, 64, NULL, "threads de vérification des mots de passe"},
+    {"auth-queue", CONFIG_INT, FIELD(auth_queue), 1, 65536, NULL, "vérifications en attente au plus"},
+    {"batch-size", CONFIG_INT, FIELD(batch_size), 1, 65536, NULL, "messages écrits par transaction"},
+    {"batch-delay-ms", CONFIG_INT, FIELD(batch_delay_ms), 1, 60000, NULL, "délai maximal avant l'écriture d'un message"},
+    {"replay-max", CONFIG_INT, FIELD(replay_max), 0, 1000000, NULL, "messages manqués renvoyés au plus"},
+    {"outqueue-max-bytes", CONFIG_LONG, FIELD(outqueue_max_bytes), 64 * 1024, 1L << 30, NULL, "octets en attente pour un client lent"},
+    {"file-cache-files", CONFIG_INT, FIELD(file_cache_files), 0, 65536, NULL, "fichiers téléchargés gardés ouverts"},
+    {"file-cache-bytes", CONFIG_LONG, FIELD(file_cache_bytes), 0, 1L << 40, NULL, "octets de fichiers projetés en mémoire"},
+    {"compress-jobs", CONFIG_INT, FIELD(compress_jobs), 1, 64, NULL, "fichiers compressés en même temps en arrière-plan"},
+    {"read-workers", CONFIG_INT, FIELD(read_workers), 1, 64, NULL, "threads de lecture de l'historique"},
+    {"read-queue", CONFIG_INT, FIELD(read_queue), 1, 65536, NULL, "lectures de l'historique en attente au plus"},
+    {"max-message-bytes", CONFIG_LONG, FIELD(max_message_bytes), 1024, 2L * 1024 * 1024, NULL, "octets d'un message long (@LONG) au plus"},
+};
+
+#define ENTRY_COUNT ((int)(sizeof(entries) / sizeof(entries[0])))
+
+static const config_entry_t *find(const char *key)
+{
+    for (int i = 0; i < ENTRY_COUNT; i++)
+    {
+        if (strcmp(entries[i].name, key) == 0)
+        {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Indice du mot dans "a|b|c", -1 s'il n'y est pas
+static int find_choice(const char *choices, const char *value)
+{
+    size_t len = strlen(value);
+    int index = 0;
+    for (const char *p = choices; p != NULL; index++)
+    {
+        const char *end = strchr(p, '|');
+        size_t word = end != NULL ? (size_t)(end - p) : strlen(p);
+        if (word == len && strncmp(p, value, len) == 0)
+        {
+            return index;
+        }
+        p = end != NULL ? end + 1 : NULL;
+    }
+    return -1;
+}
+
+static const char *choice_name(const char *choices, int index, size_t *len)
+{
+    const char *p = choices;
+    while (index-- > 0 && p != NULL)
+    {
+        p = strchr(p, '|');
+        p = p != NULL ? p + 1 : NULL;
+    }
+    if (p == NULL)
+    {
+        *len = 1;
+        return "?";
+    }
+    const char *end = strchr(p, '|');
+    *len = end != NULL ? (size_t)(end - p) : strlen(p);
+    return p;
+}
+
+const char *config_key(int index)
+{
+    return index >= 0 && index < ENTRY_COUNT ? entries[index].name : NULL;
+}
+
+int config_set(server_config_t *config, const char *key, const char *value)
+{
+    const config_entry_t *entry = find(key);
+    if (entry == NULL)
+    {
+        fprintf(stderr, "Paramètre inconnu : %s\n", key);
+        return -1;
+    }
+    char *field = (char *)config + entry->offset;
+
+    if (entry->type == CONFIG_PATH)
+    {
+        if (strlen(value) >= CONFIG_PATH_SIZE)
+        {
+            fprintf(stderr, "%s : chemin trop long (%d caractères au plus).\n", key, CONFIG_PATH_SIZE - 1);
+            return -1;
+        }
+        snprintf(field, CONFIG_PATH_SIZE, "%s", value);
+        return 0;
+    }
+    if (entry->type == CONFIG_CHOICE)
+    {
+        int index = find_choice(entry->choices, value);
+        if (index < 0)
+        {
+            fprintf(stderr, "%s : %s attendu.\n", key, entry->choices);
+            return -1;
+        }
+        *(int *)field = index;
+        return 0;
+    }
+
+    // Nombre, avec un multiple pour les tailles (64k, 256m, 1g)
+    char *end;
+    errno = 0;
+    long number = strtol(value, &end, 10);
+    if (entry->type == CONFIG_LONG && end != value)
+    {
+        int shift = tolower((unsigned char)*end) == 'k' ? 10 : tolower((unsigned char)*end) == 'm' ? 20 : tolower((unsigned char)*end) == 'g' ? 30 : 0;
+        if (shift > 0 && number <= (entry->max >> shift))
+        {
+            number <<= shift;
+            end++;
+        }
+    }
+    if (errno != 0 || end == value || *end != '\0' || number < entry->min || number > entry->max)
+    {
+        fprintf(stderr, "%s : nombre entre %ld et %ld attendu.\n", key, entry->min, entry->max);
+        return -1;
+    }
+    if (entry->type == CONFIG_LONG)
+    {
+        *(long *)field = number;
+    }
+    else
+    {
+        *(int *)field = (int)number;
+    }
+    return 0;
+}
+
+// Retire les espaces au début et à la fin
+static char *trim(char *text)
+{
+    while (isspace((unsigned char)*text))
+    {
+        text++;
+    }
+    size_t len = strlen(text);
+    while (len > 0 && isspace((unsigned char)text[len - 1]))
+    {
+        text[--len] = '\0';
+    }
+    return text;
+}
+
+int config_load(server_config_t *config, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Impossible d'ouvrir le fichier de configuration %s : %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char line[CONFIG_LINE_SIZE];
+    int number = 0;
+    int status = 0;
+    while (status == 0 && fgets(line, sizeof(line), file) != NULL)
+    {
+        number++;
+        char *text = trim(line);
+        if (*text == '\0' || *text == '#')
+        {
+            continue;
+        }
+        char *equal = strchr(text, '=');
+        if (equal == NULL)
+        {
+            fprintf(stderr, "%s:%d : « nom = valeur » attendu.\n", path, number);
+            status = -1;
+            continue;
+        }
+        *equal = '\0';
+        if (config_set(config, trim(text), trim(equal + 1)) < 0)
+        {
+            fprintf(stderr, "%s:%d : paramètre refusé.\n", path, number);
+            status = -1;
+        }
+    }
+    fclose(file);
+    return status;
+}
+
+void config_format(const server_config_t *config, char *buffer, size_t size)
+{
+    size_t used = 0;
+    buffer[0] = '\0';
+    for (int i = 0; i < ENTRY_COUNT && used < size; i++)
+    {
+        const config_entry_t *entry = &entries[i];
+        const char *field = (const char *)config + entry->offset;
+        int written;
+        if (entry->type == CONFIG_PATH)
+        {
+            written = snprintf(buffer + used, size - used, "%s = %s\n", entry->name, field);
+        }
+        else if (entry->type == CONFIG_CHOICE)
+        {
+            size_t len;
+            const char *name = choice_name(entry->choices, *(const int *)field, &len);
+            written = snprintf(buffer + used, size - used, "%s = %.*s\n", entry->name, (int)len, name);
+        }
+        else if (entry->type == CONFIG_LONG)
+        {
+            written = snprintf(buffer + used, size - used, "%s = %ld\n", entry->name, *(const long *)field);
+        }
+        else
+        {
+            written = snprintf(buffer + used, size - used, "%s = %d\n", entry->name, *(const int *)field);
+        }
+        if (written < 0)
+        {
+            break;
+        }
+        used += (size_t)written;
+    }
+}
+
+void config_usage(FILE *stream)
+{
+    for (int i = 0; i < ENTRY_COUNT; i++)
+    {
+        const config_entry_t *entry = &entries[i];
+        char option[64];
+        snprintf(option, sizeof(option), "--%s %s", entry->name,
+                 entry->type == CONFIG_PATH ? "chemin" : entry->type == CONFIG_CHOICE ? entry->choices : entry->type == CONFIG_LONG ? "octets" : "n");
+        fprintf(stream, "  %-36s %s\n", option, entry->help);
+    }
+}
+
+int config_check(const server_config_t *config)
+{
+    // Un message long doit tenir dans la file d'un client, avec sa ligne @LONG et le nom de l'expéditeur
+    long needed = config->max_message_bytes + LONGMSG_HEADER_SIZE + LONGMSG_PREFIX_SIZE;
+    if (config->outqueue_max_bytes < needed)
+    {
+        fprintf(stderr, "outqueue-max-bytes : %ld octets au moins attendus (max-message-bytes et l'en-tête d'un message long).\n",
+                needed);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file config.h
+ * @brief Runtime settings of the server: configuration file and command line.
+ *
+ * Every setting has a name, used both as a line `name = value` of the
+ * configuration file (`--config`) and as a command line option `--name
+ * value`. The file is read first, then the options of the command line,
+ * which win. Empty lines and lines starting with `#` are ignored; an
+ * unknown name or a value out of its range stops the server with a message.
+ *
+ * The defaults are the compile-time constants of the modules (server.h,
+ * auth.h, filecache.h, zcache.h, longmsg.h, readpool.h), so a server started without
+ * any setting behaves as before. A hot restart starts the new process with the same
+ * arguments: it reads the file again, so an edited file is applied without
+ * closing the connections.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define CONFIG_PATH_SIZE 256 /**< Size of a path setting */
+#define CONFIG_LINE_SIZE 512 /**< Longest line of the configuration file */
+
+/**
+ * @brief Settings of the server.
+ */
+typedef struct
+{
+    int port;                       /**< Port on which the clients connect */
+    int backlog;                    /**< Connections waiting to be accepted (listen()) */
+    int max_clients;                /**< Clients connected at the same time */
+    long socket_buffer;             /**< Send and receive buffers of a client socket in bytes, 0 for the system default */
+    char data_dir[CONFIG_PATH_SIZE]; /**< Directory of database.db, of the channel files (server/) and of the logs */
+    char tls_cert[CONFIG_PATH_SIZE]; /**< Certificate of the server, empty without TLS */
+    char tls_key[CONFIG_PATH_SIZE];  /**< Private key of the server, empty without TLS */
+    int io;                         /**< POLLER_AUTO, POLLER_EPOLL or POLLER_URING */
+    int storage;                    /**< STORAGE_SQLITE or STORAGE_LOG */
+    int retention_days;             /**< Age in days after which messages are removed, 0 to keep them */
+    int auth_workers;               /**< Password verification threads */
+    int auth_queue;                 /**< Password verifications waiting at most */
+    int batch_size;                 /**< Messages written to the database in one transaction */
+    int batch_delay_ms;             /**< Longest delay before a message is written */
+    int replay_max;                 /**< Missed messages replayed to a client at most */
+    long outqueue_max_bytes;        /**< Messages waiting for a slow client before it is disconnected */
+    int file_cache_files;           /**< Downloaded files kept open */
+    long file_cache_bytes;          /**< Bytes of the files kept open mapped in memory */
+    int compress_jobs;              /**< Files compressed at the same time in the background */
+    long max_message_bytes;         /**< Largest long message (`@LONG`), see longmsg.h */
+    int read_workers;               /**< History reading threads, see readpool.h */
+    int read_queue;                 /**< History reads waiting at most */
+} server_config_t;
+
+/**
+ * @brief Returns the name of a setting, to build the command line options.
+ *
+ * @param[in] index The index of the setting, from 0.
+ * @return The name, or NULL after the last setting.
+ */
+const char *config_key(int index);
+
+/**
+ * @brief Sets a setting from its text.
+ *
+ * @param[in,out] config The settings.
+ * @param[in] key The name of the setting.
+ * @param[in] value The value.
+ * @return 0 on success, -1 if the name is unknown or the value invalid (a message is printed).
+ */
+int config_set(server_config_t *config, const char *key, const char *value);
+
+/**
+ * @brief Reads a configuration file.
+ *
+ * @param[in,out] config The settings, changed by the lines of the file.
+ * @param[in] path The path of the file.
+ * @return 0 on success, -1 on error (a message gives the line).
+ */
+int config_load(server_config_t *config, const char *path);
+
+/**
+ * @brief Writes the settings in use, in the format of the file.
+ *
+ * @param[in] config The settings.
+ * @param[out] buffer The buffer receiving the text (one line per setting).
+ * @param[in] size The size of the buffer.
+ */
+void config_format(const server_config_t *config, char *buffer, size_t size);
+
+/**
+ * @brief Prints the options of the settings, for the usage message.
+ *
+ * @param[in] stream The stream receiving the text.
+ */
+void config_usage(FILE *stream);
+
+/**
+ * @brief Checks the settings that depend on each other, once they are all read.
+ *
+ * The queue of a client (`outqueue-max-bytes`) must hold the longest message
+ * (`max-message-bytes`) with its `@LONG` line and the name of its sender.
+ *
+ * @param[in] config The settings.
+ * @return 0 if they are consistent, -1 otherwise (a message is printed).
+ */
+int config_check(const server_config_t *config);
+
+#endif
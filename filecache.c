@@ -0,0 +1,282 @@
+#include "filecache.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "util.h"
+
+#define FILECACHE_PATH_SIZE 512
+
+struct filecache_entry
+{
+    char path[FILECACHE_PATH_SIZE];
+    int fd;
+    struct stat st;
+    char *data;           // Projection du fichier entier, ou NULL
+    uint32_t crc;
+    bool crc_known;
+    int users;            // Téléchargements en cours
+    bool cached;          // false une fois remplacé ou évincé : libéré par le dernier utilisateur
+    uint64_t checked_ms;  // Dernière comparaison avec le disque
+    struct filecache_entry *prev, *next; // Du plus récent au plus ancien
+};
+
+static filecache_entry_t *newest = NULL;
+static filecache_entry_t *oldest = NULL;
+static int cached_count = 0;
+static long mapped_bytes = 0;
+static int limit_files = FILECACHE_MAX_FILES;
+static long limit_mapped = FILECACHE_MAX_MAPPED;
+static unsigned long hits = 0;
+static unsigned long misses = 0;
+static unsigned long stale = 0;
+static unsigned long evictions = 0;
+
+static void unlink_entry(filecache_entry_t *entry)
+{
+    if (entry->prev != NULL)
+    {
+        entry->prev->next = entry->next;
+    }
+    else
+    {
+        newest = entry->next;
+    }
+    if (entry->next != NULL)
+    {
+        entry->next->prev = entry->prev;
+    }
+    else
+    {
+        oldest = entry->prev;
+    }
+    entry->prev = entry->next = NULL;
+}
+
+static void push_newest(filecache_entry_t *entry)
+{
+    entry->prev = NULL;
+    entry->next = newest;
+    if (newest != NULL)
+    {
+        newest->prev = entry;
+    }
+    newest = entry;
+    if (oldest == NULL)
+    {
+        oldest = entry;
+    }
+}
+
+static void free_entry(filecache_entry_t *entry)
+{
+    if (entry->data != NULL)
+    {
+        munmap(entry->data, entry->st.st_size);
+        mapped_bytes -= entry->st.st_size;
+    }
+    close(entry->fd);
+    free(entry);
+}
+
+// Retire le fichier du cache ; les téléchargements en cours le gardent jusqu'à la fin
+static void drop(filecache_entry_t *entry)
+{
+    unlink_entry(entry);
+    entry->cached = false;
+    cached_count--;
+    if (entry->users == 0)
+    {
+        free_entry(entry);
+    }
+}
+
+// Ferme les fichiers inutilisés les plus anciens jusqu'à repasser sous les limites
+static void evict(int max_files, long max_mapped)
+{
+    filecache_entry_t *entry = oldest;
+    while (entry != NULL && (cached_count > max_files || mapped_bytes > max_mapped))
+    {
+        filecache_entry_t *previous = entry->prev;
+        if (entry->users == 0)
+        {
+            drop(entry);
+            evictions++;
+        }
+        entry = previous;
+    }
+}
+
+static filecache_entry_t *find(const char *path)
+{
+    for (filecache_entry_t *entry = newest; entry != NULL; entry = entry->next)
+    {
+        if (strcmp(entry->path, path) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static bool same_file(const struct stat *a, const struct stat *b)
+{
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino && a->st_size == b->st_size &&
+           a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+void filecache_set_limits(int max_files, long max_mapped)
+{
+    limit_files = max_files;
+    limit_mapped = max_mapped;
+}
+
+filecache_entry_t *filecache_open(const char *path)
+{
+    uint64_t now = monotonic_ms();
+    filecache_entry_t *entry = find(path);
+
+    // Un fichier modifié hors du serveur n'est pas servi plus de FILECACHE_CHECK_MS
+    if (entry != NULL && now - entry->checked_ms >= FILECACHE_CHECK_MS)
+    {
+        struct stat st;
+        if (stat(path, &st) < 0 || !same_file(&st, &entry->st))
+        {
+            drop(entry);
+            entry = NULL;
+            stale++;
+        }
+        else
+        {
+            entry->checked_ms = now;
+        }
+    }
+    if (entry != NULL)
+    {
+        hits++;
+        unlink_entry(entry);
+        push_newest(entry);
+        entry->users++;
+        return entry;
+    }
+
+    misses++;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    entry = calloc(1, sizeof(filecache_entry_t));
+    if (entry == NULL || fstat(fd, &entry->st) < 0)
+    {
+        free(entry);
+        close(fd);
+        return NULL;
+    }
+    snprintf(entry->path, sizeof(entry->path), "%s", path);
+    entry->fd = fd;
+    entry->checked_ms = now;
+
+    // Projeter le fichier s'il reste de la place, après avoir fermé les fichiers inutilisés si besoin
+    long size = entry->st.st_size;
+    if (size > 0 && size <= FILECACHE_MAP_MAX_SIZE)
+    {
+        evict(limit_files, limit_mapped - size);
+        if (mapped_bytes + size <= limit_mapped)
+        {
+            entry->data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (entry->data == MAP_FAILED)
+            {
+                entry->data = NULL;
+            }
+            else
+            {
+                mapped_bytes += size;
+            }
+        }
+    }
+
+    entry->cached = true;
+    entry->users = 1;
+    push_newest(entry);
+    cached_count++;
+    evict(limit_files, limit_mapped);
+    return entry;
+}
+
+int filecache_fd(const filecache_entry_t *entry)
+{
+    return entry->fd;
+}
+
+const struct stat *filecache_stat(const filecache_entry_t *entry)
+{
+    return &entry->st;
+}
+
+const char *filecache_data(const filecache_entry_t *entry)
+{
+    return entry->data;
+}
+
+bool filecache_checksum(const filecache_entry_t *entry, uint32_t *crc)
+{
+    *crc = entry->crc;
+    return entry->crc_known;
+}
+
+void filecache_set_checksum(filecache_entry_t *entry, uint32_t crc)
+{
+    entry->crc = crc;
+    entry->crc_known = true;
+}
+
+void filecache_release(void *ref)
+{
+    filecache_entry_t *entry = ref;
+    entry->users--;
+    if (entry->users > 0)
+    {
+        return;
+    }
+    if (!entry->cached)
+    {
+        free_entry(entry);
+        return;
+    }
+    evict(limit_files, limit_mapped); // Les limites ont pu être dépassées pendant l'envoi
+}
+
+void filecache_invalidate(const char *path)
+{
+    filecache_entry_t *entry = find(path);
+    if (entry != NULL)
+    {
+        drop(entry);
+    }
+}
+
+void filecache_invalidate_channel(const char *channel)
+{
+    char prefix[FILECACHE_PATH_SIZE];
+    int len = snprintf(prefix, sizeof(prefix), "server/%s/", channel);
+    filecache_entry_t *entry = newest;
+    while (entry != NULL)
+    {
+        filecache_entry_t *next = entry->next;
+        if (strncmp(entry->path, prefix, len) == 0)
+        {
+            drop(entry);
+        }
+        entry = next;
+    }
+}
+
+void filecache_format_stats(char *buffer, size_t size)
+{
+    snprintf(buffer, size, "Cache de fichiers : %d ouverts (%ld Ko projetés), %lu succès, %lu défauts, %lu périmés, %lu évincés\n",
+             cached_count, mapped_bytes / 1024, hits, misses, stale, evictions);
+}
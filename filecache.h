@@ -0,0 +1,126 @@
+/**
+ * @file filecache.h
+ * @brief Cache of the channel files being downloaded: descriptors, status and mappings.
+ *
+ * When a file is announced in a channel, many members download it at once.
+ * Instead of opening and examining the file for each download, the server
+ * keeps the FILECACHE_MAX_FILES files downloaded last open, with their
+ * status, their checksum and, up to FILECACHE_MAX_MAPPED bytes in total, a
+ * read-only mapping. The downloads of a cached file share its descriptor
+ * (sendfile) and its mapping (TLS without kTLS, see outqueue.h).
+ *
+ * The least recently used files are closed first, once no download uses
+ * them anymore. The server replaces a file by renaming a new one over it,
+ * so a file being sent is never truncated: filecache_invalidate() only makes
+ * the next downloads open the new file. A cached file is also checked
+ * against the disk at most every FILECACHE_CHECK_MS milliseconds.
+ */
+
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define FILECACHE_MAX_FILES 32                        /**< Default number of files kept open */
+#define FILECACHE_MAX_MAPPED (256L * 1024 * 1024)     /**< Default number of bytes mapped in total */
+#define FILECACHE_MAP_MAX_SIZE (64L * 1024 * 1024)    /**< Larger files are not mapped */
+#define FILECACHE_CHECK_MS 1000                       /**< Delay after which a cached file is checked against the disk */
+
+/**
+ * @brief File of the cache.
+ */
+typedef struct filecache_entry filecache_entry_t;
+
+/**
+ * @brief Sets the size of the cache (before the first file is opened).
+ *
+ * @param[in] max_files The number of files kept open.
+ * @param[in] max_mapped The number of bytes mapped in total.
+ */
+void filecache_set_limits(int max_files, long max_mapped);
+
+/**
+ * @brief Opens a file through the cache.
+ *
+ * @param[in] path The path of the file.
+ * @return The file, to release with filecache_release(), or NULL if it cannot be opened (errno is set).
+ */
+filecache_entry_t *filecache_open(const char *path);
+
+/**
+ * @brief Returns the descriptor of a cached file (shared: it must not be closed).
+ *
+ * @param[in] entry The file.
+ * @return The descriptor.
+ */
+int filecache_fd(const filecache_entry_t *entry);
+
+/**
+ * @brief Returns the status of a cached file.
+ *
+ * @param[in] entry The file.
+ * @return The status read when the file was opened.
+ */
+const struct stat *filecache_stat(const filecache_entry_t *entry);
+
+/**
+ * @brief Returns the mapping of a cached file.
+ *
+ * @param[in] entry The file.
+ * @return The bytes of the whole file, or NULL if the file is not mapped (empty, too large, or no room left).
+ */
+const char *filecache_data(const filecache_entry_t *entry);
+
+/**
+ * @brief Returns the checksum remembered for a cached file.
+ *
+ * @param[in] entry The file.
+ * @param[out] crc The CRC-32C of the file.
+ * @return true if the checksum is known.
+ */
+bool filecache_checksum(const filecache_entry_t *entry, uint32_t *crc);
+
+/**
+ * @brief Remembers the checksum of a cached file.
+ *
+ * @param[in,out] entry The file.
+ * @param[in] crc The CRC-32C of the file.
+ */
+void filecache_set_checksum(filecache_entry_t *entry, uint32_t crc);
+
+/**
+ * @brief Releases a file opened with filecache_open().
+ *
+ * The argument is untyped so that the function can be given to
+ * outqueue_push_shared().
+ *
+ * @param[in] entry The file.
+ */
+void filecache_release(void *entry);
+
+/**
+ * @brief Forgets a file that has been replaced or removed.
+ *
+ * @param[in] path The path of the file.
+ */
+void filecache_invalidate(const char *path);
+
+/**
+ * @brief Forgets the files of a channel that is deleted.
+ *
+ * @param[in] channel The channel.
+ */
+void filecache_invalidate_channel(const char *channel);
+
+/**
+ * @brief Writes the statistics of the cache.
+ *
+ * @param[out] buffer The buffer receiving the text (one line).
+ * @param[in] size The size of the buffer.
+ */
+void filecache_format_stats(char *buffer, size_t size);
+
+#endif
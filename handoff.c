@@ -0,0 +1,163 @@
+#define _GNU_SOURCE
+#include "handoff.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int handoff_spawn(char *const argv[], const char *directory, pid_t *pid)
+{
+    // Des paquets plutôt qu'un flux : chaque enregistrement arrive entier avec son descripteur
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) < 0)
+    {
+        perror("socketpair failed");
+        return -1;
+    }
+
+    *pid = fork();
+    if (*pid < 0)
+    {
+        perror("fork failed");
+        close(pair[0]);
+        close(pair[1]);
+        return -1;
+    }
+
+    if (*pid == 0)
+    {
+        // Le nouveau processus ne garde que les entrées/sorties standard et le socket de passation
+        if (pair[1] == HANDOFF_FD)
+        {
+            fcntl(HANDOFF_FD, F_SETFD, 0);
+        }
+        else if (dup2(pair[1], HANDOFF_FD) < 0)
+        {
+            _exit(127);
+        }
+        close_range(HANDOFF_FD + 1, ~0U, 0);
+
+        // Le processus courant a pu changer de dossier (dossier des données)
+        if (chdir(directory) < 0)
+        {
+            _exit(127);
+        }
+
+        // Mêmes arguments, sans un éventuel --inherit d'un redémarrage précédent
+        int argc = 0;
+        while (argv[argc] != NULL)
+        {
+            argc++;
+        }
+        char **args = calloc(argc + 3, sizeof(char *));
+        if (args == NULL)
+        {
+            _exit(127);
+        }
+        int n = 0;
+        for (int i = 0; i < argc; i++)
+        {
+            if (strcmp(argv[i], "--inherit") == 0)
+            {
+                i++;
+                continue;
+            }
+            if (strncmp(argv[i], "--inherit=", 10) == 0)
+            {
+                continue;
+            }
+            args[n++] = argv[i];
+        }
+        char fd_str[16];
+        snprintf(fd_str, sizeof(fd_str), "%d", HANDOFF_FD);
+        args[n++] = "--inherit";
+        args[n++] = fd_str;
+        args[n] = NULL;
+
+        // L'exécutable est relu sur le disque : c'est la nouvelle version qui démarre
+        execvp(args[0], args);
+        perror("execvp failed");
+        _exit(127);
+    }
+
+    close(pair[1]);
+    return pair[0];
+}
+
+int handoff_send(int sock, const handoff_record_t *record, int fd)
+{
+    struct iovec iov = {.iov_base = (void *)record, .iov_len = sizeof(*record)};
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    // Le descripteur voyage dans les données auxiliaires
+    if (fd >= 0)
+    {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(*record) ? 0 : -1;
+}
+
+int handoff_recv(int sock, handoff_record_t *record, int *fd)
+{
+    struct iovec iov = {.iov_base = record, .iov_len = sizeof(*record)};
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    *fd = -1;
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != (ssize_t)sizeof(*record))
+    {
+        return -1;
+    }
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+    {
+        memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    return 0;
+}
+
+int handoff_ready(int sock)
+{
+    char ready = 'R';
+    return send(sock, &ready, 1, MSG_NOSIGNAL) == 1 ? 0 : -1;
+}
+
+int handoff_wait_ready(int sock, int timeout_ms)
+{
+    struct pollfd pfd = {.fd = sock, .events = POLLIN};
+    char ready = 0;
+    if (poll(&pfd, 1, timeout_ms) <= 0 || recv(sock, &ready, 1, 0) != 1)
+    {
+        return -1; // Le nouveau processus a échoué ou ne répond pas
+    }
+    return ready == 'R' ? 0 : -1;
+}
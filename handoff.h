@@ -0,0 +1,100 @@
+/**
+ * @file handoff.h
+ * @brief Hands the sockets of a running server over to a new server process.
+ *
+ * A hot restart starts the new executable with a Unix socket connected to
+ * the old process. The old process sends the listening socket and the
+ * sockets of its clients with `SCM_RIGHTS`, together with the state needed
+ * to keep each session (user, channel, unprocessed input). The listening
+ * socket is never closed, so no connection is refused during a deploy, and
+ * the clients that are handed over do not even notice the restart.
+ */
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "session.h"
+
+#define HANDOFF_LISTENER 1      /**< Record carrying the listening socket */
+#define HANDOFF_CLIENT 2        /**< Record carrying the socket of a client */
+#define HANDOFF_END 3           /**< Last record, without socket */
+#define HANDOFF_CLUSTER 4       /**< Record carrying the listening socket of the cluster */
+#define HANDOFF_PENDING_SIZE 1024 /**< Unprocessed input kept per client, the size of the server input buffer */
+#define HANDOFF_FD 3            /**< Descriptor of the handoff socket in the new process */
+#define HANDOFF_TIMEOUT_MS 5000 /**< Delay for the new process to take over */
+
+/**
+ * @brief Structure representing a socket and its state sent to the new process.
+ */
+typedef struct
+{
+    int type;                           /**< HANDOFF_LISTENER, HANDOFF_CLUSTER, HANDOFF_CLIENT or HANDOFF_END */
+    int is_admin;                       /**< 1 if the client is an admin */
+    char username[50];                  /**< Username of the client, empty if not logged in */
+    char current_channel[50];           /**< Channel of the client */
+    int compress;                       /**< 1 if the client accepted the compression of the files */
+    int checksum;                       /**< 1 if the client accepted the checksum trailers of the files */
+    int presence;                       /**< 1 if the client receives the presence events */
+    int away;                           /**< 1 if the user of the client is marked away */
+    char session[SESSION_ID_SIZE];      /**< Session of the client (session.h), empty if none */
+    char session_token[SESSION_TOKEN_SIZE]; /**< Token of the session of the client, empty if none */
+    size_t pending_len;                 /**< Number of bytes in pending */
+    char pending[HANDOFF_PENDING_SIZE]; /**< Bytes received and not processed yet */
+} handoff_record_t;
+
+/**
+ * @brief Starts the new server process.
+ *
+ * The executable of argv[0] is started again with the same arguments and
+ * `--inherit`. Every descriptor of the current process is closed in the new
+ * process, except the standard streams and the handoff socket (HANDOFF_FD).
+ * The new process starts in `directory`, so the relative paths of the
+ * arguments mean the same as for the current process.
+ *
+ * @param[in] argv The arguments of the current process.
+ * @param[in] directory The directory in which the current process was started.
+ * @param[out] pid The process ID of the new process.
+ * @return The handoff socket of the current process, or -1 on error.
+ */
+int handoff_spawn(char *const argv[], const char *directory, pid_t *pid);
+
+/**
+ * @brief Sends a record, and the socket it describes, to the other process.
+ *
+ * @param[in] sock The handoff socket.
+ * @param[in] record The record.
+ * @param[in] fd The socket to send, or -1.
+ * @return 0 on success, -1 on error.
+ */
+int handoff_send(int sock, const handoff_record_t *record, int fd);
+
+/**
+ * @brief Receives a record and its socket from the other process.
+ *
+ * @param[in] sock The handoff socket.
+ * @param[out] record The record.
+ * @param[out] fd The received socket, or -1 if the record has none.
+ * @return 0 on success, -1 on error.
+ */
+int handoff_recv(int sock, handoff_record_t *record, int *fd);
+
+/**
+ * @brief Tells the old process that the new one is serving.
+ *
+ * @param[in] sock The handoff socket.
+ * @return 0 on success, -1 on error.
+ */
+int handoff_ready(int sock);
+
+/**
+ * @brief Waits until the new process is serving.
+ *
+ * @param[in] sock The handoff socket.
+ * @param[in] timeout_ms The maximum waiting time.
+ * @return 0 if the new process took over, -1 otherwise.
+ */
+int handoff_wait_ready(int sock, int timeout_ms);
+
+#endif
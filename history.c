@@ -0,0 +1,189 @@
+#include "history.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    uint64_t seq;
+    size_t len;
+    char *text;
+} history_entry_t;
+
+// Un salon : son dernier numéro et ses derniers messages (tampon circulaire indexé par numéro)
+typedef struct
+{
+    char name[HISTORY_CHANNEL_SIZE];
+    uint64_t last_seq;
+    size_t bytes; // Octets des messages gardés, au plus HISTORY_MEMORY_BYTES
+    history_entry_t entries[HISTORY_MEMORY];
+} history_channel_t;
+
+static history_last_fn load_last_seq = NULL;
+static history_channel_t **channels = NULL;
+static int channel_count = 0;
+static int channel_capacity = 0;
+static unsigned long replayed_from_memory = 0;
+static unsigned long replay_misses = 0;
+static unsigned long not_kept = 0;
+
+void history_init(history_last_fn last_seq)
+{
+    load_last_seq = last_seq;
+}
+
+static history_channel_t *find_channel(const char *name, int create)
+{
+    for (int i = 0; i < channel_count; i++)
+    {
+        if (strcmp(channels[i]->name, name) == 0)
+        {
+            return channels[i];
+        }
+    }
+    if (!create)
+    {
+        return NULL;
+    }
+
+    if (channel_count == channel_capacity)
+    {
+        int capacity = channel_capacity > 0 ? 2 * channel_capacity : 8;
+        history_channel_t **grown = realloc(channels, capacity * sizeof(history_channel_t *));
+        if (grown == NULL)
+        {
+            return NULL;
+        }
+        channels = grown;
+        channel_capacity = capacity;
+    }
+    history_channel_t *channel = calloc(1, sizeof(history_channel_t));
+    if (channel == NULL)
+    {
+        return NULL;
+    }
+    snprintf(channel->name, sizeof(channel->name), "%s", name);
+
+    // Reprendre la numérotation là où la base de données l'a laissée
+    channel->last_seq = load_last_seq != NULL ? load_last_seq(name) : 0;
+    channels[channel_count++] = channel;
+    return channel;
+}
+
+uint64_t history_append(const char *channel_name, const char *message, size_t len)
+{
+    history_channel_t *channel = find_channel(channel_name, 1);
+    if (channel == NULL)
+    {
+        return 0;
+    }
+
+    uint64_t seq = ++channel->last_seq;
+    history_entry_t *entry = &channel->entries[seq % HISTORY_MEMORY];
+    channel->bytes -= entry->len;
+    free(entry->text); // Le message le plus ancien laisse sa place
+    entry->text = NULL;
+    entry->seq = 0;
+    entry->len = 0;
+
+    // Un message plus grand que le budget du salon n'est relu que depuis le stockage
+    if (len > HISTORY_MEMORY_BYTES)
+    {
+        not_kept++;
+        return seq;
+    }
+
+    // Sinon les plus anciens messages laissent la place qu'il faut
+    for (uint64_t old = seq > HISTORY_MEMORY ? seq - HISTORY_MEMORY + 1 : 1; old < seq && channel->bytes + len > HISTORY_MEMORY_BYTES; old++)
+    {
+        history_entry_t *oldest = &channel->entries[old % HISTORY_MEMORY];
+        if (oldest->seq == old)
+        {
+            channel->bytes -= oldest->len;
+            free(oldest->text);
+            oldest->text = NULL;
+            oldest->seq = 0;
+            oldest->len = 0;
+        }
+    }
+
+    entry->text = malloc(len);
+    entry->seq = entry->text != NULL ? seq : 0;
+    entry->len = entry->text != NULL ? len : 0;
+    if (entry->text != NULL)
+    {
+        memcpy(entry->text, message, len);
+        channel->bytes += len;
+    }
+    return seq;
+}
+
+uint64_t history_last(const char *channel_name)
+{
+    history_channel_t *channel = find_channel(channel_name, 1);
+    return channel != NULL ? channel->last_seq : 0;
+}
+
+int history_replay(const char *channel_name, uint64_t after, history_emit_fn emit, void *context)
+{
+    history_channel_t *channel = find_channel(channel_name, 1);
+    if (channel == NULL || after >= channel->last_seq)
+    {
+        return 0; // Rien de manqué
+    }
+
+    // Tous les messages manqués doivent encore être en mémoire
+    for (uint64_t seq = after + 1; seq <= channel->last_seq; seq++)
+    {
+        if (channel->entries[seq % HISTORY_MEMORY].seq != seq)
+        {
+            replay_misses++;
+            return -1;
+        }
+    }
+
+    int count = 0;
+    for (uint64_t seq = after + 1; seq <= channel->last_seq; seq++)
+    {
+        history_entry_t *entry = &channel->entries[seq % HISTORY_MEMORY];
+        emit(context, seq, entry->text, entry->len);
+        count++;
+    }
+    replayed_from_memory += count;
+    return count;
+}
+
+void history_clear(const char *channel_name)
+{
+    history_channel_t *channel = find_channel(channel_name, 0);
+    if (channel == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < HISTORY_MEMORY; i++)
+    {
+        free(channel->entries[i].text);
+        channel->entries[i].text = NULL;
+        channel->entries[i].seq = 0;
+        channel->entries[i].len = 0;
+    }
+    channel->bytes = 0;
+}
+
+void history_format_stats(char *buffer, size_t size)
+{
+    size_t kept = 0;
+    size_t bytes = 0;
+    for (int i = 0; i < channel_count; i++)
+    {
+        for (int j = 0; j < HISTORY_MEMORY; j++)
+        {
+            kept += channels[i]->entries[j].text != NULL;
+        }
+        bytes += channels[i]->bytes;
+    }
+    snprintf(buffer, size,
+             "Historique : %d salon(s) suivis, %zu messages en mémoire (%zu Ko), %lu trop longs pour la mémoire, %lu rejoués depuis la mémoire, %lu lus dans la base\n",
+             channel_count, kept, bytes / 1024, not_kept, replayed_from_memory, replay_misses);
+}
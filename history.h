@@ -0,0 +1,90 @@
+/**
+ * @file history.h
+ * @brief Sequence numbers of the channel messages and recent messages kept in memory.
+ *
+ * Every message broadcast in a channel gets the next sequence number of the
+ * channel (1, 2, 3...), sent to the clients with the message and stored with
+ * it in the database. A client that comes back gives the last number it has
+ * seen, and receives only the messages it missed.
+ *
+ * The last HISTORY_MEMORY messages of each channel are kept in memory, so a
+ * short disconnection is caught up without reading the database. A channel
+ * keeps at most HISTORY_MEMORY_BYTES of messages: long messages (longmsg.h)
+ * push the oldest ones out, and a message larger than that is only kept by
+ * the storage, from which a replay that needs it reads. The first
+ * use of a channel asks the database for its last number (see
+ * history_init()), so the numbering goes on after a restart.
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HISTORY_MEMORY 256       /**< Messages kept in memory per channel */
+#define HISTORY_MEMORY_BYTES (256 * 1024) /**< Bytes of messages kept in memory per channel */
+#define HISTORY_CHANNEL_SIZE 50  /**< Size of a channel name, as in client_t */
+
+/**
+ * @brief Function returning the last sequence number of a channel stored in the database.
+ */
+typedef uint64_t (*history_last_fn)(const char *channel);
+
+/**
+ * @brief Function receiving a replayed message.
+ */
+typedef void (*history_emit_fn)(void *context, uint64_t seq, const char *message, size_t len);
+
+/**
+ * @brief Sets the function reading the last sequence number of a channel from the database.
+ *
+ * @param[in] last_seq The function.
+ */
+void history_init(history_last_fn last_seq);
+
+/**
+ * @brief Gives a message the next sequence number of its channel and keeps it in memory.
+ *
+ * @param[in] channel The channel.
+ * @param[in] message The message.
+ * @param[in] len The length of the message.
+ * @return The sequence number of the message.
+ */
+uint64_t history_append(const char *channel, const char *message, size_t len);
+
+/**
+ * @brief Returns the last sequence number of a channel.
+ *
+ * @param[in] channel The channel.
+ * @return The number of the last message, 0 if the channel has none.
+ */
+uint64_t history_last(const char *channel);
+
+/**
+ * @brief Replays from memory the messages of a channel that follow a sequence number.
+ *
+ * @param[in] channel The channel.
+ * @param[in] after The last sequence number seen by the client.
+ * @param[in] emit The function receiving each message, in order.
+ * @param[in] context The first argument of emit.
+ * @return The number of messages replayed, or -1 if some of them are no longer in memory.
+ */
+int history_replay(const char *channel, uint64_t after, history_emit_fn emit, void *context);
+
+/**
+ * @brief Drops the messages of a deleted channel. Its numbering goes on if it is created again.
+ *
+ * @param[in] channel The channel.
+ */
+void history_clear(const char *channel);
+
+/**
+ * @brief Writes the statistics of the history.
+ *
+ * @param[out] buffer The buffer receiving the text (one line).
+ * @param[in] size The size of the buffer.
+ */
+void history_format_stats(char *buffer, size_t size);
+
+#endif
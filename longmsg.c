@@ -0,0 +1,230 @@
+#include "longmsg.h"
+#include "slab.h"
+#include "transport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct longmsg_segment
+{
+    struct longmsg_segment *next;
+    size_t used;
+    char data[LONGMSG_SEGMENT_SIZE];
+};
+
+// Segments partagés par tous les messages en cours de réception
+static slab_t segment_slab;
+
+// Statistiques, affichées par la commande stats du serveur
+static unsigned long messages_received = 0;
+static unsigned long messages_refused = 0;
+static unsigned long long bytes_received = 0;
+static size_t largest_message = 0;
+static unsigned long scatter_reads = 0;
+
+static longmsg_segment_t *new_segment(void)
+{
+    if (segment_slab.objects_per_block == 0)
+    {
+        slab_init(&segment_slab, "segments de message long", sizeof(longmsg_segment_t), LONGMSG_SLAB_SEGMENTS);
+    }
+    longmsg_segment_t *segment = slab_alloc(&segment_slab);
+    if (segment != NULL)
+    {
+        segment->next = NULL;
+        segment->used = 0;
+    }
+    return segment;
+}
+
+static void free_segments(longmsg_segment_t *segment)
+{
+    while (segment != NULL)
+    {
+        longmsg_segment_t *next = segment->next;
+        slab_free(&segment_slab, segment);
+        segment = next;
+    }
+}
+
+longmsg_t *longmsg_start(size_t expected)
+{
+    longmsg_t *msg = malloc(sizeof(longmsg_t));
+    if (msg == NULL)
+    {
+        return NULL;
+    }
+    msg->head = new_segment();
+    if (msg->head == NULL)
+    {
+        free(msg);
+        return NULL;
+    }
+    msg->tail = msg->head;
+    msg->expected = expected;
+    msg->received = 0;
+    return msg;
+}
+
+// Ajoute un segment vide après le dernier, NULL si l'allocation échoue
+static longmsg_segment_t *grow(longmsg_t *msg)
+{
+    longmsg_segment_t *segment = new_segment();
+    if (segment != NULL)
+    {
+        msg->tail->next = segment;
+        msg->tail = segment;
+    }
+    return segment;
+}
+
+size_t longmsg_append(longmsg_t *msg, const char *data, size_t len)
+{
+    size_t wanted = msg->expected - msg->received;
+    size_t taken = 0;
+    if (len > wanted)
+    {
+        len = wanted;
+    }
+    while (taken < len)
+    {
+        if (msg->tail->used == LONGMSG_SEGMENT_SIZE && grow(msg) == NULL)
+        {
+            break;
+        }
+        size_t room = LONGMSG_SEGMENT_SIZE - msg->tail->used;
+        size_t part = len - taken < room ? len - taken : room;
+        memcpy(msg->tail->data + msg->tail->used, data + taken, part);
+        msg->tail->used += part;
+        taken += part;
+    }
+    msg->received += taken;
+    return taken;
+}
+
+ssize_t longmsg_read(longmsg_t *msg, int socket)
+{
+    size_t wanted = msg->expected - msg->received;
+    if (msg->tail->used == LONGMSG_SEGMENT_SIZE && grow(msg) == NULL)
+    {
+        return -1;
+    }
+
+    // Lecture dispersée : fin du dernier segment, puis un nouveau segment s'il en manque
+    longmsg_segment_t *last = msg->tail;
+    struct iovec iov[2];
+    int count = 1;
+    size_t room = LONGMSG_SEGMENT_SIZE - last->used;
+    iov[0].iov_base = last->data + last->used;
+    iov[0].iov_len = room < wanted ? room : wanted;
+    longmsg_segment_t *extra = NULL;
+    if (room < wanted)
+    {
+        extra = new_segment();
+        if (extra != NULL)
+        {
+            size_t rest = wanted - room;
+            iov[1].iov_base = extra->data;
+            iov[1].iov_len = rest < LONGMSG_SEGMENT_SIZE ? rest : LONGMSG_SEGMENT_SIZE;
+            count = 2;
+        }
+    }
+
+    ssize_t n = transport_recvv(socket, iov, count);
+    if (n > 0)
+    {
+        size_t first = (size_t)n < iov[0].iov_len ? (size_t)n : iov[0].iov_len;
+        last->used += first;
+        if ((size_t)n > first)
+        {
+            extra->used = (size_t)n - first;
+            last->next = extra;
+            msg->tail = extra;
+            extra = NULL;
+        }
+        msg->received += (size_t)n;
+        if (count == 2)
+        {
+            scatter_reads++;
+        }
+    }
+    if (extra != NULL)
+    {
+        slab_free(&segment_slab, extra);
+    }
+    return n;
+}
+
+bool longmsg_complete(const longmsg_t *msg)
+{
+    return msg->received == msg->expected;
+}
+
+longmsg_text_t *longmsg_finish(longmsg_t *msg, const char *prefix)
+{
+    size_t prefix_len = strlen(prefix);
+    longmsg_text_t *text = malloc(sizeof(longmsg_text_t) + prefix_len + msg->received + 2);
+    if (text != NULL)
+    {
+        text->refs = 1;
+        memcpy(text->data, prefix, prefix_len);
+        size_t len = prefix_len;
+        for (longmsg_segment_t *segment = msg->head; segment != NULL; segment = segment->next)
+        {
+            memcpy(text->data + len, segment->data, segment->used);
+            len += segment->used;
+        }
+        text->data[len++] = '\n'; // Terminé comme une ligne de discussion
+        text->data[len] = '\0';
+        text->len = len;
+
+        messages_received++;
+        bytes_received += msg->received;
+        if (msg->received > largest_message)
+        {
+            largest_message = msg->received;
+        }
+    }
+    longmsg_abort(msg);
+    return text;
+}
+
+void longmsg_abort(longmsg_t *msg)
+{
+    if (msg != NULL)
+    {
+        free_segments(msg->head);
+        free(msg);
+    }
+}
+
+void longmsg_retain(longmsg_text_t *text)
+{
+    text->refs++;
+}
+
+void longmsg_release(void *text)
+{
+    longmsg_text_t *shared = text;
+    if (--shared->refs == 0)
+    {
+        free(shared);
+    }
+}
+
+void longmsg_count_refused(void)
+{
+    messages_refused++;
+}
+
+void longmsg_format_stats(char *buffer, size_t size)
+{
+    char slab[128] = "segments de message long inutilisés";
+    if (segment_slab.objects_per_block != 0)
+    {
+        slab_format_stats(&segment_slab, slab, sizeof(slab));
+    }
+    snprintf(buffer, size, "Messages longs : %lu reçus (%llu octets, le plus long %zu), %lu refusés, %lu lectures dispersées ; %s\n",
+             messages_received, bytes_received, largest_message, messages_refused, scatter_reads, slab);
+}
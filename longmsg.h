@@ -0,0 +1,144 @@
+/**
+ * @file longmsg.h
+ * @brief Messages longer than a line, received in chained segments and shared by reference.
+ *
+ * A chat line is limited to BUFFER_SIZE bytes. A longer message, or one
+ * made of several lines (a paste), is sent as `@LONG <bytes>` followed by
+ * exactly that many bytes, and delivered as `@LONG <channel> <seq> <bytes>`
+ * followed by the message.
+ *
+ * The bytes are read from the socket straight into a chain of
+ * LONGMSG_SEGMENT_SIZE segments, with a scatter read across the free space
+ * of the last segment and a new one (transport_recvv()). The segments come
+ * from a slab allocator and only exist while a long message is received: a
+ * connection that only sends short lines keeps a NULL pointer.
+ *
+ * Once complete, the message is joined into a single reference-counted
+ * text, which is queued by reference to every member of the channel
+ * (outqueue_push_ref()): its bytes are not copied for each recipient, and
+ * they are written with the header line in a single gather write.
+ */
+
+#ifndef LONGMSG_H
+#define LONGMSG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define LONGMSG_SEGMENT_SIZE 16384          /**< Size of a segment of a message being received */
+#define LONGMSG_SLAB_SEGMENTS 8             /**< Segments allocated at once by the slab allocator */
+#define LONGMSG_MAX_BYTES (1024 * 1024)     /**< Default largest long message (`max-message-bytes`) */
+#define LONGMSG_HEADER_SIZE 128             /**< Size of a `@LONG <channel> <seq> <bytes>` line */
+#define LONGMSG_PREFIX_SIZE 64              /**< Size of the `<user>: ` prefix put before a long message */
+
+/**
+ * @brief Segment of a message being received.
+ */
+typedef struct longmsg_segment longmsg_segment_t;
+
+/**
+ * @brief Structure representing a long message being received.
+ */
+typedef struct
+{
+    longmsg_segment_t *head; /**< First segment */
+    longmsg_segment_t *tail; /**< Segment being filled */
+    size_t expected;         /**< Bytes announced by `@LONG` */
+    size_t received;         /**< Bytes received so far */
+} longmsg_t;
+
+/**
+ * @brief Complete long message, shared by the queues of its recipients.
+ */
+typedef struct
+{
+    int refs;     /**< References: the sender, then one per queue */
+    size_t len;   /**< Length of the text */
+    char data[];  /**< The text, followed by a null byte */
+} longmsg_text_t;
+
+/**
+ * @brief Starts receiving a long message.
+ *
+ * @param[in] expected The number of bytes announced.
+ * @return The message, or NULL if the allocation failed.
+ */
+longmsg_t *longmsg_start(size_t expected);
+
+/**
+ * @brief Adds bytes already received (the rest of a read buffer) to a message.
+ *
+ * @param[in,out] msg The message.
+ * @param[in] data The bytes.
+ * @param[in] len The number of bytes.
+ * @return The number of bytes taken, at most what the message still expects.
+ */
+size_t longmsg_append(longmsg_t *msg, const char *data, size_t len);
+
+/**
+ * @brief Reads the next bytes of a message from a socket, with a scatter read.
+ *
+ * No more than the bytes still expected are read, so the commands that
+ * follow the message stay in the socket.
+ *
+ * @param[in,out] msg The message.
+ * @param[in] socket The socket.
+ * @return The number of bytes read, 0 if the peer closed the connection, or -1 on error (errno is set).
+ */
+ssize_t longmsg_read(longmsg_t *msg, int socket);
+
+/**
+ * @brief Checks if all the announced bytes have been received.
+ *
+ * @param[in] msg The message.
+ * @return true if the message is complete.
+ */
+bool longmsg_complete(const longmsg_t *msg);
+
+/**
+ * @brief Joins the segments of a complete message into a shared text, and frees the message.
+ *
+ * The text is the prefix, the message and a newline, as a chat line.
+ *
+ * @param[in] msg The message.
+ * @param[in] prefix The text put before the message (the name of the sender).
+ * @return The text, with one reference, or NULL if the allocation failed.
+ */
+longmsg_text_t *longmsg_finish(longmsg_t *msg, const char *prefix);
+
+/**
+ * @brief Drops a message being received (connection closed).
+ *
+ * @param[in] msg The message, or NULL.
+ */
+void longmsg_abort(longmsg_t *msg);
+
+/**
+ * @brief Adds a reference to a shared text.
+ *
+ * @param[in,out] text The text.
+ */
+void longmsg_retain(longmsg_text_t *text);
+
+/**
+ * @brief Removes a reference to a shared text, and frees it after the last one.
+ *
+ * @param[in] text The text (a void pointer, to be given to outqueue_push_ref()).
+ */
+void longmsg_release(void *text);
+
+/**
+ * @brief Counts a long message refused (too long, or sent outside of a channel).
+ */
+void longmsg_count_refused(void);
+
+/**
+ * @brief Writes the statistics of the long messages.
+ *
+ * @param[out] buffer The buffer receiving the text (one line).
+ * @param[in] size The size of the buffer.
+ */
+void longmsg_format_stats(char *buffer, size_t size);
+
+#endif
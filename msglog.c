@@ -0,0 +1,1005 @@
+#define _GNU_SOURCE
+#include "msglog.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "checksum.h"
+#include "util.h"
+
+#define SEGMENT_NAME_LEN 24 // "<numéro sur 20 chiffres>.seg"
+#define DELETED_PREFIX ".deleted-"
+#define LOG_PATH_SIZE PATH_MAX // Les noms lus dans les dossiers peuvent faire 255 octets
+#define DAY_SECONDS 86400L
+
+// En-tête d'un enregistrement, suivi du nom de l'expéditeur puis du message
+typedef struct
+{
+    uint32_t crc;          // CRC-32C du reste de l'enregistrement
+    uint32_t length;       // Longueur totale, multiple de 8 ; 0 : fin du segment
+    uint64_t seq;
+    int64_t timestamp;
+    uint16_t username_len;
+    uint16_t message_len;
+    uint32_t message_len_high; // Bits de poids fort de la longueur du message (messages longs), 0 sinon
+} record_t;
+
+// Longueur du message d'un enregistrement
+static size_t record_message_len(const record_t *record)
+{
+    return record->message_len | (size_t)record->message_len_high << 16;
+}
+
+// Entrée de l'index : position d'un enregistrement dans son segment
+typedef struct
+{
+    uint64_t seq;
+    uint64_t offset;
+} index_entry_t;
+
+typedef struct
+{
+    uint64_t base_seq; // Numéro du premier message, qui donne le nom du fichier
+    time_t modified;   // Date du dernier message
+} segment_t;
+
+typedef struct log_channel
+{
+    char name[50];
+    segment_t *segments; // Du plus ancien au plus récent ; le dernier est le segment actif
+    int segment_count;
+    int segment_capacity;
+
+    // Segment actif, projeté en entier
+    int fd;              // -1 si le salon n'a encore aucun segment
+    int index_fd;
+    char *data;
+    size_t end;          // Fin des enregistrements
+    size_t indexed;      // Position de la dernière entrée de l'index
+    index_entry_t *index;
+    int index_count;
+    int index_capacity;
+
+    uint64_t last_seq;
+    bool dirty;          // Dans la liste des salons à synchroniser
+    struct log_channel *next;
+    struct log_channel *next_dirty;
+} log_channel_t;
+
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_wakeup = PTHREAD_COND_INITIALIZER;
+static log_channel_t *channel_table[MSGLOG_BUCKETS];
+static log_channel_t *dirty_channels = NULL;
+static int *closing_fds = NULL; // Segments fermés et dossiers modifiés, à synchroniser puis fermer
+static int closing_count = 0;
+static int closing_capacity = 0;
+static bool compact_requested = true; // Une première passe au démarrage
+static int global_retention_days = 0;
+static unsigned long deleted_counter = 0;
+
+static int open_channels = 0;
+static unsigned long records_written = 0;
+static unsigned long bytes_written = 0;
+static unsigned long records_unsynced = 0;
+static unsigned long syncs = 0;
+static unsigned long records_synced = 0;
+static unsigned long segments_created = 0;
+static unsigned long segments_dropped = 0;
+static unsigned long reads = 0;
+
+static void segment_path(char *path, size_t size, const char *channel, uint64_t base_seq, const char *suffix)
+{
+    snprintf(path, size, MSGLOG_DIR "/%s/%020llu%s", channel, (unsigned long long)base_seq, suffix);
+}
+
+static void push_closing(int fd)
+{
+    if (fd < 0)
+    {
+        return;
+    }
+    if (closing_count == closing_capacity)
+    {
+        int capacity = closing_capacity > 0 ? closing_capacity * 2 : 16;
+        int *grown = realloc(closing_fds, capacity * sizeof(int));
+        if (grown == NULL)
+        {
+            fdatasync(fd); // Pas de place : synchroniser tout de suite
+            close(fd);
+            return;
+        }
+        closing_fds = grown;
+        closing_capacity = capacity;
+    }
+    closing_fds[closing_count++] = fd;
+}
+
+// Vérifie l'enregistrement qui commence à offset ; NULL à la fin des enregistrements valides
+static const record_t *record_at(const char *data, size_t offset, size_t limit)
+{
+    if (offset + sizeof(record_t) > limit)
+    {
+        return NULL;
+    }
+    const record_t *record = (const record_t *)(data + offset);
+    if (record->length < sizeof(record_t) || record->length % 8 != 0 || record->length > limit - offset ||
+        sizeof(record_t) + record->username_len + record_message_len(record) > record->length)
+    {
+        return NULL;
+    }
+    if (crc32c(0, (const char *)record + sizeof(uint32_t), record->length - sizeof(uint32_t)) != record->crc)
+    {
+        return NULL;
+    }
+    return record;
+}
+
+// Position de départ d'une lecture : la dernière entrée de l'index qui précède le numéro cherché
+static size_t index_lookup(const index_entry_t *index, int count, uint64_t seq)
+{
+    int low = 0, high = count - 1;
+    size_t offset = 0;
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        if (index[middle].seq <= seq)
+        {
+            offset = index[middle].offset;
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return offset;
+}
+
+// Lit l'index d'un segment ; les entrées au-delà de limit (écriture interrompue) sont ignorées
+static int load_index(const char *path, size_t limit, index_entry_t **index)
+{
+    *index = NULL;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(index_entry_t))
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return 0;
+    }
+    int count = st.st_size / sizeof(index_entry_t);
+    *index = malloc(count * sizeof(index_entry_t));
+    if (*index == NULL || read(fd, *index, count * sizeof(index_entry_t)) != (ssize_t)(count * sizeof(index_entry_t)))
+    {
+        free(*index);
+        *index = NULL;
+        close(fd);
+        return 0;
+    }
+    close(fd);
+    while (count > 0 && (*index)[count - 1].offset >= limit)
+    {
+        count--;
+    }
+    return count;
+}
+
+static void add_index(log_channel_t *channel, uint64_t seq, size_t offset)
+{
+    index_entry_t entry = {seq, offset};
+    if (channel->index_count == channel->index_capacity)
+    {
+        int capacity = channel->index_capacity > 0 ? channel->index_capacity * 2 : 64;
+        index_entry_t *grown = realloc(channel->index, capacity * sizeof(index_entry_t));
+        if (grown == NULL)
+        {
+            return; // Les lectures partiront d'une entrée précédente
+        }
+        channel->index = grown;
+        channel->index_capacity = capacity;
+    }
+    channel->index[channel->index_count++] = entry;
+    channel->indexed = offset;
+    if (write(channel->index_fd, &entry, sizeof(entry)) != (ssize_t)sizeof(entry))
+    {
+        perror("Erreur lors de l'écriture de l'index du journal");
+    }
+}
+
+// Projette le dernier segment du salon ; un segment existant est relu jusqu'à son premier enregistrement invalide
+static int open_active(log_channel_t *channel)
+{
+    segment_t *segment = &channel->segments[channel->segment_count - 1];
+    char path[LOG_PATH_SIZE];
+    segment_path(path, sizeof(path), channel->name, segment->base_seq, ".seg");
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        perror("Erreur lors de l'ouverture d'un segment du journal");
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    if (st.st_size < MSGLOG_SEGMENT_SIZE && ftruncate(fd, MSGLOG_SEGMENT_SIZE) < 0)
+    {
+        perror("Erreur lors de l'agrandissement d'un segment du journal");
+        close(fd);
+        return -1;
+    }
+    char *data = mmap(NULL, MSGLOG_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        perror("Erreur lors de la projection d'un segment du journal");
+        close(fd);
+        return -1;
+    }
+
+    // Retrouver la fin du journal
+    size_t end = 0;
+    const record_t *record;
+    channel->last_seq = segment->base_seq > 0 ? segment->base_seq - 1 : 0;
+    while ((record = record_at(data, end, MSGLOG_SEGMENT_SIZE)) != NULL)
+    {
+        channel->last_seq = record->seq;
+        end += record->length;
+    }
+    // Reste d'une écriture interrompue : effacé, pour que d'anciens enregistrements ne réapparaissent pas après les nouveaux
+    if (end + sizeof(record_t) <= MSGLOG_SEGMENT_SIZE && ((const record_t *)(data + end))->length != 0)
+    {
+        memset(data + end, 0, MSGLOG_SEGMENT_SIZE - end);
+    }
+
+    char index_path[LOG_PATH_SIZE];
+    segment_path(index_path, sizeof(index_path), channel->name, segment->base_seq, ".idx");
+    channel->index_count = load_index(index_path, end, &channel->index);
+    channel->index_capacity = channel->index_count;
+    channel->index_fd = open(index_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (channel->index_fd >= 0 && ftruncate(channel->index_fd, channel->index_count * sizeof(index_entry_t)) < 0)
+    {
+        perror("Erreur lors de la réparation de l'index du journal");
+    }
+
+    channel->fd = fd;
+    channel->data = data;
+    channel->end = end;
+    channel->indexed = channel->index_count > 0 ? channel->index[channel->index_count - 1].offset : 0;
+    return 0;
+}
+
+static void close_active(log_channel_t *channel, bool sync)
+{
+    if (channel->fd < 0)
+    {
+        return;
+    }
+    munmap(channel->data, MSGLOG_SEGMENT_SIZE);
+    if (sync)
+    {
+        // Segment terminé : il garde la taille de ses enregistrements
+        if (ftruncate(channel->fd, channel->end) < 0)
+        {
+            perror("Erreur lors de la fermeture d'un segment du journal");
+        }
+        push_closing(channel->fd);
+        push_closing(channel->index_fd);
+    }
+    else
+    {
+        close(channel->fd);
+        if (channel->index_fd >= 0)
+        {
+            close(channel->index_fd);
+        }
+    }
+    free(channel->index);
+    channel->index = NULL;
+    channel->index_count = channel->index_capacity = 0;
+    channel->fd = channel->index_fd = -1;
+    channel->data = NULL;
+}
+
+static int is_segment(const struct dirent *entry)
+{
+    return strlen(entry->d_name) == SEGMENT_NAME_LEN && strcmp(entry->d_name + SEGMENT_NAME_LEN - 4, ".seg") == 0;
+}
+
+static log_channel_t *lookup(const char *name)
+{
+    for (log_channel_t *channel = channel_table[hash_string(name) % MSGLOG_BUCKETS]; channel != NULL; channel = channel->next)
+    {
+        if (strcmp(channel->name, name) == 0)
+        {
+            return channel;
+        }
+    }
+    return NULL;
+}
+
+// Salon ouvert, chargé depuis ses fichiers à la première utilisation
+static log_channel_t *find_channel(const char *name)
+{
+    log_channel_t *channel = lookup(name);
+    if (channel != NULL)
+    {
+        return channel;
+    }
+    channel = calloc(1, sizeof(log_channel_t));
+    if (channel == NULL)
+    {
+        return NULL;
+    }
+    snprintf(channel->name, sizeof(channel->name), "%s", name);
+    channel->fd = channel->index_fd = -1;
+
+    char path[LOG_PATH_SIZE];
+    snprintf(path, sizeof(path), MSGLOG_DIR "/%s", name);
+    struct dirent **list;
+    int count = scandir(path, &list, is_segment, alphasort); // Numéros de même longueur : ordre croissant
+    if (count > 0)
+    {
+        channel->segments = malloc(count * sizeof(segment_t));
+        for (int i = 0; i < count && channel->segments != NULL; i++)
+        {
+            struct stat st;
+            segment_t *segment = &channel->segments[channel->segment_count++];
+            segment->base_seq = strtoull(list[i]->d_name, NULL, 10);
+            snprintf(path, sizeof(path), MSGLOG_DIR "/%s/%s", name, list[i]->d_name);
+            segment->modified = stat(path, &st) == 0 ? st.st_mtime : time(NULL);
+        }
+        channel->segment_capacity = channel->segment_count;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        free(list[i]);
+    }
+    if (count >= 0)
+    {
+        free(list);
+    }
+    if (channel->segment_count > 0 && open_active(channel) < 0)
+    {
+        free(channel->segments);
+        free(channel);
+        return NULL;
+    }
+
+    unsigned int index = hash_string(name) % MSGLOG_BUCKETS;
+    channel->next = channel_table[index];
+    channel_table[index] = channel;
+    open_channels++;
+    return channel;
+}
+
+// Termine le segment actif et en commence un nouveau à partir de base_seq
+static int rotate(log_channel_t *channel, uint64_t base_seq)
+{
+    char path[LOG_PATH_SIZE];
+    if (channel->fd < 0)
+    {
+        snprintf(path, sizeof(path), MSGLOG_DIR "/%s", channel->name);
+        if (mkdir(path, 0700) < 0 && errno != EEXIST)
+        {
+            perror("Erreur lors de la création du journal d'un salon");
+            return -1;
+        }
+    }
+    if (channel->segment_count == channel->segment_capacity)
+    {
+        int capacity = channel->segment_capacity > 0 ? channel->segment_capacity * 2 : 8;
+        segment_t *grown = realloc(channel->segments, capacity * sizeof(segment_t));
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        channel->segments = grown;
+        channel->segment_capacity = capacity;
+    }
+    close_active(channel, true);
+
+    segment_t *segment = &channel->segments[channel->segment_count++];
+    segment->base_seq = base_seq;
+    segment->modified = time(NULL);
+    if (open_active(channel) < 0)
+    {
+        channel->segment_count--;
+        return -1;
+    }
+    segments_created++;
+
+    // Le nouveau fichier doit aussi survivre à une panne : synchroniser le dossier
+    snprintf(path, sizeof(path), MSGLOG_DIR "/%s", channel->name);
+    push_closing(open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    return 0;
+}
+
+static int append(log_channel_t *channel, const storage_message_t *message)
+{
+    size_t username_len = strnlen(message->username, sizeof(message->username));
+    const char *text = message->text != NULL ? message->text : message->message;
+    size_t message_len = message->text != NULL ? strlen(message->text) : strnlen(message->message, sizeof(message->message));
+    size_t length = (sizeof(record_t) + username_len + message_len + 7) & ~(size_t)7;
+    if ((channel->fd < 0 || channel->end + length > MSGLOG_SEGMENT_SIZE) && rotate(channel, message->seq) < 0)
+    {
+        return -1;
+    }
+
+    // Une copie dans la projection : le noyau écrira la page, la synchronisation la rendra durable
+    record_t *record = (record_t *)(channel->data + channel->end);
+    char *payload = (char *)(record + 1);
+    memcpy(payload, message->username, username_len);
+    memcpy(payload + username_len, text, message_len);
+    memset(payload + username_len + message_len, 0, length - sizeof(record_t) - username_len - message_len);
+    record->length = length;
+    record->seq = message->seq;
+    record->timestamp = message->timestamp;
+    record->username_len = username_len;
+    record->message_len = (uint16_t)message_len;
+    record->message_len_high = (uint32_t)(message_len >> 16);
+    record->crc = crc32c(0, (const char *)record + sizeof(uint32_t), length - sizeof(uint32_t));
+
+    if (channel->end == 0 || channel->end - channel->indexed >= MSGLOG_INDEX_INTERVAL)
+    {
+        add_index(channel, message->seq, channel->end);
+    }
+    channel->end += length;
+    channel->last_seq = message->seq;
+    channel->segments[channel->segment_count - 1].modified = message->timestamp;
+
+    if (!channel->dirty)
+    {
+        channel->dirty = true;
+        channel->next_dirty = dirty_channels;
+        dirty_channels = channel;
+    }
+    records_written++;
+    records_unsynced++;
+    bytes_written += length;
+    return 0;
+}
+
+static void free_channel(log_channel_t *channel)
+{
+    log_channel_t **link = &channel_table[hash_string(channel->name) % MSGLOG_BUCKETS];
+    while (*link != NULL && *link != channel)
+    {
+        link = &(*link)->next;
+    }
+    if (*link != NULL)
+    {
+        *link = channel->next;
+    }
+    if (channel->dirty)
+    {
+        link = &dirty_channels;
+        while (*link != NULL && *link != channel)
+        {
+            link = &(*link)->next_dirty;
+        }
+        if (*link != NULL)
+        {
+            *link = channel->next_dirty;
+        }
+    }
+    close_active(channel, false); // Ses fichiers vont disparaître
+    free(channel->segments);
+    free(channel);
+    open_channels--;
+}
+
+// Écarte le dossier d'un salon ; le thread de synchronisation le supprime
+static void discard_directory(const char *name)
+{
+    char from[LOG_PATH_SIZE], to[LOG_PATH_SIZE];
+    snprintf(from, sizeof(from), MSGLOG_DIR "/%s", name);
+    snprintf(to, sizeof(to), MSGLOG_DIR "/" DELETED_PREFIX "%s-%ld-%lu", name, (long)time(NULL), deleted_counter++);
+    if (rename(from, to) < 0 && errno != ENOENT)
+    {
+        perror("Erreur lors de la suppression du journal d'un salon");
+    }
+}
+
+static void remove_directory(const char *path)
+{
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    char file[LOG_PATH_SIZE * 2];
+    while (dir != NULL && (entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+        {
+            snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+            unlink(file);
+        }
+    }
+    if (dir != NULL)
+    {
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+// Synchronise en une fois tout ce qui a été écrit depuis la dernière passe (group commit)
+static void sync_pass(void)
+{
+    pthread_mutex_lock(&log_lock);
+    int count = closing_count;
+    for (log_channel_t *channel = dirty_channels; channel != NULL; channel = channel->next_dirty)
+    {
+        count++;
+    }
+    int *fds = count > 0 ? malloc(count * sizeof(int)) : NULL;
+    if (fds == NULL)
+    {
+        pthread_mutex_unlock(&log_lock);
+        return;
+    }
+    int n = 0;
+    for (int i = 0; i < closing_count; i++)
+    {
+        fds[n++] = closing_fds[i];
+    }
+    closing_count = 0;
+    for (log_channel_t *channel = dirty_channels; channel != NULL; channel = channel->next_dirty)
+    {
+        // Un double du descripteur : le salon peut changer de segment pendant la synchronisation
+        int fd = dup(channel->fd);
+        if (fd >= 0)
+        {
+            fds[n++] = fd;
+        }
+        channel->dirty = false;
+    }
+    dirty_channels = NULL;
+    unsigned long records = records_unsynced;
+    records_unsynced = 0;
+    pthread_mutex_unlock(&log_lock);
+
+    for (int i = 0; i < n; i++)
+    {
+        fdatasync(fds[i]);
+        close(fds[i]);
+    }
+    free(fds);
+
+    pthread_mutex_lock(&log_lock);
+    syncs++;
+    records_synced += records;
+    pthread_mutex_unlock(&log_lock);
+}
+
+// Supprime les segments dont tous les messages sont au-delà de la rétention ; le segment actif reste
+static void compact_channel(log_channel_t *channel, int max_age_days, long max_count, time_t now)
+{
+    int dropped = 0;
+    while (dropped < channel->segment_count - 1)
+    {
+        segment_t *segment = &channel->segments[dropped];
+        uint64_t segment_last = channel->segments[dropped + 1].base_seq - 1;
+        bool expired = (global_retention_days > 0 && segment->modified < now - global_retention_days * DAY_SECONDS) ||
+                       (max_age_days > 0 && segment->modified < now - max_age_days * DAY_SECONDS);
+        bool excess = max_count > 0 && channel->last_seq > (uint64_t)max_count && segment_last <= channel->last_seq - max_count;
+        if (!expired && !excess)
+        {
+            break;
+        }
+        char path[LOG_PATH_SIZE];
+        segment_path(path, sizeof(path), channel->name, segment->base_seq, ".seg");
+        unlink(path);
+        segment_path(path, sizeof(path), channel->name, segment->base_seq, ".idx");
+        unlink(path);
+        dropped++;
+    }
+    if (dropped > 0)
+    {
+        memmove(channel->segments, channel->segments + dropped, (channel->segment_count - dropped) * sizeof(segment_t));
+        channel->segment_count -= dropped;
+        segments_dropped += dropped;
+    }
+}
+
+static void compact_pass(void)
+{
+    time_t now = time(NULL);
+    storage_retention_t *rules;
+    int rule_count = storage_load_retention(&rules);
+
+    DIR *dir = opendir(MSGLOG_DIR);
+    struct dirent *entry;
+    while (dir != NULL && (entry = readdir(dir)) != NULL)
+    {
+        char path[LOG_PATH_SIZE];
+        if (strncmp(entry->d_name, DELETED_PREFIX, strlen(DELETED_PREFIX)) == 0)
+        {
+            snprintf(path, sizeof(path), MSGLOG_DIR "/%s", entry->d_name);
+            remove_directory(path); // Journal d'un salon supprimé
+            continue;
+        }
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        int max_age_days = 0;
+        long max_count = 0;
+        for (int r = 0; r < rule_count; r++)
+        {
+            if (strcmp(rules[r].channel, entry->d_name) == 0)
+            {
+                max_age_days = rules[r].max_age_days;
+                max_count = rules[r].max_count;
+            }
+        }
+        if (global_retention_days == 0 && max_age_days == 0 && max_count == 0)
+        {
+            continue;
+        }
+        pthread_mutex_lock(&log_lock);
+        log_channel_t *channel = find_channel(entry->d_name);
+        if (channel != NULL)
+        {
+            compact_channel(channel, max_age_days, max_count, now);
+        }
+        pthread_mutex_unlock(&log_lock);
+    }
+    if (dir != NULL)
+    {
+        closedir(dir);
+    }
+    free(rules);
+}
+
+static void *sync_thread(void *arg)
+{
+    (void)arg;
+    struct timespec next_compact;
+    clock_gettime(CLOCK_MONOTONIC, &next_compact);
+    pthread_mutex_lock(&log_lock);
+    while (1)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += MSGLOG_SYNC_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (!compact_requested)
+        {
+            pthread_cond_timedwait(&log_wakeup, &log_lock, &deadline);
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        bool compact = compact_requested || now.tv_sec >= next_compact.tv_sec;
+        compact_requested = false;
+        pthread_mutex_unlock(&log_lock);
+
+        sync_pass();
+        if (compact)
+        {
+            compact_pass();
+            next_compact.tv_sec = now.tv_sec + MSGLOG_COMPACT_INTERVAL_MS / 1000;
+        }
+
+        pthread_mutex_lock(&log_lock);
+    }
+    return NULL;
+}
+
+int msglog_init(int retention_days)
+{
+    global_retention_days = retention_days;
+    if (mkdir(MSGLOG_DIR, 0700) < 0 && errno != EEXIST)
+    {
+        perror("Erreur lors de la création du dossier " MSGLOG_DIR);
+        return -1;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, sync_thread, NULL) != 0)
+    {
+        fprintf(stderr, "Erreur lors du démarrage de la synchronisation du journal.\n");
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+int msglog_write(const storage_message_t *messages, int count)
+{
+    int status = 0;
+    pthread_mutex_lock(&log_lock);
+    for (int i = 0; i < count; i++)
+    {
+        log_channel_t *channel = find_channel(messages[i].channel);
+        if (channel == NULL || append(channel, &messages[i]) < 0)
+        {
+            status = -1;
+        }
+    }
+    pthread_mutex_unlock(&log_lock);
+    return status;
+}
+
+uint64_t msglog_last_seq(const char *channel_name)
+{
+    pthread_mutex_lock(&log_lock);
+    log_channel_t *channel = find_channel(channel_name);
+    uint64_t seq = channel != NULL ? channel->last_seq : 0;
+    pthread_mutex_unlock(&log_lock);
+    return seq;
+}
+
+// Fonction appelée pour chaque enregistrement lu ; false arrête la lecture
+typedef bool (*record_visit_fn)(void *context, const record_t *record);
+
+// Parcourt les enregistrements d'un salon à partir du segment de after + 1. Sous le verrou, seulement un
+// instantané : les segments à lire et la fin du segment actif ; les segments sont ensuite projetés et lus
+// sans le verrou, pour que les lectures longues ne retardent pas l'écriture des lots. Les enregistrements
+// jusqu'à la fin de l'instantané sont complets ; un segment supprimé entre-temps par la rétention est sauté.
+static int scan_channel(const char *channel_name, uint64_t after, record_visit_fn visit, void *context)
+{
+    pthread_mutex_lock(&log_lock);
+    log_channel_t *channel = find_channel(channel_name);
+    if (channel == NULL || channel->segment_count <= 0)
+    {
+        pthread_mutex_unlock(&log_lock);
+        return 0;
+    }
+    reads++;
+
+    // Segment du premier message manqué : le dernier qui commence avant lui
+    int first = 0;
+    for (int low = 0, high = channel->segment_count - 1; low <= high;)
+    {
+        int middle = (low + high) / 2;
+        if (channel->segments[middle].base_seq <= after + 1)
+        {
+            first = middle;
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    size_t count = channel->segment_count - first;
+    uint64_t *bases = malloc(count * sizeof(uint64_t));
+    if (bases == NULL)
+    {
+        pthread_mutex_unlock(&log_lock);
+        return 0;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        bases[i] = channel->segments[first + i].base_seq;
+    }
+    size_t active_end = channel->end;
+    char name[sizeof(channel->name)];
+    memcpy(name, channel->name, sizeof(name));
+    pthread_mutex_unlock(&log_lock);
+
+    int visited = 0;
+    bool more = true;
+    for (size_t i = 0; i < count && more; i++)
+    {
+        char path[LOG_PATH_SIZE];
+        struct stat st;
+        char *mapped;
+        segment_path(path, sizeof(path), name, bases[i], ".seg");
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0 ||
+            (mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            continue;
+        }
+        close(fd);
+
+        // Le segment actif est lu jusqu'à la fin de l'instantané ; les autres ont la taille de leurs enregistrements
+        size_t limit = (size_t)st.st_size;
+        if (i == count - 1 && active_end < limit)
+        {
+            limit = active_end;
+        }
+        index_entry_t *index;
+        segment_path(path, sizeof(path), name, bases[i], ".idx");
+        int index_count = load_index(path, limit, &index);
+
+        const record_t *record;
+        for (size_t offset = index_lookup(index, index_count, after + 1); more && (record = record_at(mapped, offset, limit)) != NULL; offset += record->length)
+        {
+            if (record->seq > after)
+            {
+                more = visit(context, record);
+                visited++;
+            }
+        }
+        munmap(mapped, st.st_size);
+        free(index);
+    }
+    free(bases);
+    return visited;
+}
+
+typedef struct
+{
+    history_emit_fn emit;
+    void *context;
+} replay_t;
+
+static bool replay_record(void *context, const record_t *record)
+{
+    replay_t *replay = context;
+    replay->emit(replay->context, record->seq, (const char *)(record + 1) + record->username_len, record_message_len(record));
+    return true;
+}
+
+int msglog_replay(const char *channel_name, uint64_t after, history_emit_fn emit, void *context)
+{
+    replay_t replay = {emit, context};
+    return scan_channel(channel_name, after, replay_record, &replay);
+}
+
+// Recherche : les max derniers messages qui contiennent le motif, dans un tampon circulaire
+typedef struct
+{
+    const char *pattern;
+    size_t pattern_len;
+    int max;
+    int count;    // Messages trouvés en tout
+    uint64_t *seqs;
+    char **messages;
+    size_t *lens;
+} search_t;
+
+// Le texte contient-il le motif, sans tenir compte de la casse des lettres ASCII ?
+static bool contains_nocase(const char *text, size_t len, const char *pattern, size_t pattern_len)
+{
+    for (size_t i = 0; i + pattern_len <= len; i++)
+    {
+        size_t j = 0;
+        while (j < pattern_len && tolower((unsigned char)text[i + j]) == tolower((unsigned char)pattern[j]))
+        {
+            j++;
+        }
+        if (j == pattern_len)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool search_record(void *context, const record_t *record)
+{
+    search_t *search = context;
+    const char *message = (const char *)(record + 1) + record->username_len;
+    size_t len = record_message_len(record);
+    if (!contains_nocase(message, len, search->pattern, search->pattern_len))
+    {
+        return true;
+    }
+
+    // Le plus ancien des messages gardés laisse sa place
+    int slot = search->count % search->max;
+    char *copy = realloc(search->messages[slot], len);
+    if (copy != NULL)
+    {
+        memcpy(copy, message, len);
+        search->messages[slot] = copy;
+        search->lens[slot] = len;
+        search->seqs[slot] = record->seq;
+        search->count++;
+    }
+    return true;
+}
+
+int msglog_search(const char *channel_name, const char *pattern, int max, history_emit_fn emit, void *context)
+{
+    search_t search = {pattern, strlen(pattern), max, 0, calloc(max, sizeof(uint64_t)), calloc(max, sizeof(char *)),
+                       calloc(max, sizeof(size_t))};
+    int sent = 0;
+    if (max > 0 && search.seqs != NULL && search.messages != NULL && search.lens != NULL)
+    {
+        // Le journal ne se lit que dans l'ordre : tout le salon est parcouru, hors du verrou
+        scan_channel(channel_name, 0, search_record, &search);
+        for (int i = search.count - 1; i >= 0 && i >= search.count - max; i--, sent++)
+        {
+            int slot = i % max;
+            emit(context, search.seqs[slot], search.messages[slot], search.lens[slot]);
+        }
+    }
+    for (int i = 0; search.messages != NULL && i < max; i++)
+    {
+        free(search.messages[i]);
+    }
+    free(search.seqs);
+    free(search.messages);
+    free(search.lens);
+    return sent;
+}
+
+void msglog_apply_retention(void)
+{
+    pthread_mutex_lock(&log_lock);
+    compact_requested = true;
+    pthread_cond_signal(&log_wakeup);
+    pthread_mutex_unlock(&log_lock);
+}
+
+void msglog_forget_channel(const char *channel_name)
+{
+    pthread_mutex_lock(&log_lock);
+    log_channel_t *channel = lookup(channel_name);
+    if (channel != NULL)
+    {
+        free_channel(channel);
+    }
+    discard_directory(channel_name); // Un salon du même nom repartira d'un journal vide
+    compact_requested = true;
+    pthread_cond_signal(&log_wakeup);
+    pthread_mutex_unlock(&log_lock);
+}
+
+void msglog_clear(void)
+{
+    pthread_mutex_lock(&log_lock);
+    for (int i = 0; i < MSGLOG_BUCKETS; i++)
+    {
+        while (channel_table[i] != NULL)
+        {
+            free_channel(channel_table[i]);
+        }
+    }
+    DIR *dir = opendir(MSGLOG_DIR);
+    struct dirent *entry;
+    while (dir != NULL && (entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] != '.')
+        {
+            discard_directory(entry->d_name);
+        }
+    }
+    if (dir != NULL)
+    {
+        closedir(dir);
+    }
+    compact_requested = true;
+    pthread_cond_signal(&log_wakeup);
+    pthread_mutex_unlock(&log_lock);
+}
+
+void msglog_sync(void)
+{
+    sync_pass();
+}
+
+void msglog_format_stats(char *buffer, size_t size)
+{
+    pthread_mutex_lock(&log_lock);
+    snprintf(buffer, size,
+             "Journal des messages : %d salons ouverts, %lu messages écrits (%lu Ko), %lu synchronisations (%.1f messages par synchronisation), "
+             "%lu segments créés, %lu supprimés, %lu lectures\n",
+             open_channels, records_written, bytes_written / 1024, syncs, syncs > 0 ? (double)records_synced / syncs : 0.0,
+             segments_created, segments_dropped, reads);
+    pthread_mutex_unlock(&log_lock);
+}
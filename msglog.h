@@ -0,0 +1,122 @@
+/**
+ * @file msglog.h
+ * @brief Log storage engine: append-only log of memory-mapped segments per channel.
+ *
+ * The messages of a channel are appended to `log/<channel>/`, in segment
+ * files of MSGLOG_SEGMENT_SIZE bytes named after the sequence number of
+ * their first message. The segment being written is mapped in memory:
+ * appending a message is a copy into the mapping, without any system call.
+ * Each record carries a CRC-32C, so the end of the log is found again after
+ * a crash by reading the last segment up to its first invalid record.
+ *
+ * Each segment has an offset index (`.idx`), with one entry every
+ * MSGLOG_INDEX_INTERVAL bytes: a history read looks for the segment of the
+ * first missed message, then for the closest entry before it, and reads
+ * forward from there, whatever the size of the log.
+ *
+ * A background thread syncs the segments written to disk every
+ * MSGLOG_SYNC_MS milliseconds, for all the batches written in the meantime
+ * at once (group commit); a message can therefore be lost on a crash up to
+ * MSGLOG_SYNC_MS after being written, as with the batches of the server.
+ * The same thread applies the retention, segment by segment: a segment
+ * whose messages are all beyond the retention is removed, the segment being
+ * written is always kept. The log of a deleted channel is removed in the
+ * background too.
+ */
+
+#ifndef MSGLOG_H
+#define MSGLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "storage.h"
+
+#define MSGLOG_DIR "log"                           /**< Directory of the logs */
+#define MSGLOG_SEGMENT_SIZE (4 * 1024 * 1024)      /**< Size of a segment */
+#define MSGLOG_INDEX_INTERVAL 4096                 /**< Bytes of records between two entries of the index */
+#define MSGLOG_SYNC_MS 50                          /**< Interval of the group commit */
+#define MSGLOG_COMPACT_INTERVAL_MS 60000           /**< Delay between two retention passes */
+#define MSGLOG_BUCKETS 256                         /**< Size of the hash table of the open channels */
+
+/**
+ * @brief Opens the log and starts the sync thread.
+ *
+ * @param[in] retention_days Age in days after which a segment is removed, 0 to keep the messages forever.
+ * @return 0 on success, -1 on error.
+ */
+int msglog_init(int retention_days);
+
+/**
+ * @brief Appends a batch of messages to the logs of their channels.
+ *
+ * @param[in] messages The messages.
+ * @param[in] count The number of messages.
+ * @return 0 on success, -1 on error.
+ */
+int msglog_write(const storage_message_t *messages, int count);
+
+/**
+ * @brief Returns the last sequence number of a channel in its log.
+ *
+ * @param[in] channel The channel.
+ * @return The number of its last message, 0 if it has none.
+ */
+uint64_t msglog_last_seq(const char *channel);
+
+/**
+ * @brief Sends the messages of a channel that follow a sequence number, in order.
+ *
+ * @param[in] channel The channel.
+ * @param[in] after The last number seen by the client.
+ * @param[in] emit The function receiving each message.
+ * @param[in] context The argument given to emit.
+ * @return The number of messages sent.
+ */
+int msglog_replay(const char *channel, uint64_t after, history_emit_fn emit, void *context);
+
+/**
+ * @brief Sends the most recent messages of a channel that contain a text, from the most recent.
+ *
+ * The text is searched without regard to the case of ASCII letters, in the
+ * message with its "username: " prefix.
+ *
+ * @param[in] channel The channel.
+ * @param[in] pattern The text searched.
+ * @param[in] max The largest number of messages sent.
+ * @param[in] emit The function receiving each message.
+ * @param[in] context The argument given to emit.
+ * @return The number of messages sent.
+ */
+int msglog_search(const char *channel, const char *pattern, int max, history_emit_fn emit, void *context);
+
+/**
+ * @brief Starts a retention pass without waiting for the next one (a retention changed).
+ */
+void msglog_apply_retention(void);
+
+/**
+ * @brief Closes the log of a deleted channel; its files are removed in the background.
+ *
+ * @param[in] channel The channel.
+ */
+void msglog_forget_channel(const char *channel);
+
+/**
+ * @brief Removes the logs of all the channels.
+ */
+void msglog_clear(void);
+
+/**
+ * @brief Syncs the segments written to disk now, and waits for it.
+ */
+void msglog_sync(void);
+
+/**
+ * @brief Writes the statistics of the log.
+ *
+ * @param[out] buffer The buffer receiving the text (one line).
+ * @param[in] size The size of the buffer.
+ */
+void msglog_format_stats(char *buffer, size_t size);
+
+#endif
@@ -0,0 +1,291 @@
+#include "outqueue.h"
+#include "slab.h"
+#include "transport.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Blocs mémoire de taille standard et segments de fichier, partagés par toutes les files
+static slab_t chunk_slab;
+static slab_t segment_slab;
+
+static void init_slabs(void)
+{
+    if (chunk_slab.objects_per_block == 0)
+    {
+        slab_init(&chunk_slab, "blocs d'envoi", sizeof(out_chunk_t) + OUTQUEUE_CHUNK_SIZE, OUTQUEUE_SLAB_CHUNKS);
+        slab_init(&segment_slab, "segments de fichier", sizeof(out_chunk_t), OUTQUEUE_SLAB_CHUNKS);
+    }
+}
+
+void outqueue_init(outqueue_t *queue)
+{
+    init_slabs();
+    queue->head = NULL;
+    queue->tail = NULL;
+    queue->buffered = 0;
+}
+
+static void append_chunk(outqueue_t *queue, out_chunk_t *chunk)
+{
+    chunk->next = NULL;
+    if (queue->tail != NULL)
+    {
+        queue->tail->next = chunk;
+    }
+    else
+    {
+        queue->head = chunk;
+    }
+    queue->tail = chunk;
+}
+
+static void free_head(outqueue_t *queue)
+{
+    out_chunk_t *chunk = queue->head;
+    queue->head = chunk->next;
+    if (queue->head == NULL)
+    {
+        queue->tail = NULL;
+    }
+    if (chunk->file_fd >= 0)
+    {
+        if (chunk->release != NULL)
+        {
+            chunk->release(chunk->ref); // Fichier partagé : il reste ouvert pour les autres
+        }
+        else
+        {
+            close(chunk->file_fd);
+        }
+        slab_free(&segment_slab, chunk);
+    }
+    else if (chunk->release != NULL)
+    {
+        chunk->release(chunk->ref); // Octets partagés avec les autres files
+        slab_free(&segment_slab, chunk);
+    }
+    else if (chunk->capacity == OUTQUEUE_CHUNK_SIZE)
+    {
+        slab_free(&chunk_slab, chunk);
+    }
+    else
+    {
+        free(chunk); // Message plus grand qu'un bloc standard
+    }
+}
+
+int outqueue_push(outqueue_t *queue, const void *data, size_t len)
+{
+    out_chunk_t *tail = queue->tail;
+
+    // Compléter le dernier bloc mémoire s'il reste de la place
+    if (tail != NULL && tail->file_fd < 0 && tail->release == NULL && tail->capacity - tail->end >= len)
+    {
+        memcpy(tail->data + tail->end, data, len);
+        tail->end += len;
+        queue->buffered += len;
+        return 0;
+    }
+
+    size_t capacity = len > OUTQUEUE_CHUNK_SIZE ? len : OUTQUEUE_CHUNK_SIZE;
+    out_chunk_t *chunk = capacity == OUTQUEUE_CHUNK_SIZE ? slab_alloc(&chunk_slab) : malloc(sizeof(out_chunk_t) + capacity);
+    if (chunk == NULL)
+    {
+        return -1;
+    }
+    chunk->file_fd = -1;
+    chunk->mapped = NULL;
+    chunk->release = NULL;
+    chunk->start = 0;
+    chunk->end = len;
+    chunk->capacity = capacity;
+    memcpy(chunk->data, data, len);
+    append_chunk(queue, chunk);
+    queue->buffered += len;
+    return 0;
+}
+
+int outqueue_push_file(outqueue_t *queue, int file_fd, off_t offset, size_t len)
+{
+    out_chunk_t *chunk = slab_alloc(&segment_slab);
+    if (chunk == NULL)
+    {
+        close(file_fd);
+        return -1;
+    }
+    chunk->file_fd = file_fd;
+    chunk->mapped = NULL;
+    chunk->release = NULL;
+    chunk->start = offset;
+    chunk->end = offset + len;
+    chunk->capacity = 0;
+    append_chunk(queue, chunk);
+    return 0;
+}
+
+int outqueue_push_shared(outqueue_t *queue, int file_fd, const char *mapped, off_t offset, size_t len,
+                         void (*release)(void *ref), void *ref)
+{
+    out_chunk_t *chunk = slab_alloc(&segment_slab);
+    if (chunk == NULL)
+    {
+        release(ref);
+        return -1;
+    }
+    chunk->file_fd = file_fd;
+    chunk->mapped = mapped;
+    chunk->release = release;
+    chunk->ref = ref;
+    chunk->start = offset;
+    chunk->end = offset + len;
+    chunk->capacity = 0;
+    append_chunk(queue, chunk);
+    return 0;
+}
+
+int outqueue_push_ref(outqueue_t *queue, const void *data, size_t len, void (*release)(void *ref), void *ref)
+{
+    out_chunk_t *chunk = slab_alloc(&segment_slab);
+    if (chunk == NULL)
+    {
+        release(ref);
+        return -1;
+    }
+    chunk->file_fd = -1;
+    chunk->mapped = data;
+    chunk->release = release;
+    chunk->ref = ref;
+    chunk->start = 0;
+    chunk->end = len;
+    chunk->capacity = 0;
+    append_chunk(queue, chunk);
+    queue->buffered += len;
+    return 0;
+}
+
+// Écrit d'un coup les éléments en mémoire en tête de file (blocs et références)
+static ssize_t flush_memory(outqueue_t *queue, int socket)
+{
+    struct iovec iov[OUTQUEUE_IOV_MAX];
+    int count = 0;
+    for (out_chunk_t *chunk = queue->head; chunk != NULL && chunk->file_fd < 0 && count < OUTQUEUE_IOV_MAX; chunk = chunk->next)
+    {
+        if (chunk->end > chunk->start)
+        {
+            const char *bytes = chunk->release != NULL ? chunk->mapped : chunk->data;
+            iov[count].iov_base = (void *)(bytes + chunk->start);
+            iov[count++].iov_len = chunk->end - chunk->start;
+        }
+    }
+    ssize_t written = count > 0 ? transport_sendv(socket, iov, count) : 0;
+    if (written < 0)
+    {
+        return -1;
+    }
+
+    // Avancer dans les éléments écrits, et libérer ceux qui sont terminés (une écriture partielle
+    // s'arrête au milieu d'un élément : l'appel suivant dira si le socket est plein)
+    size_t left = written;
+    queue->buffered -= written;
+    while (queue->head != NULL && queue->head->file_fd < 0)
+    {
+        out_chunk_t *chunk = queue->head;
+        size_t len = chunk->end - chunk->start;
+        if (left < len)
+        {
+            chunk->start += left;
+            break;
+        }
+        left -= len;
+        free_head(queue);
+    }
+    return written;
+}
+
+ssize_t outqueue_flush(outqueue_t *queue, int socket)
+{
+    ssize_t total = 0;
+
+    while (queue->head != NULL)
+    {
+        out_chunk_t *chunk = queue->head;
+        size_t len = chunk->end - chunk->start;
+        ssize_t written = 0;
+
+        // Messages en mémoire : écrits ensemble, en un seul appel système
+        if (chunk->file_fd < 0)
+        {
+            written = flush_memory(queue, socket);
+            if (written < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    break; // Le socket est plein : on reprendra sur POLLOUT
+                }
+                return -1;
+            }
+            total += written;
+            continue;
+        }
+
+        if (len > 0)
+        {
+            if (chunk->mapped != NULL && transport_copies_files(socket))
+            {
+                written = transport_send(socket, chunk->mapped + chunk->start, len); // Chiffré depuis la projection, sans relire le fichier
+            }
+            else
+            {
+                written = transport_sendfile(socket, chunk->file_fd, chunk->start, len);
+            }
+
+            if (written < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    break; // Le socket est plein : on reprendra sur POLLOUT
+                }
+                return -1;
+            }
+        }
+
+        chunk->start += written;
+        total += written;
+
+        if (chunk->start < chunk->end)
+        {
+            continue; // Écriture partielle : l'appel suivant dira si le socket est plein
+        }
+        free_head(queue);
+    }
+
+    return total;
+}
+
+bool outqueue_empty(const outqueue_t *queue)
+{
+    return queue->head == NULL;
+}
+
+void outqueue_clear(outqueue_t *queue)
+{
+    while (queue->head != NULL)
+    {
+        free_head(queue);
+    }
+    queue->buffered = 0;
+}
+
+void outqueue_format_stats(char *buffer, size_t size)
+{
+    init_slabs();
+    slab_format_stats(&chunk_slab, buffer, size);
+    size_t len = strlen(buffer);
+    snprintf(buffer + len, size - len, ", ");
+    len = strlen(buffer);
+    slab_format_stats(&segment_slab, buffer + len, size - len);
+}
@@ -0,0 +1,155 @@
+/**
+ * @file outqueue.h
+ * @brief Queue of pending writes of a non-blocking connection.
+ *
+ * Every message for a client is appended to its queue and written when the
+ * socket is writable, so a slow or dead peer never blocks the event loop.
+ * A queue holds memory chunks and file segments in order: a file download is
+ * queued like a message and sent with transport_sendfile(), and messages
+ * queued after it are only sent once the file is complete. A file shared
+ * by several downloads (see filecache.h) is queued with its mapping: on a
+ * TLS connection without kTLS, its bytes are encrypted straight from the
+ * mapping instead of being read again for each client.
+ *
+ * Chunks of OUTQUEUE_CHUNK_SIZE bytes and file segments come from slab
+ * allocators shared by all the queues (see slab.h); only the messages larger
+ * than a chunk are allocated on their own. A long message sent to several
+ * clients is queued by reference instead (outqueue_push_ref()), so its bytes
+ * are not copied for each of them. The consecutive memory elements of a
+ * queue are written together with a single gather write (transport_sendv()).
+ */
+
+#ifndef OUTQUEUE_H
+#define OUTQUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define OUTQUEUE_CHUNK_SIZE 4096 /**< Minimum capacity of a memory chunk, small messages are packed together */
+#define OUTQUEUE_SLAB_CHUNKS 16  /**< Chunks allocated at once by the slab allocator of the queues */
+#define OUTQUEUE_IOV_MAX 16      /**< Memory elements written by one gather write */
+
+/**
+ * @brief Structure representing an element of the queue.
+ */
+typedef struct out_chunk
+{
+    struct out_chunk *next;  /**< Next element of the queue */
+    int file_fd;             /**< File to send, or -1 for memory */
+    const char *mapped;      /**< Mapping of the whole shared file, or the bytes of a reference, or NULL */
+    void (*release)(void *ref); /**< Releases a shared file or the bytes of a reference, or NULL */
+    void *ref;               /**< Argument of release */
+    off_t start;             /**< Offset of the first byte not sent yet */
+    off_t end;               /**< Offset after the last byte to send */
+    size_t capacity;         /**< Size of data (memory chunks only) */
+    char data[];             /**< Bytes to send (memory chunks only) */
+} out_chunk_t;
+
+/**
+ * @brief Structure representing the queue of a connection.
+ */
+typedef struct
+{
+    out_chunk_t *head;  /**< Element being sent */
+    out_chunk_t *tail;  /**< Last element, extended by the next message */
+    size_t buffered;    /**< Bytes of memory chunks waiting to be sent */
+} outqueue_t;
+
+/**
+ * @brief Initializes an empty queue.
+ *
+ * @param[out] queue The queue to initialize.
+ */
+void outqueue_init(outqueue_t *queue);
+
+/**
+ * @brief Appends bytes to a queue.
+ *
+ * @param[in,out] queue The queue.
+ * @param[in] data The bytes to send.
+ * @param[in] len The number of bytes.
+ * @return 0 on success, -1 if the allocation failed.
+ */
+int outqueue_push(outqueue_t *queue, const void *data, size_t len);
+
+/**
+ * @brief Appends a segment of a file to a queue.
+ *
+ * The queue takes ownership of the descriptor and closes it once the segment
+ * is sent or the queue is cleared.
+ *
+ * @param[in,out] queue The queue.
+ * @param[in] file_fd The file to send.
+ * @param[in] offset The offset of the first byte to send.
+ * @param[in] len The number of bytes to send.
+ * @return 0 on success, -1 if the allocation failed (the descriptor is closed).
+ */
+int outqueue_push_file(outqueue_t *queue, int file_fd, off_t offset, size_t len);
+
+/**
+ * @brief Appends a segment of a file shared with other queues.
+ *
+ * The descriptor stays open: release(ref) is called once the segment is sent
+ * or the queue is cleared, and the mapping must stay valid until then.
+ *
+ * @param[in,out] queue The queue.
+ * @param[in] file_fd The file to send.
+ * @param[in] mapped The mapping of the whole file, or NULL to always use transport_sendfile().
+ * @param[in] offset The offset of the first byte to send.
+ * @param[in] len The number of bytes to send.
+ * @param[in] release The function releasing the file.
+ * @param[in] ref The argument of release.
+ * @return 0 on success, -1 if the allocation failed (release is called).
+ */
+int outqueue_push_shared(outqueue_t *queue, int file_fd, const char *mapped, off_t offset, size_t len,
+                         void (*release)(void *ref), void *ref);
+
+/**
+ * @brief Appends bytes shared with other queues, without copying them.
+ *
+ * The bytes must stay valid until release(ref) is called, once they are
+ * sent or the queue is cleared. They count in `buffered` like a copy.
+ *
+ * @param[in,out] queue The queue.
+ * @param[in] data The bytes to send.
+ * @param[in] len The number of bytes.
+ * @param[in] release The function releasing the bytes.
+ * @param[in] ref The argument of release.
+ * @return 0 on success, -1 if the allocation failed (release is called).
+ */
+int outqueue_push_ref(outqueue_t *queue, const void *data, size_t len, void (*release)(void *ref), void *ref);
+
+/**
+ * @brief Writes as much of the queue as the socket accepts.
+ *
+ * @param[in,out] queue The queue.
+ * @param[in] socket The non-blocking socket.
+ * @return The number of bytes written, or -1 if the connection failed.
+ */
+ssize_t outqueue_flush(outqueue_t *queue, int socket);
+
+/**
+ * @brief Checks if everything has been sent.
+ *
+ * @param[in] queue The queue.
+ * @return true if the queue is empty.
+ */
+bool outqueue_empty(const outqueue_t *queue);
+
+/**
+ * @brief Drops everything still queued and closes the queued files.
+ *
+ * @param[in,out] queue The queue.
+ */
+void outqueue_clear(outqueue_t *queue);
+
+/**
+ * @brief Writes the usage of the chunk allocators shared by the queues.
+ *
+ * @param[out] buffer The buffer receiving the text (no line break).
+ * @param[in] size The size of the buffer.
+ */
+void outqueue_format_stats(char *buffer, size_t size);
+
+#endif
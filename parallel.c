@@ -0,0 +1,230 @@
+#include "parallel.h"
+#include "checksum.h"
+
+#include <fcntl.h>
+#include <openssl/rand.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct
+{
+    long offset;
+    long length;
+    uint32_t crc;
+    int done;
+} parallel_part_t;
+
+struct parallel_upload
+{
+    char token[PARALLEL_TOKEN_SIZE];
+    char channel[50];
+    char filename[256];
+    char path[256];
+    long size;
+    int owner;
+    int fd;
+    int part_count;
+    parallel_part_t parts[PARALLEL_MAX_PARTS];
+};
+
+static parallel_upload_t *uploads[PARALLEL_MAX_UPLOADS];
+static unsigned long uploads_completed = 0;
+static unsigned long uploads_failed = 0;
+static unsigned long parts_received = 0;
+
+parallel_upload_t *parallel_start(const char *channel, const char *filename, const char *path, long size, int owner, char *token)
+{
+    int slot = -1;
+    for (int i = 0; i < PARALLEL_MAX_UPLOADS && slot < 0; i++)
+    {
+        slot = uploads[i] == NULL ? i : -1;
+    }
+    if (slot < 0)
+    {
+        return NULL;
+    }
+
+    // Jeton aléatoire : seul le client qui l'a demandé le connaît
+    unsigned char random[(PARALLEL_TOKEN_SIZE - 1) / 2];
+    if (RAND_bytes(random, sizeof(random)) != 1)
+    {
+        return NULL;
+    }
+
+    parallel_upload_t *upload = calloc(1, sizeof(parallel_upload_t));
+    if (upload == NULL)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(random); i++)
+    {
+        snprintf(upload->token + 2 * i, 3, "%02x", random[i]);
+    }
+
+    // Le fichier a tout de suite sa taille finale : chaque partie est écrite à sa place
+    upload->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (upload->fd < 0 || ftruncate(upload->fd, size) < 0)
+    {
+        perror("Erreur lors de la création du fichier");
+        if (upload->fd >= 0)
+        {
+            close(upload->fd);
+            unlink(path);
+        }
+        free(upload);
+        return NULL;
+    }
+    snprintf(upload->channel, sizeof(upload->channel), "%s", channel);
+    snprintf(upload->filename, sizeof(upload->filename), "%s", filename);
+    snprintf(upload->path, sizeof(upload->path), "%s", path);
+    upload->size = size;
+    upload->owner = owner;
+    uploads[slot] = upload;
+    memcpy(token, upload->token, PARALLEL_TOKEN_SIZE);
+    return upload;
+}
+
+parallel_upload_t *parallel_find(const char *token)
+{
+    for (int i = 0; i < PARALLEL_MAX_UPLOADS; i++)
+    {
+        if (uploads[i] != NULL && strcmp(uploads[i]->token, token) == 0)
+        {
+            return uploads[i];
+        }
+    }
+    return NULL;
+}
+
+int parallel_claim(parallel_upload_t *upload, long offset, long length)
+{
+    if (offset < 0 || length <= 0 || offset > upload->size - length || upload->part_count == PARALLEL_MAX_PARTS)
+    {
+        return -1;
+    }
+
+    // Deux connexions ne doivent pas écrire les mêmes octets
+    for (int i = 0; i < upload->part_count; i++)
+    {
+        parallel_part_t *part = &upload->parts[i];
+        if (offset < part->offset + part->length && part->offset < offset + length)
+        {
+            return -1;
+        }
+    }
+
+    parallel_part_t *part = &upload->parts[upload->part_count++];
+    part->offset = offset;
+    part->length = length;
+    part->crc = 0;
+    part->done = 0;
+    return dup(upload->fd);
+}
+
+void parallel_part_done(const char *token, long offset, uint32_t crc)
+{
+    parallel_upload_t *upload = parallel_find(token);
+    if (upload == NULL)
+    {
+        return; // Envoi annulé pendant la réception de la partie
+    }
+    for (int i = 0; i < upload->part_count; i++)
+    {
+        if (upload->parts[i].offset == offset)
+        {
+            upload->parts[i].crc = crc;
+            upload->parts[i].done = 1;
+            parts_received++;
+            return;
+        }
+    }
+}
+
+static int compare_parts(const void *a, const void *b)
+{
+    long left = ((const parallel_part_t *)a)->offset, right = ((const parallel_part_t *)b)->offset;
+    return (left > right) - (left < right);
+}
+
+static void release(parallel_upload_t *upload, int keep_file)
+{
+    for (int i = 0; i < PARALLEL_MAX_UPLOADS; i++)
+    {
+        if (uploads[i] == upload)
+        {
+            uploads[i] = NULL;
+        }
+    }
+    close(upload->fd);
+    if (!keep_file)
+    {
+        unlink(upload->path);
+    }
+    free(upload);
+}
+
+int parallel_finish(parallel_upload_t *upload, uint32_t crc)
+{
+    // Les parties, dans l'ordre du fichier, doivent se suivre sans trou jusqu'à la fin
+    qsort(upload->parts, upload->part_count, sizeof(parallel_part_t), compare_parts);
+    uint32_t combined = 0;
+    long covered = 0;
+    int complete = 1;
+    for (int i = 0; i < upload->part_count && complete; i++)
+    {
+        parallel_part_t *part = &upload->parts[i];
+        complete = part->done && part->offset == covered;
+        combined = crc32c_combine(combined, part->crc, part->length);
+        covered += part->length;
+    }
+    int valid = complete && covered == upload->size && combined == crc;
+
+    if (valid)
+    {
+        uploads_completed++;
+    }
+    else
+    {
+        uploads_failed++;
+    }
+    release(upload, valid);
+    return valid;
+}
+
+int parallel_owner(const parallel_upload_t *upload, char *channel, char *filename)
+{
+    snprintf(channel, 50, "%s", upload->channel);
+    snprintf(filename, 256, "%s", upload->filename);
+    return upload->owner;
+}
+
+void parallel_cancel_owner(int owner)
+{
+    for (int i = 0; i < PARALLEL_MAX_UPLOADS; i++)
+    {
+        if (uploads[i] != NULL && uploads[i]->owner == owner)
+        {
+            uploads_failed++;
+            release(uploads[i], 0);
+        }
+    }
+}
+
+int parallel_in_progress(void)
+{
+    int running = 0;
+    for (int i = 0; i < PARALLEL_MAX_UPLOADS; i++)
+    {
+        running += uploads[i] != NULL;
+    }
+    return running;
+}
+
+void parallel_format_stats(char *buffer, size_t size)
+{
+    int running = parallel_in_progress();
+    snprintf(buffer, size, "Envois parallèles : %lu terminés, %lu échoués, %d en cours, %lu parties reçues\n",
+             uploads_completed, uploads_failed, running, parts_received);
+}
@@ -0,0 +1,117 @@
+/**
+ * @file parallel.h
+ * @brief Uploads of large files split over several data connections.
+ *
+ * One TCP stream limits the throughput of a transfer on a link with a high
+ * latency. For a large file, the client asks for a parallel upload on its
+ * connection (`psend <name> <size>`) and receives a random token
+ * (`@TOKEN <token>`). It then opens several data connections; each one sends,
+ * instead of the credentials, `@DATA <token> <offset> <length>` followed by
+ * the bytes of that part of the file, written at their offset with pwrite.
+ * The server answers `@OK` on the data connection once the part is written.
+ *
+ * When all the parts are acknowledged, the client sends
+ * `pdone <token> <crc32c>` on its connection. The upload succeeds if the parts
+ * cover the whole file and if the CRC-32C of the file, combined from the
+ * CRC-32C of each part (crc32c_combine), is the one of the client. Otherwise
+ * the file is removed. The token is only valid while the connection that
+ * requested it stays open.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PARALLEL_MAX_UPLOADS 8         /**< Parallel uploads in progress at the same time */
+#define PARALLEL_MAX_PARTS 64          /**< Parts of a parallel upload */
+#define PARALLEL_TOKEN_SIZE 33         /**< Size of a token (32 hexadecimal digits) */
+
+/**
+ * @brief Parallel upload in progress.
+ */
+typedef struct parallel_upload parallel_upload_t;
+
+/**
+ * @brief Starts a parallel upload: creates the file at its final size and issues a token.
+ *
+ * @param[in] channel The channel of the file.
+ * @param[in] filename The name of the file.
+ * @param[in] path The path of the file.
+ * @param[in] size The size of the file.
+ * @param[in] owner The socket of the connection that requested the upload.
+ * @param[out] token The token of the upload (PARALLEL_TOKEN_SIZE bytes).
+ * @return The upload, or NULL if too many uploads are in progress or if the file cannot be created.
+ */
+parallel_upload_t *parallel_start(const char *channel, const char *filename, const char *path, long size, int owner, char *token);
+
+/**
+ * @brief Finds a parallel upload by its token.
+ *
+ * @param[in] token The token.
+ * @return The upload, or NULL if the token is unknown.
+ */
+parallel_upload_t *parallel_find(const char *token);
+
+/**
+ * @brief Reserves a part of the file for a data connection.
+ *
+ * @param[in] upload The upload.
+ * @param[in] offset The offset of the part.
+ * @param[in] length The length of the part.
+ * @return A descriptor of the file for this part, or -1 if the part is outside the file, overlaps another part, or if there are too many parts.
+ */
+int parallel_claim(parallel_upload_t *upload, long offset, long length);
+
+/**
+ * @brief Records that a part has been written.
+ *
+ * @param[in] token The token of the upload (it may have been cancelled meanwhile).
+ * @param[in] offset The offset of the part.
+ * @param[in] crc The CRC-32C of the part.
+ */
+void parallel_part_done(const char *token, long offset, uint32_t crc);
+
+/**
+ * @brief Ends a parallel upload.
+ *
+ * @param[in] upload The upload, released by this call.
+ * @param[in] crc The CRC-32C of the whole file computed by the client.
+ * @return 1 if the file is complete and its checksum matches, 0 otherwise (the file is removed).
+ */
+int parallel_finish(parallel_upload_t *upload, uint32_t crc);
+
+/**
+ * @brief Returns the owner, channel and name of a parallel upload.
+ *
+ * @param[in] upload The upload.
+ * @param[out] channel The channel of the file (50 bytes).
+ * @param[out] filename The name of the file (256 bytes).
+ * @return The socket of the connection that requested the upload.
+ */
+int parallel_owner(const parallel_upload_t *upload, char *channel, char *filename);
+
+/**
+ * @brief Cancels the parallel uploads requested by a connection that is closed, and removes their files.
+ *
+ * @param[in] owner The socket of the connection.
+ */
+void parallel_cancel_owner(int owner);
+
+/**
+ * @brief Checks if parallel uploads are in progress (a restart waits for them).
+ *
+ * @return The number of parallel uploads in progress.
+ */
+int parallel_in_progress(void);
+
+/**
+ * @brief Writes the statistics of the parallel uploads.
+ *
+ * @param[out] buffer The buffer receiving the text (one line).
+ * @param[in] size The size of the buffer.
+ */
+void parallel_format_stats(char *buffer, size_t size);
+
+#endif
@@ -0,0 +1,519 @@
+#define _GNU_SOURCE
+#include "poller.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+// user_data des requêtes io_uring : descripteur, génération et type de requête
+#define OP_POLL 0
+#define OP_ACCEPT 1
+#define OP_CANCEL 2
+#define GENERATION_MASK 0x3fffffffU
+#define USER_DATA(fd, generation, op) \
+    ((uint64_t)(uint32_t)(fd) | (uint64_t)((generation) & GENERATION_MASK) << 32 | (uint64_t)(op) << 62)
+
+typedef struct
+{
+    uint64_t tag;
+    uint32_t events;     // Événements demandés
+    uint32_t generation; // Change à chaque requête : les complétions des anciennes requêtes sont ignorées
+    bool registered;
+    bool armed;          // io_uring : une requête est en cours dans le noyau
+    bool queued;         // io_uring : la requête sera soumise à la prochaine attente
+    bool accept_by_poll; // io_uring sans accept multishot : attendre POLLIN, puis accept4
+    uint64_t armed_data; // user_data de la requête en cours
+} poller_fd_t;
+
+static int backend = -1;
+static poller_fd_t *table = NULL; // Indexée par descripteur
+static int table_size = 0;
+
+static int epoll_fd = -1;
+
+static int ring_fd = -1;
+static unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+static unsigned sq_entries;
+static unsigned sq_local_tail; // Entrées préparées, publiées au noyau à la soumission
+static struct io_uring_sqe *sqes;
+static unsigned *cq_head, *cq_tail, *cq_mask;
+static struct io_uring_cqe *cqes;
+
+// Descripteurs dont la requête io_uring doit être (re)soumise
+static int *arm_list = NULL;
+static int arm_count = 0;
+static int arm_capacity = 0;
+
+static unsigned long waits = 0;
+static unsigned long events_returned = 0;
+static unsigned long changes = 0;
+
+static poller_fd_t *entry(int fd)
+{
+    if (fd >= table_size)
+    {
+        int size = table_size > 0 ? table_size : 64;
+        while (size <= fd)
+        {
+            size *= 2;
+        }
+        poller_fd_t *grown = realloc(table, size * sizeof(poller_fd_t));
+        if (grown == NULL)
+        {
+            return NULL;
+        }
+        memset(grown + table_size, 0, (size - table_size) * sizeof(poller_fd_t));
+        table = grown;
+        table_size = size;
+    }
+    return &table[fd];
+}
+
+static int emit(poller_event_t *events, int n, uint64_t tag, uint32_t revents, int fd)
+{
+    events[n].tag = tag;
+    events[n].revents = revents;
+    events[n].fd = fd;
+    return n + 1;
+}
+
+// Accepte les connexions en attente sur un socket d'écoute prêt
+static int accept_ready(int fd, poller_event_t *events, int n, int max)
+{
+    while (n < max)
+    {
+        int socket = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (socket < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                perror("accept failed");
+            }
+            break;
+        }
+        n = emit(events, n, table[fd].tag, POLLER_ACCEPT, socket);
+    }
+    return n;
+}
+
+/* ---------- io_uring ---------- */
+
+static int uring_enter(unsigned to_submit, unsigned min_complete, int timeout_ms)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    if (timeout_ms >= 0)
+    {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+    unsigned flags = IORING_ENTER_EXT_ARG | (min_complete > 0 ? IORING_ENTER_GETEVENTS : 0);
+    return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, &arg, sizeof(arg));
+}
+
+static unsigned uring_unsubmitted(void)
+{
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    return sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+}
+
+static struct io_uring_sqe *uring_get_sqe(void)
+{
+    // File de soumission pleine : la soumettre tout de suite
+    if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == sq_entries)
+    {
+        uring_enter(uring_unsubmitted(), 0, 0);
+        if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == sq_entries)
+        {
+            return NULL;
+        }
+    }
+    unsigned index = sq_local_tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    sq_local_tail++;
+    changes++;
+    return sqe;
+}
+
+static void uring_queue_arm(int fd)
+{
+    if (table[fd].queued)
+    {
+        return;
+    }
+    if (arm_count == arm_capacity)
+    {
+        int capacity = arm_capacity > 0 ? arm_capacity * 2 : 64;
+        int *grown = realloc(arm_list, capacity * sizeof(int));
+        if (grown == NULL)
+        {
+            return;
+        }
+        arm_list = grown;
+        arm_capacity = capacity;
+    }
+    arm_list[arm_count++] = fd;
+    table[fd].queued = true;
+}
+
+static void uring_arm(int fd)
+{
+    poller_fd_t *e = &table[fd];
+    if (!e->registered || e->armed || e->events == 0)
+    {
+        return;
+    }
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    if (sqe == NULL)
+    {
+        uring_queue_arm(fd); // Réessayer à la prochaine attente
+        return;
+    }
+
+    e->generation++;
+    sqe->fd = fd;
+    if (e->events & POLLER_ACCEPT && !e->accept_by_poll)
+    {
+        // Le noyau accepte les connexions lui-même, une complétion par connexion
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        sqe->user_data = USER_DATA(fd, e->generation, OP_ACCEPT);
+    }
+    else
+    {
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->poll32_events = e->events & POLLER_ACCEPT ? POLLIN : e->events;
+        sqe->user_data = USER_DATA(fd, e->generation, OP_POLL);
+    }
+    e->armed_data = sqe->user_data;
+    e->armed = true;
+}
+
+static void uring_cancel(int fd)
+{
+    poller_fd_t *e = &table[fd];
+    if (!e->armed)
+    {
+        return;
+    }
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    if (sqe != NULL)
+    {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = e->armed_data;
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS; // Seul un échec produit une complétion
+        sqe->user_data = USER_DATA(fd, 0, OP_CANCEL);
+    }
+    e->armed = false;
+    e->generation++; // Les complétions de l'ancienne requête seront ignorées
+}
+
+static int uring_init(void)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd = syscall(__NR_io_uring_setup, POLLER_RING_ENTRIES, &params);
+    if (ring_fd < 0)
+    {
+        return -1;
+    }
+
+    // Attente avec délai en un seul appel, et annulations sans complétion
+    unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_CQE_SKIP;
+    if ((params.features & required) != required)
+    {
+        close(ring_fd);
+        ring_fd = -1;
+        return -1;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    size_t ring_size = sq_size > cq_size ? sq_size : cq_size;
+    char *ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (ring == MAP_FAILED || sqes == MAP_FAILED)
+    {
+        close(ring_fd);
+        ring_fd = -1;
+        return -1;
+    }
+
+    sq_head = (unsigned *)(ring + params.sq_off.head);
+    sq_tail = (unsigned *)(ring + params.sq_off.tail);
+    sq_mask = (unsigned *)(ring + params.sq_off.ring_mask);
+    sq_array = (unsigned *)(ring + params.sq_off.array);
+    sq_entries = params.sq_entries;
+    sq_local_tail = *sq_tail;
+    cq_head = (unsigned *)(ring + params.cq_off.head);
+    cq_tail = (unsigned *)(ring + params.cq_off.tail);
+    cq_mask = (unsigned *)(ring + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+    return 0;
+}
+
+static int uring_complete(const struct io_uring_cqe *cqe, poller_event_t *events, int n, int max)
+{
+    int op = cqe->user_data >> 62;
+    int fd = (uint32_t)cqe->user_data;
+    uint32_t generation = (cqe->user_data >> 32) & GENERATION_MASK;
+    if (op == OP_CANCEL || fd >= table_size)
+    {
+        return n; // La requête visée était déjà terminée
+    }
+    poller_fd_t *e = &table[fd];
+    bool current = e->registered && e->armed && (e->generation & GENERATION_MASK) == generation;
+
+    if (op == OP_ACCEPT)
+    {
+        if (cqe->res >= 0)
+        {
+            // Une connexion acceptée juste avant l'annulation n'est pas perdue si le socket d'écoute est toujours enregistré
+            if (e->registered)
+            {
+                n = emit(events, n, e->tag, POLLER_ACCEPT, cqe->res);
+            }
+            else
+            {
+                close(cqe->res);
+            }
+        }
+        else if (current && cqe->res == -EINVAL)
+        {
+            e->accept_by_poll = true; // Noyau sans accept multishot
+        }
+        else if (current && cqe->res != -ECANCELED)
+        {
+            fprintf(stderr, "accept failed: %s\n", strerror(-cqe->res));
+        }
+        if (current && !(cqe->flags & IORING_CQE_F_MORE))
+        {
+            e->armed = false;
+            uring_queue_arm(fd);
+        }
+        return n;
+    }
+
+    if (!current)
+    {
+        return n;
+    }
+    e->armed = false;
+    uring_queue_arm(fd); // Requête à un coup : elle sera soumise à nouveau avec la prochaine attente
+    if (cqe->res < 0)
+    {
+        return cqe->res == -ECANCELED ? n : emit(events, n, e->tag, POLLERR, fd);
+    }
+    if (e->events & POLLER_ACCEPT)
+    {
+        return accept_ready(fd, events, n, max);
+    }
+    return emit(events, n, e->tag, cqe->res, fd);
+}
+
+static int uring_wait(poller_event_t *events, int max, int timeout_ms)
+{
+    // Les requêtes à (re)soumettre partent avec l'attente, dans le même appel système
+    int count = arm_count;
+    arm_count = 0;
+    for (int i = 0; i < count; i++)
+    {
+        table[arm_list[i]].queued = false;
+        uring_arm(arm_list[i]);
+    }
+
+    unsigned to_submit = uring_unsubmitted();
+    unsigned ready = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE) - *cq_head;
+    if (to_submit > 0 || (ready == 0 && timeout_ms != 0))
+    {
+        waits++;
+        if (uring_enter(to_submit, ready == 0 && timeout_ms != 0 ? 1 : 0, timeout_ms) < 0 &&
+            errno != ETIME && errno != EINTR && errno != EBUSY)
+        {
+            return -1;
+        }
+    }
+
+    int n = 0;
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && n < max)
+    {
+        n = uring_complete(&cqes[head & *cq_mask], events, n, max);
+        head++;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+/* ---------- epoll ---------- */
+
+static uint32_t epoll_events(uint32_t events)
+{
+    return events & POLLER_ACCEPT ? EPOLLIN : events & (POLLIN | POLLOUT);
+}
+
+static int epoll_wait_events(poller_event_t *events, int max, int timeout_ms)
+{
+    struct epoll_event ready[POLLER_MAX_EVENTS];
+    waits++;
+    int count = epoll_wait(epoll_fd, ready, max < POLLER_MAX_EVENTS ? max : POLLER_MAX_EVENTS, timeout_ms);
+    if (count < 0)
+    {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    int n = 0;
+    for (int i = 0; i < count && n < max; i++)
+    {
+        int fd = ready[i].data.fd;
+        if (fd >= table_size || !table[fd].registered)
+        {
+            continue;
+        }
+        if (table[fd].events & POLLER_ACCEPT)
+        {
+            n = accept_ready(fd, events, n, max);
+        }
+        else
+        {
+            n = emit(events, n, table[fd].tag, ready[i].events & (POLLIN | POLLOUT | POLLERR | POLLHUP), fd);
+        }
+    }
+    return n;
+}
+
+/* ---------- Interface ---------- */
+
+int poller_init(int requested)
+{
+    if (requested != POLLER_EPOLL && uring_init() == 0)
+    {
+        backend = POLLER_URING;
+        return 0;
+    }
+    if (requested == POLLER_URING)
+    {
+        fprintf(stderr, "io_uring n'est pas disponible.\n");
+        return -1;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0)
+    {
+        perror("epoll_create1 failed");
+        return -1;
+    }
+    backend = POLLER_EPOLL;
+    return 0;
+}
+
+const char *poller_backend(void)
+{
+    return backend == POLLER_URING ? "io_uring" : "epoll";
+}
+
+int poller_add(int fd, uint32_t events, uint64_t tag)
+{
+    poller_fd_t *e = entry(fd);
+    if (e == NULL)
+    {
+        return -1;
+    }
+    e->tag = tag;
+    e->events = events;
+    e->armed = false;
+    e->accept_by_poll = false;
+
+    if (backend == POLLER_EPOLL)
+    {
+        struct epoll_event ev = {.events = epoll_events(events), .data.fd = fd};
+        changes++;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        {
+            return -1;
+        }
+        e->registered = true;
+        return 0;
+    }
+
+    e->registered = true;
+    uring_queue_arm(fd);
+    return 0;
+}
+
+void poller_modify(int fd, uint32_t events)
+{
+    if (fd >= table_size || !table[fd].registered || table[fd].events == events)
+    {
+        return;
+    }
+    poller_fd_t *e = &table[fd];
+
+    if (backend == POLLER_EPOLL)
+    {
+        e->events = events;
+        struct epoll_event ev = {.events = epoll_events(events), .data.fd = fd};
+        changes++;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+        return;
+    }
+
+    // La requête en cours attend d'autres événements : l'annuler et en soumettre une nouvelle
+    uring_cancel(fd);
+    e->events = events;
+    uring_queue_arm(fd);
+}
+
+void poller_remove(int fd)
+{
+    if (fd >= table_size || !table[fd].registered)
+    {
+        return;
+    }
+    poller_fd_t *e = &table[fd];
+
+    if (backend == POLLER_EPOLL)
+    {
+        changes++;
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    else
+    {
+        // L'annulation part avec la prochaine attente, dans la même boucle
+        uring_cancel(fd);
+    }
+    e->registered = false;
+    e->events = 0;
+}
+
+int poller_wait(poller_event_t *events, int max, int timeout_ms)
+{
+    int n = backend == POLLER_URING ? uring_wait(events, max, timeout_ms) : epoll_wait_events(events, max, timeout_ms);
+    if (n > 0)
+    {
+        events_returned += n;
+    }
+    return n;
+}
+
+void poller_format_stats(char *buffer, size_t size)
+{
+    snprintf(buffer, size, "Boucle d'événements : %s, %lu attentes, %lu événements, %lu changements d'abonnement\n",
+             poller_backend(), waits, events_returned, changes);
+}
@@ -0,0 +1,120 @@
+/**
+ * @file poller.h
+ * @brief Readiness notifications of the event loop, with io_uring or epoll.
+ *
+ * The event loop registers each descriptor once with the events it waits for
+ * and a tag, and changes the events only when they change, instead of
+ * handing the whole descriptor list to poll() at every iteration.
+ *
+ * With io_uring, the registrations, changes and removals of an iteration are
+ * queued as submission entries and submitted by the same system call that
+ * waits for the completions: an iteration costs one system call whatever the
+ * number of connections. Listening sockets use a multishot accept, so the
+ * kernel accepts the connections itself. Connections use one-shot polls,
+ * re-armed in that same system call: the level-triggered behaviour lets the
+ * server read one chunk per event, which a multishot poll (edge-triggered)
+ * would not allow.
+ *
+ * Only the readiness goes through io_uring: sends stay synchronous. A
+ * writable client sends its whole queue with one `sendmsg` (one iovec per
+ * chunk, see outqueue.h) or `sendfile`, and TLS sessions are written by
+ * OpenSSL itself. Sends submitted as `IORING_OP_SENDMSG` would keep the
+ * chunks of the queue pinned until their completion and would not cover TLS
+ * nor files, so they are not used.
+ *
+ * When io_uring is not available (old kernel, disabled by the
+ * administrator), the same interface is provided by epoll.
+ */
+
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define POLLER_AUTO 0               /**< io_uring if available, epoll otherwise */
+#define POLLER_EPOLL 1              /**< Always epoll */
+#define POLLER_URING 2              /**< io_uring, fails if not available */
+
+#define POLLER_ACCEPT 0x10000       /**< Event of a listening socket: a connection was accepted */
+#define POLLER_MAX_EVENTS 256       /**< Maximum number of events returned by poller_wait() */
+#define POLLER_RING_ENTRIES 256     /**< Size of the io_uring submission queue */
+
+/**
+ * @brief Structure representing an event returned by poller_wait().
+ */
+typedef struct
+{
+    uint64_t tag;     /**< Tag given to poller_add() */
+    uint32_t revents; /**< POLLIN, POLLOUT, POLLERR, POLLHUP, or POLLER_ACCEPT */
+    int fd;           /**< The registered descriptor, or the accepted socket for POLLER_ACCEPT */
+} poller_event_t;
+
+/**
+ * @brief Creates the poller.
+ *
+ * @param[in] backend POLLER_AUTO, POLLER_EPOLL or POLLER_URING.
+ * @return 0 on success, -1 on error.
+ */
+int poller_init(int backend);
+
+/**
+ * @brief Returns the name of the backend in use.
+ *
+ * @return "io_uring" or "epoll".
+ */
+const char *poller_backend(void);
+
+/**
+ * @brief Registers a descriptor.
+ *
+ * A listening socket is registered with POLLER_ACCEPT: the connections are
+ * accepted by the poller (non-blocking, close-on-exec) and returned as events.
+ *
+ * @param[in] fd The descriptor.
+ * @param[in] events POLLIN and/or POLLOUT, POLLER_ACCEPT, or 0 to wait for nothing yet.
+ * @param[in] tag The tag returned with the events of this descriptor.
+ * @return 0 on success, -1 on error (for example a regular file with epoll).
+ */
+int poller_add(int fd, uint32_t events, uint64_t tag);
+
+/**
+ * @brief Changes the events of a registered descriptor.
+ *
+ * Calling it with unchanged events costs nothing, so the event loop can call
+ * it for every descriptor at every iteration.
+ *
+ * @param[in] fd The descriptor.
+ * @param[in] events The new events.
+ */
+void poller_modify(int fd, uint32_t events);
+
+/**
+ * @brief Unregisters a descriptor. Must be called before closing it.
+ *
+ * Events of the descriptor not returned yet are dropped.
+ *
+ * @param[in] fd The descriptor.
+ */
+void poller_remove(int fd);
+
+/**
+ * @brief Submits the pending changes and waits for events.
+ *
+ * @param[out] events The events.
+ * @param[in] max The size of events (POLLER_MAX_EVENTS at most).
+ * @param[in] timeout_ms The maximum waiting time, -1 to wait without limit.
+ * @return The number of events, or -1 on error.
+ */
+int poller_wait(poller_event_t *events, int max, int timeout_ms);
+
+/**
+ * @brief Writes the statistics of the poller.
+ *
+ * @param[out] buffer The buffer receiving the text (one line).
+ * @param[in] size The size of the buffer.
+ */
+void poller_format_stats(char *buffer, size_t size);
+
+#endif
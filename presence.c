@@ -0,0 +1,359 @@
+#include "presence.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+
+#define PRESENCE_FLUSH_CHANNELS 8 // Salons dont les lignes @TYPING sont préparées en même temps
+
+// Ligne d'événements en cours de préparation
+typedef struct
+{
+    char channel[50]; // Vide : ligne @PRESENCE pour tous les abonnés
+    char text[PRESENCE_LINE_SIZE];
+    size_t len;
+    size_t prefix_len;
+} event_line_t;
+
+static presence_user_t *user_table[PRESENCE_BUCKETS]; // Utilisateurs connectés, ou dont le départ n'est pas encore annoncé
+static presence_user_t *pending = NULL;               // Utilisateurs dont les changements restent à envoyer
+static presence_deliver_fn deliver = NULL;
+static timer_wheel_t *timer_wheel = NULL;
+static wheel_timer_t flush_timer;
+static int connected_users = 0;
+static unsigned long changes = 0;
+static unsigned long events_sent = 0;
+static unsigned long lines_sent = 0;
+static unsigned long batches = 0;
+
+static const char *status_names[] = {"offline", "online", "away"};
+
+static void flush_expired(wheel_timer_t *timer)
+{
+    (void)timer;
+    presence_flush(monotonic_ms());
+}
+
+void presence_init(timer_wheel_t *wheel, presence_deliver_fn deliver_fn)
+{
+    timer_wheel = wheel;
+    deliver = deliver_fn;
+    timer_init(&flush_timer, flush_expired, NULL);
+}
+
+static presence_user_t *lookup(const char *username)
+{
+    for (presence_user_t *user = user_table[hash_string(username) % PRESENCE_BUCKETS]; user != NULL; user = user->next)
+    {
+        if (strcmp(user->username, username) == 0)
+        {
+            return user;
+        }
+    }
+    return NULL;
+}
+
+static void remove_user(presence_user_t *user)
+{
+    presence_user_t **link = &user_table[hash_string(user->username) % PRESENCE_BUCKETS];
+    while (*link != NULL && *link != user)
+    {
+        link = &(*link)->next;
+    }
+    if (*link != NULL)
+    {
+        *link = user->next;
+    }
+    free(user);
+}
+
+// Ajoute l'utilisateur au prochain lot ; le premier changement du lot programme son envoi
+static void mark_changed(presence_user_t *user)
+{
+    changes++;
+    if (user->pending)
+    {
+        return;
+    }
+    user->pending = true;
+    user->next_pending = pending;
+    if (pending == NULL)
+    {
+        timer_schedule(timer_wheel, &flush_timer, monotonic_ms() + PRESENCE_FLUSH_MS);
+    }
+    pending = user;
+}
+
+presence_user_t *presence_connect(presence_link_t *link, const char *username, void *connection)
+{
+    presence_user_t *user = lookup(username);
+    if (user == NULL)
+    {
+        user = calloc(1, sizeof(presence_user_t));
+        if (user == NULL)
+        {
+            return NULL;
+        }
+        snprintf(user->username, sizeof(user->username), "%s", username);
+        unsigned int index = hash_string(username) % PRESENCE_BUCKETS;
+        user->next = user_table[index];
+        user_table[index] = user;
+    }
+
+    link->user = user;
+    link->connection = connection;
+    link->next = user->connections;
+    user->connections = link;
+    if (user->connection_count++ == 0)
+    {
+        connected_users++;
+        user->status = PRESENCE_ONLINE;
+        mark_changed(user);
+    }
+    return user;
+}
+
+void presence_disconnect(presence_link_t *link)
+{
+    presence_user_t *user = link->user;
+    if (user == NULL)
+    {
+        return;
+    }
+
+    presence_link_t **cursor = &user->connections;
+    while (*cursor != NULL && *cursor != link)
+    {
+        cursor = &(*cursor)->next;
+    }
+    if (*cursor != NULL)
+    {
+        *cursor = link->next;
+    }
+    link->next = NULL;
+    link->user = NULL;
+
+    if (--user->connection_count > 0)
+    {
+        return;
+    }
+    // Dernière connexion : l'entrée reste jusqu'à l'annonce du départ
+    connected_users--;
+    user->status = PRESENCE_OFFLINE;
+    user->typing[0] = '\0';
+    if (user->published == PRESENCE_OFFLINE && user->typing_published[0] == '\0' && !user->pending)
+    {
+        remove_user(user); // Rien n'a été annoncé
+        return;
+    }
+    mark_changed(user);
+}
+
+presence_user_t *presence_find(const char *username)
+{
+    presence_user_t *user = lookup(username);
+    return user != NULL && user->connection_count > 0 ? user : NULL;
+}
+
+void presence_set_away(presence_user_t *user, bool away)
+{
+    presence_status_t status = away ? PRESENCE_AWAY : PRESENCE_ONLINE;
+    if (user->status != status)
+    {
+        user->status = status;
+        mark_changed(user);
+    }
+}
+
+void presence_typing(presence_user_t *user, const char *channel, uint64_t now)
+{
+    if (channel[0] != '\0')
+    {
+        user->typing_until = now + PRESENCE_TYPING_MS; // Prolongé à chaque indication
+    }
+    if (strcmp(user->typing, channel) != 0)
+    {
+        snprintf(user->typing, sizeof(user->typing), "%s", channel);
+        mark_changed(user);
+    }
+}
+
+static void line_init(event_line_t *line, const char *channel)
+{
+    snprintf(line->channel, sizeof(line->channel), "%s", channel != NULL ? channel : "");
+    if (channel == NULL)
+    {
+        line->len = snprintf(line->text, sizeof(line->text), "@PRESENCE");
+    }
+    else
+    {
+        line->len = snprintf(line->text, sizeof(line->text), "@TYPING %s", channel);
+    }
+    line->prefix_len = line->len;
+}
+
+static void line_send(event_line_t *line)
+{
+    if (line->len > line->prefix_len)
+    {
+        line->text[line->len++] = '\n';
+        deliver(line->channel[0] != '\0' ? line->channel : NULL, line->text, line->len);
+        lines_sent++;
+    }
+    line->len = line->prefix_len;
+}
+
+static void line_append(event_line_t *line, const char *event)
+{
+    size_t event_len = strlen(event);
+    if (line->len + 1 + event_len + 1 > sizeof(line->text))
+    {
+        line_send(line); // Ligne pleine : la suite part sur une autre ligne
+    }
+    line->text[line->len++] = ' ';
+    memcpy(line->text + line->len, event, event_len);
+    line->len += event_len;
+    events_sent++;
+}
+
+// Ligne @TYPING d'un salon ; les salons sont rarement nombreux dans un même lot
+static event_line_t *typing_line(event_line_t *lines, int *count, const char *channel)
+{
+    for (int i = 0; i < *count; i++)
+    {
+        if (strcmp(lines[i].channel, channel) == 0)
+        {
+            return &lines[i];
+        }
+    }
+    if (*count == PRESENCE_FLUSH_CHANNELS)
+    {
+        for (int i = 0; i < *count; i++)
+        {
+            line_send(&lines[i]);
+        }
+        *count = 0;
+    }
+    line_init(&lines[*count], channel);
+    return &lines[(*count)++];
+}
+
+void presence_flush(uint64_t now)
+{
+    timer_cancel(timer_wheel, &flush_timer);
+    if (pending == NULL)
+    {
+        return;
+    }
+
+    event_line_t status_line;
+    event_line_t typing_lines[PRESENCE_FLUSH_CHANNELS];
+    int typing_count = 0;
+    line_init(&status_line, NULL);
+
+    presence_user_t *still_typing = NULL;
+    presence_user_t *user = pending;
+    pending = NULL;
+    while (user != NULL)
+    {
+        presence_user_t *next = user->next_pending;
+        char event[64];
+
+        if (user->typing[0] != '\0' && now >= user->typing_until)
+        {
+            user->typing[0] = '\0'; // Indication expirée
+        }
+
+        // Seul le dernier état compte : un aller-retour pendant le délai ne produit rien
+        if (user->status != user->published)
+        {
+            snprintf(event, sizeof(event), "%s=%s", user->username, status_names[user->status]);
+            line_append(&status_line, event);
+            user->published = user->status;
+        }
+        if (strcmp(user->typing, user->typing_published) != 0)
+        {
+            if (user->typing_published[0] != '\0')
+            {
+                snprintf(event, sizeof(event), "-%s", user->username);
+                line_append(typing_line(typing_lines, &typing_count, user->typing_published), event);
+            }
+            if (user->typing[0] != '\0')
+            {
+                snprintf(event, sizeof(event), "+%s", user->username);
+                line_append(typing_line(typing_lines, &typing_count, user->typing), event);
+            }
+            snprintf(user->typing_published, sizeof(user->typing_published), "%s", user->typing);
+        }
+
+        // Un utilisateur qui écrit reste dans la liste jusqu'à l'expiration de son indication
+        if (user->typing[0] != '\0')
+        {
+            user->next_pending = still_typing;
+            still_typing = user;
+        }
+        else
+        {
+            user->pending = false;
+            if (user->connection_count == 0)
+            {
+                remove_user(user);
+            }
+        }
+        user = next;
+    }
+
+    unsigned long lines_before = lines_sent;
+    line_send(&status_line);
+    for (int i = 0; i < typing_count; i++)
+    {
+        line_send(&typing_lines[i]);
+    }
+    if (lines_sent > lines_before)
+    {
+        batches++;
+    }
+
+    pending = still_typing;
+    if (pending != NULL)
+    {
+        timer_schedule(timer_wheel, &flush_timer, now + PRESENCE_FLUSH_MS);
+    }
+}
+
+void presence_snapshot(void (*emit)(void *context, const char *line, size_t len), void *context)
+{
+    // Statuts déjà annoncés : les changements en attente suivront avec le prochain lot
+    char line[PRESENCE_LINE_SIZE];
+    size_t len = snprintf(line, sizeof(line), "@PRESENCE");
+    size_t prefix_len = len;
+    for (int i = 0; i < PRESENCE_BUCKETS; i++)
+    {
+        for (presence_user_t *user = user_table[i]; user != NULL; user = user->next)
+        {
+            if (user->published == PRESENCE_OFFLINE)
+            {
+                continue;
+            }
+            char event[64];
+            size_t event_len = snprintf(event, sizeof(event), " %s=%s", user->username, status_names[user->published]);
+            if (len + event_len + 1 > sizeof(line))
+            {
+                line[len++] = '\n';
+                emit(context, line, len);
+                len = prefix_len;
+            }
+            memcpy(line + len, event, event_len);
+            len += event_len;
+        }
+    }
+    line[len++] = '\n';
+    emit(context, line, len); // Toujours au moins une ligne, éventuellement vide
+}
+
+void presence_format_stats(char *buffer, size_t size)
+{
+    snprintf(buffer, size, "Présence : %d utilisateurs connectés, %lu changements, %lu événements envoyés (%lu lignes, %lu lots)\n",
+             connected_users, changes, events_sent, lines_sent, batches);
+}
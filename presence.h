@@ -0,0 +1,165 @@
+/**
+ * @file presence.h
+ * @brief Index of the connected users and coalesced presence events.
+ *
+ * Each logged-in connection is linked to the entry of its user in a hash
+ * table, so the connections of a user are found without scanning all the
+ * clients (direct messages, presence). A user is online while one of their
+ * connections is open, and can mark themselves away; a connection can also
+ * report that its user is typing in a channel, which expires after
+ * PRESENCE_TYPING_MS milliseconds.
+ *
+ * Changes are not sent when they happen: they are collected and published
+ * at most every PRESENCE_FLUSH_MS milliseconds, as one batch. Only the last
+ * state of a user counts, so a user who reconnects or comes back before the
+ * batch is sent causes no event at all. Events are lines:
+ *
+ * - `@PRESENCE <user>=<online|away|offline> ...`: sent to every subscriber;
+ * - `@TYPING <channel> +<user> -<user> ...`: users who started or stopped
+ *   typing, sent to the subscribers in the channel.
+ */
+
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "timer_wheel.h"
+
+#define PRESENCE_CAPS "presence"     /**< Capability of the clients receiving the presence events (`@CAPS`) */
+#define PRESENCE_BUCKETS 256         /**< Size of the hash table of the users */
+#define PRESENCE_FLUSH_MS 500        /**< Delay during which the changes are collected before being sent */
+#define PRESENCE_TYPING_MS 5000      /**< Duration of a typing indication */
+#define PRESENCE_LINE_SIZE 1024      /**< Largest event line; a larger batch is split */
+
+/**
+ * @brief Presence status of a user.
+ */
+typedef enum
+{
+    PRESENCE_OFFLINE, /**< No connection */
+    PRESENCE_ONLINE,  /**< Connected */
+    PRESENCE_AWAY     /**< Connected, marked away */
+} presence_status_t;
+
+struct presence_user;
+
+/**
+ * @brief Link of a connection to its user.
+ *
+ * The structure is meant to be embedded in the connection, so that the
+ * index never allocates memory per connection.
+ */
+typedef struct presence_link
+{
+    struct presence_link *next;   /**< Next connection of the same user */
+    struct presence_user *user;   /**< User of the connection, NULL if not linked */
+    void *connection;             /**< Connection owning the link */
+} presence_link_t;
+
+/**
+ * @brief Entry of a user in the index.
+ */
+typedef struct presence_user
+{
+    char username[50];                   /**< Username */
+    presence_link_t *connections;        /**< Connections of the user */
+    int connection_count;                /**< Number of connections */
+    presence_status_t status;            /**< Current status */
+    presence_status_t published;         /**< Status last sent to the subscribers */
+    char typing[50];                     /**< Channel in which the user is typing, empty otherwise */
+    char typing_published[50];           /**< Typing channel last sent to the subscribers */
+    uint64_t typing_until;               /**< Time at which the typing indication expires */
+    bool pending;                        /**< true if the user is in the list of the changes to send */
+    struct presence_user *next;          /**< Next entry in the hash bucket */
+    struct presence_user *next_pending;  /**< Next user with changes to send */
+} presence_user_t;
+
+/**
+ * @brief Function sending an event line to the subscribers.
+ *
+ * @param[in] channel The channel whose members receive the line, or NULL for all the subscribers.
+ * @param[in] line The line, ending with a newline.
+ * @param[in] len The length of the line.
+ */
+typedef void (*presence_deliver_fn)(const char *channel, const char *line, size_t len);
+
+/**
+ * @brief Initializes the presence index.
+ *
+ * @param[in] wheel The timing wheel of the server, used to send the batches.
+ * @param[in] deliver The function sending the events.
+ */
+void presence_init(timer_wheel_t *wheel, presence_deliver_fn deliver);
+
+/**
+ * @brief Links a logged-in connection to its user; the user becomes online if it was not.
+ *
+ * @param[out] link The link embedded in the connection.
+ * @param[in] username The username.
+ * @param[in] connection The connection.
+ * @return The user, or NULL if the allocation failed.
+ */
+presence_user_t *presence_connect(presence_link_t *link, const char *username, void *connection);
+
+/**
+ * @brief Unlinks a connection that is closed; the user becomes offline after its last connection.
+ *
+ * Does nothing if the connection is not linked.
+ *
+ * @param[in,out] link The link of the connection.
+ */
+void presence_disconnect(presence_link_t *link);
+
+/**
+ * @brief Finds a connected user.
+ *
+ * @param[in] username The username.
+ * @return The user, whose connections can be walked from `connections`, or NULL if the user is not connected.
+ */
+presence_user_t *presence_find(const char *username);
+
+/**
+ * @brief Marks a user away, or back.
+ *
+ * @param[in,out] user The user.
+ * @param[in] away true if the user is away.
+ */
+void presence_set_away(presence_user_t *user, bool away);
+
+/**
+ * @brief Reports that a user is typing in a channel, or stopped.
+ *
+ * @param[in,out] user The user.
+ * @param[in] channel The channel, or an empty string if the user stopped typing (message sent, channel left).
+ * @param[in] now The current monotonic time in milliseconds.
+ */
+void presence_typing(presence_user_t *user, const char *channel, uint64_t now);
+
+/**
+ * @brief Sends the pending changes now.
+ *
+ * Called by the timer of the batches, and before the server stops.
+ *
+ * @param[in] now The current monotonic time in milliseconds.
+ */
+void presence_flush(uint64_t now);
+
+/**
+ * @brief Writes the status of the connected users, for a client that subscribes.
+ *
+ * @param[in] emit The function receiving each `@PRESENCE` line.
+ * @param[in] context The argument given to emit.
+ */
+void presence_snapshot(void (*emit)(void *context, const char *line, size_t len), void *context);
+
+/**
+ * @brief Writes the statistics of the presence index.
+ *
+ * @param[out] buffer The buffer receiving the text (one line).
+ * @param[in] size The size of the buffer.
+ */
+void presence_format_stats(char *buffer, size_t size);
+
+#endif
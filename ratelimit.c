@@ -0,0 +1,127 @@
+#include "ratelimit.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static user_limits_t *user_table[USER_LIMITS_BUCKETS]; // Limites des utilisateurs connectés, ou pas encore rechargées
+
+static void bucket_refill(token_bucket_t *bucket, uint64_t now)
+{
+    if (now > bucket->last_ns)
+    {
+        bucket->tokens += bucket->rate * (now - bucket->last_ns) / 1e9;
+        if (bucket->tokens > bucket->burst)
+        {
+            bucket->tokens = bucket->burst;
+        }
+        bucket->last_ns = now;
+    }
+}
+
+void bucket_init(token_bucket_t *bucket, double rate, double burst)
+{
+    bucket->tokens = burst;
+    bucket->rate = rate;
+    bucket->burst = burst;
+    bucket->last_ns = monotonic_ns();
+}
+
+bool bucket_take(token_bucket_t *bucket, double amount, uint64_t now)
+{
+    bucket_refill(bucket, now);
+    if (bucket->tokens < amount)
+    {
+        return false;
+    }
+    bucket->tokens -= amount;
+    return true;
+}
+
+uint64_t bucket_charge(token_bucket_t *bucket, double amount, uint64_t now)
+{
+    bucket_refill(bucket, now);
+    bucket->tokens -= amount;
+    if (bucket->tokens >= 0)
+    {
+        return 0;
+    }
+    return (uint64_t)(-bucket->tokens / bucket->rate * 1e9); // Temps nécessaire pour rembourser la dette
+}
+
+void rate_limits_init_connection(rate_limits_t *limits)
+{
+    bucket_init(&limits->messages, CONN_MESSAGES_PER_SEC, CONN_MESSAGES_BURST);
+    bucket_init(&limits->bytes, CONN_BYTES_PER_SEC, CONN_BYTES_BURST);
+    bucket_init(&limits->uploads, CONN_UPLOADS_PER_SEC, CONN_UPLOADS_BURST);
+}
+
+// Vrai si les compteurs sont de nouveau pleins : les recréer ne rendrait rien à l'utilisateur
+static bool user_limits_refilled(user_limits_t *entry, uint64_t now)
+{
+    bucket_refill(&entry->limits.messages, now);
+    bucket_refill(&entry->limits.bytes, now);
+    bucket_refill(&entry->limits.uploads, now);
+    return entry->limits.messages.tokens >= entry->limits.messages.burst && entry->limits.bytes.tokens >= entry->limits.bytes.burst &&
+           entry->limits.uploads.tokens >= entry->limits.uploads.burst;
+}
+
+// Libère les entrées d'une liste qui n'ont plus de connexion et dont les compteurs sont pleins
+static void purge_refilled(unsigned int index)
+{
+    uint64_t now = monotonic_ns();
+    user_limits_t **link = &user_table[index];
+    while (*link != NULL)
+    {
+        user_limits_t *entry = *link;
+        if (entry->refcount == 0 && user_limits_refilled(entry, now))
+        {
+            *link = entry->next;
+            free(entry);
+        }
+        else
+        {
+            link = &entry->next;
+        }
+    }
+}
+
+user_limits_t *user_limits_acquire(const char *username)
+{
+    unsigned int index = hash_string(username) % USER_LIMITS_BUCKETS;
+    purge_refilled(index);
+    for (user_limits_t *entry = user_table[index]; entry != NULL; entry = entry->next)
+    {
+        if (strcmp(entry->username, username) == 0)
+        {
+            entry->refcount++;
+            return entry;
+        }
+    }
+
+    // Première connexion de l'utilisateur : créer ses compteurs
+    user_limits_t *entry = calloc(1, sizeof(user_limits_t));
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+    strncpy(entry->username, username, sizeof(entry->username) - 1);
+    entry->refcount = 1;
+    bucket_init(&entry->limits.messages, USER_MESSAGES_PER_SEC, USER_MESSAGES_BURST);
+    bucket_init(&entry->limits.bytes, USER_BYTES_PER_SEC, USER_BYTES_BURST);
+    bucket_init(&entry->limits.uploads, USER_UPLOADS_PER_SEC, USER_UPLOADS_BURST);
+    entry->next = user_table[index];
+    user_table[index] = entry;
+    return entry;
+}
+
+void user_limits_release(user_limits_t *limits)
+{
+    if (limits == NULL || --limits->refcount > 0)
+    {
+        return;
+    }
+
+    // Dernière connexion fermée : l'entrée reste tant que ses compteurs ne sont pas pleins, sinon se
+    // reconnecter suffirait à retrouver tout son quota
+    purge_refilled(hash_string(limits->username) % USER_LIMITS_BUCKETS);
+}
@@ -0,0 +1,124 @@
+/**
+ * @file ratelimit.h
+ * @brief Token buckets limiting the traffic of connections and users.
+ *
+ * Each connection and each user owns token buckets for messages per second,
+ * bytes per second and file uploads. Buckets are refilled lazily from a
+ * monotonic clock when they are used, so a refill costs O(1) and no timer
+ * is needed. Over-limit messages and uploads are rejected; over-limit bytes
+ * are accepted as a debt, and the connection is not read again until the
+ * debt is paid, which pushes the backpressure back to the client socket.
+ */
+
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "util.h"
+
+#define CONN_MESSAGES_PER_SEC 5.0      /**< Messages per second allowed on a connection */
+#define CONN_MESSAGES_BURST 20.0       /**< Messages a connection can send in a burst */
+#define CONN_BYTES_PER_SEC 16384.0     /**< Chat bytes per second allowed on a connection */
+#define CONN_BYTES_BURST 65536.0       /**< Chat bytes a connection can send in a burst */
+#define CONN_UPLOADS_PER_SEC 0.5       /**< File uploads per second allowed on a connection */
+#define CONN_UPLOADS_BURST 3.0         /**< File uploads a connection can start in a burst */
+
+#define USER_MESSAGES_PER_SEC 10.0     /**< Messages per second allowed for a user, all connections included */
+#define USER_MESSAGES_BURST 40.0       /**< Messages a user can send in a burst */
+#define USER_BYTES_PER_SEC 32768.0     /**< Chat bytes per second allowed for a user */
+#define USER_BYTES_BURST 131072.0      /**< Chat bytes a user can send in a burst */
+#define USER_UPLOADS_PER_SEC 1.0       /**< File uploads per second allowed for a user */
+#define USER_UPLOADS_BURST 5.0         /**< File uploads a user can start in a burst */
+
+#define USER_LIMITS_BUCKETS 256        /**< Size of the hash table of the per-user limits */
+
+/**
+ * @brief Structure representing a token bucket.
+ */
+typedef struct
+{
+    double tokens;     /**< Tokens currently available (negative when in debt) */
+    double rate;       /**< Tokens added per second */
+    double burst;      /**< Maximum number of tokens */
+    uint64_t last_ns;  /**< Time of the last refill */
+} token_bucket_t;
+
+/**
+ * @brief Structure grouping the limits of a connection or of a user.
+ */
+typedef struct
+{
+    token_bucket_t messages;  /**< Messages per second */
+    token_bucket_t bytes;     /**< Bytes per second */
+    token_bucket_t uploads;   /**< File uploads */
+} rate_limits_t;
+
+/**
+ * @brief Structure representing the shared limits of a user.
+ */
+typedef struct user_limits
+{
+    char username[50];          /**< Username owning the limits */
+    int refcount;               /**< Number of connections of the user, 0 while the buckets refill */
+    rate_limits_t limits;       /**< Token buckets of the user */
+    struct user_limits *next;   /**< Next entry in the hash bucket */
+} user_limits_t;
+
+/**
+ * @brief Initializes a token bucket, full.
+ *
+ * @param[out] bucket The bucket to initialize.
+ * @param[in] rate The number of tokens added per second.
+ * @param[in] burst The maximum number of tokens.
+ */
+void bucket_init(token_bucket_t *bucket, double rate, double burst);
+
+/**
+ * @brief Takes tokens from a bucket if enough are available.
+ *
+ * @param[in,out] bucket The bucket.
+ * @param[in] amount The number of tokens to take.
+ * @param[in] now The current time.
+ * @return true if the tokens were taken, false if the bucket does not hold enough tokens.
+ */
+bool bucket_take(token_bucket_t *bucket, double amount, uint64_t now);
+
+/**
+ * @brief Takes tokens from a bucket, even if this puts it in debt.
+ *
+ * @param[in,out] bucket The bucket.
+ * @param[in] amount The number of tokens to take.
+ * @param[in] now The current time.
+ * @return The time in nanoseconds until the debt is paid, 0 if there is no debt.
+ */
+uint64_t bucket_charge(token_bucket_t *bucket, double amount, uint64_t now);
+
+/**
+ * @brief Initializes the limits of a connection.
+ *
+ * @param[out] limits The limits to initialize.
+ */
+void rate_limits_init_connection(rate_limits_t *limits);
+
+/**
+ * @brief Gets the limits of a user, creating them full if the user has none.
+ *
+ * @param[in] username The username.
+ * @return The limits of the user, or NULL if the allocation failed.
+ */
+user_limits_t *user_limits_acquire(const char *username);
+
+/**
+ * @brief Releases the limits of a user when one of their connections closes.
+ *
+ * After the last connection, the entry is kept until its buckets are full
+ * again, so reconnecting does not give a user a fresh quota; it is freed
+ * by a later call on the same hash bucket.
+ *
+ * @param[in] limits The limits returned by user_limits_acquire().
+ */
+void user_limits_release(user_limits_t *limits);
+
+#endif
@@ -0,0 +1,143 @@
+#include "readpool.h"
+#include "storage.h"
+#include "workpool.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    int socket;
+    int type;
+    char channel[50];
+    uint64_t after;
+    char pattern[READPOOL_PATTERN_SIZE];
+} read_job_t;
+
+static workpool_t pool;
+
+// Statistiques par type de lecture, tenues par la boucle d'événements
+static unsigned long total_replays = 0;
+static unsigned long total_searches = 0;
+static unsigned long long total_messages = 0;
+
+// Résultat rempli par un thread, avec la taille allouée de ses enregistrements
+typedef struct
+{
+    readpool_result_t *result;
+    size_t capacity;
+} collector_t;
+
+// Ajoute un message aux enregistrements d'un résultat : numéro, longueur, puis le texte
+static void collect(void *context, uint64_t seq, const char *message, size_t len)
+{
+    collector_t *collector = context;
+    readpool_result_t *result = collector->result;
+    size_t needed = result->len + sizeof(seq) + sizeof(len) + len;
+    if (needed > collector->capacity)
+    {
+        size_t grown = collector->capacity > 0 ? collector->capacity * 2 : 4096;
+        while (grown < needed)
+        {
+            grown *= 2;
+        }
+        char *records = realloc(result->records, grown);
+        if (records == NULL)
+        {
+            return; // Message perdu : le client le redemandera en revenant dans le salon
+        }
+        result->records = records;
+        collector->capacity = grown;
+    }
+    memcpy(result->records + result->len, &seq, sizeof(seq));
+    memcpy(result->records + result->len + sizeof(seq), &len, sizeof(len));
+    memcpy(result->records + result->len + sizeof(seq) + sizeof(len), message, len);
+    result->len = needed;
+    result->count++;
+}
+
+// Lit l'historique dans un thread du pool
+static void run_read(void *job, unsigned int ticket, void *result)
+{
+    read_job_t *read = job;
+    readpool_result_t *done = result;
+    done->socket = read->socket;
+    done->ticket = ticket;
+    done->type = read->type;
+    done->after = read->after;
+    strcpy(done->channel, read->channel);
+    strcpy(done->pattern, read->pattern);
+    collector_t collector = {done, 0};
+    if (read->type == READPOOL_SEARCH)
+    {
+        storage_search(read->channel, read->pattern, READPOOL_SEARCH_MAX, collect, &collector);
+    }
+    else
+    {
+        storage_replay(read->channel, read->after, collect, &collector);
+    }
+}
+
+int readpool_start(int workers, int capacity)
+{
+    return workpool_start(&pool, "Lecture de l'historique", run_read, sizeof(read_job_t), sizeof(readpool_result_t), workers,
+                          capacity, 0);
+}
+
+int readpool_submit(int socket, int type, const char *channel, uint64_t after, const char *pattern, unsigned int *ticket)
+{
+    read_job_t job = {socket, type, "", after, ""};
+    snprintf(job.channel, sizeof(job.channel), "%s", channel);
+    snprintf(job.pattern, sizeof(job.pattern), "%s", pattern != NULL ? pattern : "");
+    return workpool_submit(&pool, &job, ticket);
+}
+
+int readpool_collect(readpool_result_t *results, int max)
+{
+    int n = workpool_collect(&pool, results, max);
+    for (int i = 0; i < n; i++)
+    {
+        if (results[i].type == READPOOL_SEARCH)
+        {
+            total_searches++;
+        }
+        else
+        {
+            total_replays++;
+        }
+        total_messages += results[i].count;
+    }
+    return n;
+}
+
+bool readpool_next(const readpool_result_t *result, size_t *offset, uint64_t *seq, const char **message, size_t *len)
+{
+    if (*offset + sizeof(*seq) + sizeof(*len) > result->len)
+    {
+        return false;
+    }
+    memcpy(seq, result->records + *offset, sizeof(*seq));
+    memcpy(len, result->records + *offset + sizeof(*seq), sizeof(*len));
+    *message = result->records + *offset + sizeof(*seq) + sizeof(*len);
+    *offset += sizeof(*seq) + sizeof(*len) + *len;
+    return true;
+}
+
+void readpool_free(readpool_result_t *result)
+{
+    free(result->records);
+    result->records = NULL;
+    result->len = 0;
+}
+
+void readpool_format_stats(char *buffer, size_t size)
+{
+    pthread_mutex_lock(&pool.lock);
+    snprintf(buffer, size,
+             "Lectures de l'historique : file %d/%d (max %d), threads occupés %d/%d, relectures %lu, recherches %lu, %llu messages lus, refusées (file pleine) %lu, durée moyenne %.1f ms (max %.1f ms)\n",
+             pool.jobs_count, pool.capacity, pool.max_queued, pool.busy, pool.workers, total_replays, total_searches,
+             total_messages, pool.rejected, pool.done > 0 ? pool.total_ms / pool.done : 0.0, pool.max_ms);
+    pthread_mutex_unlock(&pool.lock);
+}
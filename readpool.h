@@ -0,0 +1,111 @@
+/**
+ * @file readpool.h
+ * @brief Worker threads reading the stored history, away from the event loop.
+ *
+ * Replaying messages older than the in-memory history (history.h) and
+ * searching a channel read the storage engine, which can take a while on a
+ * large archive. The event loop submits these reads to a small pool of
+ * worker threads (workpool.h), as for the logins (auth.h), and is woken up
+ * when a result is ready: live messages keep being delivered meanwhile.
+ *
+ * The workers only read. With the SQLite archive, each query opens its own
+ * read-only connection on a WAL snapshot, which never blocks the batches
+ * written by the event loop; with the message log, a read takes a snapshot
+ * of the segments under the lock of the log and reads them without it.
+ */
+
+#ifndef READPOOL_H
+#define READPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define READPOOL_WORKERS 2          /**< Default number of reading threads (`read-workers`) */
+#define READPOOL_QUEUE_CAPACITY 64  /**< Default maximum number of pending reads (`read-queue`) */
+#define READPOOL_SEARCH_MAX 20      /**< Most recent matches returned by a search */
+#define READPOOL_PATTERN_SIZE 128   /**< Size of a search pattern */
+
+#define READPOOL_REPLAY 0 /**< Messages of a channel after a sequence number */
+#define READPOOL_SEARCH 1 /**< Most recent messages of a channel containing a text */
+
+/**
+ * @brief Structure representing a finished read.
+ */
+typedef struct
+{
+    int socket;                          /**< Socket of the client that asked for the read */
+    unsigned int ticket;                 /**< Ticket returned by readpool_submit() */
+    int type;                            /**< READPOOL_REPLAY or READPOOL_SEARCH */
+    char channel[50];                    /**< Channel read */
+    uint64_t after;                      /**< Last number seen by the client (READPOOL_REPLAY) */
+    char pattern[READPOOL_PATTERN_SIZE]; /**< Text searched (READPOOL_SEARCH) */
+    char *records;                       /**< Messages read, to go through with readpool_next() */
+    size_t len;                          /**< Bytes of records */
+    int count;                           /**< Number of messages read */
+} readpool_result_t;
+
+/**
+ * @brief Starts the reading threads.
+ *
+ * @param[in] workers The number of threads.
+ * @param[in] capacity The maximum number of pending reads; more are refused.
+ * @return The eventfd to watch for results, or -1 on error.
+ */
+int readpool_start(int workers, int capacity);
+
+/**
+ * @brief Queues a read of the stored history of a channel.
+ *
+ * @param[in] socket The socket of the client.
+ * @param[in] type READPOOL_REPLAY or READPOOL_SEARCH.
+ * @param[in] channel The channel.
+ * @param[in] after The last number seen by the client (READPOOL_REPLAY).
+ * @param[in] pattern The text searched (READPOOL_SEARCH), or NULL.
+ * @param[out] ticket The ticket identifying the read, never 0.
+ * @return 0 on success, -1 if the queue is full.
+ */
+int readpool_submit(int socket, int type, const char *channel, uint64_t after, const char *pattern, unsigned int *ticket);
+
+/**
+ * @brief Collects the finished reads.
+ *
+ * This function must be called when the eventfd returned by readpool_start()
+ * is readable. Each result must be released with readpool_free().
+ *
+ * @param[out] results The array receiving the results.
+ * @param[in] max The size of the array.
+ * @return The number of results written.
+ */
+int readpool_collect(readpool_result_t *results, int max);
+
+/**
+ * @brief Goes through the messages of a result, in the order of the storage.
+ *
+ * Replays give the messages by increasing number; searches from the most recent.
+ *
+ * @param[in] result The result.
+ * @param[in,out] offset The position in the records, 0 for the first message.
+ * @param[out] seq The sequence number of the message.
+ * @param[out] message The message (not null-terminated).
+ * @param[out] len The length of the message.
+ * @return true if a message was returned, false after the last one.
+ */
+bool readpool_next(const readpool_result_t *result, size_t *offset, uint64_t *seq, const char **message, size_t *len);
+
+/**
+ * @brief Releases the messages of a result.
+ *
+ * @param[in,out] result The result.
+ */
+void readpool_free(readpool_result_t *result);
+
+/**
+ * @brief Writes the statistics of the reading threads.
+ *
+ * @param[out] buffer The buffer receiving the text (one line).
+ * @param[in] size The size of the buffer.
+ */
+void readpool_format_stats(char *buffer, size_t size);
+
+#endif
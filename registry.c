@@ -0,0 +1,181 @@
+#include "registry.h"
+
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "util.h"
+
+// Salon connu ; chaîné dans sa case de la table et dans l'ordre de création
+typedef struct registry_entry
+{
+    char name[50];
+    bool directory_ready;
+    struct registry_entry *next;
+    struct registry_entry *prev_created;
+    struct registry_entry *next_created;
+} registry_entry_t;
+
+static registry_entry_t *table[REGISTRY_BUCKETS];
+static registry_entry_t *first_created = NULL;
+static registry_entry_t *last_created = NULL;
+static int channel_count = 0;
+static int directories_ready = 0;
+static double load_ms = 0;
+
+static registry_entry_t *lookup(const char *channel)
+{
+    for (registry_entry_t *entry = table[hash_string(channel) % REGISTRY_BUCKETS]; entry != NULL; entry = entry->next)
+    {
+        if (strcmp(entry->name, channel) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+int registry_load(void)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    if (sqlite3_open_v2("database.db", &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+    {
+        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return -1;
+    }
+    sqlite3_busy_timeout(db, 1000);
+
+    // Une seule requête, dans l'ordre de création des salons
+    if (sqlite3_prepare_v2(db, "SELECT name FROM salons ORDER BY id;", -1, &stmt, 0) != SQLITE_OK)
+    {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return -1;
+    }
+    int status = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        if (registry_add((const char *)sqlite3_column_text(stmt, 0)) < 0)
+        {
+            status = -1;
+            break;
+        }
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    load_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    return status < 0 ? -1 : channel_count;
+}
+
+bool registry_exists(const char *channel)
+{
+    return lookup(channel) != NULL;
+}
+
+int registry_add(const char *channel)
+{
+    if (lookup(channel) != NULL)
+    {
+        return 0;
+    }
+    registry_entry_t *entry = calloc(1, sizeof(registry_entry_t));
+    if (entry == NULL)
+    {
+        return -1;
+    }
+    snprintf(entry->name, sizeof(entry->name), "%s", channel);
+
+    unsigned int index = hash_string(channel) % REGISTRY_BUCKETS;
+    entry->next = table[index];
+    table[index] = entry;
+
+    entry->prev_created = last_created;
+    if (last_created != NULL)
+    {
+        last_created->next_created = entry;
+    }
+    else
+    {
+        first_created = entry;
+    }
+    last_created = entry;
+    channel_count++;
+    return 0;
+}
+
+void registry_remove(const char *channel)
+{
+    registry_entry_t **link = &table[hash_string(channel) % REGISTRY_BUCKETS];
+    while (*link != NULL && strcmp((*link)->name, channel) != 0)
+    {
+        link = &(*link)->next;
+    }
+    registry_entry_t *entry = *link;
+    if (entry == NULL)
+    {
+        return;
+    }
+    *link = entry->next;
+
+    if (entry->prev_created != NULL)
+    {
+        entry->prev_created->next_created = entry->next_created;
+    }
+    else
+    {
+        first_created = entry->next_created;
+    }
+    if (entry->next_created != NULL)
+    {
+        entry->next_created->prev_created = entry->prev_created;
+    }
+    else
+    {
+        last_created = entry->prev_created;
+    }
+
+    channel_count--;
+    if (entry->directory_ready)
+    {
+        directories_ready--;
+    }
+    free(entry);
+}
+
+void registry_foreach(registry_visit_fn visit, void *context)
+{
+    for (registry_entry_t *entry = first_created; entry != NULL; entry = entry->next_created)
+    {
+        visit(context, entry->name);
+    }
+}
+
+bool registry_directory_ready(const char *channel)
+{
+    registry_entry_t *entry = lookup(channel);
+    return entry != NULL && entry->directory_ready;
+}
+
+void registry_set_directory_ready(const char *channel)
+{
+    registry_entry_t *entry = lookup(channel);
+    if (entry != NULL && !entry->directory_ready)
+    {
+        entry->directory_ready = true;
+        directories_ready++;
+    }
+}
+
+void registry_format_stats(char *buffer, size_t size)
+{
+    snprintf(buffer, size, "Registre des salons : %d salons (chargés en %.1f ms au démarrage), %d dossiers préparés\n", channel_count, load_ms,
+             directories_ready);
+}
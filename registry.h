@@ -0,0 +1,91 @@
+/**
+ * @file registry.h
+ * @brief In-memory registry of the channels.
+ *
+ * The names of the channels are read from database.db once, with a single
+ * query, when the server starts; afterwards the existence checks and the
+ * channel list are answered from a hash table, without opening the
+ * database. Creating or deleting a channel still writes to the database,
+ * then updates the registry.
+ *
+ * The registry also remembers whether the file directory of a channel
+ * (`server/<channel>`) has been prepared by this process: the directories
+ * are no longer created at startup, but on the first upload to the channel,
+ * which also removes the partial uploads left by a previous process.
+ */
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define REGISTRY_BUCKETS 1024 /**< Size of the hash table of the channels */
+
+/**
+ * @brief Callback receiving the name of a channel.
+ */
+typedef void (*registry_visit_fn)(void *context, const char *channel);
+
+/**
+ * @brief Loads the names of all the channels from the database.
+ *
+ * @return The number of channels loaded, -1 on error.
+ */
+int registry_load(void);
+
+/**
+ * @brief Checks whether a channel is in the registry.
+ *
+ * @param[in] channel The channel.
+ * @return true if the channel exists.
+ */
+bool registry_exists(const char *channel);
+
+/**
+ * @brief Adds a channel that was just created.
+ *
+ * @param[in] channel The channel.
+ * @return 0 on success (or if it is already known), -1 on allocation failure.
+ */
+int registry_add(const char *channel);
+
+/**
+ * @brief Removes a deleted channel.
+ *
+ * @param[in] channel The channel.
+ */
+void registry_remove(const char *channel);
+
+/**
+ * @brief Calls a function for each channel, in the order of their creation.
+ *
+ * @param[in] visit The function.
+ * @param[in] context The argument given to visit.
+ */
+void registry_foreach(registry_visit_fn visit, void *context);
+
+/**
+ * @brief Checks whether the file directory of a channel has been prepared by this process.
+ *
+ * @param[in] channel The channel.
+ * @return true if it has, false otherwise or if the channel is unknown.
+ */
+bool registry_directory_ready(const char *channel);
+
+/**
+ * @brief Records that the file directory of a channel has been prepared.
+ *
+ * @param[in] channel The channel.
+ */
+void registry_set_directory_ready(const char *channel);
+
+/**
+ * @brief Writes the statistics of the registry.
+ *
+ * @param[out] buffer The buffer receiving the text (one line).
+ * @param[in] size The size of the buffer.
+ */
+void registry_format_stats(char *buffer, size_t size);
+
+#endif
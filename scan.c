@@ -0,0 +1,371 @@
+#include "scan.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+/*
+ * Chaque implémentation fournit trois recherches : la fin de ligne, le premier
+ * octet non ASCII et le premier octet non imprimable. Le reste (validation
+ * UTF-8, nettoyage) est commun et ne traite octet par octet que les caractères
+ * trouvés par ces recherches.
+ */
+typedef struct
+{
+    const char *name;
+    size_t (*find_newline)(const char *buffer, size_t len);
+    size_t (*skip_ascii)(const char *buffer, size_t len);
+    size_t (*skip_printable)(const char *buffer, size_t len);
+} scan_impl_t;
+
+static size_t find_newline_scalar(const char *buffer, size_t len)
+{
+    const char *end = memchr(buffer, '\n', len);
+    return end != NULL ? (size_t)(end - buffer) : len;
+}
+
+static size_t skip_ascii_scalar(const char *buffer, size_t len)
+{
+    size_t i = 0;
+    while (i < len && (unsigned char)buffer[i] < 0x80)
+    {
+        i++;
+    }
+    return i;
+}
+
+static size_t skip_printable_scalar(const char *buffer, size_t len)
+{
+    size_t i = 0;
+    while (i < len && (unsigned char)buffer[i] >= 0x20 && (unsigned char)buffer[i] < 0x7f)
+    {
+        i++;
+    }
+    return i;
+}
+
+static const scan_impl_t scan_scalar = {"scalar", find_newline_scalar, skip_ascii_scalar, skip_printable_scalar};
+
+#ifdef SCAN_X86
+
+/*
+ * Les masques ont un bit par octet, à 1 pour les octets cherchés. La fin d'un
+ * tampon qui ne remplit pas un registre est traitée en relisant les derniers
+ * octets (chargement qui chevauche le bloc précédent) plutôt qu'octet par
+ * octet : la plupart des messages sont plus courts que 32 octets.
+ */
+
+typedef unsigned (*mask_fn)(const char *p);
+
+static inline unsigned newline_mask16(const char *p)
+{
+    __m128i bytes = _mm_loadu_si128((const __m128i *)p);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')));
+}
+
+static inline unsigned non_ascii_mask16(const char *p)
+{
+    // Le bit de poids fort de chaque octet indique un octet non ASCII
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)p));
+}
+
+static inline unsigned unprintable_mask16(const char *p)
+{
+    // Comparaisons signées : les octets non ASCII sont négatifs, donc pas au-dessus de 0x1f
+    __m128i bytes = _mm_loadu_si128((const __m128i *)p);
+    __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(0x1f)), _mm_cmpgt_epi8(_mm_set1_epi8(0x7f), bytes));
+    return ~_mm_movemask_epi8(printable) & 0xffff;
+}
+
+// Premier octet cherché par blocs de 16 octets, ou len
+static inline __attribute__((always_inline)) size_t search16(const char *buffer, size_t len, mask_fn mask16,
+                                                             size_t (*scalar)(const char *, size_t))
+{
+    if (len < 16)
+    {
+        return scalar(buffer, len);
+    }
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        unsigned mask = mask16(buffer + i);
+        if (mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    if (i < len)
+    {
+        // Les octets déjà vus sont les premiers du dernier bloc : les écarter du masque
+        unsigned mask = mask16(buffer + len - 16) >> (16 - (len - i));
+        if (mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return len;
+}
+
+static size_t find_newline_sse2(const char *buffer, size_t len)
+{
+    return search16(buffer, len, newline_mask16, find_newline_scalar);
+}
+
+static size_t skip_ascii_sse2(const char *buffer, size_t len)
+{
+    return search16(buffer, len, non_ascii_mask16, skip_ascii_scalar);
+}
+
+static size_t skip_printable_sse2(const char *buffer, size_t len)
+{
+    return search16(buffer, len, unprintable_mask16, skip_printable_scalar);
+}
+
+static const scan_impl_t scan_sse2 = {"sse2", find_newline_sse2, skip_ascii_sse2, skip_printable_sse2};
+
+// AVX2 : 32 octets par comparaison, si le processeur le permet
+
+__attribute__((target("avx2"))) static inline unsigned newline_mask32(const char *p)
+{
+    __m256i bytes = _mm256_loadu_si256((const __m256i *)p);
+    return (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')));
+}
+
+__attribute__((target("avx2"))) static inline unsigned non_ascii_mask32(const char *p)
+{
+    return (unsigned)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)p));
+}
+
+__attribute__((target("avx2"))) static inline unsigned unprintable_mask32(const char *p)
+{
+    __m256i bytes = _mm256_loadu_si256((const __m256i *)p);
+    __m256i printable = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(0x1f)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8(0x7f), bytes));
+    return ~(unsigned)_mm256_movemask_epi8(printable);
+}
+
+// Même parcours par blocs de 32 octets ; les tampons plus courts passent par les blocs de 16 (encodés en VEX ici)
+__attribute__((target("avx2"))) static inline __attribute__((always_inline)) size_t
+search32(const char *buffer, size_t len, mask_fn mask32, mask_fn mask16, size_t (*scalar)(const char *, size_t))
+{
+    if (len < 32)
+    {
+        return search16(buffer, len, mask16, scalar);
+    }
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        unsigned mask = mask32(buffer + i);
+        if (mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    if (i < len)
+    {
+        unsigned mask = mask32(buffer + len - 32) >> (32 - (len - i));
+        if (mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return len;
+}
+
+__attribute__((target("avx2"))) static size_t find_newline_avx2(const char *buffer, size_t len)
+{
+    return search32(buffer, len, newline_mask32, newline_mask16, find_newline_scalar);
+}
+
+__attribute__((target("avx2"))) static size_t skip_ascii_avx2(const char *buffer, size_t len)
+{
+    return search32(buffer, len, non_ascii_mask32, non_ascii_mask16, skip_ascii_scalar);
+}
+
+__attribute__((target("avx2"))) static size_t skip_printable_avx2(const char *buffer, size_t len)
+{
+    return search32(buffer, len, unprintable_mask32, unprintable_mask16, skip_printable_scalar);
+}
+
+static const scan_impl_t scan_avx2 = {"avx2", find_newline_avx2, skip_ascii_avx2, skip_printable_avx2};
+
+#endif
+
+static const scan_impl_t *impl = NULL;
+
+static const scan_impl_t *get_impl(void)
+{
+    if (impl == NULL)
+    {
+#ifdef SCAN_X86
+        __builtin_cpu_init();
+        impl = __builtin_cpu_supports("avx2") ? &scan_avx2 : &scan_sse2;
+#else
+        impl = &scan_scalar;
+#endif
+    }
+    return impl;
+}
+
+int scan_set_backend(const char *name)
+{
+    if (strcmp(name, "scalar") == 0)
+    {
+        impl = &scan_scalar;
+        return 0;
+    }
+#ifdef SCAN_X86
+    if (strcmp(name, "sse2") == 0)
+    {
+        impl = &scan_sse2;
+        return 0;
+    }
+    __builtin_cpu_init();
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    {
+        impl = &scan_avx2;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+const char *scan_backend(void)
+{
+    return get_impl()->name;
+}
+
+// Longueur de la séquence UTF-8 qui commence à s, ou 0 si elle est invalide (RFC 3629)
+static size_t utf8_sequence(const unsigned char *s, size_t len)
+{
+    unsigned char c = s[0];
+    size_t n;
+    unsigned char min = 0x80, max = 0xbf; // Bornes du deuxième octet
+
+    if (c >= 0xc2 && c <= 0xdf)
+    {
+        n = 2;
+    }
+    else if (c >= 0xe0 && c <= 0xef)
+    {
+        n = 3;
+        if (c == 0xe0)
+        {
+            min = 0xa0; // Forme trop longue
+        }
+        else if (c == 0xed)
+        {
+            max = 0x9f; // Demi-codets UTF-16
+        }
+    }
+    else if (c >= 0xf0 && c <= 0xf4)
+    {
+        n = 4;
+        if (c == 0xf0)
+        {
+            min = 0x90;
+        }
+        else if (c == 0xf4)
+        {
+            max = 0x8f; // Au-delà de U+10FFFF
+        }
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (len < n || s[1] < min || s[1] > max)
+    {
+        return 0;
+    }
+    for (size_t i = 2; i < n; i++)
+    {
+        if ((s[i] & 0xc0) != 0x80)
+        {
+            return 0;
+        }
+    }
+    return n;
+}
+
+size_t scan_find_newline(const char *buffer, size_t len)
+{
+    return get_impl()->find_newline(buffer, len);
+}
+
+bool scan_utf8_valid(const char *buffer, size_t len)
+{
+    const scan_impl_t *scan = get_impl();
+    size_t i = 0;
+    while (1)
+    {
+        i += scan->skip_ascii(buffer + i, len - i);
+        if (i >= len)
+        {
+            return true;
+        }
+        size_t n = utf8_sequence((const unsigned char *)buffer + i, len - i);
+        if (n == 0)
+        {
+            return false;
+        }
+        i += n;
+    }
+}
+
+size_t scan_sanitize(char *buffer, size_t len)
+{
+    const scan_impl_t *scan = get_impl();
+    size_t in = 0, out = 0;
+    while (in < len)
+    {
+        // Recopier d'un bloc les caractères imprimables (rien à faire tant que rien n'a été retiré)
+        size_t run = scan->skip_printable(buffer + in, len - in);
+        if (out != in)
+        {
+            memmove(buffer + out, buffer + in, run);
+        }
+        in += run;
+        out += run;
+        if (in >= len)
+        {
+            break;
+        }
+
+        unsigned char c = buffer[in];
+        if (c == '\t')
+        {
+            buffer[out++] = c;
+            in++;
+        }
+        else if (c < 0x80)
+        {
+            in++; // Caractère de contrôle : retiré
+        }
+        else
+        {
+            size_t n = utf8_sequence((unsigned char *)buffer + in, len - in);
+            if (n == 2 && c == 0xc2 && (unsigned char)buffer[in + 1] < 0xa0)
+            {
+                in += 2; // Caractère de contrôle C1 (U+0080 à U+009F) : retiré aussi
+            }
+            else if (n == 0)
+            {
+                buffer[out++] = '?';
+                in++;
+            }
+            else
+            {
+                memmove(buffer + out, buffer + in, n);
+                in += n;
+                out += n;
+            }
+        }
+    }
+    return out;
+}
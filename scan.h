@@ -0,0 +1,67 @@
+/**
+ * @file scan.h
+ * @brief Vectorized scanning of the lines received from the clients.
+ *
+ * The event loop looks for the end of each command line, then sanitizes the
+ * line before it is interpreted or broadcast: control characters (terminal
+ * escape sequences, carriage returns...) are removed, and the bytes that are
+ * not valid UTF-8 are replaced by '?', so a client cannot corrupt the display
+ * of the other members of a channel.
+ *
+ * The kernels process 32 bytes (AVX2) or 16 bytes (SSE2) at a time and fall
+ * back to byte-by-byte processing only around non-ASCII characters. The
+ * implementation is chosen at the first call according to the processor, and
+ * can be forced with scan_set_backend() (used by the benchmark).
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Finds the first line feed of a buffer.
+ *
+ * @param[in] buffer The bytes to search.
+ * @param[in] len The number of bytes.
+ * @return The offset of the line feed, or len if there is none.
+ */
+size_t scan_find_newline(const char *buffer, size_t len);
+
+/**
+ * @brief Checks if a buffer is valid UTF-8 (no overlong forms, no surrogates).
+ *
+ * @param[in] buffer The bytes to check.
+ * @param[in] len The number of bytes.
+ * @return true if the buffer is valid UTF-8.
+ */
+bool scan_utf8_valid(const char *buffer, size_t len);
+
+/**
+ * @brief Removes the control characters of a line and replaces invalid UTF-8.
+ *
+ * Tabs are kept. The line is modified in place and is only shortened.
+ *
+ * @param[in,out] buffer The line.
+ * @param[in] len The length of the line.
+ * @return The new length of the line.
+ */
+size_t scan_sanitize(char *buffer, size_t len);
+
+/**
+ * @brief Forces an implementation of the kernels.
+ *
+ * @param[in] name "avx2", "sse2" or "scalar".
+ * @return 0 on success, -1 if the processor does not support it.
+ */
+int scan_set_backend(const char *name);
+
+/**
+ * @brief Returns the name of the implementation in use.
+ *
+ * @return "avx2", "sse2" or "scalar".
+ */
+const char *scan_backend(void);
+
+#endif
@@ -0,0 +1,263 @@
+/*
+ * Compare le découpage et le nettoyage des lignes reçues par le serveur avec
+ * chaque implémentation de scan.h, et avec l'ancien chemin (memchr, puis
+ * clean_input avec deux strchr, puis strlen).
+ *
+ * Les messages suivent une distribution proche d'un salon de discussion :
+ * surtout des messages courts, quelques longs, une partie avec des accents
+ * et quelques caractères de contrôle.
+ *
+ * Usage : scan_bench.exe [--messages n] [--rounds n] [--seed n]
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "scan.h"
+
+#define LINE_MAX_SIZE 1024 // BUFFER_SIZE du serveur
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Taille d'un message : 60 % de 5 à 40 octets, 30 % jusqu'à 200, 9 % jusqu'à 600, 1 % jusqu'à 1000
+static size_t message_size(void)
+{
+    int r = rand() % 100;
+    if (r < 60)
+    {
+        return 5 + rand() % 36;
+    }
+    if (r < 90)
+    {
+        return 40 + rand() % 161;
+    }
+    if (r < 99)
+    {
+        return 200 + rand() % 401;
+    }
+    return 600 + rand() % 401;
+}
+
+// Flux de lignes tel que le serveur le reçoit
+static char *generate_stream(int count, size_t *stream_len)
+{
+    static const char words[] = "bonjour salut le salon fichier message serveur demain merci voila ";
+    char *stream = malloc((size_t)count * (LINE_MAX_SIZE + 1));
+    size_t len = 0;
+    for (int i = 0; i < count; i++)
+    {
+        size_t size = message_size();
+        int accented = rand() % 10 == 0;  // 10 % des messages ont des accents
+        int control = rand() % 200 == 0;  // 0,5 % contiennent un caractère de contrôle
+        for (size_t j = 0; j < size; j++)
+        {
+            if (accented && j % 17 == 5 && j + 1 < size)
+            {
+                stream[len++] = (char)0xc3; // "é"
+                stream[len++] = (char)0xa9;
+                j++;
+            }
+            else if (control && j == size / 2)
+            {
+                stream[len++] = 0x1b;
+            }
+            else
+            {
+                stream[len++] = words[(i + j) % (sizeof(words) - 1)];
+            }
+        }
+        stream[len++] = '\n';
+    }
+    *stream_len = len;
+    return stream;
+}
+
+// Ancien traitement d'une ligne par le serveur
+static void clean_input_legacy(char *str)
+{
+    char *pos;
+    if ((pos = strchr(str, '\n')) != NULL || (pos = strchr(str, '\r')) != NULL)
+    {
+        *pos = '\0';
+    }
+}
+
+static size_t run_legacy(const char *stream, size_t stream_len, char *output)
+{
+    size_t total = 0, offset = 0;
+    char line[LINE_MAX_SIZE];
+    while (offset < stream_len)
+    {
+        const char *end = memchr(stream + offset, '\n', stream_len - offset);
+        size_t len = end - (stream + offset);
+        memcpy(line, stream + offset, len);
+        line[len] = '\0';
+        clean_input_legacy(line);
+        size_t clean_len = strlen(line);
+        memcpy(output + total, line, clean_len);
+        total += clean_len;
+        offset += len + 1;
+    }
+    return total;
+}
+
+static size_t run_scan(const char *stream, size_t stream_len, char *output)
+{
+    size_t total = 0, offset = 0;
+    char line[LINE_MAX_SIZE];
+    while (offset < stream_len)
+    {
+        size_t len = scan_find_newline(stream + offset, stream_len - offset);
+        memcpy(line, stream + offset, len);
+        size_t clean_len = scan_sanitize(line, len);
+        memcpy(output + total, line, clean_len);
+        total += clean_len;
+        offset += len + 1;
+    }
+    return total;
+}
+
+static size_t run_memchr(const char *stream, size_t stream_len, char *output)
+{
+    (void)output;
+    size_t lines = 0, offset = 0;
+    while (offset < stream_len)
+    {
+        const char *end = memchr(stream + offset, '\n', stream_len - offset);
+        offset = end - stream + 1;
+        lines++;
+    }
+    return lines;
+}
+
+static size_t run_newline(const char *stream, size_t stream_len, char *output)
+{
+    (void)output;
+    size_t lines = 0, offset = 0;
+    while (offset < stream_len)
+    {
+        offset += scan_find_newline(stream + offset, stream_len - offset) + 1;
+        lines++;
+    }
+    return lines;
+}
+
+static size_t run_utf8(const char *stream, size_t stream_len, char *output)
+{
+    (void)output;
+    size_t valid = 0, offset = 0;
+    while (offset < stream_len)
+    {
+        size_t len = scan_find_newline(stream + offset, stream_len - offset);
+        valid += scan_utf8_valid(stream + offset, len);
+        offset += len + 1;
+    }
+    return valid;
+}
+
+static void measure(const char *label, size_t (*run)(const char *, size_t, char *), const char *stream,
+                    size_t stream_len, char *output, int messages, int rounds)
+{
+    uint64_t best = UINT64_MAX;
+    for (int r = 0; r < rounds; r++)
+    {
+        uint64_t start = now_ns();
+        run(stream, stream_len, output);
+        uint64_t elapsed = now_ns() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+    printf("%-28s %7.1f ns/message  %6.2f Go/s\n", label, (double)best / messages, (double)stream_len / best);
+}
+
+int main(int argc, char *argv[])
+{
+    int messages = 200000;
+    int rounds = 10;
+    unsigned seed = 1;
+
+    static struct option long_options[] = {
+        {"messages", required_argument, 0, 'm'},
+        {"rounds", required_argument, 0, 'r'},
+        {"seed", required_argument, 0, 's'},
+        {0, 0, 0, 0}};
+    int opt;
+    while ((opt = getopt_long(argc, argv, "m:r:s:", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            messages = atoi(optarg);
+            break;
+        case 'r':
+            rounds = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage : %s [--messages n] [--rounds n] [--seed n]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (messages <= 0 || rounds <= 0)
+    {
+        fprintf(stderr, "Usage : %s [--messages n] [--rounds n] [--seed n]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    srand(seed);
+    size_t stream_len;
+    char *stream = generate_stream(messages, &stream_len);
+    char *output = malloc(stream_len);
+    char *reference = malloc(stream_len);
+    printf("%d messages, %.1f octets en moyenne, meilleur de %d passages :\n", messages,
+           (double)stream_len / messages - 1, rounds);
+
+    measure("memchr : fin de ligne", run_memchr, stream, stream_len, output, messages, rounds);
+    measure("memchr + clean_input", run_legacy, stream, stream_len, output, messages, rounds);
+
+    // Toutes les implémentations doivent produire exactement le même résultat
+    size_t reference_len = 0;
+    const char *backends[] = {"scalar", "sse2", "avx2"};
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+    {
+        if (scan_set_backend(backends[i]) < 0)
+        {
+            printf("%-28s non disponible sur ce processeur\n", backends[i]);
+            continue;
+        }
+        char label[64];
+        snprintf(label, sizeof(label), "%s : fin de ligne", backends[i]);
+        measure(label, run_newline, stream, stream_len, output, messages, rounds);
+        snprintf(label, sizeof(label), "%s : ligne + nettoyage", backends[i]);
+        measure(label, run_scan, stream, stream_len, output, messages, rounds);
+        snprintf(label, sizeof(label), "%s : validation UTF-8", backends[i]);
+        measure(label, run_utf8, stream, stream_len, output, messages, rounds);
+
+        size_t len = run_scan(stream, stream_len, output);
+        if (reference_len == 0)
+        {
+            reference_len = len;
+            memcpy(reference, output, len);
+        }
+        else if (len != reference_len || memcmp(output, reference, len) != 0)
+        {
+            fprintf(stderr, "%s : résultat différent de l'implémentation scalaire.\n", backends[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    free(stream);
+    free(output);
+    free(reference);
+    return 0;
+}
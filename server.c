@@ -1,6 +1,40 @@
+#define _GNU_SOURCE
 #include "server.h"
 
-client_t *clients[MAX_CLIENTS];
+client_t **clients;
+
+// Les client_t sont recyclés d'une connexion à l'autre au lieu de passer par malloc
+slab_t client_slab;
+
+// Compteurs de la limitation de débit
+unsigned long rate_rejected_messages = 0;
+unsigned long rate_rejected_uploads = 0;
+unsigned long uploads_verified = 0;
+unsigned long uploads_corrupted = 0;
+unsigned long direct_messages = 0;
+unsigned long rate_deferred = 0;
+
+// Minuteurs des connexions et compteurs des délais dépassés
+timer_wheel_t timer_wheel;
+unsigned long timeouts_auth = 0;
+unsigned long timeouts_idle = 0;
+unsigned long timeouts_ping = 0;
+unsigned long timeouts_stall = 0;
+unsigned long slow_consumers = 0;
+
+// Messages en attente d'écriture dans la base, écrits par lots dans une transaction
+storage_message_t *message_batch; // config.batch_size messages
+int message_batch_count = 0;
+wheel_timer_t message_batch_timer;
+unsigned long message_batches_written = 0;
+
+// Écriture différée des jetons de session émis (session.h)
+wheel_timer_t session_save_timer;
+int session_save_scheduled = 0;
+
+// Arrêt progressif ou redémarrage en cours (DRAIN_SHUTDOWN, DRAIN_RESTART), 0 sinon
+int draining = 0;
+uint64_t drain_deadline_ms = 0;
 
 int is_admin(const char *username)
 {
@@ -13,6 +47,7 @@ int is_admin(const char *username)
         fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
         return 0;
     }
+    sqlite3_busy_timeout(db, 1000); // Un thread d'authentification peut être en train de rehacher un mot de passe
 
     const char *sql = "SELECT role FROM users WHERE username = ?;";
     if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
@@ -40,16 +75,7 @@ int is_admin(const char *username)
 
 void clean_input(char *str)
 {
-    char *pos;
-    if ((pos = strchr(str, '\n')) != NULL || (pos = strchr(str, '\r')) != NULL)
-    {
-        *pos = '\0'; // Remplacer le retour à la ligne ou retour chariot par un caractère de fin de chaîne
-    }
-}
-
-void clear_server_directory()
-{
-    system("rm -rf server/*");
+    str[strcspn(str, "\r\n")] = '\0'; // Couper au premier retour à la ligne ou retour chariot, en un seul passage
 }
 
 int authenticate_user(const char *username, const char *password)
@@ -57,14 +83,16 @@ int authenticate_user(const char *username, const char *password)
     sqlite3 *db;
     sqlite3_stmt *stmt;
     int result = 0;
+    bool needs_rehash = false;
 
     if (sqlite3_open("database.db", &db) != SQLITE_OK)
     {
         fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
         return 0;
     }
+    sqlite3_busy_timeout(db, 1000); // Les threads d'authentification se partagent la base
 
-    const char *sql = "SELECT id FROM users WHERE username = ? AND password = ?;";
+    const char *sql = "SELECT password FROM users WHERE username = ?;";
     if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
     {
         fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
@@ -73,123 +101,194 @@ int authenticate_user(const char *username, const char *password)
     }
 
     sqlite3_bind_text(stmt, 1, username, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, password, -1, SQLITE_STATIC);
 
-    // Afficher la requête et les paramètres utilisés
-    printf("Authenticating user: %s, password: %s\n", username, password);
+    printf("Authenticating user: %s\n", username);
 
     if (sqlite3_step(stmt) == SQLITE_ROW)
     {
-        result = 1; // Authentification réussie
+        const char *stored = (const char *)sqlite3_column_text(stmt, 0);
+        result = password_verify(password, stored, &needs_rehash); // Vérification de l'empreinte scrypt
     }
-    else
+
+    if (!result)
     {
         // Ajoute un message pour voir si la requête échoue
         printf("Authentication failed for user: %s\n", username);
     }
 
     sqlite3_finalize(stmt);
+
+    // Remplacer un mot de passe en clair (ou une empreinte obsolète) par une nouvelle empreinte
+    char hash[AUTH_HASH_SIZE];
+    if (result && needs_rehash && password_hash(password, hash, sizeof(hash)) == 0)
+    {
+        sql = "UPDATE users SET password = ? WHERE username = ?;";
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) == SQLITE_OK)
+        {
+            sqlite3_bind_text(stmt, 1, hash, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, username, -1, SQLITE_STATIC);
+            if (sqlite3_step(stmt) == SQLITE_DONE)
+            {
+                printf("Mot de passe de %s rehaché.\n", username);
+            }
+            sqlite3_finalize(stmt);
+        }
+    }
+
     sqlite3_close(db);
     return result;
 }
 
-void store_file_in_salon(const char *salon_name, const char *filename)
+int check_credentials(const char *username, const char *password, int *admin)
 {
-    char directory_path[256];
-    snprintf(directory_path, sizeof(directory_path), "server/%s", salon_name);
-
-    // Créer le dossier si nécessaire
-    struct stat st = {0};
-    if (stat(directory_path, &st) == -1)
+    if (!authenticate_user(username, password))
     {
-        mkdir(directory_path, 0700);
+        return 0;
     }
-
-    // Construire le chemin de destination pour le fichier
-    char destination_path[256];
-    snprintf(destination_path, sizeof(destination_path), "%s/%s", directory_path, filename);
-
-    // Utiliser la commande cp pour copier le fichier
-    char command[512];
-    snprintf(command, sizeof(command), "cp %s %s", filename, destination_path);
-    system(command);
+    *admin = is_admin(username);
+    return 1;
 }
 
-void store_message_in_db(const char *channel, const char *username, const char *message)
+void complete_authentication(const auth_result_t *result)
 {
-    sqlite3 *db;
-    sqlite3_stmt *stmt;
-
-    if (sqlite3_open("database.db", &db) != SQLITE_OK)
+    // Retrouver le client : il a pu se déconnecter pendant la vérification
+    client_t *client = NULL;
+    for (int i = 0; i < config.max_clients; i++)
     {
-        fprintf(stderr, "Erreur lors de l'ouverture de la base de données : %s\n", sqlite3_errmsg(db));
-        return;
+        if (clients[i] && clients[i]->socket == result->socket &&
+            clients[i]->auth_pending && clients[i]->auth_ticket == result->ticket)
+        {
+            client = clients[i];
+            break;
+        }
     }
-
-    // Préparer la requête SQL pour insérer le message
-    const char *sql = "INSERT INTO messages (salon_id, username, message) VALUES ((SELECT id FROM salons WHERE name = ?), ?, ?);";
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    if (client == NULL)
     {
-        fprintf(stderr, "Erreur lors de la préparation de la requête SQL : %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
         return;
     }
 
-    // Lier les valeurs du nom du salon, du nom d'utilisateur et du message à la requête SQL
-    sqlite3_bind_text(stmt, 1, channel, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, username, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, message, -1, SQLITE_STATIC);
-
-    // Exécuter la requête SQL
-    if (sqlite3_step(stmt) != SQLITE_DONE)
+    client->auth_pending = 0;
+    if (result->authenticated)
     {
-        fprintf(stderr, "Erreur lors de l'insertion du message : %s\n", sqlite3_errmsg(db));
+        log_in_client(client, result->username, result->is_admin); // Rôle lu par le thread de vérification
+    }
+    else
+    {
+        queue_text(client, "Échec de l'authentification\n");
     }
-
-    // Finaliser et fermer la connexion à la base de données
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
 }
 
-void clear_messages_in_db()
+void log_in_client(client_t *client, const char *username, int is_admin)
 {
-    sqlite3 *db;
+    snprintf(client->username, sizeof(client->username), "%s", username);
+    client->is_admin = is_admin;
+    client->user_limits = user_limits_acquire(client->username);
+    link_user(client);
+    queue_text(client, "Authentification réussie\n");
+}
 
-    if (sqlite3_open("database.db", &db) != SQLITE_OK)
+void resume_session(client_t *client, const char *arguments)
+{
+    // Le jeton est vérifié en mémoire : pas de scrypt, pas de file d'authentification
+    char username[50] = "", token[SESSION_TOKEN_SIZE] = "", id[SESSION_ID_SIZE];
+    int is_admin = 0;
+    if (sscanf(arguments, "%49s %48s", username, token) == 2 && session_resume(username, token, &is_admin, id))
     {
-        fprintf(stderr, "Erreur lors de l'ouverture de la base de données : %s\n", sqlite3_errmsg(db));
-        return;
+        snprintf(client->session, sizeof(client->session), "%s", id);
+        snprintf(client->session_token, sizeof(client->session_token), "%s", token);
+        log_in_client(client, username, is_admin);
+        printf("Session de %s reprise.\n", username);
     }
+    else
+    {
+        queue_text(client, "Session expirée\n");
+    }
+}
 
-    // Requête SQL pour supprimer tous les messages
-    const char *sql = "DELETE FROM messages;";
-    char *err_msg = 0;
-
-    if (sqlite3_exec(db, sql, 0, 0, &err_msg) != SQLITE_OK)
+void issue_session(client_t *client)
+{
+    // Une connexion garde son jeton : le redemander ne crée pas de nouvelle session
+    if (client->session[0] == '\0' || client->session_token[0] == '\0' || !session_exists(client->session))
     {
-        fprintf(stderr, "Erreur lors de la suppression des messages : %s\n", err_msg);
-        sqlite3_free(err_msg);
+        char token[SESSION_TOKEN_SIZE], id[SESSION_ID_SIZE];
+        if (session_issue(client->username, client->is_admin, token, id) < 0)
+        {
+            queue_text(client, "@SESSION -\n");
+            return;
+        }
+        snprintf(client->session, sizeof(client->session), "%s", id);
+        snprintf(client->session_token, sizeof(client->session_token), "%s", token);
+        schedule_session_save();
     }
-    else
+
+    char response[128];
+    snprintf(response, sizeof(response), "@SESSION %s %d\n", client->session_token, SESSION_TTL_S);
+    queue_text(client, response);
+}
+
+void schedule_session_save(void)
+{
+    // Les jetons émis pendant SESSION_SAVE_MS sont écrits ensemble dans la base
+    if (!session_save_scheduled)
     {
-        printf("Tous les messages ont été supprimés de la base de données.\n");
+        timer_schedule(&timer_wheel, &session_save_timer, monotonic_ms() + SESSION_SAVE_MS);
+        session_save_scheduled = 1;
     }
+}
 
-    sqlite3_close(db);
+void session_save_expired(wheel_timer_t *timer)
+{
+    (void)timer;
+    session_save_scheduled = 0;
+    session_save();
 }
 
-void delete_salon_directory(const char *salon_name)
+void format_stats(char *buffer, size_t size)
 {
-    char directory_path[256];
-    snprintf(directory_path, sizeof(directory_path), "server/%s", salon_name);
+    int connected = 0;
+    for (int i = 0; i < config.max_clients; i++)
+    {
+        if (clients[i])
+        {
+            connected++;
+        }
+    }
 
-    // Supprimer le dossier du salon
-    char command[512];
-    snprintf(command, sizeof(command), "rm -rf %s", directory_path);
-    system(command);
+    snprintf(buffer, size, "Statistiques du serveur :\nClients connectés : %d/%d\n", connected, config.max_clients);
+    auth_pool_stats(buffer + strlen(buffer), size - strlen(buffer));
+    snprintf(buffer + strlen(buffer), size - strlen(buffer),
+             "Limitation de débit : messages refusés %lu, envois refusés %lu, lectures différées %lu\n",
+             rate_rejected_messages, rate_rejected_uploads, rate_deferred);
+    snprintf(buffer + strlen(buffer), size - strlen(buffer),
+             "Déconnexions : authentification trop lente %lu, inactivité %lu, ping sans réponse %lu, transferts bloqués %lu, clients trop lents %lu\n",
+             timeouts_auth, timeouts_idle, timeouts_ping, timeouts_stall, slow_consumers);
+    snprintf(buffer + strlen(buffer), size - strlen(buffer),
+             "Écriture des messages : %lu lots écrits, %d messages en attente\n",
+             message_batches_written, message_batch_count);
+    storage_format_stats(buffer + strlen(buffer), size - strlen(buffer));
+    readpool_format_stats(buffer + strlen(buffer), size - strlen(buffer));
+    registry_format_stats(buffer + strlen(buffer), size - strlen(buffer));
+    session_format_stats(buffer + strlen(buffer), size - strlen(buffer));
+    snprintf(buffer + strlen(buffer), size - strlen(buffer), "Messages privés : %lu\n", direct_messages);
+    longmsg_format_stats(buffer + strlen(buffer), size - strlen(buffer));
+    poller_format_stats(buffer + strlen(buffer), size - strlen(buffer));
+    snprintf(buffer + strlen(buffer), size - strlen(buffer), "Mémoire : ");
+    slab_format_stats(&client_slab, buffer + strlen(buffer), size - strlen(buffer));
+    snprintf(buffer + strlen(buffer), size - strlen(buffer), ", ");
+    outqueue_format_stats(buffer + strlen(buffer), size - strlen(buffer));
+    snprintf(buffer + strlen(buffer), size - strlen(buffer), "\n");
+    history_format_stats(buffer + strlen(buffer), size - strlen(buffer));
+    snprintf(buffer + strlen(buffer), size - strlen(buffer),
+             "Sommes de contrôle (crc32c, %s) : %lu fichiers reçus vérifiés, %lu corrompus\n",
+             crc32c_backend(), uploads_verified, uploads_corrupted);
+    zcache_format_stats(buffer + strlen(buffer), size - strlen(buffer));
+    filecache_format_stats(buffer + strlen(buffer), size - strlen(buffer));
+    presence_format_stats(buffer + strlen(buffer), size - strlen(buffer));
+    parallel_format_stats(buffer + strlen(buffer), size - strlen(buffer));
+    cluster_format_stats(buffer + strlen(buffer), size - strlen(buffer));
 }
 
-void create_salon_directory(const char *salon_name)
+void store_file_in_salon(const char *salon_name, const char *filename)
 {
     char directory_path[256];
     snprintf(directory_path, sizeof(directory_path), "server/%s", salon_name);
@@ -199,244 +298,359 @@ void create_salon_directory(const char *salon_name)
     if (stat(directory_path, &st) == -1)
     {
         mkdir(directory_path, 0700);
-        printf("Dossier créé pour le salon : %s\n", salon_name);
     }
+
+    // Construire le chemin de destination pour le fichier
+    char destination_path[256];
+    snprintf(destination_path, sizeof(destination_path), "%s/%s", directory_path, filename);
+
+    // Utiliser la commande cp pour copier le fichier
+    char command[512];
+    snprintf(command, sizeof(command), "cp %s %s", filename, destination_path);
+    system(command);
 }
 
-int channel_exists(const char *channel_name)
+void store_message_in_db(const char *channel, const char *username, const char *message, uint64_t seq)
 {
-    sqlite3 *db;
-    sqlite3_stmt *stmt;
-    int exists = 0;
+    // Ajouter le message au lot en cours : une seule transaction pour plusieurs messages
+    storage_message_t *pending = &message_batch[message_batch_count++];
+    snprintf(pending->channel, sizeof(pending->channel), "%s", channel);
+    snprintf(pending->username, sizeof(pending->username), "%s", username);
+    snprintf(pending->message, sizeof(pending->message), "%s", message);
+    pending->text = strlen(message) >= sizeof(pending->message) ? strdup(message) : NULL; // Message long
+    pending->seq = seq;
+    pending->timestamp = time(NULL);
 
-    if (sqlite3_open("database.db", &db) != SQLITE_OK)
+    if (message_batch_count == config.batch_size)
     {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-        return 0;
+        flush_message_batch(); // Lot complet
     }
-
-    const char *sql = "SELECT 1 FROM salons WHERE name = ?;";
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    else if (message_batch_count == 1)
     {
-        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return 0;
+        // Premier message du lot : il sera écrit au plus tard après ce délai
+        timer_schedule(&timer_wheel, &message_batch_timer, monotonic_ms() + config.batch_delay_ms);
     }
+}
 
-    sqlite3_bind_text(stmt, 1, channel_name, -1, SQLITE_STATIC);
+void flush_message_batch(void)
+{
+    timer_cancel(&timer_wheel, &message_batch_timer);
+    if (message_batch_count == 0)
+    {
+        return;
+    }
 
-    if (sqlite3_step(stmt) == SQLITE_ROW)
+    // Le lot part en une seule écriture : une transaction SQLite, ou une copie dans le journal
+    if (storage_write(message_batch, message_batch_count) == 0)
+    {
+        message_batches_written++;
+    }
+    for (int i = 0; i < message_batch_count; i++)
     {
-        exists = 1; // Le salon existe
+        free(message_batch[i].text);
     }
+    message_batch_count = 0;
+}
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
-    return exists;
+void message_batch_expired(wheel_timer_t *timer)
+{
+    (void)timer;
+    flush_message_batch();
 }
 
-void create_channel(client_t *client, const char *channel_name)
+void migrate_database(void)
 {
-    // Vérifier si l'utilisateur est un admin
-    if (!is_admin(client->username))
+    sqlite3 *db;
+    if (sqlite3_open("database.db", &db) != SQLITE_OK)
     {
-        send(client->socket, "Vous devez être un administrateur pour créer un salon.\n", 55, 0);
+        fprintf(stderr, "Erreur lors de l'ouverture de la base de données : %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
         return;
     }
 
-    // Vérifier si le salon existe déjà
-    if (channel_exists(channel_name))
+    // Numéro de chaque message dans son salon, avant le déplacement de l'ancienne table vers l'archive
+    // (échoue sans conséquence si la colonne existe déjà ou si la table n'existe plus)
+    sqlite3_exec(db, "ALTER TABLE messages ADD COLUMN seq INTEGER;", 0, 0, 0);
+    sqlite3_close(db);
+}
+
+size_t format_sequenced(char *line, size_t size, const char *channel, uint64_t seq, const char *message, size_t len)
+{
+    int header = snprintf(line, size, "@MSG %s %llu ", channel, (unsigned long long)seq);
+    if (len > size - header)
     {
-        send(client->socket, "Ce salon existe déjà.\n", 23, 0);
-        return;
+        len = size - header;
     }
+    memcpy(line + header, message, len);
+    return header + len;
+}
 
-    sqlite3 *db;
-    sqlite3_stmt *stmt;
-
-    // Ouvrir la base de données
-    if (sqlite3_open("database.db", &db) != SQLITE_OK)
+void queue_channel_message(client_t *client, const char *channel, uint64_t seq, const char *message, size_t len)
+{
+    // Une ligne @MSG, sauf pour un message long ou de plusieurs lignes (le dernier retour à la ligne termine le message)
+    if (len < BUFFER_SIZE && (len == 0 || memchr(message, '\n', len - 1) == NULL))
     {
-        send(client->socket, "Erreur d'ouverture de la base de données.\n", 41, 0);
+        char line[SEQUENCED_SIZE];
+        queue_message(client, line, format_sequenced(line, sizeof(line), channel, seq, message, len));
         return;
     }
+    char header[LONGMSG_HEADER_SIZE];
+    int header_len = snprintf(header, sizeof(header), "@LONG %s %llu %zu\n", channel, (unsigned long long)seq, len);
+    queue_message(client, header, header_len);
+    queue_message(client, message, len);
+}
 
-    // Préparer la requête SQL pour insérer un nouveau salon
-    const char *sql = "INSERT INTO salons (name) VALUES (?);";
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+// Envoie un message rejoué avec son numéro, comme une diffusion
+static void queue_sequenced(void *context, uint64_t seq, const char *message, size_t len)
+{
+    client_t *client = context;
+    queue_channel_message(client, client->current_channel, seq, message, len);
+}
+
+// Confie la relecture au pool ; le lot en attente est écrit d'abord pour être relu avec les autres
+static void submit_replay(client_t *client, const char *channel, uint64_t after)
+{
+    flush_message_batch();
+    if (readpool_submit(client->socket, READPOOL_REPLAY, channel, after, NULL, &client->replay_ticket) < 0)
     {
-        send(client->socket, "Erreur lors de la préparation de la requête SQL.\n", 48, 0);
-        sqlite3_close(db);
+        queue_text(client, "Historique indisponible pour l'instant : rejoignez le salon plus tard pour le recevoir.\n");
         return;
     }
+    client->replay_upto = history_last(channel);
+}
 
-    // Nettoyer le nom du salon et le lier à la requête SQL
-    clean_input((char *)channel_name);
-    sqlite3_bind_text(stmt, 1, channel_name, -1, SQLITE_STATIC);
-
-    // Exécuter la requête
-    if (sqlite3_step(stmt) == SQLITE_DONE)
+void replay_channel(client_t *client, const char *channel, uint64_t after)
+{
+    uint64_t last = history_last(channel);
+    if (last > (uint64_t)config.replay_max && after < last - config.replay_max)
     {
-        send(client->socket, "Salon créé avec succès.\n", 25, 0);
-        printf("Création du channel %s par %s\n", channel_name, client->username);
-
-        // Créer le dossier pour le salon
-        create_salon_directory(channel_name);
+        after = last - config.replay_max; // Trop de messages manqués : seulement les plus récents
     }
-    else
+    if (after >= last || history_replay(channel, after, queue_sequenced, client) >= 0)
     {
-        send(client->socket, "Erreur lors de la création du salon.\n", 37, 0);
+        return;
     }
 
-    // Finaliser la requête et fermer la base de données
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    // Messages plus anciens que ceux gardés en mémoire : lus sur disque par le pool de lecture
+    submit_replay(client, channel, after);
 }
 
-void list_users_in_channel(client_t *client)
+bool receives_live(const client_t *client, const char *channel)
 {
-    char message[BUFFER_SIZE];
-    snprintf(message, sizeof(message), "Utilisateurs connectés dans le salon %s:\n", client->current_channel);
-
-    int found_user = 0; // Flag pour vérifier si des utilisateurs sont trouvés
+    // Pendant une relecture, les nouveaux messages suivront ceux lus sur disque
+    return client->replay_ticket == 0 && strcmp(client->current_channel, channel) == 0;
+}
 
-    // Parcourir la liste des clients pour trouver ceux qui sont dans le même salon
-    for (int i = 0; i < MAX_CLIENTS; i++)
+void search_channel(client_t *client, const char *pattern)
+{
+    char response[BUFFER_SIZE];
+    if (strlen(client->current_channel) == 0)
     {
-        if (clients[i] && strcmp(clients[i]->current_channel, client->current_channel) == 0)
-        {
-            // Exclure l'utilisateur lui-même de la liste
-            if (strcmp(clients[i]->username, client->username) != 0)
-            {
-                snprintf(message + strlen(message), sizeof(message) - strlen(message), "%s\n", clients[i]->username);
-                found_user = 1; // Marquer qu'au moins un utilisateur a été trouvé
-            }
-        }
+        queue_text(client, "Vous n'êtes dans aucun salon.\n");
     }
-
-    // Si aucun autre utilisateur n'a été trouvé
-    if (!found_user)
+    else if (pattern[0] == '\0')
     {
-        snprintf(message + strlen(message), sizeof(message) - strlen(message), "Aucun autre utilisateur connecté.\n");
+        queue_text(client, "Usage : search <texte>\n");
     }
-
-    // Envoyer la liste des utilisateurs au client
-    if (send(client->socket, message, strlen(message), 0) < 0)
+    else if (strlen(pattern) >= READPOOL_PATTERN_SIZE)
+    {
+        snprintf(response, sizeof(response), "Texte recherché trop long : %d caractères au plus.\n", READPOOL_PATTERN_SIZE - 1);
+        queue_text(client, response);
+    }
+    else if (client->search_ticket != 0)
+    {
+        queue_text(client, "Une recherche est déjà en cours.\n");
+    }
+    else
     {
-        perror("Erreur lors de l'envoi de la liste des utilisateurs");
+        flush_message_batch(); // Les derniers messages sont cherchés aussi
+        if (readpool_submit(client->socket, READPOOL_SEARCH, client->current_channel, 0, pattern, &client->search_ticket) < 0)
+        {
+            queue_text(client, "Recherche impossible pour l'instant, réessayez plus tard.\n");
+        }
     }
 }
 
-void send_message_to_channel(const char *channel, const char *message, int sender_socket)
+// Une ligne par message trouvé : son numéro et le début de sa première ligne
+static void send_search_results(client_t *client, const readpool_result_t *result)
 {
-    // Parcourir la liste des clients et envoyer le message à ceux qui sont dans le même salon
-    for (int i = 0; i < MAX_CLIENTS; i++)
+    char line[BUFFER_SIZE];
+    if (result->count == 0)
+    {
+        snprintf(line, sizeof(line), "Aucun message de %s ne contient « %s ».\n", result->channel, result->pattern);
+        queue_text(client, line);
+        return;
+    }
+    snprintf(line, sizeof(line), "Recherche « %s » dans %s : %d résultat(s)\n", result->pattern, result->channel, result->count);
+    queue_text(client, line);
+
+    size_t offset = 0;
+    uint64_t seq;
+    const char *message;
+    size_t len;
+    while (readpool_next(result, &offset, &seq, &message, &len))
     {
-        if (clients[i] && clients[i]->socket != sender_socket && strcmp(clients[i]->current_channel, channel) == 0)
+        const char *newline = memchr(message, '\n', len);
+        size_t shown = newline != NULL ? (size_t)(newline - message) : len;
+        int cut = shown + 1 < len;
+        if (shown > SEARCH_LINE_MAX)
         {
-            if (send(clients[i]->socket, message, strlen(message), 0) < 0)
+            // Couper avant un caractère UTF-8, pas au milieu
+            shown = SEARCH_LINE_MAX;
+            while (shown > 0 && ((unsigned char)message[shown] & 0xC0) == 0x80)
             {
-                perror("Erreur lors de l'envoi du message au client");
+                shown--;
             }
+            cut = 1;
         }
+        snprintf(line, sizeof(line), "  #%llu %.*s%s\n", (unsigned long long)seq, (int)shown, message, cut ? " [...]" : "");
+        queue_text(client, line);
     }
+}
 
-    // Extraire le nom d'utilisateur de l'envoyeur et stocker le message dans la base de données
-    for (int i = 0; i < MAX_CLIENTS; i++)
+void complete_history_read(const readpool_result_t *result)
+{
+    // Retrouver le client : il a pu se déconnecter, ou changer de salon, pendant la lecture
+    client_t *client = NULL;
+    for (int i = 0; i < config.max_clients; i++)
     {
-        if (clients[i] && clients[i]->socket == sender_socket)
+        if (clients[i] && clients[i]->socket == result->socket &&
+            (result->type == READPOOL_SEARCH ? clients[i]->search_ticket : clients[i]->replay_ticket) == result->ticket)
         {
-            store_message_in_db(channel, clients[i]->username, message);
+            client = clients[i];
             break;
         }
     }
-}
-
-void delete_channel(client_t *client, const char *channel_name)
-{
-    // Vérifier si l'utilisateur est un admin
-    if (!is_admin(client->username))
+    if (client == NULL)
     {
-        send(client->socket, "Vous devez être un administrateur pour supprimer un salon.\n", 58, 0);
         return;
     }
-
-    sqlite3 *db;
-    sqlite3_stmt *stmt;
-    char sql[BUFFER_SIZE];
-
-    // Ouvrir la base de données
-    if (sqlite3_open("database.db", &db) != SQLITE_OK)
+    if (result->type == READPOOL_SEARCH)
     {
-        send(client->socket, "Erreur d'ouverture de la base de données.\n", 41, 0);
+        client->search_ticket = 0;
+        send_search_results(client, result);
         return;
     }
 
-    // Supprimer les messages liés au salon
-    snprintf(sql, sizeof(sql), "DELETE FROM messages WHERE salon_id = (SELECT id FROM salons WHERE name = ?);");
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    client->replay_ticket = 0;
+    uint64_t last_sent = result->after;
+    size_t offset = 0;
+    uint64_t seq;
+    const char *message;
+    size_t len;
+    while (readpool_next(result, &offset, &seq, &message, &len))
     {
-        send(client->socket, "Erreur lors de la préparation de la requête SQL pour supprimer les messages.\n", 75, 0);
-        sqlite3_close(db);
-        return;
+        queue_channel_message(client, result->channel, seq, message, len);
+        last_sent = seq;
     }
-    sqlite3_bind_text(stmt, 1, channel_name, -1, SQLITE_STATIC);
 
-    if (sqlite3_step(stmt) != SQLITE_DONE)
+    // Puis les messages arrivés pendant la lecture, encore en mémoire, ou relus s'ils y sont déjà trop anciens
+    uint64_t after = last_sent > client->replay_upto ? last_sent : client->replay_upto;
+    if (after < history_last(result->channel) && history_replay(result->channel, after, queue_sequenced, client) < 0)
     {
-        send(client->socket, "Erreur lors de la suppression des messages du salon.\n", 54, 0);
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
-        return;
+        submit_replay(client, result->channel, after);
     }
-    sqlite3_finalize(stmt);
+}
 
-    // Annonce la suppression du salon à tous les clients présents
-    char message[BUFFER_SIZE];
-    snprintf(message, sizeof(message), "Le salon %s a été supprimé par %s.\n", channel_name, client->username);
-    send_message_to_channel(channel_name, message, client->socket); // Informer tous les utilisateurs
+void clear_messages_in_db()
+{
+    // Les messages en attente partent avec les autres
+    for (int i = 0; i < message_batch_count; i++)
+    {
+        free(message_batch[i].text);
+    }
+    message_batch_count = 0;
+    timer_cancel(&timer_wheel, &message_batch_timer);
+    storage_clear();
+    printf("Tous les messages enregistrés ont été supprimés.\n");
+}
 
-    // Déconnecter tous les utilisateurs présents dans le salon
-    for (int i = 0; i < MAX_CLIENTS; i++)
+// Supprime un dossier et ce qu'il contient, sans suivre les liens symboliques
+static void remove_directory(const char *path)
+{
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    char file[PATH_MAX];
+    struct stat st;
+    while (dir != NULL && (entry = readdir(dir)) != NULL)
     {
-        if (clients[i] && strcmp(clients[i]->current_channel, channel_name) == 0)
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
         {
-            // Informer l'utilisateur qu'il a été déconnecté
-            send(clients[i]->socket, "Vous avez été déconnecté car le salon a été supprimé.\n", 60, 0);
-            strcpy(clients[i]->current_channel, "\0");
-            clients[i] = NULL; // Retirer le client de la liste
+            snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+            if (lstat(file, &st) == 0 && S_ISDIR(st.st_mode))
+            {
+                remove_directory(file);
+            }
+            else
+            {
+                unlink(file);
+            }
         }
     }
+    if (dir != NULL)
+    {
+        closedir(dir);
+    }
+    rmdir(path);
+}
 
-    // Supprimer le dossier du salon
-    delete_salon_directory(channel_name);
-
-    // Supprimer le salon
-    snprintf(sql, sizeof(sql), "DELETE FROM salons WHERE name = ?;");
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+void delete_salon_directory(const char *salon_name)
+{
+    // Les salons créés avant la restriction des noms (« général », « a.b ») gardent leur nom : seul ce qui
+    // sortirait de server/ est refusé
+    if (salon_name[0] == '\0' || strchr(salon_name, '/') != NULL || strcmp(salon_name, ".") == 0 || strcmp(salon_name, "..") == 0)
     {
-        send(client->socket, "Erreur lors de la préparation de la requête SQL pour supprimer le salon.\n", 72, 0);
-        sqlite3_close(db);
+        fprintf(stderr, "Dossier du salon %s non supprimé : nom dangereux.\n", salon_name);
         return;
     }
-    sqlite3_bind_text(stmt, 1, channel_name, -1, SQLITE_STATIC);
+    char directory_path[256];
+    snprintf(directory_path, sizeof(directory_path), "server/%s", salon_name);
+    remove_directory(directory_path);
+}
 
-    if (sqlite3_step(stmt) == SQLITE_DONE)
+int create_salon_directory(const char *salon_name)
+{
+    // Le dossier est préparé au premier envoi dans le salon, une fois par processus
+    if (registry_directory_ready(salon_name))
     {
-        send(client->socket, "Salon supprimé avec succès.\n", 29, 0);
-        printf("Suppression du channel %s par %s\n", channel_name, client->username);
+        return 0;
     }
-    else
+
+    char directory_path[256];
+    snprintf(directory_path, sizeof(directory_path), "server/%s", salon_name);
+    if (mkdir(directory_path, 0700) < 0 && errno != EEXIST)
     {
-        send(client->socket, "Erreur lors de la suppression du salon.\n", 40, 0);
+        perror("Erreur lors de la création du dossier du salon");
+        return -1;
     }
 
-    // Finaliser la requête et fermer la base de données
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    // Les fichiers partiels d'un processus précédent ne seront jamais terminés ; les fichiers complets sont gardés
+    DIR *directory = opendir(directory_path);
+    if (directory != NULL)
+    {
+        struct dirent *entry;
+        while ((entry = readdir(directory)) != NULL)
+        {
+            size_t len = strlen(entry->d_name);
+            if (entry->d_name[0] == '.' && len > 5 && strcmp(entry->d_name + len - 5, ".part") == 0)
+            {
+                unlinkat(dirfd(directory), entry->d_name, 0);
+                printf("Envoi inachevé supprimé : %s/%s\n", salon_name, entry->d_name);
+            }
+        }
+        closedir(directory);
+    }
+
+    registry_set_directory_ready(salon_name);
+    return 0;
+}
+
+int channel_exists(const char *channel_name)
+{
+    return registry_exists(channel_name); // Le registre est chargé au démarrage et tenu à jour
 }
 
-void list_channels(int socket)
+int insert_channels(char *names[], int count)
 {
     sqlite3 *db;
     sqlite3_stmt *stmt;
@@ -444,283 +658,2138 @@ void list_channels(int socket)
     if (sqlite3_open("database.db", &db) != SQLITE_OK)
     {
         fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-        return;
+        sqlite3_close(db);
+        return -1;
     }
+    sqlite3_busy_timeout(db, 1000);
 
-    const char *sql = "SELECT name FROM salons;";
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    // Tous les salons sont créés dans une seule transaction : aucun si l'un échoue
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", 0, 0, 0) != SQLITE_OK)
     {
-        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
         sqlite3_close(db);
+        return -1;
+    }
+    int status = sqlite3_prepare_v2(db, "INSERT INTO salons (name) VALUES (?);", -1, &stmt, 0) == SQLITE_OK ? 0 : -1;
+    for (int i = 0; i < count && status == 0; i++)
+    {
+        sqlite3_bind_text(stmt, 1, names[i], -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE)
+        {
+            fprintf(stderr, "Erreur lors de la création du salon %s : %s\n", names[i], sqlite3_errmsg(db));
+            status = -1;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    if (status == 0 && sqlite3_exec(db, "COMMIT;", 0, 0, 0) != SQLITE_OK)
+    {
+        status = -1;
+    }
+    if (status < 0)
+    {
+        sqlite3_exec(db, "ROLLBACK;", 0, 0, 0);
+    }
+    sqlite3_close(db);
+    if (status < 0)
+    {
+        return -1;
+    }
+
+    // Le registre n'est mis à jour qu'une fois la transaction validée ; les dossiers sont créés au premier fichier envoyé
+    for (int i = 0; i < count; i++)
+    {
+        registry_add(names[i]);
+    }
+    return 0;
+}
+
+int valid_channel_name(const char *channel_name)
+{
+    // Le nom sert de nom de dossier (server/, log/) : lettres, chiffres, '_' et '-' seulement ;
+    // les noms commençant par '@', réservés aux messages privés entre nœuds, sont donc exclus aussi
+    size_t len = strspn(channel_name, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-");
+    return len > 0 && channel_name[len] == '\0' && len < sizeof(((client_t *)0)->current_channel);
+}
+
+void create_channel(client_t *client, const char *channel_name)
+{
+    // Vérifier si l'utilisateur est un admin
+    if (!is_admin(client->username))
+    {
+        queue_text(client, "Vous devez être un administrateur pour créer un salon.\n");
         return;
     }
 
-    char message[BUFFER_SIZE];
-    snprintf(message, sizeof(message), "Liste des salons :\n");
+    clean_input((char *)channel_name);
+    if (!valid_channel_name(channel_name))
+    {
+        queue_text(client, "Nom de salon invalide.\n");
+        return;
+    }
 
-    while (sqlite3_step(stmt) == SQLITE_ROW)
+    // Vérifier si le salon existe déjà
+    if (channel_exists(channel_name))
     {
-        const char *channel_name = (const char *)sqlite3_column_text(stmt, 0);
-        snprintf(message + strlen(message), sizeof(message) - strlen(message), "%s\n", channel_name);
+        queue_text(client, "Ce salon existe déjà.\n");
+        return;
     }
 
-    send(socket, message, strlen(message), 0); // Envoyer la liste au client
+    char *names[] = {(char *)channel_name};
+    if (insert_channels(names, 1) == 0)
+    {
+        queue_text(client, "Salon créé avec succès.\n");
+        printf("Création du channel %s par %s\n", channel_name, client->username);
+    }
+    else
+    {
+        queue_text(client, "Erreur lors de la création du salon.\n");
+    }
+}
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+int split_names(char *arguments, char *names[], int max)
+{
+    int count = 0;
+    char *saveptr = NULL;
+    for (char *name = strtok_r(arguments, " ", &saveptr); name != NULL && count < max; name = strtok_r(NULL, " ", &saveptr))
+    {
+        names[count++] = name;
+    }
+    return count;
 }
 
-void handle_list_admin(int admin_socket)
+// Ajoute un nom à une liste "a, b, c" de la réponse
+static void append_name(char *list, size_t size, const char *name)
 {
-    // Suppression de l'utilisation du mutex, car la gestion des clients est désormais gérée par `poll`
-    char message[BUFFER_SIZE];
-    snprintf(message, sizeof(message), "Liste des utilisateurs connectés et leurs salons :\n");
+    snprintf(list + strlen(list), size - strlen(list), "%s%s", list[0] != '\0' ? ", " : "", name);
+}
 
-    // Boucle pour parcourir les clients et récupérer leurs informations
-    for (int i = 0; i < MAX_CLIENTS; i++)
+// Ajoute une ligne "<titre> : <liste>" à la réponse si la liste n'est pas vide
+static void append_list(char *response, const char *title, const char *list)
+{
+    if (list[0] != '\0')
     {
-        if (clients[i]) // Si un client est connecté
+        snprintf(response + strlen(response), BUFFER_SIZE - strlen(response), "%s : %s\n", title, list);
+    }
+}
+
+void create_channels(client_t *client, char *arguments)
+{
+    if (!is_admin(client->username))
+    {
+        queue_text(client, "Vous devez être un administrateur pour créer un salon.\n");
+        return;
+    }
+
+    char *names[ADMIN_BATCH_MAX];
+    int count = split_names(arguments, names, ADMIN_BATCH_MAX);
+    if (count == 0)
+    {
+        queue_text(client, "Usage : create_many <salon> [<salon>...]\n");
+        return;
+    }
+
+    // Les noms invalides, existants ou répétés sont écartés ; les autres sont créés ensemble
+    char *created[ADMIN_BATCH_MAX];
+    int created_count = 0;
+    char existing[BUFFER_SIZE] = "", invalid[BUFFER_SIZE] = "";
+    for (int i = 0; i < count; i++)
+    {
+        bool repeated = false;
+        for (int j = 0; j < created_count && !repeated; j++)
         {
-            snprintf(message + strlen(message), sizeof(message) - strlen(message),
-                     "Utilisateur : %s, Salon : %s\n",
-                     clients[i]->username,
-                     strlen(clients[i]->current_channel) > 0 ? clients[i]->current_channel : "Aucun");
+            repeated = strcmp(created[j], names[i]) == 0;
+        }
+        if (!valid_channel_name(names[i]))
+        {
+            append_name(invalid, sizeof(invalid), names[i]);
+        }
+        else if (repeated || channel_exists(names[i]))
+        {
+            append_name(existing, sizeof(existing), names[i]);
+        }
+        else
+        {
+            created[created_count++] = names[i];
         }
     }
 
-    // Envoyer la liste complète des utilisateurs connectés à l'administrateur
-    if (send(admin_socket, message, strlen(message), 0) < 0)
+    if (created_count > 0 && insert_channels(created, created_count) < 0)
     {
-        perror("Erreur lors de l'envoi de la liste des utilisateurs");
+        queue_text(client, "Erreur lors de la création des salons : aucun salon n'a été créé.\n");
+        return;
     }
+    printf("Création de %d salons par %s\n", created_count, client->username);
+
+    char response[BUFFER_SIZE];
+    snprintf(response, sizeof(response), "Salons créés : %d\n", created_count);
+    append_list(response, "Déjà existants", existing);
+    append_list(response, "Noms invalides", invalid);
+    queue_text(client, response);
 }
 
-void notify_current_channel(client_t *client)
+void list_users_in_channel(client_t *client)
 {
-    // Vérification que le client n'est pas NULL et que le salon actuel est valide
-    if (client != NULL && strlen(client->current_channel) > 0)
+    char message[BUFFER_SIZE];
+    snprintf(message, sizeof(message), "Utilisateurs connectés dans le salon %s:\n", client->current_channel);
+
+    int found_user = 0; // Flag pour vérifier si des utilisateurs sont trouvés
+
+    // Parcourir la liste des clients pour trouver ceux qui sont dans le même salon
+    for (int i = 0; i < config.max_clients; i++)
     {
-        // Ajout d'un message de débogage pour s'assurer que la chaîne est correcte
-        printf("Salon actuel du client %s = %s\n", client->username, client->current_channel);
+        if (clients[i] && strcmp(clients[i]->current_channel, client->current_channel) == 0)
+        {
+            // Exclure l'utilisateur lui-même de la liste
+            if (strcmp(clients[i]->username, client->username) != 0)
+            {
+                snprintf(message + strlen(message), sizeof(message) - strlen(message), "%s\n", clients[i]->username);
+                found_user = 1; // Marquer qu'au moins un utilisateur a été trouvé
+            }
+        }
+    }
 
-        // Créer un message à envoyer au client
-        char message[BUFFER_SIZE];
-        snprintf(message, sizeof(message), "Salon actuel : %s\n", client->current_channel);
+    // Si aucun autre utilisateur n'a été trouvé
+    if (!found_user)
+    {
+        snprintf(message + strlen(message), sizeof(message) - strlen(message), "Aucun autre utilisateur connecté.\n");
+    }
 
-        // Envoyer le message au client
-        if (send(client->socket, message, strlen(message), 0) < 0)
+    // Envoyer la liste des utilisateurs au client
+    queue_text(client, message);
+}
+
+void send_message_to_channel(const char *channel, const char *message, int sender_socket)
+{
+    // Numéroter le message dans son salon ; la ligne est formatée une seule fois pour tous les destinataires
+    size_t len = strlen(message);
+    uint64_t seq = history_append(channel, message, len);
+    char line[SEQUENCED_SIZE];
+    size_t line_len = format_sequenced(line, sizeof(line), channel, seq, message, len);
+
+    // Parcourir la liste des clients et envoyer le message à ceux qui sont dans le même salon
+    for (int i = 0; i < config.max_clients; i++)
+    {
+        if (clients[i] && clients[i]->socket != sender_socket && receives_live(clients[i], channel))
         {
-            perror("Erreur lors de l'envoi du message de salon actuel");
+            queue_message(clients[i], line, line_len); // Envoyé dès que le socket du destinataire est prêt
         }
     }
-    else
+
+    // Extraire le nom d'utilisateur de l'envoyeur et stocker le message dans la base de données
+    for (int i = 0; i < config.max_clients; i++)
     {
-        // Si aucun salon n'est rejoint, informer le client
-        printf("Client %s n'a rejoint aucun salon.\n", client->username);
-        if (send(client->socket, "Vous n'êtes dans aucun salon.\n", 31, 0) < 0)
+        if (clients[i] && clients[i]->socket == sender_socket)
         {
-            perror("Erreur lors de l'envoi du message d'absence de salon");
+            store_message_in_db(channel, clients[i]->username, message, seq);
+            break;
         }
     }
+
+    // Transmettre aux autres nœuds qui ont des membres dans ce salon
+    cluster_publish(channel, message, strlen(message));
 }
 
-void initialize_salon_directories()
+void start_long_message(client_t *client, const char *arguments, int accepted)
 {
-    sqlite3 *db;
-    sqlite3_stmt *stmt;
-
-    if (sqlite3_open("database.db", &db) != SQLITE_OK)
+    char *end;
+    errno = 0;
+    long long size = strtoll(arguments, &end, 10);
+    if (errno != 0 || end == arguments || *end != '\0' || size <= 0)
     {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+        queue_text(client, "Usage : @LONG <octets>\n");
         return;
     }
 
-    const char *sql = "SELECT name FROM salons;";
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    // Un message refusé est quand même lu jusqu'au bout, pour retrouver les commandes qui le suivent
+    char reason[128] = "";
+    if (size > config.max_message_bytes)
     {
-        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+        snprintf(reason, sizeof(reason), "Message trop long : %ld octets au plus.\n", config.max_message_bytes);
     }
-
-    while (sqlite3_step(stmt) == SQLITE_ROW)
+    else if (strlen(client->current_channel) == 0)
+    {
+        snprintf(reason, sizeof(reason), "Vous n'êtes dans aucun salon.\n");
+    }
+    else if (accepted && (client->long_message = longmsg_start((size_t)size)) == NULL)
     {
-        const char *salon_name = (const char *)sqlite3_column_text(stmt, 0);
-        create_salon_directory(salon_name); // Créer le dossier pour chaque salon
+        snprintf(reason, sizeof(reason), "Erreur : mémoire insuffisante pour le message.\n");
     }
+    if (client->long_message == NULL)
+    {
+        longmsg_count_refused();
+        client->long_skip = (size_t)size;
+        if (reason[0] != '\0')
+        {
+            queue_text(client, reason); // Sinon la limite de débit a déjà répondu
+        }
+    }
+}
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+// Retire les caractères de contrôle de chaque ligne d'un message long, en gardant les retours à la ligne
+static size_t sanitize_lines(char *text, size_t len)
+{
+    size_t kept = 0;
+    size_t start = 0;
+    while (start <= len)
+    {
+        const char *newline = memchr(text + start, '\n', len - start);
+        size_t line_len = newline != NULL ? (size_t)(newline - (text + start)) : len - start;
+        memmove(text + kept, text + start, line_len);
+        kept += scan_sanitize(text + kept, line_len);
+        if (newline == NULL)
+        {
+            break;
+        }
+        text[kept++] = '\n';
+        start += line_len + 1;
+    }
+    return kept;
 }
 
-void send_file_to_client(int client_socket, const char *salon_name, const char *filename)
+void send_long_to_channel(client_t *sender, longmsg_text_t *text)
 {
-    char file_path[256];
-    snprintf(file_path, sizeof(file_path), "server/%s/%s", salon_name, filename);
+    const char *channel = sender->current_channel;
+    uint64_t seq = history_append(channel, text->data, text->len);
+    for (int i = 0; i < config.max_clients; i++)
+    {
+        if (clients[i] && clients[i] != sender && receives_live(clients[i], channel))
+        {
+            queue_long_message(clients[i], channel, seq, text);
+        }
+    }
+    store_message_in_db(channel, sender->username, text->data, seq);
+
+    // Transmettre aux autres nœuds qui ont des membres dans ce salon
+    cluster_publish(channel, text->data, text->len);
+}
 
-    FILE *file = fopen(file_path, "rb");
-    if (file == NULL)
+void deliver_long_message(client_t *client)
+{
+    char prefix[LONGMSG_PREFIX_SIZE];
+    int prefix_len = snprintf(prefix, sizeof(prefix), "%s: ", client->username);
+    longmsg_text_t *text = longmsg_finish(client->long_message, prefix);
+    client->long_message = NULL;
+    if (text == NULL)
     {
-        perror("Erreur lors de l'ouverture du fichier");
-        send(client_socket, "Erreur : fichier introuvable.\n", 30, 0);
+        queue_text(client, "Erreur : mémoire insuffisante pour le message.\n");
         return;
     }
 
-    // Obtenir la taille du fichier
-    fseek(file, 0L, SEEK_END);
-    long file_size = ftell(file);
-    rewind(file);
+    // Même nettoyage qu'une ligne, sans le dernier retour à la ligne ajouté par longmsg_finish()
+    size_t body = sanitize_lines(text->data + prefix_len, text->len - prefix_len - 1);
+    text->len = prefix_len + body;
+    text->data[text->len++] = '\n';
+    text->data[text->len] = '\0';
+
+    if (body > 0 && strlen(client->current_channel) > 0)
+    {
+        send_long_to_channel(client, text);
+        if (client->user_link.user != NULL)
+        {
+            presence_typing(client->user_link.user, "", monotonic_ms()); // Le message est parti
+        }
+    }
+    longmsg_release(text);
+}
 
-    // Envoyer la taille du fichier
-    char size_str[20];
-    snprintf(size_str, sizeof(size_str), "%ld", file_size);
-    send(client_socket, size_str, strlen(size_str), 0);
+size_t receive_long_data(client_t *client, const char *data, size_t len)
+{
+    if (client->long_message == NULL)
+    {
+        // Message refusé : ses octets sont jetés
+        size_t skipped = len < client->long_skip ? len : client->long_skip;
+        client->long_skip -= skipped;
+        return skipped;
+    }
 
-    // Attendre la confirmation du client pour démarrer le transfert
-    char buffer[BUFFER_SIZE];
-    recv(client_socket, buffer, sizeof(buffer), 0);
+    size_t taken = longmsg_append(client->long_message, data, len);
+    client->progress_ms = monotonic_ms();
+    charge_rate_bytes(client, taken, monotonic_ns());
+    if (taken < len && !longmsg_complete(client->long_message))
+    {
+        // Plus de segments disponibles : abandonner le message et jeter la suite
+        client->long_skip = client->long_message->expected - client->long_message->received;
+        longmsg_abort(client->long_message);
+        client->long_message = NULL;
+        queue_text(client, "Erreur : mémoire insuffisante pour le message.\n");
+    }
+    else if (longmsg_complete(client->long_message))
+    {
+        deliver_long_message(client);
+    }
+    return taken;
+}
+
+void deliver_cluster_message(const char *channel, const char *message, size_t len)
+{
+    // Message privé transmis par le nœud de l'expéditeur
+    if (channel[0] == '@')
+    {
+        deliver_direct_message(channel + 1, message, len);
+        return;
+    }
+
+    // Message d'un autre nœud : numéroté et enregistré ici aussi, pour que les membres locaux puissent le rattraper
+    uint64_t seq = history_append(channel, message, len);
+    char *text = strndup(message, len);
+    if (text == NULL)
+    {
+        return;
+    }
+    char username[50];
+    const char *colon = strchr(text, ':'); // "utilisateur: message", ou une notification sans auteur
+    snprintf(username, sizeof(username), "%.*s", colon != NULL ? (int)(colon - text) : 0, text);
+    store_message_in_db(channel, username, text, seq);
+    free(text);
 
-    // Transférer le fichier bit par bit
-    char byte;
-    while (fread(&byte, 1, 1, file) == 1)
+    for (int i = 0; i < config.max_clients; i++)
     {
-        if (send(client_socket, &byte, 1, 0) < 0)
+        if (clients[i] && receives_live(clients[i], channel))
         {
-            perror("Erreur lors de l'envoi du fichier");
-            break;
+            queue_channel_message(clients[i], channel, seq, message, len);
         }
     }
+}
 
-    fclose(file);
-    printf("Fichier '%s' envoyé au client.\n", filename);
+void link_user(client_t *client)
+{
+    if (presence_connect(&client->user_link, client->username, client) == NULL)
+    {
+        return;
+    }
+    // Les messages privés de l'utilisateur peuvent venir des autres nœuds
+    char direct[CLUSTER_CHANNEL_SIZE];
+    if (cluster_enabled() && snprintf(direct, sizeof(direct), "@%s", client->username) < (int)sizeof(direct) - 1)
+    {
+        cluster_join(direct);
+    }
 }
 
-void receive_file_from_client(int client_socket, const char *salon_name, const char *filename)
+void unlink_user(client_t *client)
 {
-    char file_path[256];
-    snprintf(file_path, sizeof(file_path), "server/%s/%s", salon_name, filename);
+    if (client->user_link.user == NULL)
+    {
+        return;
+    }
+    char direct[CLUSTER_CHANNEL_SIZE];
+    if (cluster_enabled() && snprintf(direct, sizeof(direct), "@%s", client->username) < (int)sizeof(direct) - 1)
+    {
+        cluster_leave(direct);
+    }
+    presence_disconnect(&client->user_link);
+}
 
-    // Réception de la taille du fichier
-    char buffer[BUFFER_SIZE];
-    int bytes_received = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
-    if (bytes_received <= 0)
+void send_direct_message(client_t *client, const char *arguments)
+{
+    char recipient[50];
+    int offset = 0;
+    if (sscanf(arguments, "%49s %n", recipient, &offset) != 1 || offset == 0 || arguments[offset] == '\0')
     {
-        perror("Erreur lors de la réception de la taille du fichier");
+        queue_text(client, "Usage : msg <utilisateur> <message>\n");
         return;
     }
-    buffer[bytes_received] = '\0';
-    long file_size = atol(buffer); // Convertir la taille en nombre
 
-    // Envoyer la confirmation pour démarrer le transfert
-    send(client_socket, "OK", 2, 0);
+    char message[BUFFER_SIZE];
+    int len = snprintf(message, sizeof(message), "[privé] %s: %s\n", client->username, arguments + offset);
+    if (len >= (int)sizeof(message))
+    {
+        len = sizeof(message) - 1;
+        message[len - 1] = '\n';
+    }
+    if (deliver_direct_message(recipient, message, len) > 0)
+    {
+        direct_messages++;
+        return;
+    }
 
-    // Ouvrir le fichier pour l'écriture
-    FILE *file = fopen(file_path, "wb");
-    if (file == NULL)
+    // Pas sur ce nœud : transmis au nœud où le destinataire est connecté, s'il y en a un
+    char direct[CLUSTER_CHANNEL_SIZE];
+    if (cluster_enabled() && snprintf(direct, sizeof(direct), "@%s", recipient) < (int)sizeof(direct) - 1 &&
+        cluster_has_subscriber(direct))
     {
-        perror("Erreur lors de la création du fichier");
+        cluster_publish(direct, message, len);
+        direct_messages++;
         return;
     }
+    char response[BUFFER_SIZE];
+    snprintf(response, sizeof(response), "Utilisateur %s non connecté.\n", recipient);
+    queue_text(client, response);
+}
+
+int deliver_direct_message(const char *username, const char *message, size_t len)
+{
+    // L'index donne directement les connexions du destinataire
+    presence_user_t *user = presence_find(username);
+    int reached = 0;
+    for (presence_link_t *link = user != NULL ? user->connections : NULL; link != NULL; link = link->next)
+    {
+        queue_message(link->connection, message, len);
+        reached++;
+    }
+    return reached;
+}
 
-    // Recevoir les bits du fichier un par un
-    char byte;
-    long received_bytes = 0;
-    while (received_bytes < file_size)
+void deliver_presence(const char *channel, const char *line, size_t len)
+{
+    // Une seule ligne par lot, formatée une fois pour tous les abonnés
+    for (int i = 0; i < config.max_clients; i++)
     {
-        int byte_received = recv(client_socket, &byte, 1, 0);
-        if (byte_received <= 0)
+        if (clients[i] && clients[i]->presence && (channel == NULL || strcmp(clients[i]->current_channel, channel) == 0))
         {
-            perror("Erreur lors de la réception du fichier");
-            break;
+            queue_message(clients[i], line, len);
         }
-
-        // Écrire le byte dans le fichier
-        fwrite(&byte, 1, 1, file);
-        received_bytes++;
     }
+}
 
-    fclose(file);
+static void queue_presence(void *context, const char *line, size_t len)
+{
+    queue_message(context, line, len);
+}
 
-    if (received_bytes == file_size)
+void set_client_channel(client_t *client, const char *channel)
+{
+    // L'indication "en train d'écrire" ne concerne que le salon quitté
+    if (client->user_link.user != NULL)
     {
-        printf("Fichier '%s' reçu avec succès et stocké dans le salon %s.\n", filename, salon_name);
+        presence_typing(client->user_link.user, "", monotonic_ms());
+    }
 
-        // Notifier les utilisateurs dans le salon que le fichier est disponible
-        char notification[BUFFER_SIZE];
-        snprintf(notification, sizeof(notification), "Un nouveau fichier '%s' est disponible au téléchargement dans le salon %s.\n", filename, salon_name);
-        send_message_to_channel(salon_name, notification, client_socket);
+    // Les autres nœuds ne transmettent un salon que s'il a des membres ici
+    if (strlen(client->current_channel) > 0)
+    {
+        cluster_leave(client->current_channel);
     }
-    else
+    snprintf(client->current_channel, sizeof(client->current_channel), "%s", channel);
+    client->replay_ticket = 0; // La relecture en cours concernait le salon quitté
+    if (strlen(client->current_channel) > 0)
     {
-        printf("Erreur : fichier incomplet reçu.\n");
+        cluster_join(client->current_channel);
     }
 }
 
-void handle_client(int client_socket, client_t *client)
+int remove_channels(client_t *client, char *names[], int count)
 {
-    char buffer[BUFFER_SIZE];
-    int bytes_received = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
 
-    // Vérifier si le client s'est déconnecté ou s'il y a une erreur
-    if (bytes_received <= 0)
+    if (sqlite3_open("database.db", &db) != SQLITE_OK)
     {
-        printf("Client %s disconnected\n", client->username);
+        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return -1;
+    }
+    sqlite3_busy_timeout(db, 1000);
+
+    // Tous les salons sont supprimés dans une seule transaction : aucun si l'un échoue
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", 0, 0, 0) != SQLITE_OK)
+    {
+        sqlite3_close(db);
+        return -1;
+    }
+    int status = sqlite3_prepare_v2(db, "DELETE FROM salons WHERE name = ?;", -1, &stmt, 0) == SQLITE_OK ? 0 : -1;
+    for (int i = 0; i < count && status == 0; i++)
+    {
+        sqlite3_bind_text(stmt, 1, names[i], -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE)
+        {
+            fprintf(stderr, "Erreur lors de la suppression du salon %s : %s\n", names[i], sqlite3_errmsg(db));
+            status = -1;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    if (status == 0 && sqlite3_exec(db, "COMMIT;", 0, 0, 0) != SQLITE_OK)
+    {
+        status = -1;
+    }
+    if (status < 0)
+    {
+        sqlite3_exec(db, "ROLLBACK;", 0, 0, 0);
+    }
+    sqlite3_close(db);
+    if (status < 0)
+    {
+        return -1;
+    }
+
+    // Les messages encore en attente sont écrits avant que leurs salons soient oubliés
+    flush_message_batch();
+
+    for (int i = 0; i < count; i++)
+    {
+        // Les membres sont prévenus et sortis du salon, mais restent connectés
+        char message[BUFFER_SIZE];
+        snprintf(message, sizeof(message), "Le salon %s a été supprimé par %s.\n", names[i], client->username);
+        for (int j = 0; j < config.max_clients; j++)
+        {
+            if (clients[j] && strcmp(clients[j]->current_channel, names[i]) == 0)
+            {
+                queue_text(clients[j], message);
+                set_client_channel(clients[j], "");
+            }
+        }
+
+        // Supprimer le dossier du salon, et oublier ses fichiers gardés ouverts et ses messages
+        history_clear(names[i]);
+        filecache_invalidate_channel(names[i]);
+        delete_salon_directory(names[i]);
+        registry_remove(names[i]);
+        storage_forget_channel(names[i]); // Ses messages enregistrés sont supprimés en arrière-plan
+        printf("Suppression du channel %s par %s\n", names[i], client->username);
+    }
+    return 0;
+}
+
+void delete_channel(client_t *client, const char *channel_name)
+{
+    // Vérifier si l'utilisateur est un admin
+    if (!is_admin(client->username))
+    {
+        queue_text(client, "Vous devez être un administrateur pour supprimer un salon.\n");
+        return;
+    }
+
+    if (!channel_exists(channel_name))
+    {
+        queue_text(client, "Ce salon n'existe pas.\n");
+        return;
+    }
+
+    char *names[] = {(char *)channel_name};
+    if (remove_channels(client, names, 1) == 0)
+    {
+        queue_text(client, "Salon supprimé avec succès.\n");
+    }
+    else
+    {
+        queue_text(client, "Erreur lors de la suppression du salon.\n");
+    }
+}
+
+void delete_channels(client_t *client, char *arguments)
+{
+    if (!is_admin(client->username))
+    {
+        queue_text(client, "Vous devez être un administrateur pour supprimer un salon.\n");
+        return;
+    }
+
+    char *names[ADMIN_BATCH_MAX];
+    int count = split_names(arguments, names, ADMIN_BATCH_MAX);
+    if (count == 0)
+    {
+        queue_text(client, "Usage : delete_many <salon> [<salon>...]\n");
+        return;
+    }
+
+    // Les salons inconnus ou répétés sont écartés ; les autres sont supprimés ensemble
+    char *deleted[ADMIN_BATCH_MAX];
+    int deleted_count = 0;
+    char unknown[BUFFER_SIZE] = "";
+    for (int i = 0; i < count; i++)
+    {
+        bool repeated = false;
+        for (int j = 0; j < deleted_count && !repeated; j++)
+        {
+            repeated = strcmp(deleted[j], names[i]) == 0;
+        }
+        if (!repeated && !channel_exists(names[i]))
+        {
+            append_name(unknown, sizeof(unknown), names[i]);
+        }
+        else if (!repeated)
+        {
+            deleted[deleted_count++] = names[i];
+        }
+    }
+
+    if (deleted_count > 0 && remove_channels(client, deleted, deleted_count) < 0)
+    {
+        queue_text(client, "Erreur lors de la suppression des salons : aucun salon n'a été supprimé.\n");
+        return;
+    }
+
+    char response[BUFFER_SIZE];
+    snprintf(response, sizeof(response), "Salons supprimés : %d\n", deleted_count);
+    append_list(response, "Salons inexistants", unknown);
+    queue_text(client, response);
+}
+
+void kick_users(client_t *client, char *arguments)
+{
+    if (!is_admin(client->username))
+    {
+        queue_text(client, "Vous devez être un administrateur pour expulser un utilisateur.\n");
+        return;
+    }
+
+    char *names[ADMIN_BATCH_MAX];
+    int count = split_names(arguments, names, ADMIN_BATCH_MAX);
+    if (count == 0)
+    {
+        queue_text(client, "Usage : kick <utilisateur> [<utilisateur>...]\n");
+        return;
+    }
+
+    char kicked[BUFFER_SIZE] = "", absent[BUFFER_SIZE] = "";
+    int connections = 0;
+    char message[BUFFER_SIZE];
+    snprintf(message, sizeof(message), "Vous avez été expulsé par %s.\n", client->username);
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(names[i], client->username) == 0)
+        {
+            continue; // Un administrateur ne s'expulse pas lui-même
+        }
+        session_revoke_user(names[i]); // Sans quoi ses clients se reconnecteraient aussitôt avec leur jeton
+
+        // L'index de présence donne les connexions de l'utilisateur ; elles sont fermées à la fin du tour de boucle
+        presence_user_t *user = presence_find(names[i]);
+        int closed = 0;
+        for (presence_link_t *link = user != NULL ? user->connections : NULL; link != NULL; link = link->next)
+        {
+            client_t *target = link->connection;
+            if (!target->closing)
+            {
+                queue_text(target, message);
+                flush_client(target);
+                target->closing = 1;
+                closed++;
+            }
+        }
+        append_name(closed > 0 ? kicked : absent, sizeof(kicked), names[i]);
+        connections += closed;
+        if (closed > 0)
+        {
+            printf("Utilisateur %s expulsé par %s\n", names[i], client->username);
+        }
+    }
+
+    char response[BUFFER_SIZE];
+    snprintf(response, sizeof(response), "Connexions fermées : %d\n", connections);
+    append_list(response, "Utilisateurs expulsés", kicked);
+    append_list(response, "Utilisateurs non connectés", absent);
+    queue_text(client, response);
+}
+
+void move_users(client_t *client, char *arguments)
+{
+    if (!is_admin(client->username))
+    {
+        queue_text(client, "Vous devez être un administrateur pour déplacer un utilisateur.\n");
+        return;
+    }
+
+    char *names[ADMIN_BATCH_MAX];
+    int count = split_names(arguments, names, ADMIN_BATCH_MAX);
+    if (count < 2)
+    {
+        queue_text(client, "Usage : move <salon> <utilisateur> [<utilisateur>...]\n");
+        return;
+    }
+    const char *channel = names[0];
+    if (!channel_exists(channel))
+    {
+        queue_text(client, "Ce salon n'existe pas.\n");
+        return;
+    }
+
+    char moved[BUFFER_SIZE] = "", absent[BUFFER_SIZE] = "";
+    char message[BUFFER_SIZE];
+    snprintf(message, sizeof(message), "Vous avez été déplacé dans le salon %s par %s.\n", channel, client->username);
+    for (int i = 1; i < count; i++)
+    {
+        presence_user_t *user = presence_find(names[i]);
+        bool found = false;
+        for (presence_link_t *link = user != NULL ? user->connections : NULL; link != NULL; link = link->next)
+        {
+            client_t *target = link->connection;
+            found = true;
+            if (target->closing || strcmp(target->current_channel, channel) == 0)
+            {
+                continue;
+            }
+
+            // Même suite d'événements qu'un "leave" suivi d'un "join"
+            if (strlen(target->current_channel) > 0)
+            {
+                send_message_to_channel(target->current_channel, "Un utilisateur a quitté le salon.\n", target->socket);
+            }
+            set_client_channel(target, channel);
+            queue_text(target, message);
+            char response[BUFFER_SIZE];
+            snprintf(response, sizeof(response), "@SEQ %s %llu\n", channel, (unsigned long long)history_last(channel));
+            queue_text(target, response);
+            send_message_to_channel(channel, "Un utilisateur a rejoint le salon.\n", target->socket);
+        }
+        append_name(found ? moved : absent, sizeof(moved), names[i]);
+    }
+    printf("Utilisateurs déplacés dans le salon %s par %s\n", channel, client->username);
+
+    // Réponse bornée à BUFFER_SIZE, comme celles des autres commandes par lots
+    char response[BUFFER_SIZE] = "", title[128];
+    snprintf(title, sizeof(title), "Utilisateurs déplacés dans le salon %s", channel);
+    append_list(response, title, moved[0] != '\0' ? moved : "aucun");
+    append_list(response, "Utilisateurs non connectés", absent);
+    queue_text(client, response);
+}
+
+void set_channel_retention(client_t *client, char *arguments)
+{
+    if (!is_admin(client->username))
+    {
+        queue_text(client, "Vous devez être un administrateur pour changer la rétention d'un salon.\n");
+        return;
+    }
+
+    char *saveptr;
+    char *channel_name = strtok_r(arguments, " ", &saveptr);
+    char *rule = strtok_r(NULL, " ", &saveptr);
+    if (channel_name == NULL || rule == NULL)
+    {
+        queue_text(client, "Usage : retention <salon> <N>d|<N>|off\n");
+        return;
+    }
+
+    // "30d" : durée en jours, "1000" : nombre de messages, "off" : aucune limite
+    int max_age_days = 0;
+    long max_count = 0;
+    for (; rule != NULL; rule = strtok_r(NULL, " ", &saveptr))
+    {
+        char *end;
+        long value = strtol(rule, &end, 10);
+        if (strcmp(rule, "off") == 0)
+        {
+            max_age_days = 0;
+            max_count = 0;
+        }
+        else if (end != rule && value > 0 && strcmp(end, "d") == 0)
+        {
+            max_age_days = (int)value;
+        }
+        else if (end != rule && value > 0 && *end == '\0')
+        {
+            max_count = value;
+        }
+        else
+        {
+            queue_text(client, "Usage : retention <salon> <N>d|<N>|off\n");
+            return;
+        }
+    }
+
+    if (storage_set_retention(channel_name, max_age_days, max_count) < 0)
+    {
+        queue_text(client, "Salon inexistant.\n");
+        return;
+    }
+    char message[BUFFER_SIZE];
+    if (max_age_days == 0 && max_count == 0)
+    {
+        snprintf(message, sizeof(message), "Les messages du salon %s sont conservés sans limite.\n", channel_name);
+    }
+    else
+    {
+        snprintf(message, sizeof(message), "Rétention du salon %s : %d jours, %ld messages (0 : sans limite).\n", channel_name, max_age_days, max_count);
+    }
+    queue_text(client, message);
+    printf("Rétention du salon %s changée par %s\n", channel_name, client->username);
+}
+
+static void append_channel_name(void *context, const char *channel_name)
+{
+    char *message = context;
+    snprintf(message + strlen(message), BUFFER_SIZE - strlen(message), "%s\n", channel_name);
+}
+
+void list_channels(client_t *client)
+{
+    char message[BUFFER_SIZE];
+    snprintf(message, sizeof(message), "Liste des salons :\n");
+
+    // Les salons sont lus dans le registre en mémoire, sans ouvrir la base
+    registry_foreach(append_channel_name, message);
+
+    queue_text(client, message); // Envoyer la liste au client
+}
+
+void handle_list_admin(client_t *admin)
+{
+    // Suppression de l'utilisation du mutex, car la gestion des clients est désormais gérée par `poll`
+    char message[BUFFER_SIZE];
+    snprintf(message, sizeof(message), "Liste des utilisateurs connectés et leurs salons :\n");
+
+    // Boucle pour parcourir les clients et récupérer leurs informations
+    for (int i = 0; i < config.max_clients; i++)
+    {
+        if (clients[i]) // Si un client est connecté
+        {
+            snprintf(message + strlen(message), sizeof(message) - strlen(message),
+                     "Utilisateur : %s, Salon : %s\n",
+                     clients[i]->username,
+                     strlen(clients[i]->current_channel) > 0 ? clients[i]->current_channel : "Aucun");
+        }
+    }
+
+    // Envoyer la liste complète des utilisateurs connectés à l'administrateur
+    queue_text(admin, message);
+}
+
+void notify_current_channel(client_t *client)
+{
+    // Vérification que le client n'est pas NULL et que le salon actuel est valide
+    if (client != NULL && strlen(client->current_channel) > 0)
+    {
+        // Ajout d'un message de débogage pour s'assurer que la chaîne est correcte
+        printf("Salon actuel du client %s = %s\n", client->username, client->current_channel);
+
+        // Créer un message à envoyer au client
+        char message[BUFFER_SIZE];
+        snprintf(message, sizeof(message), "Salon actuel : %s\n", client->current_channel);
+
+        // Envoyer le message au client
+        queue_text(client, message);
+    }
+    else
+    {
+        // Si aucun salon n'est rejoint, informer le client
+        printf("Client %s n'a rejoint aucun salon.\n", client->username);
+        queue_text(client, "Vous n'êtes dans aucun salon.\n");
+    }
+}
+
+int valid_filename(const char *filename)
+{
+    // Le fichier doit rester dans le dossier du salon
+    return filename[0] != '\0' && filename[0] != '.' && strchr(filename, '/') == NULL;
+}
+
+void send_file_to_client(client_t *client, const char *salon_name, const char *filename)
+{
+    char file_path[256];
+    snprintf(file_path, sizeof(file_path), "server/%s/%s", salon_name, filename);
+
+    // Les téléchargements simultanés d'un même fichier partagent son descripteur et sa projection
+    filecache_entry_t *entry = valid_filename(filename) ? filecache_open(file_path) : NULL;
+    if (entry == NULL)
+    {
+        perror("Erreur lors de l'ouverture du fichier");
+        queue_text(client, "@ERR Erreur : fichier introuvable.\n");
+        return;
+    }
+    struct stat st = *filecache_stat(entry);
+    long file_size = st.st_size;
+
+    // Somme de contrôle, gardée avec le fichier : il n'est pas relu pour la calculer
+    uint32_t crc = 0;
+    bool crc_known = false;
+    if (client->checksum)
+    {
+        crc_known = filecache_checksum(entry, &crc);
+        if (!crc_known && zcache_checksum(salon_name, filename, &st, &crc) == 0)
+        {
+            filecache_set_checksum(entry, crc);
+            crc_known = true;
+        }
+    }
+
+    // Le client accepte la compression : envoyer la copie compressée si elle est prête
+    long compressed_size = 0;
+    int compressed_fd = client->compress ? zcache_open(salon_name, filename, &st, &compressed_size) : -1;
+    char header[64];
+    if (compressed_fd >= 0)
+    {
+        filecache_release(entry);
+        entry = NULL;
+        snprintf(header, sizeof(header), "@FILEZ %ld %ld\n", compressed_size, file_size);
+        zcache_count_sent(file_size, compressed_size);
+        file_size = compressed_size;
+    }
+    else
+    {
+        // Annoncer la taille du fichier, qui suit immédiatement
+        snprintf(header, sizeof(header), "@FILE %ld\n", file_size);
+    }
+    queue_text(client, header);
+
+    // Le fichier part sans copie (sendfile, ou kTLS si le socket est chiffré) quand le socket est prêt ;
+    // la copie compressée est propre au client, le fichier en cache est partagé
+    int pushed = entry == NULL ? outqueue_push_file(&client->out, compressed_fd, 0, file_size)
+                               : outqueue_push_shared(&client->out, filecache_fd(entry), filecache_data(entry), 0, file_size,
+                                                      filecache_release, entry);
+    if (pushed < 0)
+    {
+        client->closing = 1; // Le client attendrait un fichier qui ne viendra pas
+        return;
+    }
+
+    // Suivi de sa somme de contrôle
+    if (client->checksum)
+    {
+        char trailer[32];
+        if (crc_known)
+        {
+            snprintf(trailer, sizeof(trailer), "@CRC32C %08x\n", crc);
+        }
+        else
+        {
+            snprintf(trailer, sizeof(trailer), "@CRC32C -\n");
+        }
+        queue_text(client, trailer);
+    }
+    printf("Envoi du fichier '%s' au client %s.\n", filename, client->username);
+}
+
+void upload_temp_path(char *path, size_t size, const char *salon_name, const char *filename, int socket)
+{
+    snprintf(path, size, "server/%s/.%s.%d.part", salon_name, filename, socket);
+}
+
+void replace_salon_file(const char *temp_path, const char *salon_name, const char *filename, uint32_t crc)
+{
+    char file_path[256];
+    snprintf(file_path, sizeof(file_path), "server/%s/%s", salon_name, filename);
+
+    // Le renommage remplace le fichier d'un coup : les téléchargements en cours gardent l'ancien
+    if (rename(temp_path, file_path) < 0)
+    {
+        perror("Erreur lors du remplacement du fichier");
+        unlink(temp_path);
+        return;
+    }
+    zcache_invalidate(salon_name, filename); // L'ancienne copie compressée ne correspond plus
+    filecache_invalidate(file_path);
+    zcache_store_checksum(salon_name, filename, crc);
+}
+
+void receive_file_from_client(client_t *client, const char *salon_name, const char *filename, long file_size, long compressed_size)
+{
+    // Le fichier est reçu à part, puis remplace l'ancien une fois complet
+    if (create_salon_directory(salon_name) < 0)
+    {
+        queue_text(client, "@ERR Erreur lors de la création du fichier.\n");
+        return;
+    }
+    upload_temp_path(client->upload_path, sizeof(client->upload_path), salon_name, filename, client->socket);
+
+    // Ouvrir le fichier pour l'écriture
+    int file_fd = open(client->upload_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (file_fd < 0)
+    {
+        perror("Erreur lors de la création du fichier");
+        queue_text(client, "@ERR Erreur lors de la création du fichier.\n");
+        return;
+    }
+
+    // Un fichier compressé est décompressé au fil de la réception
+    client->upload_inflater = NULL;
+    if (compressed_size >= 0 && (client->upload_inflater = inflater_new(file_fd, file_size)) == NULL)
+    {
+        close(file_fd);
+        unlink(client->upload_path);
+        queue_text(client, "@ERR Erreur lors de la création du fichier.\n");
+        return;
+    }
+
+    // Les octets suivants de la connexion appartiennent au fichier
+    client->upload_fd = file_fd;
+    client->upload_remaining = compressed_size >= 0 ? compressed_size : file_size;
+    client->upload_size = file_size;
+    client->upload_compressed = compressed_size;
+    client->upload_crc = 0;
+    snprintf(client->upload_name, sizeof(client->upload_name), "%s", filename);
+    snprintf(client->upload_channel, sizeof(client->upload_channel), "%s", salon_name);
+    client->progress_ms = monotonic_ms();
+
+    // Envoyer la confirmation pour démarrer le transfert
+    queue_text(client, "@OK\n");
+
+    if (client->upload_remaining == 0)
+    {
+        finish_upload(client);
+    }
+}
+
+size_t receive_upload_data(client_t *client, const char *data, size_t len)
+{
+    size_t to_write = len < (size_t)client->upload_remaining ? len : (size_t)client->upload_remaining;
+
+    // Écrire le bloc dans le fichier, ou ce qu'il donne une fois décompressé
+    size_t written = 0;
+    if (client->upload_inflater != NULL && inflater_write(client->upload_inflater, data, to_write) < 0)
+    {
+        printf("Erreur : fichier compressé invalide reçu de %s.\n", client->username);
+        abort_upload(client);
+        client->closing = 1;
+        return len;
+    }
+    while (client->upload_inflater == NULL && written < to_write)
+    {
+        // Une partie d'un envoi parallèle est écrite à sa place dans le fichier
+        ssize_t n = client->upload_offset >= 0
+                        ? pwrite(client->upload_fd, data + written, to_write - written, client->upload_offset + written)
+                        : write(client->upload_fd, data + written, to_write - written);
+        if (n < 0)
+        {
+            // La suite du fichier serait lue comme des commandes : fermer la connexion
+            perror("Erreur lors de l'écriture du fichier");
+            abort_upload(client);
+            client->closing = 1;
+            return len;
+        }
+        written += n;
+    }
+
+    if (client->upload_offset >= 0)
+    {
+        client->upload_offset += to_write;
+    }
+    if (client->upload_inflater == NULL)
+    {
+        client->upload_crc = crc32c(client->upload_crc, data, to_write); // Les octets sont encore en cache
+    }
+    client->upload_remaining -= to_write;
+    client->progress_ms = monotonic_ms();
+    if (client->upload_remaining == 0)
+    {
+        finish_upload(client);
+    }
+    return to_write;
+}
+
+void finish_upload(client_t *client)
+{
+    if (client->upload_offset >= 0)
+    {
+        // Partie d'un envoi parallèle : l'annonce attend la fin de toutes les parties (pdone)
+        close(client->upload_fd);
+        client->upload_fd = -1;
+        client->upload_offset = -1;
+        parallel_part_done(client->data_token, client->part_offset, client->upload_crc);
+        queue_text(client, "@OK\n");
+        return;
+    }
+    if (client->upload_inflater != NULL)
+    {
+        // Le flux compressé doit donner exactement la taille annoncée
+        if (!inflater_complete(client->upload_inflater, client->upload_size))
+        {
+            abort_upload(client);
+            queue_text(client, "Erreur : le fichier compressé reçu est incomplet.\n");
+            return;
+        }
+        zcache_count_received(client->upload_size, client->upload_compressed);
+        client->upload_crc = inflater_checksum(client->upload_inflater);
+        inflater_free(client->upload_inflater);
+        client->upload_inflater = NULL;
+    }
+    close(client->upload_fd);
+    client->upload_fd = -1;
+
+    // La ligne suivante doit être la somme de contrôle calculée par le client
+    if (client->checksum)
+    {
+        client->upload_verifying = 1;
+        return;
+    }
+    complete_upload(client);
+}
+
+void verify_upload(client_t *client, const char *line)
+{
+    client->upload_verifying = 0;
+    unsigned int crc;
+    char end;
+    if (sscanf(line, "@CRC32C %8x%c", &crc, &end) != 1)
+    {
+        // Les octets du fichier et les commandes sont désynchronisés : rien de ce qui suit n'est fiable
+        printf("Erreur : somme de contrôle manquante après le fichier '%s' de %s.\n", client->upload_name, client->username);
+        unlink(client->upload_path);
+        uploads_corrupted++;
+        client->closing = 1;
+        return;
+    }
+    if (crc != client->upload_crc)
+    {
+        printf("Erreur : fichier '%s' corrompu reçu de %s.\n", client->upload_name, client->username);
+        unlink(client->upload_path);
+        uploads_corrupted++;
+        queue_text(client, "Erreur : le fichier reçu est corrompu (somme de contrôle incorrecte).\n");
+        return;
+    }
+    uploads_verified++;
+    complete_upload(client);
+}
+
+void complete_upload(client_t *client)
+{
+    replace_salon_file(client->upload_path, client->upload_channel, client->upload_name, client->upload_crc);
+    printf("Fichier '%s' reçu avec succès et stocké dans le salon %s.\n", client->upload_name, client->upload_channel);
+    announce_file(client->upload_channel, client->upload_name, client->socket);
+}
+
+void announce_file(const char *channel, const char *filename, int sender_socket)
+{
+    // Notifier les utilisateurs dans le salon que le fichier est disponible
+    char notification[BUFFER_SIZE];
+    snprintf(notification, sizeof(notification), "Un nouveau fichier '%s' est disponible au téléchargement dans le salon %s.\n", filename, channel);
+    send_message_to_channel(channel, notification, sender_socket);
+}
+
+void receive_part_from_client(client_t *client, const char *line)
+{
+    char token[PARALLEL_TOKEN_SIZE];
+    long offset, length;
+    parallel_upload_t *upload = NULL;
+    int file_fd = -1;
+    if (sscanf(line, "@DATA %32s %ld %ld", token, &offset, &length) == 3 && (upload = parallel_find(token)) != NULL)
+    {
+        file_fd = parallel_claim(upload, offset, length);
+    }
+    if (file_fd < 0)
+    {
+        // Les octets qui suivent ne doivent pas être lus comme des commandes
+        printf("Partie d'envoi parallèle refusée.\n");
+        client->closing = 1;
+        return;
+    }
+
+    // Les octets suivants de la connexion appartiennent à cette partie du fichier
+    snprintf(client->data_token, sizeof(client->data_token), "%s", token);
+    client->upload_fd = file_fd;
+    client->upload_path[0] = '\0'; // Le fichier appartient à l'envoi parallèle : ne pas le supprimer en cas d'abandon
+    client->upload_remaining = length;
+    client->upload_offset = offset;
+    client->part_offset = offset;
+    client->upload_crc = 0;
+    client->progress_ms = monotonic_ms();
+}
+
+void start_parallel_upload(client_t *client, const char *filename, long file_size)
+{
+    char path[256], token[PARALLEL_TOKEN_SIZE];
+    if (create_salon_directory(client->current_channel) < 0)
+    {
+        reject_file_from_client(client, "Erreur lors de la création du fichier.\n");
+        return;
+    }
+    upload_temp_path(path, sizeof(path), client->current_channel, filename, client->socket);
+    if (parallel_start(client->current_channel, filename, path, file_size, client->socket, token) == NULL)
+    {
+        reject_file_from_client(client, "Trop d'envois en cours, réessayez plus tard.\n");
+        return;
+    }
+
+    char response[64];
+    snprintf(response, sizeof(response), "@TOKEN %s\n", token);
+    queue_text(client, response);
+}
+
+void finish_parallel_upload(client_t *client, const char *arguments)
+{
+    char token[PARALLEL_TOKEN_SIZE], channel[50], filename[256];
+    unsigned long crc;
+    parallel_upload_t *upload = NULL;
+    if (sscanf(arguments, "%32s %lx", token, &crc) != 2 || (upload = parallel_find(token)) == NULL ||
+        parallel_owner(upload, channel, filename) != client->socket)
+    {
+        queue_text(client, "@ERR Envoi parallèle inconnu.\n");
+        return;
+    }
+
+    if (!parallel_finish(upload, (uint32_t)crc))
+    {
+        printf("Erreur : fichier '%s' incomplet ou corrompu reçu de %s.\n", filename, client->username);
+        queue_text(client, "@ERR Fichier incomplet ou somme de contrôle incorrecte.\n");
+        return;
+    }
+    char path[256];
+    upload_temp_path(path, sizeof(path), channel, filename, client->socket);
+    replace_salon_file(path, channel, filename, (uint32_t)crc);
+    printf("Fichier '%s' reçu avec succès en parallèle et stocké dans le salon %s.\n", filename, channel);
+    queue_text(client, "@OK\n");
+    announce_file(channel, filename, client->socket);
+}
+
+void abort_upload(client_t *client)
+{
+    if (client->upload_fd < 0 && !client->upload_verifying)
+    {
+        return;
+    }
+
+    // Ne pas laisser un fichier tronqué, ou pas encore vérifié, dans le salon
+    inflater_free(client->upload_inflater);
+    client->upload_inflater = NULL;
+    if (client->upload_fd >= 0)
+    {
+        close(client->upload_fd);
+    }
+    client->upload_fd = -1;
+    client->upload_verifying = 0;
+    client->upload_offset = -1;
+    if (client->upload_path[0] != '\0')
+    {
+        unlink(client->upload_path);
+    }
+    printf("Erreur : fichier incomplet reçu.\n");
+}
+
+void queue_message(client_t *client, const void *data, size_t len)
+{
+    if (client->closing)
+    {
+        return;
+    }
+
+    // Le délai de transfert court à partir du moment où la file n'est plus vide
+    if (outqueue_empty(&client->out))
+    {
+        client->progress_ms = monotonic_ms();
+    }
+
+    // Un client qui ne lit plus ses messages ne doit pas accumuler de la mémoire sans fin
+    // Seuls les octets déjà en attente comptent : un message, même long, passe toujours dans une file vide
+    if (client->out.buffered >= (size_t)config.outqueue_max_bytes || outqueue_push(&client->out, data, len) < 0)
+    {
+        printf("Client %s trop lent, déconnexion.\n", client->username);
+        slow_consumers++;
+        client->closing = 1;
+    }
+}
+
+void queue_text(client_t *client, const char *text)
+{
+    queue_message(client, text, strlen(text));
+}
+
+void queue_long_message(client_t *client, const char *channel, uint64_t seq, longmsg_text_t *text)
+{
+    char header[LONGMSG_HEADER_SIZE];
+    int header_len = snprintf(header, sizeof(header), "@LONG %s %llu %zu\n", channel, (unsigned long long)seq, text->len);
+    queue_message(client, header, header_len);
+    if (client->closing)
+    {
+        return;
+    }
+
+    // Le texte n'est pas copié : la file garde une référence, rendue une fois le texte envoyé (ou en cas d'échec)
+    bool queued = client->out.buffered < (size_t)config.outqueue_max_bytes;
+    if (queued)
+    {
+        longmsg_retain(text);
+        queued = outqueue_push_ref(&client->out, text->data, text->len, longmsg_release, text) == 0;
+    }
+    if (!queued)
+    {
+        printf("Client %s trop lent, déconnexion.\n", client->username);
+        slow_consumers++;
+        client->closing = 1;
+    }
+}
+
+void flush_client(client_t *client)
+{
+    ssize_t written = outqueue_flush(&client->out, client->socket);
+    if (written < 0)
+    {
+        perror("Erreur lors de l'envoi au client");
+        client->closing = 1;
+    }
+    else if (written > 0)
+    {
+        client->progress_ms = monotonic_ms();
+    }
+}
+
+void disconnect_client(client_t *client)
+{
+    // Supprimer le client de la liste des clients
+    for (int i = 0; i < config.max_clients; i++)
+    {
+        if (clients[i] == client)
+        {
+            clients[i] = NULL;
+            break;
+        }
+    }
+
+    set_client_channel(client, "");
+    unlink_user(client);
+    if (client->session[0] != '\0')
+    {
+        session_extend(client->session); // Le jeton reste valable pour se reconnecter
+        schedule_session_save();
+    }
+    timer_cancel(&timer_wheel, &client->timer);
+    abort_upload(client);
+    longmsg_abort(client->long_message);
+    parallel_cancel_owner(client->socket);
+    outqueue_clear(&client->out);
+    user_limits_release(client->user_limits);
+    poller_remove(client->socket);
+    transport_close(client->socket);
+    slab_free(&client_slab, client);
+}
+
+void check_client_timeouts(client_t *client, uint64_t now)
+{
+    const char *reason = NULL;
+    uint64_t deadline = 0;
+    bool keepalive = false; // Vrai si l'échéance d'inactivité s'applique aussi
+    bool idle = false;
+
+    if (strlen(client->username) == 0 && client->upload_fd < 0)
+    {
+        // Négociation TLS et identifiants doivent arriver rapidement après la connexion
+        deadline = client->accepted_ms + AUTH_TIMEOUT_MS;
+        if (now >= deadline)
+        {
+            timeouts_auth++;
+            reason = "délai d'authentification dépassé";
+        }
+    }
+    else if (client->upload_fd >= 0 || client->long_message != NULL || !outqueue_empty(&client->out))
+    {
+        // Pendant un transfert, seule compte la progression : pas de ping au milieu d'un fichier
+        deadline = client->progress_ms + TRANSFER_STALL_MS;
+        if (now >= deadline)
+        {
+            timeouts_stall++;
+            reason = "transfert bloqué";
+        }
+    }
+    else if (now >= client->last_command_ms + IDLE_TIMEOUT_MS)
+    {
+        timeouts_idle++;
+        reason = "inactivité";
+        idle = true;
+    }
+    else if (client->ping_sent_ms != 0)
+    {
+        keepalive = true;
+
+        // La réponse peut avoir attendu la fin d'un transfert
+        uint64_t since = client->progress_ms > client->ping_sent_ms ? client->progress_ms : client->ping_sent_ms;
+        deadline = since + PONG_TIMEOUT_MS;
+        if (now >= deadline)
+        {
+            timeouts_ping++;
+            reason = "pas de réponse au ping";
+        }
+    }
+    else
+    {
+        // Rien reçu depuis un moment : vérifier que le client est toujours là
+        keepalive = true;
+        deadline = client->last_activity_ms + PING_INTERVAL_MS;
+        if (now >= deadline)
+        {
+            queue_text(client, "@PING\n");
+            client->ping_sent_ms = now;
+            deadline = now + PONG_TIMEOUT_MS;
+        }
+    }
+
+    if (reason != NULL)
+    {
+        printf("Client %s déconnecté : %s.\n", strlen(client->username) > 0 ? client->username : "(non authentifié)", reason);
+        if (idle)
+        {
+            // Fermeture voulue : le client ne doit pas se reconnecter aussitôt
+            queue_text(client, "@BYE idle\n");
+            flush_client(client);
+        }
+        disconnect_client(client);
+        return;
+    }
+
+    // Les activités ne replacent pas le minuteur : l'échéance est recalculée ici, quand il expire
+    if (keepalive && client->last_command_ms + IDLE_TIMEOUT_MS < deadline)
+    {
+        deadline = client->last_command_ms + IDLE_TIMEOUT_MS;
+    }
+    timer_schedule(&timer_wheel, &client->timer, deadline);
+}
+
+void client_timer_expired(wheel_timer_t *timer)
+{
+    check_client_timeouts((client_t *)timer->data, monotonic_ms());
+}
+
+client_t *add_client(int socket, int handshaking)
+{
+    // Chercher un emplacement libre
+    int slot = -1;
+    for (int i = 0; i < config.max_clients; i++)
+    {
+        if (clients[i] == NULL)
+        {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0)
+    {
+        return NULL;
+    }
+
+    // Créer un nouveau client_t et l'associer au client
+    client_t *new_client = slab_alloc(&client_slab);
+    if (new_client == NULL)
+    {
+        return NULL;
+    }
+    new_client->socket = socket;
+    strcpy(new_client->username, "");        // Initialiser le nom d'utilisateur à vide
+    strcpy(new_client->current_channel, ""); // Initialiser le salon à vide
+    new_client->is_admin = 0;
+    new_client->auth_pending = 0;
+    new_client->replay_ticket = 0;
+    new_client->search_ticket = 0;
+    rate_limits_init_connection(&new_client->limits);
+    new_client->user_limits = NULL;
+    new_client->throttled_until = 0;
+    new_client->poll_tag = 0; // Enregistré dans le poller par la boucle d'événements
+    new_client->rate_notified = 0;
+    new_client->handshaking = handshaking;
+    new_client->closing = 0;
+    new_client->session[0] = '\0';
+    new_client->session_token[0] = '\0';
+    new_client->compress = 0;
+    new_client->checksum = 0;
+    new_client->presence = 0;
+    new_client->user_link.user = NULL;
+    new_client->upload_verifying = 0;
+    new_client->inlen = 0;
+    new_client->long_message = NULL;
+    new_client->long_skip = 0;
+    outqueue_init(&new_client->out);
+    new_client->upload_fd = -1;
+    new_client->upload_remaining = 0;
+    new_client->upload_inflater = NULL;
+    new_client->upload_offset = -1;
+    new_client->data_token[0] = '\0';
+
+    // Le premier délai est celui de l'authentification
+    uint64_t accepted = monotonic_ms();
+    new_client->accepted_ms = accepted;
+    new_client->last_activity_ms = accepted;
+    new_client->last_command_ms = accepted;
+    new_client->ping_sent_ms = 0;
+    new_client->progress_ms = accepted;
+    timer_init(&new_client->timer, client_timer_expired, new_client);
+    timer_schedule(&timer_wheel, &new_client->timer, accepted + AUTH_TIMEOUT_MS);
+
+    clients[slot] = new_client; // Associer ce client à l'index correspondant de clients[]
+    return new_client;
+}
+
+void start_drain(int action)
+{
+    if (draining)
+    {
+        printf("Arrêt déjà en cours.\n");
+        return;
+    }
+
+    draining = action;
+    drain_deadline_ms = monotonic_ms() + DRAIN_TIMEOUT_MS;
+    printf(action == DRAIN_RESTART ? "Redémarrage : fin des transferts en cours...\n" : "Arrêt : fin des transferts en cours...\n");
+
+    // Prévenir les utilisateurs d'un arrêt (un redémarrage passe inaperçu)
+    if (action == DRAIN_SHUTDOWN)
+    {
+        for (int i = 0; i < config.max_clients; i++)
+        {
+            if (clients[i] != NULL && strlen(clients[i]->username) > 0)
+            {
+                queue_text(clients[i], "Le serveur s'arrête.\n");
+            }
+        }
+    }
+}
+
+int drain_complete(void)
+{
+    // Attendre les réponses en attente, les transferts, les authentifications et les lectures de l'historique en cours
+    for (int i = 0; i < config.max_clients; i++)
+    {
+        client_t *client = clients[i];
+        if (client != NULL && (client->upload_fd >= 0 || client->long_message != NULL || !outqueue_empty(&client->out) ||
+                               client->auth_pending || client->replay_ticket != 0 || client->search_ticket != 0))
+        {
+            return 0;
+        }
+    }
+    return parallel_in_progress() == 0;
+}
+
+int can_hand_off(const client_t *client)
+{
+    // Une session TLS ne peut pas changer de processus ; un transfert, un message long ou une lecture inachevés non plus
+    return !transport_enabled() && !client->closing && !client->handshaking && !client->auth_pending &&
+           client->replay_ticket == 0 && client->search_ticket == 0 &&
+           client->upload_fd < 0 && !client->upload_verifying && client->long_message == NULL && client->long_skip == 0 &&
+           outqueue_empty(&client->out);
+}
+
+int hand_off(int server_fd, char *argv[])
+{
+    fflush(stdout);
+
+    pid_t pid;
+    int sock = handoff_spawn(argv, launch_dir, &pid);
+    if (sock < 0)
+    {
+        return -1;
+    }
+
+    // D'abord le socket d'écoute : il n'est jamais fermé, aucune connexion n'est refusée
+    handoff_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.type = HANDOFF_LISTENER;
+    int ok = handoff_send(sock, &record, server_fd) == 0;
+    if (ok && cluster_enabled())
+    {
+        record.type = HANDOFF_CLUSTER;
+        ok = handoff_send(sock, &record, cluster_listener()) == 0;
+    }
+
+    // Puis chaque client, avec sa session
+    int handed = 0;
+    for (int i = 0; ok && i < config.max_clients; i++)
+    {
+        client_t *client = clients[i];
+        if (client == NULL || !can_hand_off(client))
+        {
+            continue;
+        }
+        memset(&record, 0, sizeof(record));
+        record.type = HANDOFF_CLIENT;
+        record.is_admin = client->is_admin;
+        strcpy(record.username, client->username);
+        strcpy(record.current_channel, client->current_channel);
+        record.compress = client->compress;
+        record.checksum = client->checksum;
+        record.presence = client->presence;
+        record.away = client->user_link.user != NULL && client->user_link.user->status == PRESENCE_AWAY;
+        strcpy(record.session, client->session);
+        strcpy(record.session_token, client->session_token);
+        record.pending_len = client->inlen < HANDOFF_PENDING_SIZE ? client->inlen : HANDOFF_PENDING_SIZE;
+        memcpy(record.pending, client->inbuf, record.pending_len);
+        ok = handoff_send(sock, &record, client->socket) == 0;
+        handed++;
+    }
+
+    memset(&record, 0, sizeof(record));
+    record.type = HANDOFF_END;
+    ok = ok && handoff_send(sock, &record, -1) == 0;
+
+    // Le nouveau processus confirme qu'il a tout repris
+    if (!ok || handoff_wait_ready(sock, HANDOFF_TIMEOUT_MS) < 0)
+    {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        close(sock);
+        return -1;
+    }
+    close(sock);
+    printf("%d client(s) transmis au nouveau processus (pid %d).\n", handed, (int)pid);
+
+    // Les autres doivent se reconnecter
+    for (int i = 0; i < config.max_clients; i++)
+    {
+        if (clients[i] != NULL && !can_hand_off(clients[i]))
+        {
+            queue_text(clients[i], "Le serveur redémarre, reconnectez-vous.\n");
+            flush_client(clients[i]);
+            disconnect_client(clients[i]);
+        }
+    }
+    return 0;
+}
+
+void finish_drain(int server_fd, char *argv[])
+{
+    // Les messages en attente sont écrits, et sur disque, avant de partir
+    flush_message_batch();
+    storage_sync();
+
+    // Les sessions en cours restent valables pour les clients qui devront se reconnecter
+    for (int i = 0; i < config.max_clients; i++)
+    {
+        if (clients[i] != NULL && clients[i]->session[0] != '\0')
+        {
+            session_extend(clients[i]->session);
+        }
+    }
+    session_save();
+
+    if (draining == DRAIN_RESTART)
+    {
+        if (hand_off(server_fd, argv) == 0)
+        {
+            // Ne surtout pas fermer les sessions : elles appartiennent au nouveau processus
+            printf("Redémarrage terminé.\n");
+            exit(0);
+        }
+        printf("Échec du redémarrage, le serveur continue.\n");
+        draining = 0;
+        return;
+    }
+
+    // Fermer toutes les connexions clients
+    for (int i = 0; i < config.max_clients; i++)
+    {
+        if (clients[i] != NULL)
+        {
+            printf("Fermeture de la connexion du client %s\n", clients[i]->username);
+            disconnect_client(clients[i]); // Fermer le socket et libérer le client
+        }
+    }
+
+    // Fermer le socket du serveur ; l'historique et les fichiers sont conservés
+    close(server_fd);
+
+    // Quitter le programme
+    printf("Serveur arrêté.\n");
+    exit(0); // Terminer le programme proprement
+}
+
+int inherit_sockets(int sock, int *cluster_fd)
+{
+    int server_fd = -1;
+    int count = 0;
+    handoff_record_t record;
+    int fd;
+
+    while (handoff_recv(sock, &record, &fd) == 0)
+    {
+        if (record.type == HANDOFF_END)
+        {
+            if (server_fd < 0)
+            {
+                break;
+            }
+
+            // Prévenir l'ancien processus qu'il peut s'arrêter
+            handoff_ready(sock);
+            close(sock);
+            printf("Reprise du processus précédent : %d client(s).\n", count);
+            return server_fd;
+        }
+
+        if (record.type == HANDOFF_LISTENER)
+        {
+            server_fd = fd;
+        }
+        else if (record.type == HANDOFF_CLUSTER)
+        {
+            *cluster_fd = fd;
+        }
+        else if (record.type == HANDOFF_CLIENT && fd >= 0)
+        {
+            client_t *client = add_client(fd, 0);
+            if (client == NULL)
+            {
+                close(fd);
+                continue;
+            }
+
+            // Reprendre la session là où elle en était
+            snprintf(client->username, sizeof(client->username), "%s", record.username);
+            set_client_channel(client, record.current_channel);
+            client->is_admin = record.is_admin;
+            client->compress = record.compress;
+            client->checksum = record.checksum;
+            client->presence = record.presence;
+            snprintf(client->session, sizeof(client->session), "%s", record.session);
+            snprintf(client->session_token, sizeof(client->session_token), "%s", record.session_token);
+            if (client->session[0] != '\0')
+            {
+                session_attach(client->session);
+            }
+            client->inlen = record.pending_len < sizeof(client->inbuf) - 1 ? record.pending_len : sizeof(client->inbuf) - 1;
+            memcpy(client->inbuf, record.pending, client->inlen);
+            if (strlen(client->username) > 0)
+            {
+                client->user_limits = user_limits_acquire(client->username);
+                link_user(client);
+                if (record.away && client->user_link.user != NULL)
+                {
+                    presence_set_away(client->user_link.user, true);
+                }
+            }
+            count++;
+        }
+    }
+
+    fprintf(stderr, "Échec de la reprise des sockets du processus précédent.\n");
+    return -1;
+}
+
+void charge_rate_bytes(client_t *client, size_t bytes, uint64_t now)
+{
+    // Débit en octets : le message est accepté, mais le socket n'est plus lu tant que la dette n'est pas remboursée
+    uint64_t wait = bucket_charge(&client->limits.bytes, bytes, now);
+    if (client->user_limits != NULL)
+    {
+        uint64_t user_wait = bucket_charge(&client->user_limits->limits.bytes, bytes, now);
+        wait = user_wait > wait ? user_wait : wait;
+    }
+    if (wait > 0)
+    {
+        client->throttled_until = now + wait;
+        rate_deferred++;
+    }
+}
+
+int check_rate_limits(client_t *client, int bytes)
+{
+    uint64_t now = monotonic_ns();
+    charge_rate_bytes(client, bytes, now);
+
+    // Nombre de messages : au-delà de la limite, le message est refusé
+    if (!bucket_take(&client->limits.messages, 1, now))
+    {
+        return reject_rate_limited(client);
+    }
+    if (client->user_limits != NULL && !bucket_take(&client->user_limits->limits.messages, 1, now))
+    {
+        client->limits.messages.tokens += 1; // Rendre le jeton de la connexion
+        return reject_rate_limited(client);
+    }
+
+    client->rate_notified = 0;
+    return 1;
+}
+
+int reject_rate_limited(client_t *client)
+{
+    rate_rejected_messages++;
+
+    // Prévenir une seule fois par rafale pour ne pas amplifier le trafic
+    if (!client->rate_notified)
+    {
+        queue_text(client, "Limite de débit atteinte : message ignoré.\n");
+        client->rate_notified = 1;
+    }
+    return 0;
+}
+
+int check_upload_limits(client_t *client)
+{
+    uint64_t now = monotonic_ns();
+
+    if (!bucket_take(&client->limits.uploads, 1, now))
+    {
+        return 0;
+    }
+    if (client->user_limits != NULL && !bucket_take(&client->user_limits->limits.uploads, 1, now))
+    {
+        client->limits.uploads.tokens += 1; // Rendre le jeton de la connexion
+        return 0;
+    }
+    return 1;
+}
+
+void reject_file_from_client(client_t *client, const char *reason)
+{
+    // La taille est annoncée avec la commande : il suffit de répondre autre chose que "@OK"
+    char message[BUFFER_SIZE];
+    snprintf(message, sizeof(message), "@ERR %s", reason);
+    queue_text(client, message);
+}
+
+void handle_client(int client_socket, client_t *client)
+{
+    // Négociation TLS pas encore terminée
+    if (client->handshaking)
+    {
+        client->handshaking = transport_handshake(client_socket);
+        if (client->handshaking < 0)
+        {
+            disconnect_client(client);
+        }
+        return;
+    }
+
+    int bytes_received;
+    if (client->long_message != NULL && client->inlen == 0)
+    {
+        // Pendant un message long, les octets reçus vont directement dans ses segments
+        bytes_received = longmsg_read(client->long_message, client_socket);
+        if (bytes_received > 0)
+        {
+            client->last_activity_ms = client->progress_ms = monotonic_ms();
+            client->ping_sent_ms = 0;
+            charge_rate_bytes(client, bytes_received, monotonic_ns());
+            if (longmsg_complete(client->long_message))
+            {
+                deliver_long_message(client);
+            }
+            return;
+        }
+    }
+    else if (client->upload_fd >= 0 && client->inlen == 0)
+    {
+        // Pendant un envoi de fichier, les octets reçus vont directement dans le fichier
+        char chunk[TRANSPORT_CHUNK_SIZE];
+        size_t to_read = client->upload_remaining < (long)sizeof(chunk) ? (size_t)client->upload_remaining : sizeof(chunk);
+        bytes_received = transport_recv(client_socket, chunk, to_read);
+        if (bytes_received > 0)
+        {
+            client->last_activity_ms = monotonic_ms();
+            receive_upload_data(client, chunk, bytes_received);
+            return;
+        }
+    }
+    else
+    {
+        bytes_received = transport_recv(client_socket, client->inbuf + client->inlen, sizeof(client->inbuf) - 1 - client->inlen);
+    }
+
+    // Rien à lire pour l'instant (socket non bloquant)
+    if (bytes_received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return;
+    }
+
+    // Vérifier si le client s'est déconnecté ou s'il y a une erreur
+    if (bytes_received <= 0)
+    {
+        printf("Client %s disconnected\n", client->username);
+        disconnect_client(client);
+        return;
+    }
+
+    // Toute donnée reçue prouve que la connexion est vivante
+    client->inlen += bytes_received;
+    client->last_activity_ms = monotonic_ms();
+    client->ping_sent_ms = 0;
+
+    while (client->inlen > 0 && !client->closing)
+    {
+        size_t consumed;
+        if (client->long_message != NULL || client->long_skip > 0)
+        {
+            // Suite d'un message long reçue avec son en-tête
+            consumed = receive_long_data(client, client->inbuf, client->inlen);
+        }
+        else if (client->upload_fd >= 0)
+        {
+            // Début du fichier reçu avec la commande d'envoi
+            consumed = receive_upload_data(client, client->inbuf, client->inlen);
+        }
+        else
+        {
+            // Les commandes sont séparées par des retours à la ligne
+            size_t line_len = scan_find_newline(client->inbuf, client->inlen);
+            bool complete = line_len < client->inlen;
+            if (!complete && client->inlen < sizeof(client->inbuf) - 1)
+            {
+                break; // Ligne incomplète : attendre la suite
+            }
+
+            // Une ligne trop longue est traitée telle quelle
+            char line[BUFFER_SIZE];
+            memcpy(line, client->inbuf, line_len);
+            consumed = complete ? line_len + 1 : line_len;
+
+            // Retirer les caractères de contrôle et l'UTF-8 invalide avant de diffuser quoi que ce soit
+            line[scan_sanitize(line, line_len)] = '\0';
+            memmove(client->inbuf, client->inbuf + consumed, client->inlen - consumed);
+            client->inlen -= consumed;
+
+            if (process_command(client, line) < 0)
+            {
+                return; // Le client s'est déconnecté
+            }
+            continue;
+        }
+        memmove(client->inbuf, client->inbuf + consumed, client->inlen - consumed);
+        client->inlen -= consumed;
+    }
+}
+
+int process_command(client_t *client, char *buffer)
+{
+    int client_socket = client->socket;
+    clean_input(buffer);
+
+    // Réponse au ping du serveur : la réception suffit
+    if (strcmp(buffer, "@PONG") == 0)
+    {
+        return 0;
+    }
+    client->last_command_ms = monotonic_ms();
+
+    if (strlen(client->username) > 0) // Ne pas afficher les identifiants
+    {
+        printf("Message reçu de %s: %s\n", client->username, buffer);
+    }
+
+    // Si l'utilisateur n'est pas encore authentifié, on demande les credentials
+    if (strlen(client->username) == 0)
+    {
+        // Une vérification est déjà en cours pour ce client
+        if (client->auth_pending)
+        {
+            return 0;
+        }
+
+        // Reconnexion avec un jeton de session à la place du mot de passe
+        if (strncmp(buffer, "@RESUME ", 8) == 0)
+        {
+            resume_session(client, buffer + 8);
+            memset(buffer, 0, strlen(buffer)); // Ne pas laisser traîner le jeton
+            return 0;
+        }
+
+        // Connexion de données d'un envoi parallèle : le jeton remplace les identifiants
+        if (strncmp(buffer, "@DATA ", 6) == 0)
+        {
+            receive_part_from_client(client, buffer);
+            return 0;
+        }
+        if (client->data_token[0] != '\0')
+        {
+            client->closing = 1; // Une connexion de données ne sert qu'aux parties de fichier
+            return 0;
+        }
+
+        // Supposons que l'utilisateur envoie 'username password'
+        char username[50] = "", password[50] = "";
+        sscanf(buffer, "%49s %49s", username, password);
+        memset(buffer, 0, strlen(buffer)); // Ne pas laisser traîner le mot de passe
+
+        // La vérification (coûteuse) est confiée aux threads d'authentification
+        if (auth_pool_submit(client_socket, username, password, &client->auth_ticket) == 0)
+        {
+            client->auth_pending = 1;
+        }
+        else
+        {
+            queue_text(client, "Serveur occupé, réessayez plus tard.\n");
+        }
+        memset(password, 0, sizeof(password));
+        return 0;
+    }
+
+    // Un fichier reçu attend sa somme de contrôle, qui n'est pas une commande (ni limitée comme telle)
+    if (client->upload_verifying)
+    {
+        verify_upload(client, buffer);
+        return 0;
+    }
+
+    // Un message long refusé par la limite de débit doit quand même être lu, pour ne pas prendre ses lignes pour des commandes
+    if (strncmp(buffer, "@LONG ", 6) == 0)
+    {
+        start_long_message(client, buffer + 6, check_rate_limits(client, strlen(buffer) + 1));
+        return 0;
+    }
+
+    // Limitation de débit par connexion et par utilisateur
+    if (!check_rate_limits(client, strlen(buffer) + 1))
+    {
+        return 0;
+    }
+
+    // Gestion des différentes commandes client
+    if (strncmp(buffer, "@CAPS", 5) == 0)
+    {
+        // Le client annonce ce qu'il sait faire : "@CAPS deflate crc32c presence" ; la réponse donne ce qui est accepté
+        int subscribe = 0;
+        char *token = strtok(buffer + 5, " ");
+        while (token != NULL)
+        {
+            client->compress |= strcmp(token, COMPRESS_CAPS) == 0;
+            client->checksum |= strcmp(token, CHECKSUM_CAPS) == 0;
+            subscribe |= strcmp(token, PRESENCE_CAPS) == 0;
+            token = strtok(NULL, " ");
+        }
+        char response[64];
+        snprintf(response, sizeof(response), "@CAPS%s%s%s\n", client->compress ? " " COMPRESS_CAPS : "",
+                 client->checksum ? " " CHECKSUM_CAPS : "", client->presence || subscribe ? " " PRESENCE_CAPS : "");
+        queue_text(client, response);
 
-        // Supprimer le client de la liste des clients
-        for (int i = 0; i < MAX_CLIENTS; i++)
+        // Un nouvel abonné reçoit d'abord l'état de tous les utilisateurs, puis les changements
+        if (subscribe && !client->presence)
         {
-            if (clients[i] == client)
-            {
-                clients[i] = NULL;
-                break;
-            }
+            client->presence = 1;
+            presence_snapshot(queue_presence, client);
         }
-
-        close(client_socket);
-        free(client);
-        return;
     }
-
-    // Terminer la chaîne reçue
-    buffer[bytes_received] = '\0';
-    printf("Message reçu de %s: %s\n", client->username, buffer);
-
-    // Si l'utilisateur n'est pas encore authentifié, on demande les credentials
-    if (strlen(client->username) == 0)
+    else if (strcmp(buffer, "@TYPING") == 0)
     {
-        // Supposons que l'utilisateur envoie 'username password'
-        char username[50], password[50];
-        sscanf(buffer, "%s %s", username, password);
-        if (authenticate_user(username, password))
+        // Le client signale que son utilisateur écrit dans le salon actuel
+        if (strlen(client->current_channel) > 0 && client->user_link.user != NULL)
         {
-            strcpy(client->username, username);
-            client->is_admin = is_admin(username); // Vérifier et stocker si l'utilisateur est admin
-            send(client_socket, "Authentification réussie\n", 25, 0);
+            presence_typing(client->user_link.user, client->current_channel, monotonic_ms());
         }
-        else
+    }
+    else if (strncmp(buffer, "msg ", 4) == 0)
+    {
+        send_direct_message(client, buffer + 4);
+    }
+    else if (strcmp(buffer, "search") == 0 || strncmp(buffer, "search ", 7) == 0)
+    {
+        // Recherche dans les messages du salon actuel, faite par le pool de lecture
+        search_channel(client, buffer[6] == ' ' ? buffer + 7 : "");
+    }
+    else if (strcmp(buffer, "away") == 0 || strcmp(buffer, "back") == 0)
+    {
+        // Statut de présence de l'utilisateur, annoncé aux abonnés avec le prochain lot
+        int away = buffer[0] == 'a';
+        if (client->user_link.user != NULL)
         {
-            send(client_socket, "Échec de l'authentification\n", 28, 0);
+            presence_set_away(client->user_link.user, away);
         }
-        return;
+        queue_text(client, away ? "Vous êtes absent.\n" : "Vous êtes de retour.\n");
     }
-    // Gestion des différentes commandes client
-    if (strncmp(buffer, "join ", 5) == 0)
+    else if (strcmp(buffer, "@SESSION") == 0)
+    {
+        issue_session(client);
+    }
+    else if (strcmp(buffer, "@SYNC") == 0)
+    {
+        // Les commandes sont traitées dans l'ordre : cette réponse suit celles des commandes précédentes
+        queue_text(client, "@SYNC\n");
+    }
+    else if (strncmp(buffer, "join ", 5) == 0)
     {
-        // Commande pour rejoindre un salon
+        // Commande pour rejoindre un salon : "join <salon>", ou "join <salon> <dernier numéro vu>" pour rattraper les messages manqués
         char *channel_name = buffer + 5;
         clean_input(channel_name);
+        unsigned long long last_seen = 0;
+        char *seen = strchr(channel_name, ' ');
+        int catch_up = seen != NULL && sscanf(seen, " %llu", &last_seen) == 1;
+        if (seen != NULL)
+        {
+            *seen = '\0';
+        }
 
         if (channel_exists(channel_name))
         {
-            strcpy(client->current_channel, channel_name);
+            set_client_channel(client, channel_name);
             char response[BUFFER_SIZE];
             snprintf(response, sizeof(response), "Vous avez rejoint le salon %s\n", channel_name);
-            send(client_socket, response, strlen(response), 0);
+            queue_text(client, response);
+
+            // Dernier numéro du salon, puis les messages manqués depuis le dernier vu
+            snprintf(response, sizeof(response), "@SEQ %s %llu\n", channel_name, (unsigned long long)history_last(channel_name));
+            queue_text(client, response);
+            if (catch_up)
+            {
+                replay_channel(client, channel_name, last_seen);
+            }
             send_message_to_channel(client->current_channel, "Un utilisateur a rejoint le salon.\n", client->socket);
         }
         else
         {
-            send(client_socket, "Ce salon n'existe pas.\n", 24, 0);
+            queue_text(client, "Ce salon n'existe pas.\n");
         }
     }
     else if (strcmp(buffer, "leave") == 0)
@@ -730,13 +2799,13 @@ void handle_client(int client_socket, client_t *client)
         {
             char response[BUFFER_SIZE];
             snprintf(response, sizeof(response), "Vous avez quitté le salon %s\n", client->current_channel);
-            send(client_socket, response, strlen(response), 0);
+            queue_text(client, response);
             send_message_to_channel(client->current_channel, "Un utilisateur a quitté le salon.\n", client->socket);
-            strcpy(client->current_channel, ""); // Réinitialiser le salon
+            set_client_channel(client, ""); // Réinitialiser le salon
         }
         else
         {
-            send(client_socket, "Vous n'êtes dans aucun salon.\n", 31, 0);
+            queue_text(client, "Vous n'êtes dans aucun salon.\n");
         }
     }
     else if (strcmp(buffer, "list_users") == 0)
@@ -748,7 +2817,7 @@ void handle_client(int client_socket, client_t *client)
         }
         else
         {
-            send(client_socket, "Vous n'êtes dans aucun salon.\n", 31, 0);
+            queue_text(client, "Vous n'êtes dans aucun salon.\n");
         }
     }
     else if (strcmp(buffer, "list_admin") == 0)
@@ -756,11 +2825,25 @@ void handle_client(int client_socket, client_t *client)
         // Vérifier si l'utilisateur est un administrateur
         if (is_admin(client->username))
         {
-            handle_list_admin(client->socket); // Appeler la fonction pour lister les utilisateurs
+            handle_list_admin(client); // Appeler la fonction pour lister les utilisateurs
+        }
+        else
+        {
+            queue_text(client, "Vous n'êtes pas autorisé à utiliser cette commande.\n");
+        }
+    }
+    else if (strcmp(buffer, "stats") == 0)
+    {
+        // Statistiques du serveur, réservées aux administrateurs
+        if (client->is_admin)
+        {
+            char stats[STATS_SIZE];
+            format_stats(stats, sizeof(stats));
+            queue_text(client, stats);
         }
         else
         {
-            send(client->socket, "Vous n'êtes pas autorisé à utiliser cette commande.\n", 52, 0);
+            queue_text(client, "Vous n'êtes pas autorisé à utiliser cette commande.\n");
         }
     }
     else if (strcmp(buffer, "current") == 0)
@@ -773,17 +2856,101 @@ void handle_client(int client_socket, client_t *client)
         create_channel(client, channel_name); // Appeler la fonction pour créer le salon
     }
 
-    else if (strncmp(buffer, "send ", 5) == 0)
+    else if (strncmp(buffer, "send ", 5) == 0 || (client->compress && strncmp(buffer, "sendz ", 6) == 0))
+    {
+        // Le client annonce le nom et la taille du fichier : "send <nom_du_fichier> <taille>",
+        // ou "sendz <nom_du_fichier> <taille compressée> <taille>" pour un fichier compressé
+        int compressed = buffer[4] == 'z';
+        char *filename = buffer + (compressed ? 6 : 5);
+        char *size_str = strrchr(filename, ' ');
+        char *end = NULL;
+        long file_size = size_str != NULL ? strtol(size_str + 1, &end, 10) : -1;
+        if (size_str != NULL)
+        {
+            *size_str = '\0';
+        }
+        long compressed_size = -1;
+        if (compressed && end != NULL && *end == '\0')
+        {
+            size_str = strrchr(filename, ' ');
+            end = NULL;
+            compressed_size = size_str != NULL ? strtol(size_str + 1, &end, 10) : -1;
+            if (size_str != NULL)
+            {
+                *size_str = '\0';
+            }
+            if (compressed_size <= 0)
+            {
+                end = NULL; // Un flux compressé n'est jamais vide
+            }
+        }
+
+        if (draining)
+        {
+            reject_file_from_client(client, "Le serveur redémarre, réessayez dans un instant.\n");
+        }
+        else if (end == NULL || *end != '\0' || file_size < 0 || !valid_filename(filename))
+        {
+            reject_file_from_client(client, "Nom de fichier ou taille invalide.\n");
+        }
+        else if (check_upload_limits(client))
+        {
+            receive_file_from_client(client, client->current_channel, filename, file_size, compressed_size);
+        }
+        else
+        {
+            rate_rejected_uploads++;
+            reject_file_from_client(client, "Limite d'envoi de fichiers atteinte, réessayez plus tard.\n");
+        }
+    }
+
+    else if (strncmp(buffer, "psend ", 6) == 0)
+    {
+        // Envoi parallèle d'un gros fichier : "psend <nom_du_fichier> <taille>", les parties arrivent sur d'autres connexions
+        char *filename = buffer + 6;
+        char *size_str = strrchr(filename, ' ');
+        char *end = NULL;
+        long file_size = size_str != NULL ? strtol(size_str + 1, &end, 10) : -1;
+        if (size_str != NULL)
+        {
+            *size_str = '\0';
+        }
+
+        if (draining)
+        {
+            reject_file_from_client(client, "Le serveur redémarre, réessayez dans un instant.\n");
+        }
+        else if (end == NULL || *end != '\0' || file_size <= 0 || !valid_filename(filename))
+        {
+            reject_file_from_client(client, "Nom de fichier ou taille invalide.\n");
+        }
+        else if (check_upload_limits(client))
+        {
+            start_parallel_upload(client, filename, file_size);
+        }
+        else
+        {
+            rate_rejected_uploads++;
+            reject_file_from_client(client, "Limite d'envoi de fichiers atteinte, réessayez plus tard.\n");
+        }
+    }
+    else if (strncmp(buffer, "pdone ", 6) == 0)
     {
-        char *filename = buffer + 5;
-        receive_file_from_client(client->socket, client->current_channel, filename);
+        finish_parallel_upload(client, buffer + 6);
     }
 
     // Par exemple, dans handle_client, si l'utilisateur envoie "receive <filename>"
     else if (strncmp(buffer, "receive ", 8) == 0)
     {
         char *filename = buffer + 8;
-        send_file_to_client(client->socket, client->current_channel, filename);
+        if (draining)
+        {
+            queue_text(client, "@ERR Le serveur redémarre, réessayez dans un instant.\n");
+        }
+        else
+        {
+            send_file_to_client(client, client->current_channel, filename);
+        }
     }
 
     else if (strncmp(buffer, "delete ", 7) == 0)
@@ -792,28 +2959,41 @@ void handle_client(int client_socket, client_t *client)
         delete_channel(client, channel_name); // Appeler la fonction pour supprimer le salon
     }
 
+    else if (strncmp(buffer, "create_many ", 12) == 0)
+    {
+        create_channels(client, buffer + 12); // Plusieurs salons dans une seule transaction
+    }
+
+    else if (strncmp(buffer, "delete_many ", 12) == 0)
+    {
+        delete_channels(client, buffer + 12);
+    }
+
+    else if (strncmp(buffer, "kick ", 5) == 0)
+    {
+        kick_users(client, buffer + 5);
+    }
+
+    else if (strncmp(buffer, "move ", 5) == 0)
+    {
+        move_users(client, buffer + 5);
+    }
+
+    else if (strncmp(buffer, "retention ", 10) == 0)
+    {
+        set_channel_retention(client, buffer + 10);
+    }
+
     else if (strcmp(buffer, "list") == 0)
     {
-        list_channels(client->socket); // Appeler la fonction pour lister les salons
+        list_channels(client); // Appeler la fonction pour lister les salons
     }
     else if (strcmp(buffer, "disconnect") == 0)
     {
         // Commande pour déconnexion
         printf("Client %s se déconnecte.\n", client->username);
-        close(client_socket);
-
-        // Supprimer le client de la liste des clients
-        for (int i = 0; i < MAX_CLIENTS; i++)
-        {
-            if (clients[i] == client)
-            {
-                clients[i] = NULL;
-                break;
-            }
-        }
-
-        free(client);
-        return;
+        disconnect_client(client);
+        return -1;
     }
     else
     {
@@ -823,163 +3003,489 @@ void handle_client(int client_socket, client_t *client)
             char message[BUFFER_SIZE];
             snprintf(message, sizeof(message), "%s: %s\n", client->username, buffer);
             send_message_to_channel(client->current_channel, message, client->socket);
+            if (client->user_link.user != NULL)
+            {
+                presence_typing(client->user_link.user, "", monotonic_ms()); // Le message est parti
+            }
         }
         else
         {
-            send(client_socket, "Vous n'êtes dans aucun salon.\n", 31, 0);
+            queue_text(client, "Vous n'êtes dans aucun salon.\n");
         }
     }
+    return 0;
 }
 
-int main()
+int main(int argc, char *argv[])
 {
     char buffer[BUFFER_SIZE];
-    clear_server_directory();
-
-    int server_fd, new_socket;
-    struct sockaddr_in server_addr;
-    socklen_t client_addr_len = sizeof(server_addr);
+    int inherit_fd = -1;
+    int cluster_port = 0;
+    int cluster_fd = -1;
+    unsigned long node_id = 0;
+    char *cluster_peers[CLUSTER_MAX_PEERS];
+    int cluster_peer_count = 0;
+
+    // Le fichier de configuration est lu avant les options, qui le remplacent
+    for (int i = 1; i < argc; i++)
+    {
+        const char *path = strcmp(argv[i], "--config") == 0 && i + 1 < argc ? argv[i + 1] : strncmp(argv[i], "--config=", 9) == 0 ? argv[i] + 9 : NULL;
+        if (path != NULL && config_load(&config, path) < 0)
+        {
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    // Initialiser les dossiers des salons existants
-    initialize_salon_directories();
+    // Options de la ligne de commande : une par paramètre de config.h, puis celles de la grappe
+    static const struct option other_options[] = {
+        {"config", required_argument, 0, 'f'},
+        {"cluster-port", required_argument, 0, 'C'},
+        {"peer", required_argument, 0, 'P'},
+        {"node-id", required_argument, 0, 'n'},
+        {"inherit", required_argument, 0, 'i'}, // Utilisée par le redémarrage à chaud
+        {0, 0, 0, 0}};
+    struct option long_options[64];
+    int option_count = 0;
+    for (const char *key; (key = config_key(option_count)) != NULL; option_count++)
+    {
+        long_options[option_count] = (struct option){key, required_argument, 0, 'K'};
+    }
+    memcpy(&long_options[option_count], other_options, sizeof(other_options));
 
-    // Configuration du serveur
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0)
+    int opt, index;
+    while ((opt = getopt_long(argc, argv, "c:k:p:", long_options, &index)) != -1)
+    {
+        switch (opt)
+        {
+        case 'K':
+            if (config_set(&config, long_options[index].name, optarg) < 0)
+            {
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'p':
+        case 'c':
+        case 'k':
+            if (config_set(&config, opt == 'p' ? "port" : opt == 'c' ? "tls-cert" : "tls-key", optarg) < 0)
+            {
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'f':
+            break; // Déjà lu
+        case 'C':
+            cluster_port = atoi(optarg);
+            break;
+        case 'P':
+            if (cluster_peer_count == CLUSTER_MAX_PEERS)
+            {
+                fprintf(stderr, "Trop de pairs (%d au maximum).\n", CLUSTER_MAX_PEERS);
+                exit(EXIT_FAILURE);
+            }
+            cluster_peers[cluster_peer_count++] = optarg;
+            break;
+        case 'n':
+            node_id = strtoul(optarg, NULL, 10);
+            break;
+        case 'i':
+            inherit_fd = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage : %s [--config fichier] [paramètres] [--cluster-port port [--node-id id] [--peer hôte:port]...]\n"
+                            "Paramètres (aussi « nom = valeur » dans le fichier de configuration) :\n",
+                    argv[0]);
+            config_usage(stderr);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (config_check(&config) < 0)
     {
-        perror("socket failed");
         exit(EXIT_FAILURE);
     }
 
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(8080);
+    // Activer TLS si un certificat est fourni
+    if (config.tls_cert[0] != '\0' || config.tls_key[0] != '\0')
+    {
+        if (config.tls_cert[0] == '\0' || config.tls_key[0] == '\0' || transport_server_init(config.tls_cert, config.tls_key) < 0)
+        {
+            fprintf(stderr, "TLS nécessite un certificat et une clé valides.\n");
+            exit(EXIT_FAILURE);
+        }
+        printf("TLS activé.\n");
+    }
 
-    if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+    // database.db, les fichiers des salons et les journaux sont relatifs au dossier des données
+    if (getcwd(launch_dir, sizeof(launch_dir)) == NULL || chdir(config.data_dir) < 0)
+    {
+        fprintf(stderr, "Dossier des données %s inaccessible : %s\n", config.data_dir, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    clients = calloc(config.max_clients, sizeof(client_t *));
+    message_batch = calloc(config.batch_size, sizeof(storage_message_t));
+    if (clients == NULL || message_batch == NULL)
     {
-        perror("bind failed");
+        perror("calloc failed");
         exit(EXIT_FAILURE);
     }
 
-    if (listen(server_fd, 5) < 0)
+    // Un client qui ferme brutalement sa connexion ne doit pas arrêter le serveur
+    signal(SIGPIPE, SIG_IGN);
+
+    // SIGTERM arrête le serveur proprement, SIGUSR2 le redémarre à chaud (bloqués avant la création des threads)
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR2);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    // Démarrer les threads de vérification des mots de passe
+    int auth_fd = auth_pool_start(check_credentials, config.auth_workers, config.auth_queue);
+    if (auth_fd < 0)
     {
-        perror("listen failed");
         exit(EXIT_FAILURE);
     }
 
-    printf("Server listening on port 8080...\n");
+    // Et ceux de lecture de l'historique
+    int reader_fd = readpool_start(config.read_workers, config.read_queue);
+    if (reader_fd < 0)
+    {
+        exit(EXIT_FAILURE);
+    }
 
-    // Tableau de structures pollfd pour surveiller les sockets et l'entrée standard
-    struct pollfd fds[MAX_CLIENTS + 2]; // +1 pour le socket du serveur et +1 pour STDIN_FILENO
-    int nfds = 2;                       // Nombre de descripteurs surveillés (server + stdin)
+    // Les délais des connexions et l'écriture des messages sont gérés par une roue de minuteurs
+    timer_wheel_init(&timer_wheel, monotonic_ms());
+    timer_init(&message_batch_timer, message_batch_expired, NULL);
+    timer_init(&session_save_timer, session_save_expired, NULL);
+    presence_init(&timer_wheel, deliver_presence);
+    slab_init(&client_slab, "clients", sizeof(client_t), config.max_clients);
+    filecache_set_limits(config.file_cache_files, config.file_cache_bytes);
+    zcache_set_max_jobs(config.compress_jobs);
 
-    // Ajouter le socket du serveur à la liste des descripteurs surveillés
-    fds[0].fd = server_fd;
-    fds[0].events = POLLIN; // Surveiller les événements d'entrée
+    // Les messages sont numérotés par salon, à la suite des numéros déjà archivés
+    migrate_database();
+    if (storage_init(config.storage, config.retention_days) < 0)
+    {
+        exit(EXIT_FAILURE);
+    }
+    history_init(storage_last_seq);
 
-    // Ajouter l'entrée standard (console) pour la commande "shut"
-    fds[1].fd = STDIN_FILENO; // Surveiller l'entrée standard (console)
-    fds[1].events = POLLIN;   // Surveiller les événements d'entrée (input)
+    // Les salons sont chargés en une requête ; leurs dossiers et fichiers sont gardés, et préparés au premier envoi
+    if (registry_load() < 0)
+    {
+        exit(EXIT_FAILURE);
+    }
+    mkdir("server", 0700);
+    if (session_init() < 0)
+    {
+        exit(EXIT_FAILURE);
+    }
 
-    // Initialiser le tableau des clients à -1 (aucun client connecté)
-    for (int i = 2; i < MAX_CLIENTS + 2; i++)
+    // Les descripteurs sont surveillés par io_uring, ou epoll si io_uring n'est pas disponible
+    if (poller_init(config.io) < 0)
     {
-        fds[i].fd = -1;
+        exit(EXIT_FAILURE);
     }
 
-    while (1)
+    int server_fd;
+    struct sockaddr_in server_addr;
+
+    if (inherit_fd >= 0)
+    {
+        // Redémarrage à chaud : reprendre le socket d'écoute et les clients de l'ancien processus
+        server_fd = inherit_sockets(inherit_fd, &cluster_fd);
+        if (server_fd < 0)
+        {
+            exit(EXIT_FAILURE);
+        }
+        fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL) | O_NONBLOCK); // Les connexions sont acceptées jusqu'à EAGAIN
+    }
+    else
     {
-        int poll_count = poll(fds, nfds, -1); // Attendre un événement sur les sockets ou l'entrée standard
+        // Configuration du serveur
+        server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (server_fd < 0)
+        {
+            perror("socket failed");
+            exit(EXIT_FAILURE);
+        }
+
+        // Permettre un redémarrage immédiat malgré les connexions en TIME_WAIT
+        int reuse = 1;
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_addr.s_addr = INADDR_ANY;
+        server_addr.sin_port = htons(config.port);
+
+        if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+        {
+            perror("bind failed");
+            exit(EXIT_FAILURE);
+        }
 
-        if (poll_count < 0)
+        if (listen(server_fd, config.backlog) < 0)
         {
-            perror("poll failed");
+            perror("listen failed");
             exit(EXIT_FAILURE);
         }
+    }
+
+    printf("Server listening on port %d...\n", config.port);
 
-        // Vérifier si le socket du serveur a une nouvelle connexion entrante
-        if (fds[0].revents & POLLIN)
+    // Mode grappe : relier ce nœud aux autres (l'identifiant par défaut est le port de la grappe)
+    if (cluster_port > 0)
+    {
+        if (cluster_init(node_id > 0 ? node_id : (unsigned long)cluster_port, cluster_port, cluster_fd, deliver_cluster_message, &timer_wheel, POLL_TAG_CLUSTER) < 0)
+        {
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < cluster_peer_count; i++)
         {
-            new_socket = accept(server_fd, (struct sockaddr *)&server_addr, &client_addr_len);
-            if (new_socket < 0)
+            if (cluster_add_peer(cluster_peers[i]) < 0)
             {
-                perror("accept failed");
+                fprintf(stderr, "Adresse de pair invalide : %s\n", cluster_peers[i]);
                 exit(EXIT_FAILURE);
             }
+        }
+        printf("Grappe : nœud %lu à l'écoute sur le port %d, %d pair(s).\n", node_id > 0 ? node_id : (unsigned long)cluster_port, cluster_port, cluster_peer_count);
+    }
+
+    // Enregistrer le socket du serveur, la console, les résultats d'authentification et les signaux
+    printf("Boucle d'événements : %s\n", poller_backend());
+    printf("Sommes de contrôle : crc32c (%s)\n", crc32c_backend()); // Choisie avant le démarrage des threads de compression
+    printf("Stockage des messages : %s\n", storage_backend());
+    if (poller_add(server_fd, POLLER_ACCEPT, POLL_TAG_LISTENER) < 0 ||
+        poller_add(auth_fd, POLLIN, POLL_TAG_AUTH) < 0 ||
+        poller_add(reader_fd, POLLIN, POLL_TAG_READER) < 0 ||
+        poller_add(signal_fd, POLLIN, POLL_TAG_SIGNAL) < 0)
+    {
+        exit(EXIT_FAILURE);
+    }
+    int console_open = poller_add(STDIN_FILENO, POLLIN, POLL_TAG_CONSOLE) == 0; // Un fichier redirigé n'est pas surveillable
+    uint32_t poll_generation = 0;
+    poller_event_t events[POLLER_MAX_EVENTS];
+
+    while (1)
+    {
+        // Pendant un arrêt, les nouvelles connexions attendent dans la file du socket d'écoute
+        poller_modify(server_fd, draining ? 0 : POLLER_ACCEPT);
+
+        // Les événements attendus ne sont transmis au poller que lorsqu'ils changent
+        uint64_t now = monotonic_ns();
+        int timeout = timer_wheel_timeout(&timer_wheel, now / 1000000);
+        if (draining && (timeout < 0 || timeout > DRAIN_POLL_MS))
+        {
+            timeout = DRAIN_POLL_MS; // Vérifier régulièrement la fin des transferts
+        }
+        for (int i = 0; i < config.max_clients; i++)
+        {
+            client_t *client = clients[i];
+            if (client == NULL)
+            {
+                continue;
+            }
+            uint32_t wanted = POLLIN;
+
+            // Attendre que le socket accepte la suite de la file d'envoi
+            if (!outqueue_empty(&client->out))
+            {
+                wanted |= POLLOUT;
+            }
 
-            printf("Nouvelle connexion acceptée.\n");
+            // Ne plus lire les clients qui ont dépassé leur débit, jusqu'à la fin de leur pénalité
+            if (client->throttled_until > now)
+            {
+                wanted &= ~POLLIN;
+                int wait_ms = (client->throttled_until - now) / 1000000 + 1;
+                if (timeout < 0 || wait_ms < timeout)
+                {
+                    timeout = wait_ms;
+                }
+            }
+            else if (transport_pending(client->socket))
+            {
+                timeout = 0; // Des données déchiffrées attendent déjà dans la session TLS
+            }
 
-            // Ajouter le nouveau client au tableau des descripteurs
-            for (int i = 2; i < MAX_CLIENTS + 2; i++)
+            if (client->poll_tag == 0)
             {
-                if (fds[i].fd == -1)
+                // Nouvelle connexion : la génération distingue ses événements de ceux de l'ancien occupant de l'emplacement
+                client->poll_tag = POLL_TAG_CLIENT | (uint64_t)(++poll_generation & 0xffffffff) << 16 | i;
+                if (poller_add(client->socket, wanted, client->poll_tag) < 0)
                 {
-                    fds[i].fd = new_socket;
-                    fds[i].events = POLLIN; // Surveiller les événements d'entrée
-                    nfds++;
-
-                    // Créer un nouveau client_t et l'associer au client
-                    client_t *new_client = malloc(sizeof(client_t));
-                    new_client->socket = new_socket;
-                    strcpy(new_client->username, "");        // Initialiser le nom d'utilisateur à vide
-                    strcpy(new_client->current_channel, ""); // Initialiser le salon à vide
-                    clients[i - 2] = new_client;             // Associer ce client à l'index i-2 (correspondance clients[])
-
-                    break;
+                    client->closing = 1;
                 }
             }
+            else
+            {
+                poller_modify(client->socket, wanted);
+            }
+        }
+
+        // Les liens avec les autres nœuds suivent les clients
+        cluster_update_events();
+
+        int count = poller_wait(events, POLLER_MAX_EVENTS, timeout); // Attendre un événement sur les sockets ou l'entrée standard
+        if (count < 0)
+        {
+            perror("poller_wait failed");
+            exit(EXIT_FAILURE);
         }
 
-        // Vérifier si une commande a été entrée dans la console (entrée standard)
-        if (fds[1].revents & POLLIN)
+        for (int e = 0; e < count; e++)
         {
-            // Lire l'entrée de la console
-            fgets(buffer, sizeof(buffer), stdin);
-            buffer[strcspn(buffer, "\n")] = 0; // Enlever le retour à la ligne
+            poller_event_t *event = &events[e];
+
+            if (event->tag & POLL_TAG_CLIENT)
+            {
+                // Un client a envoyé un message (ou a fermé sa connexion)
+                client_t *client = clients[event->tag & 0xffff];
+                if (client != NULL && client->poll_tag == event->tag && !client->closing &&
+                    event->revents & (POLLIN | POLLHUP | POLLERR))
+                {
+                    handle_client(client->socket, client); // Gérer la communication avec le client
+                }
+            }
+            else if (event->tag & POLL_TAG_CLUSTER)
+            {
+                // Messages et abonnements des autres nœuds
+                cluster_handle_event(event);
+            }
+            else if (event->tag == POLL_TAG_LISTENER)
+            {
+                // Le socket accepté ne bloque jamais la boucle d'événements et n'est pas hérité par un nouveau processus
+                int new_socket = event->fd;
+                printf("Nouvelle connexion acceptée.\n");
+                if (config.socket_buffer > 0)
+                {
+                    int bytes = (int)config.socket_buffer;
+                    setsockopt(new_socket, SOL_SOCKET, SO_SNDBUF, &bytes, sizeof(bytes));
+                    setsockopt(new_socket, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+                }
 
-            // Si la commande est "shut", fermer le serveur
-            if (strcmp(buffer, "shut") == 0)
+                // Négociation TLS si elle est activée (terminée plus tard si le client n'a pas tout envoyé)
+                int handshaking = transport_accept(new_socket);
+                if (handshaking < 0)
+                {
+                    transport_close(new_socket);
+                }
+                else if (add_client(new_socket, handshaking) == NULL)
+                {
+                    // Le serveur est plein : refuser la connexion plutôt que de la laisser ouverte
+                    printf("Nombre maximal de clients atteint, connexion refusée.\n");
+                    transport_close(new_socket);
+                }
+            }
+            else if (event->tag == POLL_TAG_AUTH)
+            {
+                // Récupérer les authentifications terminées par les threads
+                auth_result_t results[AUTH_QUEUE_CAPACITY];
+                int collected = auth_pool_collect(results, AUTH_QUEUE_CAPACITY);
+                for (int i = 0; i < collected; i++)
+                {
+                    complete_authentication(&results[i]);
+                }
+            }
+            else if (event->tag == POLL_TAG_READER)
+            {
+                // Envoyer les relectures et les recherches terminées par les threads
+                readpool_result_t results[READPOOL_QUEUE_CAPACITY];
+                int collected = readpool_collect(results, READPOOL_QUEUE_CAPACITY);
+                for (int i = 0; i < collected; i++)
+                {
+                    complete_history_read(&results[i]);
+                    readpool_free(&results[i]);
+                }
+            }
+            else if (event->tag == POLL_TAG_SIGNAL)
+            {
+                // Signaux envoyés par l'outil de déploiement
+                struct signalfd_siginfo info;
+                while (read(signal_fd, &info, sizeof(info)) == sizeof(info))
+                {
+                    start_drain(info.ssi_signo == SIGUSR2 ? DRAIN_RESTART : DRAIN_SHUTDOWN);
+                }
+            }
+            else if (event->tag == POLL_TAG_CONSOLE && console_open)
             {
-                printf("Commande 'shut' détectée. Fermeture du serveur...\n");
+                // Lire l'entrée de la console
+                if (fgets(buffer, sizeof(buffer), stdin) == NULL)
+                {
+                    poller_remove(STDIN_FILENO); // Console fermée : le serveur reste pilotable par signaux
+                    console_open = 0;
+                    buffer[0] = '\0';
+                }
+                buffer[strcspn(buffer, "\n")] = 0; // Enlever le retour à la ligne
+
+                // Afficher les statistiques du serveur
+                if (strcmp(buffer, "stats") == 0)
+                {
+                    char stats[STATS_SIZE];
+                    format_stats(stats, sizeof(stats));
+                    printf("%s", stats);
+                }
+
+                // Afficher les paramètres en service, au format du fichier de configuration
+                if (strcmp(buffer, "config") == 0)
+                {
+                    char text[CONFIG_TEXT_SIZE];
+                    config_format(&config, text, sizeof(text));
+                    printf("%s", text);
+                }
 
-                // Fermer toutes les connexions clients
-                for (int i = 2; i < MAX_CLIENTS + 2; i++)
+                // Si la commande est "shut", arrêter le serveur une fois les transferts terminés
+                if (strcmp(buffer, "shut") == 0)
                 {
-                    if (fds[i].fd != -1)
-                    {
-                        printf("Fermeture de la connexion du client %s\n", clients[i - 2]->username);
-                        close(fds[i].fd);      // Fermer le socket du client
-                        free(clients[i - 2]);  // Libérer la mémoire du client
-                        clients[i - 2] = NULL; // Supprimer le client de la liste
-                        fds[i].fd = -1;        // Retirer le socket de poll
-                    }
+                    printf("Commande 'shut' détectée. Fermeture du serveur...\n");
+                    start_drain(DRAIN_SHUTDOWN);
                 }
 
-                // Vider la table des messages
-                clear_messages_in_db();
-                // Supprimer tous les dossiers de salons
-                const char *command = "rm -rf server/*";
-                system(command);
-                printf("Répertoires des salons supprimés.\n");
+                // Si la commande est "restart", passer la main à un nouveau processus sans couper les connexions
+                if (strcmp(buffer, "restart") == 0)
+                {
+                    start_drain(DRAIN_RESTART);
+                }
+            }
+        }
 
-                // Fermer le socket du serveur
-                close(server_fd);
+        // Données déjà déchiffrées dans la session TLS : le socket ne les signale pas
+        now = monotonic_ns();
+        for (int i = 0; i < config.max_clients; i++)
+        {
+            client_t *client = clients[i];
+            if (client != NULL && !client->closing && client->throttled_until <= now && transport_pending(client->socket))
+            {
+                handle_client(client->socket, client);
+            }
+        }
 
-                // Quitter le programme
-                printf("Serveur arrêté.\n");
-                exit(0); // Terminer le programme proprement
+        // Envoyer ce qui a été mis en file pendant ce tour, sans attendre POLLOUT
+        for (int i = 0; i < config.max_clients; i++)
+        {
+            if (clients[i] != NULL && !clients[i]->closing && !outqueue_empty(&clients[i]->out))
+            {
+                flush_client(clients[i]);
             }
         }
 
-        // Vérifier les événements sur les sockets des clients existants
-        for (int i = 2; i < MAX_CLIENTS + 2; i++)
+        // Faire expirer les délais échus (authentification, inactivité, ping, transferts, écriture des messages)
+        timer_wheel_advance(&timer_wheel, monotonic_ms());
+
+        // Fermer les connexions en erreur ou trop lentes
+        for (int i = 0; i < config.max_clients; i++)
         {
-            if (fds[i].fd != -1 && fds[i].revents & POLLIN)
+            if (clients[i] != NULL && clients[i]->closing)
             {
-                // Un client a envoyé un message
-                handle_client(fds[i].fd, clients[i - 2]); // Gérer la communication avec le client
+                disconnect_client(clients[i]);
             }
         }
+
+        // Arrêt ou redémarrage une fois tout envoyé (ou le délai écoulé)
+        if (draining && (drain_complete() || monotonic_ms() >= drain_deadline_ms))
+        {
+            finish_drain(server_fd, argv);
+        }
     }
 
     close(server_fd);
@@ -16,11 +16,70 @@
 #include <sqlite3.h>
 #include <stdbool.h>
 #include <sys/stat.h>
+#include <dirent.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include "transport.h"
+#include "auth.h"
+#include "ratelimit.h"
+#include "outqueue.h"
+#include "timer_wheel.h"
+#include "handoff.h"
+#include "cluster.h"
+#include "poller.h"
+#include "slab.h"
+#include "scan.h"
+#include "history.h"
+#include "compress.h"
+#include "checksum.h"
+#include "zcache.h"
+#include "parallel.h"
+#include "filecache.h"
+#include "presence.h"
+#include "storage.h"
+#include "registry.h"
+#include "session.h"
+#include "config.h"
+#include "longmsg.h"
+#include "readpool.h"
 
 #define BUFFER_SIZE 1024  /**< Buffer size for communication */
-#define MAX_CLIENTS 10    /**< Maximum number of clients that can connect */
+#define MAX_CLIENTS 10    /**< Default maximum number of clients that can connect (`max-clients`) */
+#define SERVER_PORT 8080  /**< Default port on which the clients connect */
+#define CONFIG_TEXT_SIZE 4096 /**< Size of the text of the settings (`config` command) */
+#define STATS_SIZE 8192   /**< Size of the text of the statistics */
+#define ADMIN_BATCH_MAX 256 /**< Largest number of names in a batched admin command */
+
+#define POLL_TAG_LISTENER 1            /**< Poller tag of the listening socket */
+#define POLL_TAG_CONSOLE 2             /**< Poller tag of the standard input */
+#define POLL_TAG_AUTH 3                /**< Poller tag of the authentication results */
+#define POLL_TAG_SIGNAL 4              /**< Poller tag of the signals */
+#define POLL_TAG_READER 5              /**< Poller tag of the history reads */
+#define POLL_TAG_CLUSTER (1ULL << 62)  /**< Poller tags of the cluster (listener and links) */
+#define POLL_TAG_CLIENT (1ULL << 63)   /**< Poller tags of the clients: generation << 16 | slot */
+
+#define AUTH_TIMEOUT_MS 10000              /**< Delay to complete the TLS handshake and the login after connecting */
+#define PING_INTERVAL_MS 30000             /**< Silence after which the server sends a ping */
+#define PONG_TIMEOUT_MS 10000              /**< Delay to answer a ping */
+#define IDLE_TIMEOUT_MS (15 * 60 * 1000)   /**< Delay without any command after which a client is disconnected */
+#define TRANSFER_STALL_MS 30000            /**< Delay without progress after which a transfer is aborted */
+#define OUTQUEUE_MAX_BYTES (2 * 1024 * 1024) /**< Default bytes of messages that can wait for a slow client before it is disconnected */
+
+#define MESSAGE_BATCH_SIZE 64              /**< Default number of messages written to the database in one transaction */
+#define MESSAGE_BATCH_DELAY_MS 200         /**< Default maximum delay before a message is written to the database */
+#define REPLAY_MAX 200                     /**< Default maximum number of missed messages replayed to a client */
+#define SEQUENCED_SIZE (BUFFER_SIZE + 128) /**< Size of a message line with its "@MSG <channel> <seq>" header */
+#define SEARCH_LINE_MAX 200                /**< Bytes of a message shown in the results of a search */
+
+#define DRAIN_SHUTDOWN 1                   /**< Stop once the transfers are complete */
+#define DRAIN_RESTART 2                    /**< Hand the connections over to a new process once the transfers are complete */
+#define DRAIN_TIMEOUT_MS 10000             /**< Maximum delay given to the transfers before stopping anyway */
+#define DRAIN_POLL_MS 100                  /**< Interval at which the end of the transfers is checked */
 
 /**
  * @brief Structure representing a client.
@@ -35,10 +94,77 @@ typedef struct
     char username[50];         /**< Username of the client */
     char current_channel[50];  /**< Current chat channel the client has joined */
     int is_admin;              /**< 1 if the client is an admin, 0 otherwise */
+    int auth_pending;          /**< 1 while the credentials are being verified by the worker pool */
+    unsigned int auth_ticket;  /**< Ticket of the pending verification */
+    unsigned int replay_ticket; /**< Ticket of the replay read by the reader pool, 0 if none; live messages wait for it */
+    uint64_t replay_upto;      /**< Last message of the channel when the replay was submitted */
+    unsigned int search_ticket; /**< Ticket of the pending search, 0 if none */
+    rate_limits_t limits;      /**< Token buckets of the connection */
+    user_limits_t *user_limits; /**< Token buckets shared by all the connections of the user */
+    uint64_t throttled_until;  /**< Monotonic time until which the socket is not read (bytes/sec debt) */
+    uint64_t poll_tag;         /**< Tag of the socket in the poller, 0 until it is registered */
+    int rate_notified;         /**< 1 if the client was already told that a message was rejected */
+    int handshaking;           /**< 1 while the TLS handshake is in progress */
+    int closing;               /**< 1 if the connection must be closed at the end of the event loop iteration */
+    int compress;              /**< 1 if the client accepted the compression of the files (@CAPS deflate) */
+    int checksum;              /**< 1 if the client accepted the checksum trailers of the files (@CAPS crc32c) */
+    int presence;              /**< 1 if the client receives the presence events (@CAPS presence) */
+    presence_link_t user_link; /**< Link to the entry of the user in the presence index, once logged in */
+    char session[SESSION_ID_SIZE]; /**< Session token issued to or resumed by the client (session.h), empty if none */
+    char session_token[SESSION_TOKEN_SIZE]; /**< Token of this session, given back when the client asks again, empty if none */
+    char inbuf[BUFFER_SIZE];   /**< Bytes received and not processed yet (incomplete line) */
+    size_t inlen;              /**< Number of bytes in inbuf */
+    longmsg_t *long_message;   /**< Long message (`@LONG`) being received, or NULL */
+    size_t long_skip;          /**< Bytes of a refused long message still to be thrown away */
+    outqueue_t out;            /**< Messages and files waiting for the socket to be writable */
+    int upload_fd;             /**< File being uploaded by the client, or -1 */
+    long upload_remaining;     /**< Bytes of the upload not received yet */
+    char upload_path[256];     /**< Path of the file being uploaded */
+    char upload_name[256];     /**< Name of the file being uploaded */
+    char upload_channel[50];   /**< Channel of the file being uploaded */
+    inflater_t *upload_inflater; /**< Decompression of a compressed upload, or NULL */
+    long upload_size;          /**< Size of the uploaded file once decompressed */
+    long upload_compressed;    /**< Compressed size of a compressed upload, or -1 */
+    char data_token[PARALLEL_TOKEN_SIZE]; /**< Token of the parallel upload of a data connection, empty otherwise */
+    long part_offset;          /**< Offset of the part received by a data connection */
+    long upload_offset;        /**< Offset of the next byte of the part (pwrite), or -1 for a sequential upload */
+    uint32_t upload_crc;       /**< CRC-32C of the bytes of the file (or part) received so far, once decompressed */
+    int upload_verifying;      /**< 1 while a received file waits for its `@CRC32C` trailer */
+    wheel_timer_t timer;       /**< Timer of the next deadline of the connection */
+    uint64_t accepted_ms;      /**< Time of the connection */
+    uint64_t last_activity_ms; /**< Time of the last data received */
+    uint64_t last_command_ms;  /**< Time of the last command (pongs excluded) */
+    uint64_t ping_sent_ms;     /**< Time of the unanswered ping, or 0 */
+    uint64_t progress_ms;      /**< Time of the last progress of a transfer or of the send queue */
 } client_t;
 
-/** Array of client pointers to store connected clients. */
-client_t *clients[MAX_CLIENTS];
+/** Array of client pointers to store connected clients (`config.max_clients` slots). */
+client_t **clients;
+
+/** Settings of the server: the defaults below, then the configuration file and the command line (see config.h). */
+server_config_t config = {
+    .port = SERVER_PORT,
+    .backlog = SOMAXCONN,
+    .max_clients = MAX_CLIENTS,
+    .data_dir = ".",
+    .io = POLLER_AUTO,
+    .storage = STORAGE_SQLITE,
+    .auth_workers = AUTH_WORKERS,
+    .auth_queue = AUTH_QUEUE_CAPACITY,
+    .batch_size = MESSAGE_BATCH_SIZE,
+    .batch_delay_ms = MESSAGE_BATCH_DELAY_MS,
+    .replay_max = REPLAY_MAX,
+    .outqueue_max_bytes = OUTQUEUE_MAX_BYTES,
+    .file_cache_files = FILECACHE_MAX_FILES,
+    .file_cache_bytes = FILECACHE_MAX_MAPPED,
+    .compress_jobs = ZCACHE_MAX_JOBS,
+    .max_message_bytes = LONGMSG_MAX_BYTES,
+    .read_workers = READPOOL_WORKERS,
+    .read_queue = READPOOL_QUEUE_CAPACITY,
+};
+
+/** Directory in which the server was started; the new process of a hot restart starts there too. */
+char launch_dir[PATH_MAX];
 
 /**
  * @brief Checks if a user is an administrator.
@@ -61,20 +187,84 @@ int is_admin(const char *username);
 void clean_input(char *str);
 
 /**
- * @brief Clears the server directory by removing all files and directories within it.
+ * @brief Authenticates a user by checking their username and password in the database.
+ * 
+ * This function reads the password hash of the user and verifies the provided 
+ * password against it. If the stored value is an old clear-text password or 
+ * uses outdated parameters, it is replaced by a new hash. This function is 
+ * CPU-heavy and is called from the authentication worker threads.
+ * 
+ * @param[in] username The username to authenticate.
+ * @param[in] password The password to authenticate.
+ * @return 1 if authentication is successful, 0 otherwise.
  */
-void clear_server_directory(void);
+int authenticate_user(const char *username, const char *password);
 
 /**
- * @brief Authenticates a user by checking their username and password in the database.
+ * @brief Checks the credentials of a user and their role.
  * 
- * This function queries the database to check if the provided username and password are correct.
+ * This function is given to the authentication worker pool.
  * 
  * @param[in] username The username to authenticate.
  * @param[in] password The password to authenticate.
+ * @param[out] admin Set to 1 if the user is an admin.
  * @return 1 if authentication is successful, 0 otherwise.
  */
-int authenticate_user(const char *username, const char *password);
+int check_credentials(const char *username, const char *password, int *admin);
+
+/**
+ * @brief Completes the login of a client once its credentials have been verified.
+ * 
+ * This function is called by the event loop for each result of the worker pool. 
+ * Results for clients that disconnected in the meantime are ignored.
+ * 
+ * @param[in] result The result of the verification.
+ */
+void complete_authentication(const auth_result_t *result);
+
+/**
+ * @brief Logs a client in once its password or its session token has been checked.
+ * 
+ * @param[in,out] client The client.
+ * @param[in] username The user.
+ * @param[in] is_admin 1 if the user is an admin.
+ */
+void log_in_client(client_t *client, const char *username, int is_admin);
+
+/**
+ * @brief Logs a client in with a session token instead of its password (`@RESUME <user> <token>`).
+ * 
+ * @param[in,out] client The client, not logged in yet.
+ * @param[in] arguments The user and the token.
+ */
+void resume_session(client_t *client, const char *arguments);
+
+/**
+ * @brief Issues a session token to a logged-in client (`@SESSION`).
+ * 
+ * @param[in,out] client The client.
+ */
+void issue_session(client_t *client);
+
+/**
+ * @brief Schedules the writing of the sessions to the database in SESSION_SAVE_MS, unless it is already scheduled.
+ */
+void schedule_session_save(void);
+
+/**
+ * @brief Callback of the timer writing the sessions to the database.
+ * 
+ * @param[in] timer The timer of the sessions.
+ */
+void session_save_expired(wheel_timer_t *timer);
+
+/**
+ * @brief Formats the server statistics.
+ * 
+ * @param[out] buffer The buffer receiving the statistics.
+ * @param[in] size The size of the buffer.
+ */
+void format_stats(char *buffer, size_t size);
 
 /**
  * @brief Stores a file in the specified chat channel directory.
@@ -89,47 +279,169 @@ void store_file_in_salon(const char *salon_name, const char *filename);
 /**
  * @brief Stores a message in the database.
  * 
- * This function inserts a message into the database, associating it with the specified chat channel and username.
+ * The message is added to the current batch, which is written to the storage
+ * in a single transaction when it is full or MESSAGE_BATCH_DELAY_MS after its
+ * first message.
  * 
  * @param[in] channel The chat channel where the message was sent.
  * @param[in] username The username of the sender.
  * @param[in] message The message content.
+ * @param[in] seq The sequence number of the message in its channel.
+ */
+void store_message_in_db(const char *channel, const char *username, const char *message, uint64_t seq);
+
+/**
+ * @brief Adds the columns and indexes missing from an older database.
+ */
+void migrate_database(void);
+
+/**
+ * @brief Formats the line sent to the clients for a numbered message: "@MSG <channel> <seq> <message>".
+ * 
+ * @param[out] line The buffer receiving the line (not null-terminated).
+ * @param[in] size The size of the buffer (SEQUENCED_SIZE).
+ * @param[in] channel The chat channel.
+ * @param[in] seq The sequence number of the message.
+ * @param[in] message The message, ending with a line feed.
+ * @param[in] len The length of the message.
+ * @return The length of the line.
+ */
+size_t format_sequenced(char *line, size_t size, const char *channel, uint64_t seq, const char *message, size_t len);
+
+/**
+ * @brief Queues a numbered message of a channel for a client (replay or message of another node).
+ * 
+ * A message of one short line is sent as "@MSG <channel> <seq> <message>"; a 
+ * longer one, or one of several lines, as "@LONG <channel> <seq> <bytes>" 
+ * followed by the message.
+ * 
+ * @param[in] client The client.
+ * @param[in] channel The chat channel.
+ * @param[in] seq The sequence number of the message.
+ * @param[in] message The message, ending with a line feed.
+ * @param[in] len The length of the message.
+ */
+void queue_channel_message(client_t *client, const char *channel, uint64_t seq, const char *message, size_t len);
+
+/**
+ * @brief Sends a client the messages of a channel that follow a sequence number.
+ * 
+ * The messages come from memory if they are still there. Older ones are
+ * read from the storage by the reader pool (readpool.h): until the result
+ * arrives, the live messages of the channel are not queued to the client,
+ * and they are sent after the replayed ones. At most REPLAY_MAX messages
+ * (the most recent) are sent.
+ * 
+ * @param[in,out] client The client.
+ * @param[in] channel The chat channel.
+ * @param[in] after The last sequence number seen by the client.
  */
-void store_message_in_db(const char *channel, const char *username, const char *message);
+void replay_channel(client_t *client, const char *channel, uint64_t after);
 
 /**
- * @brief Clears all messages from the database.
+ * @brief Checks if a client receives the live messages of a channel.
+ * 
+ * @param[in] client The client.
+ * @param[in] channel The chat channel.
+ * @return true if the client is in the channel and no replay is being read for it.
+ */
+bool receives_live(const client_t *client, const char *channel);
+
+/**
+ * @brief Searches the messages of the current channel of a client (`search <text>`).
+ * 
+ * The search is done by the reader pool; the client receives the
+ * READPOOL_SEARCH_MAX most recent matches when it is done.
+ * 
+ * @param[in,out] client The client.
+ * @param[in] pattern The text searched.
+ */
+void search_channel(client_t *client, const char *pattern);
+
+/**
+ * @brief Sends a client the result of a history read of the reader pool.
+ * 
+ * This function is called by the event loop for each result of the pool.
+ * Results for clients that disconnected or changed channel in the meantime
+ * are ignored.
+ * 
+ * @param[in] result The result of the read.
+ */
+void complete_history_read(const readpool_result_t *result);
+
+/**
+ * @brief Writes the pending messages to the storage in one write.
+ */
+void flush_message_batch(void);
+
+/**
+ * @brief Callback of the timer of the message batch.
+ * 
+ * @param[in] timer The timer of the batch.
+ */
+void message_batch_expired(wheel_timer_t *timer);
+
+/**
+ * @brief Clears all the stored messages.
  */
 void clear_messages_in_db(void);
 
 /**
  * @brief Deletes a chat channel directory.
  * 
- * This function deletes the directory of the specified chat channel.
+ * This function deletes the directory of the specified chat channel and
+ * its files. Names that valid_channel_name() refuses are accepted, as 
+ * channels created before that rule may use them; nothing is done for a 
+ * name that would leave `server/` (empty, `.`, `..` or containing `/`).
  * 
  * @param[in] salon_name The name of the chat channel.
  */
 void delete_salon_directory(const char *salon_name);
 
 /**
- * @brief Creates a directory for a chat channel.
+ * @brief Prepares the directory of a chat channel before its first upload.
  * 
- * This function creates a directory for the specified chat channel if it doesn't exist.
+ * This function creates the directory of the specified chat channel if it doesn't exist,
+ * and removes the partial uploads left by a previous process. It does nothing once the
+ * directory has been prepared by this process.
  * 
  * @param[in] salon_name The name of the chat channel.
+ * @return 0 on success, -1 if the directory cannot be created.
  */
-void create_salon_directory(const char *salon_name);
+int create_salon_directory(const char *salon_name);
 
 /**
- * @brief Checks if a chat channel exists in the database.
+ * @brief Checks if a chat channel exists.
  * 
- * This function queries the database to check if the specified chat channel exists.
+ * This function looks the chat channel up in the in-memory registry loaded from the database.
  * 
  * @param[in] channel_name The name of the chat channel to check.
  * @return 1 if the chat channel exists, 0 otherwise.
  */
 int channel_exists(const char *channel_name);
 
+/**
+ * @brief Inserts chat channels in the database in a single transaction, then adds them to the registry.
+ * 
+ * Either all the channels are created, or none of them.
+ * 
+ * @param[in] names The names of the chat channels, valid and not existing yet.
+ * @param[in] count The number of names.
+ * @return 0 on success, -1 if the transaction failed.
+ */
+int insert_channels(char *names[], int count);
+
+/**
+ * @brief Checks that a name can be used for a chat channel.
+ * 
+ * The name is used as a directory name: only ASCII letters, digits, '_'
+ * and '-' are allowed.
+ * 
+ * @param[in] channel_name The name.
+ * @return 1 if the name is valid, 0 otherwise.
+ */
+int valid_channel_name(const char *channel_name);
+
 /**
  * @brief Creates a new chat channel.
  * 
@@ -140,6 +452,26 @@ int channel_exists(const char *channel_name);
  */
 void create_channel(client_t *client, const char *channel_name);
 
+/**
+ * @brief Splits the arguments of a batched admin command into names separated by spaces.
+ * 
+ * @param[in,out] arguments The arguments, cut in place.
+ * @param[out] names The names.
+ * @param[in] max The largest number of names.
+ * @return The number of names.
+ */
+int split_names(char *arguments, char *names[], int max);
+
+/**
+ * @brief Creates several chat channels in a single transaction (`create_many`).
+ * 
+ * Invalid names and existing channels are skipped and listed in the response.
+ * 
+ * @param[in] client The administrator.
+ * @param[in,out] arguments The names of the chat channels, separated by spaces.
+ */
+void create_channels(client_t *client, char *arguments);
+
 /**
  * @brief Lists the users in the client's current chat channel.
  * 
@@ -153,6 +485,9 @@ void list_users_in_channel(client_t *client);
  * @brief Sends a message to all users in the specified chat channel.
  * 
  * This function broadcasts a message to all users in the same chat channel, except the sender.
+ * The message gets the next sequence number of the channel and is sent as
+ * "@MSG <channel> <seq> <message>".
+ * In cluster mode, the message is also forwarded to the nodes that have members in the channel.
  * 
  * @param[in] channel The chat channel to which the message is sent.
  * @param[in] message The message content.
@@ -160,6 +495,142 @@ void list_users_in_channel(client_t *client);
  */
 void send_message_to_channel(const char *channel, const char *message, int sender_socket);
 
+/**
+ * @brief Delivers a message forwarded by another node to the local members of a channel.
+ * 
+ * The message gets a sequence number of this node and is stored here too, so
+ * the local members can catch it up like the local messages.
+ * 
+ * @param[in] channel The chat channel.
+ * @param[in] message The message content.
+ * @param[in] len The length of the message.
+ */
+void deliver_cluster_message(const char *channel, const char *message, size_t len);
+
+/**
+ * @brief Handles the line `@LONG <bytes>` announcing a long message.
+ * 
+ * The bytes that follow are received by receive_long_data() and 
+ * longmsg_read(). A message longer than `max-message-bytes`, sent outside of 
+ * a channel or rejected by the rate limits is read anyway and thrown away, so 
+ * the commands that follow it are still understood.
+ * 
+ * @param[in] client The client sending the message.
+ * @param[in] arguments The number of bytes announced.
+ * @param[in] accepted 0 if the rate limits rejected the message (check_rate_limits()).
+ */
+void start_long_message(client_t *client, const char *arguments, int accepted);
+
+/**
+ * @brief Takes the bytes of a long message received with other data.
+ * 
+ * The bytes of the body are also charged to the byte buckets of the client 
+ * (charge_rate_bytes()); the message is delivered once complete.
+ * 
+ * @param[in] client The client sending the message.
+ * @param[in] data The received bytes.
+ * @param[in] len The number of received bytes.
+ * @return The number of bytes that belonged to the message.
+ */
+size_t receive_long_data(client_t *client, const char *data, size_t len);
+
+/**
+ * @brief Delivers a complete long message to the channel of its sender.
+ * 
+ * Every line of the message is cleaned like a chat line, then the message is 
+ * sent to the channel by send_long_to_channel().
+ * 
+ * @param[in] client The client that sent the message.
+ */
+void deliver_long_message(client_t *client);
+
+/**
+ * @brief Sends a long message to all users of the channel of its sender, except the sender.
+ * 
+ * The message is numbered and stored like a chat line. The members receive the 
+ * same shared text by reference (queue_long_message()), without a copy per 
+ * recipient. Only the messages shorter than CLUSTER_MESSAGE_MAX are forwarded 
+ * to the other nodes.
+ * 
+ * @param[in] sender The client that sent the message.
+ * @param[in] text The message, "username: message\n".
+ */
+void send_long_to_channel(client_t *sender, longmsg_text_t *text);
+
+/**
+ * @brief Links a logged-in client to its user in the presence index.
+ * 
+ * In cluster mode, the client also subscribes to the direct messages of its 
+ * user (`@<username>` pseudo-channel).
+ * 
+ * @param[in,out] client The client.
+ */
+void link_user(client_t *client);
+
+/**
+ * @brief Unlinks a client that is closed from its user in the presence index.
+ * 
+ * @param[in,out] client The client.
+ */
+void unlink_user(client_t *client);
+
+/**
+ * @brief Sends a direct message: "msg <user> <text>".
+ * 
+ * The connections of the recipient are found through the presence index. In 
+ * cluster mode, a recipient who is not connected to this node may be 
+ * connected to another one: the message is forwarded to the nodes where 
+ * the recipient is connected.
+ * 
+ * @param[in] client The sender.
+ * @param[in] arguments The recipient and the text.
+ */
+void send_direct_message(client_t *client, const char *arguments);
+
+/**
+ * @brief Delivers a direct message to the local connections of a user.
+ * 
+ * @param[in] username The recipient.
+ * @param[in] message The message, ending with a newline.
+ * @param[in] len The length of the message.
+ * @return The number of connections reached.
+ */
+int deliver_direct_message(const char *username, const char *message, size_t len);
+
+/**
+ * @brief Sends a line of presence events to the subscribed clients.
+ * 
+ * Called by the presence index when it sends a batch of changes.
+ * 
+ * @param[in] channel The channel whose members receive the line, or NULL for all the subscribers.
+ * @param[in] line The line.
+ * @param[in] len The length of the line.
+ */
+void deliver_presence(const char *channel, const char *line, size_t len);
+
+/**
+ * @brief Changes the current channel of a client.
+ * 
+ * The local membership of the channels is kept up to date for the cluster.
+ * 
+ * @param[in,out] client The client.
+ * @param[in] channel The new channel, or "" to leave the current one.
+ */
+void set_client_channel(client_t *client, const char *channel);
+
+/**
+ * @brief Deletes chat channels from the database in a single transaction, then forgets them.
+ * 
+ * Once the transaction is committed, the members of each channel are notified and leave it
+ * (they stay connected), and its files, messages and registry entry are removed.
+ * 
+ * @param[in] client The administrator.
+ * @param[in] names The names of existing chat channels.
+ * @param[in] count The number of names.
+ * @return 0 on success, -1 if the transaction failed (nothing is deleted).
+ */
+int remove_channels(client_t *client, char *names[], int count);
+
 /**
  * @brief Deletes a chat channel and its messages.
  * 
@@ -170,23 +641,61 @@ void send_message_to_channel(const char *channel, const char *message, int sende
  */
 void delete_channel(client_t *client, const char *channel_name);
 
+/**
+ * @brief Deletes several chat channels in a single transaction (`delete_many`).
+ * 
+ * @param[in] client The administrator.
+ * @param[in,out] arguments The names of the chat channels, separated by spaces.
+ */
+void delete_channels(client_t *client, char *arguments);
+
+/**
+ * @brief Closes all the connections of several users (`kick`).
+ * 
+ * The users are notified; their connections are closed at the end of the event loop iteration.
+ * 
+ * @param[in] client The administrator.
+ * @param[in,out] arguments The usernames, separated by spaces.
+ */
+void kick_users(client_t *client, char *arguments);
+
+/**
+ * @brief Moves all the connections of several users to a chat channel (`move <channel> <user>...`).
+ * 
+ * @param[in] client The administrator.
+ * @param[in,out] arguments The channel, then the usernames, separated by spaces.
+ */
+void move_users(client_t *client, char *arguments);
+
+/**
+ * @brief Sets the retention of the messages of a chat channel (admin only).
+ * 
+ * The arguments are "<channel> <rule>...", each rule being "<N>d" (messages
+ * older than N days are removed), "<N>" (only the N most recent messages are
+ * kept) or "off" (messages kept forever).
+ * 
+ * @param[in] client The client requesting the change.
+ * @param[in] arguments The channel followed by its rules.
+ */
+void set_channel_retention(client_t *client, char *arguments);
+
 /**
  * @brief Lists all available chat channels.
  * 
  * This function sends a list of all available chat channels to the client.
  * 
- * @param[in] socket The socket of the client requesting the channel list.
+ * @param[in] client The client requesting the channel list.
  */
-void list_channels(int socket);
+void list_channels(client_t *client);
 
 /**
  * @brief Sends a list of all connected users and their chat channels to an administrator.
  * 
  * This function sends the list of all users, along with their chat channel, to an admin client.
  * 
- * @param[in] admin_socket The socket of the admin client.
+ * @param[in] admin The admin client.
  */
-void handle_list_admin(int admin_socket);
+void handle_list_admin(client_t *admin);
 
 /**
  * @brief Notifies the client of their current chat channel.
@@ -198,41 +707,369 @@ void handle_list_admin(int admin_socket);
 void notify_current_channel(client_t *client);
 
 /**
- * @brief Initializes directories for all existing chat channels.
+ * @brief Checks that a file name does not leave the directory of a channel.
  * 
- * This function creates directories for all chat channels found in the database.
+ * @param[in] filename The name of the file.
+ * @return 1 if the name is valid, 0 otherwise.
  */
-void initialize_salon_directories(void);
+int valid_filename(const char *filename);
 
 /**
  * @brief Sends a file to a client in the specified chat channel.
  * 
- * This function transfers a file from the server to a client in the given chat channel.
+ * This function announces the size of the file with a `@FILE <size>` line 
+ * and queues the file after it. The file is sent with sendfile as the 
+ * socket becomes writable. A client that accepted compression gets the 
+ * compressed copy of the file instead, announced by 
+ * `@FILEZ <compressed size> <size>`, once the copy is ready (see zcache.h).
  * 
- * @param[in] client_socket The socket of the client requesting the file.
+ * @param[in] client The client requesting the file.
  * @param[in] salon_name The chat channel to which the file belongs.
  * @param[in] filename The name of the file to send.
  */
-void send_file_to_client(int client_socket, const char *salon_name, const char *filename);
+void send_file_to_client(client_t *client, const char *salon_name, const char *filename);
+
+/**
+ * @brief Builds the path under which an upload is received before it replaces the file.
+ * 
+ * @param[out] path The buffer receiving the path.
+ * @param[in] size The size of the buffer.
+ * @param[in] salon_name The chat channel of the file.
+ * @param[in] filename The name of the file.
+ * @param[in] socket The socket of the connection that requested the upload.
+ */
+void upload_temp_path(char *path, size_t size, const char *salon_name, const char *filename, int socket);
+
+/**
+ * @brief Replaces a channel file with a completely received upload.
+ * 
+ * The upload is renamed over the file, so downloads in progress keep sending 
+ * the old file; the caches of the old file are invalidated and the checksum 
+ * of the new one is stored.
+ * 
+ * @param[in] temp_path The path of the received upload.
+ * @param[in] salon_name The chat channel of the file.
+ * @param[in] filename The name of the file.
+ * @param[in] crc The CRC-32C of the new file.
+ */
+void replace_salon_file(const char *temp_path, const char *salon_name, const char *filename, uint32_t crc);
 
 /**
- * @brief Receives a file from a client and stores it in the server's directory for the specified chat channel.
+ * @brief Starts receiving a file from a client.
  * 
- * This function receives a file from the client and saves it in the server's directory for the specified chat channel.
+ * This function creates a temporary file in the server's directory for the specified 
+ * chat channel and answers `@OK`. The bytes that follow on the connection are 
+ * then written to the file by receive_upload_data(), after decompression if 
+ * the client sends the file compressed (`sendz`).
  * 
- * @param[in] client_socket The socket of the client sending the file.
+ * @param[in] client The client sending the file.
  * @param[in] salon_name The chat channel to which the file belongs.
  * @param[in] filename The name of the file being received.
+ * @param[in] file_size The size of the file announced by the client.
+ * @param[in] compressed_size The number of compressed bytes that follow, or -1 if the file is sent raw.
+ */
+void receive_file_from_client(client_t *client, const char *salon_name, const char *filename, long file_size, long compressed_size);
+
+/**
+ * @brief Starts receiving a part of a parallel upload on a data connection.
+ * 
+ * The line `@DATA <token> <offset> <length>` replaces the credentials on a 
+ * data connection; the bytes that follow are written at their offset by 
+ * receive_upload_data(). An unknown token or an invalid part closes the 
+ * connection.
+ * 
+ * @param[in] client The data connection.
+ * @param[in] line The `@DATA` line.
+ */
+void receive_part_from_client(client_t *client, const char *line);
+
+/**
+ * @brief Starts a parallel upload requested with `psend <name> <size>`.
+ * 
+ * @param[in] client The client sending the file.
+ * @param[in] filename The name of the file.
+ * @param[in] file_size The size of the file.
+ */
+void start_parallel_upload(client_t *client, const char *filename, long file_size);
+
+/**
+ * @brief Ends a parallel upload with `pdone <token> <crc32c>` and notifies the channel if the file is valid.
+ * 
+ * @param[in] client The client that requested the upload.
+ * @param[in] arguments The token and the CRC-32C of the file.
+ */
+void finish_parallel_upload(client_t *client, const char *arguments);
+
+/**
+ * @brief Tells the members of a channel that a new file is available.
+ * 
+ * @param[in] channel The channel.
+ * @param[in] filename The name of the file.
+ * @param[in] sender_socket The socket of the client that sent the file, which is not notified.
+ */
+void announce_file(const char *channel, const char *filename, int sender_socket);
+
+/**
+ * @brief Writes received bytes to the file being uploaded.
+ * 
+ * @param[in] client The client sending the file.
+ * @param[in] data The received bytes.
+ * @param[in] len The number of received bytes.
+ * @return The number of bytes that belonged to the file.
+ */
+size_t receive_upload_data(client_t *client, const char *data, size_t len);
+
+/**
+ * @brief Closes a completed upload and notifies the channel.
+ * 
+ * If the client accepted the checksums, the channel is notified only once 
+ * the `@CRC32C` trailer that follows the file has been checked by 
+ * verify_upload().
+ * 
+ * @param[in] client The client that sent the file.
+ */
+void finish_upload(client_t *client);
+
+/**
+ * @brief Checks the trailer of a received file against the checksum computed while it was written.
+ * 
+ * The file is removed if the checksum differs. If the line is not a trailer, 
+ * the bytes of the file and the commands are out of sync: the file is 
+ * removed and the connection is closed.
+ * 
+ * @param[in] client The client that sent the file.
+ * @param[in] line The line that follows the file.
+ */
+void verify_upload(client_t *client, const char *line);
+
+/**
+ * @brief Stores the checksum of a received file and notifies the channel.
+ * 
+ * @param[in] client The client that sent the file.
+ */
+void complete_upload(client_t *client);
+
+/**
+ * @brief Aborts an upload in progress and removes the incomplete file.
+ * 
+ * @param[in] client The client that was sending the file.
+ */
+void abort_upload(client_t *client);
+
+/**
+ * @brief Queues bytes for a client.
+ * 
+ * The bytes are sent when the socket is writable. A client that lets 
+ * `outqueue-max-bytes` accumulate is disconnected; only the bytes already 
+ * waiting count, so a message always fits in an empty queue.
+ * 
+ * @param[in] client The client.
+ * @param[in] data The bytes to send.
+ * @param[in] len The number of bytes.
+ */
+void queue_message(client_t *client, const void *data, size_t len);
+
+/**
+ * @brief Queues a string for a client.
+ * 
+ * @param[in] client The client.
+ * @param[in] text The string to send.
+ */
+void queue_text(client_t *client, const char *text);
+
+/**
+ * @brief Queues a long message for a client: its `@LONG` line, then a reference to its text.
+ * 
+ * The text is sent with its header line in a single gather write, and 
+ * released by the queue once sent. The queue limit applies as in queue_message().
+ * 
+ * @param[in] client The client.
+ * @param[in] channel The chat channel.
+ * @param[in] seq The sequence number of the message.
+ * @param[in] text The shared text of the message.
+ */
+void queue_long_message(client_t *client, const char *channel, uint64_t seq, longmsg_text_t *text);
+
+/**
+ * @brief Writes the queue of a client as far as its socket allows.
+ * 
+ * @param[in] client The client.
+ */
+void flush_client(client_t *client);
+
+/**
+ * @brief Disconnects a client.
+ * 
+ * This function removes the client from the list of clients, releases its 
+ * rate limits, closes its socket and frees it.
+ * 
+ * @param[in] client The client to disconnect.
+ */
+void disconnect_client(client_t *client);
+
+/**
+ * @brief Enforces the deadlines of a connection and schedules its next check.
+ * 
+ * A connection has a single timer. Activity only updates timestamps; the 
+ * deadline that applies is computed here when the timer expires: login 
+ * (AUTH_TIMEOUT_MS), transfer progress (TRANSFER_STALL_MS), idle time 
+ * (IDLE_TIMEOUT_MS) or ping/pong (PING_INTERVAL_MS, PONG_TIMEOUT_MS). The 
+ * client is disconnected if a deadline has passed.
+ * 
+ * @param[in] client The client.
+ * @param[in] now The current monotonic time in milliseconds.
+ */
+void check_client_timeouts(client_t *client, uint64_t now);
+
+/**
+ * @brief Callback of the timer of a connection.
+ * 
+ * @param[in] timer The timer of the client.
+ */
+void client_timer_expired(wheel_timer_t *timer);
+
+/**
+ * @brief Registers a new connection in a free slot of clients[].
+ * 
+ * @param[in] socket The non-blocking socket of the client.
+ * @param[in] handshaking 1 if the TLS handshake is not complete.
+ * @return The new client, or NULL if the server is full.
+ */
+client_t *add_client(int socket, int handshaking);
+
+/**
+ * @brief Starts a graceful shutdown or a hot restart.
+ * 
+ * New connections are no longer accepted (they wait in the listen backlog)
+ * and new transfers are refused, while the current transfers, the queued
+ * messages and the pending logins complete, for at most DRAIN_TIMEOUT_MS.
+ * 
+ * @param[in] action DRAIN_SHUTDOWN or DRAIN_RESTART.
+ */
+void start_drain(int action);
+
+/**
+ * @brief Checks if nothing is left to complete before stopping.
+ * 
+ * @return 1 if no transfer, queued message or login is in progress, 0 otherwise.
+ */
+int drain_complete(void);
+
+/**
+ * @brief Checks if a session can be handed over to a new process.
+ * 
+ * TLS sessions and connections with a transfer or a login in progress
+ * cannot be moved; these clients are asked to reconnect.
+ * 
+ * @param[in] client The client.
+ * @return 1 if the socket can be sent to the new process, 0 otherwise.
  */
-void receive_file_from_client(int client_socket, const char *salon_name, const char *filename);
+int can_hand_off(const client_t *client);
+
+/**
+ * @brief Starts the new server process and hands it the listener and the sessions.
+ * 
+ * @param[in] server_fd The listening socket.
+ * @param[in] argv The arguments of the current process.
+ * @return 0 if the new process took over, -1 otherwise (the server keeps serving).
+ */
+int hand_off(int server_fd, char *argv[]);
+
+/**
+ * @brief Ends a drain: writes the pending messages, then stops or hands over.
+ * 
+ * This function does not return, unless a restart failed.
+ * 
+ * @param[in] server_fd The listening socket.
+ * @param[in] argv The arguments of the current process.
+ */
+void finish_drain(int server_fd, char *argv[]);
+
+/**
+ * @brief Takes over the listener and the sessions of the previous process.
+ * 
+ * @param[in] sock The handoff socket given with `--inherit`.
+ * @param[out] cluster_fd The listening socket of the cluster, left unchanged if the previous process had none.
+ * @return The listening socket, or -1 on error.
+ */
+int inherit_sockets(int sock, int *cluster_fd);
+
+/**
+ * @brief Applies the rate limits to a message received from a client.
+ * 
+ * The bytes of the message are charged to the byte buckets of the connection 
+ * and of the user; if they go into debt, the socket is not read again until 
+ * the debt is paid. The message is then rejected if the message buckets are 
+ * empty.
+ * 
+ * @param[in] client The client that sent the message.
+ * @param[in] bytes The size of the message.
+ * @return 1 if the message can be processed, 0 if it is rejected.
+ */
+int check_rate_limits(client_t *client, int bytes);
+
+/**
+ * @brief Charges bytes to the byte buckets of a client (connection and user).
+ * 
+ * If the buckets go into debt, the socket is not read again until the debt is 
+ * paid. Used for every message, and for the body of a long message as it is 
+ * received.
+ * 
+ * @param[in] client The client.
+ * @param[in] bytes The number of bytes.
+ * @param[in] now The current time (monotonic_ns()).
+ */
+void charge_rate_bytes(client_t *client, size_t bytes, uint64_t now);
+
+/**
+ * @brief Counts and notifies a message rejected by the rate limits.
+ * 
+ * The client is only notified once per burst of rejected messages.
+ * 
+ * @param[in] client The client whose message is rejected.
+ * @return Always 0.
+ */
+int reject_rate_limited(client_t *client);
+
+/**
+ * @brief Checks if a client is allowed to start a file upload.
+ * 
+ * @param[in] client The client that wants to upload a file.
+ * @return 1 if the upload is allowed, 0 otherwise.
+ */
+int check_upload_limits(client_t *client);
+
+/**
+ * @brief Refuses a file upload.
+ * 
+ * This function answers `@ERR` with the reason of the refusal instead of 
+ * the confirmation, so that the client does not send the file.
+ * 
+ * @param[in] client The client.
+ * @param[in] reason The message sent to the client.
+ */
+void reject_file_from_client(client_t *client, const char *reason);
 
 /**
  * @brief Handles communication with a connected client.
  * 
- * This function processes incoming messages and commands from a client, 
- * such as joining a channel, sending messages, and file transfers.
+ * This function reads what the non-blocking socket holds, splits it into 
+ * lines and hands each line to process_command(). During an upload, the 
+ * bytes are written to the file instead.
  * 
  * @param[in] client_socket The socket of the connected client.
  * @param[in] client The client data structure.
  */
 void handle_client(int client_socket, client_t *client);
+
+/**
+ * @brief Processes a command or a message received from a client.
+ * 
+ * This function handles the commands of a client, such as joining a channel, 
+ * sending messages, and file transfers.
+ * 
+ * @param[in] client The client.
+ * @param[in,out] buffer The line received, without its line feed.
+ * @return 0, or -1 if the client was disconnected.
+ */
+int process_command(client_t *client, char *buffer);
@@ -0,0 +1,331 @@
+#include "session.h"
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <sqlite3.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "util.h"
+
+#define SESSION_SWEEP_S 60 // Intervalle minimal entre deux suppressions des sessions expirées
+
+// Session connue : seule l'empreinte du jeton est gardée
+typedef struct session
+{
+    char id[SESSION_ID_SIZE];
+    char username[50];
+    int is_admin;
+    time_t expires;
+    bool dirty;  // Échéance prolongée, pas encore écrite dans la base
+    bool stored; // Déjà présente dans la base
+    int connections; // Connexions qui utilisent la session : elle n'expire pas tant qu'il en reste
+    struct session *next;
+} session_t;
+
+static session_t *table[SESSION_BUCKETS];
+static int session_count = 0;
+static time_t last_sweep = 0;
+static unsigned long issued = 0;
+static unsigned long resumed = 0;
+static unsigned long refused = 0;
+static unsigned long revoked = 0;
+
+static void token_id(const char *token, char *id)
+{
+    unsigned char digest[32];
+    unsigned int len = 0;
+    EVP_Digest(token, strlen(token), digest, &len, EVP_sha256(), NULL);
+    for (unsigned int i = 0; i < sizeof(digest); i++)
+    {
+        snprintf(id + 2 * i, 3, "%02x", digest[i]);
+    }
+}
+
+static session_t *lookup(const char *id)
+{
+    for (session_t *session = table[hash_string(id) % SESSION_BUCKETS]; session != NULL; session = session->next)
+    {
+        if (strcmp(session->id, id) == 0)
+        {
+            return session;
+        }
+    }
+    return NULL;
+}
+
+static session_t *add(const char *id, const char *username, int is_admin, time_t expires, bool stored)
+{
+    session_t *session = calloc(1, sizeof(session_t));
+    if (session == NULL)
+    {
+        return NULL;
+    }
+    snprintf(session->id, sizeof(session->id), "%s", id);
+    snprintf(session->username, sizeof(session->username), "%s", username);
+    session->is_admin = is_admin;
+    session->expires = expires;
+    session->stored = stored;
+    unsigned int index = hash_string(id) % SESSION_BUCKETS;
+    session->next = table[index];
+    table[index] = session;
+    session_count++;
+    return session;
+}
+
+// Retire de la mémoire les sessions expirées, ou toutes celles d'un utilisateur
+static void remove_matching(time_t now, const char *username)
+{
+    for (int i = 0; i < SESSION_BUCKETS; i++)
+    {
+        session_t **link = &table[i];
+        while (*link != NULL)
+        {
+            session_t *session = *link;
+            if (username != NULL ? strcmp(session->username, username) == 0 : session->connections == 0 && session->expires < now)
+            {
+                *link = session->next;
+                free(session);
+                session_count--;
+            }
+            else
+            {
+                link = &session->next;
+            }
+        }
+    }
+}
+
+static sqlite3 *open_registry(void)
+{
+    sqlite3 *db;
+    if (sqlite3_open("database.db", &db) != SQLITE_OK)
+    {
+        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return NULL;
+    }
+    sqlite3_busy_timeout(db, 1000); // Les threads d'authentification peuvent être en train d'écrire
+    return db;
+}
+
+int session_init(void)
+{
+    sqlite3 *db = open_registry();
+    if (db == NULL)
+    {
+        return -1;
+    }
+    sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS sessions (id TEXT PRIMARY KEY, username TEXT NOT NULL, "
+                     "is_admin INTEGER NOT NULL DEFAULT 0, expires INTEGER NOT NULL);", 0, 0, 0);
+
+    // Les sessions expirées pendant l'arrêt du serveur sont oubliées
+    sqlite3_stmt *stmt;
+    time_t now = time(NULL);
+    if (sqlite3_prepare_v2(db, "DELETE FROM sessions WHERE expires < ?;", -1, &stmt, 0) == SQLITE_OK)
+    {
+        sqlite3_bind_int64(stmt, 1, now);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+    if (sqlite3_prepare_v2(db, "SELECT id, username, is_admin, expires FROM sessions;", -1, &stmt, 0) != SQLITE_OK)
+    {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return -1;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        add((const char *)sqlite3_column_text(stmt, 0), (const char *)sqlite3_column_text(stmt, 1),
+            sqlite3_column_int(stmt, 2), (time_t)sqlite3_column_int64(stmt, 3), true);
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    last_sweep = now;
+    return session_count;
+}
+
+int session_issue(const char *username, int is_admin, char *token, char *id)
+{
+    unsigned char random[(SESSION_TOKEN_SIZE - 1) / 2];
+    if (RAND_bytes(random, sizeof(random)) != 1)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(random); i++)
+    {
+        snprintf(token + 2 * i, 3, "%02x", random[i]);
+    }
+    token_id(token, id);
+
+    // Le jeton n'est écrit dans la base qu'au prochain session_save(), avec les autres
+    session_t *session = add(id, username, is_admin, time(NULL) + SESSION_TTL_S, false);
+    if (session == NULL)
+    {
+        return -1;
+    }
+    session->connections = 1; // Celle qui a demandé le jeton
+    issued++;
+    return 0;
+}
+
+int session_resume(const char *username, const char *token, int *is_admin, char *id)
+{
+    token_id(token, id);
+    session_t *session = lookup(id);
+    if (session == NULL || (session->connections == 0 && session->expires < time(NULL)) || strcmp(session->username, username) != 0)
+    {
+        refused++;
+        return 0;
+    }
+    *is_admin = session->is_admin;
+    session->connections++;
+    resumed++;
+    return 1;
+}
+
+int session_exists(const char *id)
+{
+    return lookup(id) != NULL;
+}
+
+void session_attach(const char *id)
+{
+    session_t *session = lookup(id);
+    if (session != NULL)
+    {
+        session->connections++;
+    }
+}
+
+void session_extend(const char *id)
+{
+    session_t *session = lookup(id);
+    if (session != NULL)
+    {
+        if (session->connections > 0)
+        {
+            session->connections--;
+        }
+        session->expires = time(NULL) + SESSION_TTL_S;
+        session->dirty = true;
+    }
+}
+
+void session_revoke_user(const char *username)
+{
+    int before = session_count;
+    remove_matching(0, username);
+    if (session_count == before)
+    {
+        return;
+    }
+    revoked += before - session_count;
+
+    sqlite3 *db = open_registry();
+    sqlite3_stmt *stmt;
+    if (db != NULL && sqlite3_prepare_v2(db, "DELETE FROM sessions WHERE username = ?;", -1, &stmt, 0) == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, username, -1, SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+}
+
+void session_save(void)
+{
+    sqlite3 *db = open_registry();
+    sqlite3_stmt *insert, *update;
+    if (db == NULL)
+    {
+        return;
+    }
+    // Les sessions encore utilisées restent valables SESSION_TTL_S après le nettoyage, dans la base aussi
+    time_t now = time(NULL);
+    bool sweep = now - last_sweep >= SESSION_SWEEP_S;
+    if (sweep)
+    {
+        for (int i = 0; i < SESSION_BUCKETS; i++)
+        {
+            for (session_t *session = table[i]; session != NULL; session = session->next)
+            {
+                if (session->connections > 0)
+                {
+                    session->expires = now + SESSION_TTL_S;
+                    session->dirty = true;
+                }
+            }
+        }
+    }
+
+    sqlite3_exec(db, "BEGIN;", 0, 0, 0);
+    if (sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO sessions (id, username, is_admin, expires) VALUES (?, ?, ?, ?);", -1,
+                           &insert, 0) != SQLITE_OK)
+    {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK;", 0, 0, 0);
+        sqlite3_close(db);
+        return;
+    }
+    if (sqlite3_prepare_v2(db, "UPDATE sessions SET expires = ? WHERE id = ?;", -1, &update, 0) != SQLITE_OK)
+    {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        sqlite3_finalize(insert);
+        sqlite3_exec(db, "ROLLBACK;", 0, 0, 0);
+        sqlite3_close(db);
+        return;
+    }
+    for (int i = 0; i < SESSION_BUCKETS; i++)
+    {
+        for (session_t *session = table[i]; session != NULL; session = session->next)
+        {
+            if (!session->stored)
+            {
+                sqlite3_bind_text(insert, 1, session->id, -1, SQLITE_STATIC);
+                sqlite3_bind_text(insert, 2, session->username, -1, SQLITE_STATIC);
+                sqlite3_bind_int(insert, 3, session->is_admin);
+                sqlite3_bind_int64(insert, 4, session->expires);
+                if (sqlite3_step(insert) == SQLITE_DONE)
+                {
+                    session->stored = true;
+                    session->dirty = false;
+                }
+                sqlite3_reset(insert);
+            }
+            else if (session->dirty)
+            {
+                sqlite3_bind_int64(update, 1, session->expires);
+                sqlite3_bind_text(update, 2, session->id, -1, SQLITE_STATIC);
+                if (sqlite3_step(update) == SQLITE_DONE)
+                {
+                    session->dirty = false;
+                }
+                sqlite3_reset(update);
+            }
+        }
+    }
+    sqlite3_finalize(insert);
+    sqlite3_finalize(update);
+
+    // De temps en temps, oublier les sessions expirées
+    sqlite3_stmt *stmt;
+    if (sweep && sqlite3_prepare_v2(db, "DELETE FROM sessions WHERE expires < ?;", -1, &stmt, 0) == SQLITE_OK)
+    {
+        sqlite3_bind_int64(stmt, 1, now);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        remove_matching(now, NULL);
+        last_sweep = now;
+    }
+    sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+    sqlite3_close(db);
+}
+
+void session_format_stats(char *buffer, size_t size)
+{
+    snprintf(buffer, size, "Sessions : %d actives, %lu jetons émis, %lu reconnexions sans mot de passe, %lu jetons refusés, %lu révoqués\n",
+             session_count, issued, resumed, refused, revoked);
+}
@@ -0,0 +1,116 @@
+/**
+ * @file session.h
+ * @brief Short-lived session tokens letting a client log in again without its password.
+ *
+ * Once logged in with its password, a client can ask for a token
+ * (`@SESSION`, answered by `@SESSION <token> <seconds>`). After losing the
+ * connection (a deploy, a network failure), it logs in again by sending
+ * `@RESUME <user> <token>` instead of its credentials: the token is checked
+ * in memory, without the scrypt verification of the password, so a whole
+ * population of clients reconnecting at once does not saturate the
+ * authentication workers.
+ *
+ * Only a SHA-256 digest of each token is kept, in memory and in the
+ * `sessions` table of database.db, so the tokens survive a restart of the
+ * server. A token expires SESSION_TTL_S seconds after the end of the last
+ * connection that used it: a session counts its connections, and never
+ * expires while one of them is open. Issuing a token or extending a session only
+ * changes the memory: session_save() writes the new tokens and the new
+ * expiries in one transaction, SESSION_SAVE_MS after the first change and
+ * when the server stops or restarts. A crash loses the tokens issued during
+ * the last SESSION_SAVE_MS milliseconds; their clients log in again with
+ * their password.
+ *
+ * A connection holds a single token: asking again gives back the same one.
+ */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stddef.h>
+
+#define SESSION_TOKEN_SIZE 49      /**< Size of a token (48 hexadecimal digits) */
+#define SESSION_ID_SIZE 65         /**< Size of the identifier of a session: SHA-256 of its token, in hexadecimal */
+#define SESSION_TTL_S 900          /**< Lifetime of a token after the end of its last connection */
+#define SESSION_BUCKETS 256        /**< Size of the hash table of the sessions */
+#define SESSION_SAVE_MS 1000       /**< Delay before the new tokens and expiries are written to the database */
+
+/**
+ * @brief Creates the `sessions` table if needed and loads the sessions that have not expired.
+ *
+ * @return The number of sessions loaded, -1 on error.
+ */
+int session_init(void);
+
+/**
+ * @brief Issues a new token for a user who logged in with their password.
+ *
+ * The token is only kept in memory until the next session_save().
+ *
+ * @param[in] username The user.
+ * @param[in] is_admin 1 if the user is an admin.
+ * @param[out] token The token to give to the client (SESSION_TOKEN_SIZE bytes).
+ * @param[out] id The identifier of the session, kept by the connection (SESSION_ID_SIZE bytes).
+ * @return 0 on success, -1 on error.
+ */
+int session_issue(const char *username, int is_admin, char *token, char *id);
+
+/**
+ * @brief Checks the token sent by a client that reconnects.
+ *
+ * @param[in] username The user given by the client.
+ * @param[in] token The token given by the client.
+ * @param[out] is_admin Set to 1 if the user is an admin.
+ * @param[out] id The identifier of the session (SESSION_ID_SIZE bytes).
+ * @return 1 if the token is valid for this user, 0 otherwise.
+ */
+int session_resume(const char *username, const char *token, int *is_admin, char *id);
+
+/**
+ * @brief Tells whether a session is still known (not expired and removed, nor revoked).
+ *
+ * @param[in] id The identifier of the session.
+ * @return 1 if the session is known, 0 otherwise.
+ */
+int session_exists(const char *id);
+
+/**
+ * @brief Counts a connection handed over by the previous server process as using its session.
+ *
+ * session_issue() and a successful session_resume() already count the connection.
+ *
+ * @param[in] id The identifier of the session.
+ */
+void session_attach(const char *id);
+
+/**
+ * @brief Releases a session whose connection ends: it stays valid SESSION_TTL_S seconds from now.
+ *
+ * @param[in] id The identifier of the session.
+ */
+void session_extend(const char *id);
+
+/**
+ * @brief Revokes all the sessions of a user (kicked by an admin).
+ *
+ * @param[in] username The user.
+ */
+void session_revoke_user(const char *username);
+
+/**
+ * @brief Writes the tokens issued and the expiries extended since the last save, in one transaction.
+ *
+ * The expired sessions are also removed, at most once every minute; the
+ * expiry of the sessions still in use is extended first.
+ */
+void session_save(void);
+
+/**
+ * @brief Writes the statistics of the sessions.
+ *
+ * @param[out] buffer The buffer receiving the text (one line).
+ * @param[in] size The size of the buffer.
+ */
+void session_format_stats(char *buffer, size_t size);
+
+#endif
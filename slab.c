@@ -0,0 +1,144 @@
+#include "slab.h"
+
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Chaque objet est précédé de l'adresse de son bloc, sur une taille qui garde l'alignement des objets
+#define SLAB_HEADER_SIZE alignof(max_align_t)
+#define SLAB_BLOCK_HEADER ((sizeof(slab_block_t) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1))
+
+void slab_init(slab_t *slab, const char *name, size_t object_size, size_t objects_per_block)
+{
+    slab->name = name;
+    slab->object_size = SLAB_HEADER_SIZE + ((object_size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1));
+    slab->objects_per_block = objects_per_block > 0 ? objects_per_block : 1;
+    slab->partial = NULL;
+    slab->blocks = 0;
+    slab->empty_blocks = 0;
+    slab->in_use = 0;
+    slab->peak = 0;
+    slab->allocations = 0;
+    slab->block_allocations = 0;
+}
+
+static void link_partial(slab_t *slab, slab_block_t *block)
+{
+    block->prev = NULL;
+    block->next = slab->partial;
+    if (slab->partial != NULL)
+    {
+        slab->partial->prev = block;
+    }
+    slab->partial = block;
+}
+
+static void unlink_partial(slab_t *slab, slab_block_t *block)
+{
+    if (block->prev != NULL)
+    {
+        block->prev->next = block->next;
+    }
+    else
+    {
+        slab->partial = block->next;
+    }
+    if (block->next != NULL)
+    {
+        block->next->prev = block->prev;
+    }
+}
+
+static slab_block_t *new_block(slab_t *slab)
+{
+    slab_block_t *block = malloc(SLAB_BLOCK_HEADER + slab->objects_per_block * slab->object_size);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+
+    // Chaîner les objets du bloc dans sa liste libre
+    char *objects = (char *)block + SLAB_BLOCK_HEADER;
+    block->free_list = NULL;
+    block->used = 0;
+    for (size_t i = slab->objects_per_block; i-- > 0;)
+    {
+        char *header = objects + i * slab->object_size;
+        *(slab_block_t **)header = block;
+        void **object = (void **)(header + SLAB_HEADER_SIZE);
+        *object = block->free_list;
+        block->free_list = object;
+    }
+
+    link_partial(slab, block);
+    slab->blocks++;
+    slab->empty_blocks++;
+    slab->block_allocations++;
+    return block;
+}
+
+void *slab_alloc(slab_t *slab)
+{
+    slab_block_t *block = slab->partial;
+    if (block == NULL && (block = new_block(slab)) == NULL)
+    {
+        return NULL;
+    }
+
+    void **object = block->free_list;
+    block->free_list = *object;
+    if (block->used++ == 0)
+    {
+        slab->empty_blocks--;
+    }
+    if (block->free_list == NULL)
+    {
+        unlink_partial(slab, block); // Bloc plein
+    }
+
+    slab->allocations++;
+    if (++slab->in_use > slab->peak)
+    {
+        slab->peak = slab->in_use;
+    }
+    return object;
+}
+
+void slab_free(slab_t *slab, void *object)
+{
+    if (object == NULL)
+    {
+        return;
+    }
+
+    slab_block_t *block = *(slab_block_t **)((char *)object - SLAB_HEADER_SIZE);
+    if (block->free_list == NULL)
+    {
+        link_partial(slab, block); // Le bloc était plein
+    }
+    *(void **)object = block->free_list;
+    block->free_list = object;
+    slab->in_use--;
+
+    if (--block->used == 0)
+    {
+        // Garder un seul bloc vide en réserve, rendre les autres
+        if (slab->empty_blocks > 0)
+        {
+            unlink_partial(slab, block);
+            free(block);
+            slab->blocks--;
+        }
+        else
+        {
+            slab->empty_blocks++;
+        }
+    }
+}
+
+void slab_format_stats(const slab_t *slab, char *buffer, size_t size)
+{
+    snprintf(buffer, size, "%s %zu/%zu (pic %zu, %lu allocations dont %lu blocs)",
+             slab->name, slab->in_use, slab->blocks * slab->objects_per_block, slab->peak,
+             slab->allocations, slab->block_allocations);
+}
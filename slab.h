@@ -0,0 +1,85 @@
+/**
+ * @file slab.h
+ * @brief Slab allocator for objects of a fixed size.
+ *
+ * Objects are carved out of blocks holding a fixed number of them, and a
+ * freed object goes back to the free list of its block instead of the C
+ * allocator: connecting and disconnecting clients, or queueing and sending
+ * messages, reuses the same memory instead of fragmenting the heap.
+ *
+ * A block whose objects are all free is given back to the C allocator, except
+ * one kept in reserve, so a burst does not hold its peak memory forever and
+ * the next burst does not start with an allocation.
+ *
+ * The allocator is not thread-safe: it is used by the event loop only.
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+
+/**
+ * @brief Structure representing a block of objects.
+ */
+typedef struct slab_block
+{
+    struct slab_block *next; /**< Next block with free objects */
+    struct slab_block *prev; /**< Previous block with free objects */
+    void *free_list;         /**< Free objects of the block */
+    size_t used;             /**< Number of objects allocated */
+} slab_block_t;
+
+/**
+ * @brief Structure representing a slab allocator.
+ */
+typedef struct
+{
+    const char *name;           /**< Name shown in the statistics */
+    size_t object_size;         /**< Size of an object, header included */
+    size_t objects_per_block;   /**< Number of objects in a block */
+    slab_block_t *partial;      /**< Blocks with free objects */
+    size_t blocks;              /**< Number of blocks allocated */
+    size_t empty_blocks;        /**< Number of blocks without any object allocated */
+    size_t in_use;              /**< Number of objects allocated */
+    size_t peak;                /**< Highest number of objects allocated at the same time */
+    unsigned long allocations;  /**< Number of calls to slab_alloc() */
+    unsigned long block_allocations; /**< Number of blocks requested from the C allocator */
+} slab_t;
+
+/**
+ * @brief Initializes a slab allocator. No memory is allocated before the first object.
+ *
+ * @param[out] slab The allocator.
+ * @param[in] name The name shown in the statistics.
+ * @param[in] object_size The size of the objects.
+ * @param[in] objects_per_block The number of objects allocated at once.
+ */
+void slab_init(slab_t *slab, const char *name, size_t object_size, size_t objects_per_block);
+
+/**
+ * @brief Allocates an object (not initialized).
+ *
+ * @param[in,out] slab The allocator.
+ * @return The object, or NULL if the memory is exhausted.
+ */
+void *slab_alloc(slab_t *slab);
+
+/**
+ * @brief Gives an object back to its block.
+ *
+ * @param[in,out] slab The allocator that returned the object.
+ * @param[in] object The object, or NULL.
+ */
+void slab_free(slab_t *slab, void *object);
+
+/**
+ * @brief Writes the usage of an allocator.
+ *
+ * @param[in] slab The allocator.
+ * @param[out] buffer The buffer receiving the text (no line break).
+ * @param[in] size The size of the buffer.
+ */
+void slab_format_stats(const slab_t *slab, char *buffer, size_t size);
+
+#endif
@@ -0,0 +1,175 @@
+#include "storage.h"
+
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "archive.h"
+#include "msglog.h"
+
+#define STORAGE_REGISTRY "database.db"
+
+// Opérations d'un moteur ; celles à NULL n'ont rien à faire
+typedef struct
+{
+    const char *name;
+    int (*init)(int retention_days);
+    int (*write)(const storage_message_t *messages, int count);
+    uint64_t (*last_seq)(const char *channel);
+    int (*replay)(const char *channel, uint64_t after, history_emit_fn emit, void *context);
+    int (*search)(const char *channel, const char *pattern, int max, history_emit_fn emit, void *context);
+    void (*apply_retention)(void);
+    void (*forget_channel)(const char *channel);
+    void (*clear)(void);
+    void (*sync)(void);
+    void (*format_stats)(char *buffer, size_t size);
+} storage_engine_t;
+
+// L'archive retrouve les messages d'un salon supprimé au prochain compactage
+static void archive_forget_channel(const char *channel)
+{
+    (void)channel;
+    archive_compact_now();
+}
+
+static const storage_engine_t engines[] = {
+    [STORAGE_SQLITE] = {"sqlite", archive_init, archive_write, archive_last_seq, archive_replay, archive_search,
+                        archive_apply_retention, archive_forget_channel, archive_clear, NULL, archive_format_stats},
+    [STORAGE_LOG] = {"log", msglog_init, msglog_write, msglog_last_seq, msglog_replay, msglog_search,
+                     msglog_apply_retention, msglog_forget_channel, msglog_clear, msglog_sync, msglog_format_stats},
+};
+
+static const storage_engine_t *engine = &engines[STORAGE_SQLITE];
+
+int storage_init(int backend, int retention_days)
+{
+    if (backend != STORAGE_SQLITE && backend != STORAGE_LOG)
+    {
+        return -1;
+    }
+    engine = &engines[backend];
+
+    sqlite3 *db;
+    if (sqlite3_open(STORAGE_REGISTRY, &db) != SQLITE_OK)
+    {
+        fprintf(stderr, "Erreur lors de l'ouverture de la base de données : %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return -1;
+    }
+    // Rétention de chaque salon (échoue sans conséquence si les colonnes existent déjà)
+    sqlite3_exec(db, "ALTER TABLE salons ADD COLUMN retention_days INTEGER NOT NULL DEFAULT 0;", 0, 0, 0);
+    sqlite3_exec(db, "ALTER TABLE salons ADD COLUMN retention_count INTEGER NOT NULL DEFAULT 0;", 0, 0, 0);
+    sqlite3_close(db);
+
+    return engine->init(retention_days);
+}
+
+const char *storage_backend(void)
+{
+    return engine->name;
+}
+
+int storage_write(const storage_message_t *messages, int count)
+{
+    return engine->write(messages, count);
+}
+
+uint64_t storage_last_seq(const char *channel)
+{
+    return engine->last_seq(channel);
+}
+
+int storage_replay(const char *channel, uint64_t after, history_emit_fn emit, void *context)
+{
+    return engine->replay(channel, after, emit, context);
+}
+
+int storage_search(const char *channel, const char *pattern, int max, history_emit_fn emit, void *context)
+{
+    return engine->search(channel, pattern, max, emit, context);
+}
+
+int storage_set_retention(const char *channel, int max_age_days, long max_count)
+{
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    int changed = 0;
+    if (sqlite3_open(STORAGE_REGISTRY, &db) != SQLITE_OK)
+    {
+        sqlite3_close(db);
+        return -1;
+    }
+    sqlite3_busy_timeout(db, 1000);
+    if (sqlite3_prepare_v2(db, "UPDATE salons SET retention_days = ?, retention_count = ? WHERE name = ?;", -1, &stmt, 0) == SQLITE_OK)
+    {
+        sqlite3_bind_int(stmt, 1, max_age_days);
+        sqlite3_bind_int64(stmt, 2, max_count);
+        sqlite3_bind_text(stmt, 3, channel, -1, SQLITE_STATIC);
+        changed = sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(db) == 1;
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    if (!changed)
+    {
+        return -1;
+    }
+    engine->apply_retention();
+    return 0;
+}
+
+int storage_load_retention(storage_retention_t **rules)
+{
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    int count = 0;
+    *rules = NULL;
+    if (sqlite3_open_v2(STORAGE_REGISTRY, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+    {
+        sqlite3_close(db);
+        return 0;
+    }
+    sqlite3_busy_timeout(db, 1000);
+    const char *sql = "SELECT id, name, retention_days, retention_count FROM salons WHERE retention_days > 0 OR retention_count > 0;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) == SQLITE_OK)
+    {
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            storage_retention_t *grown = realloc(*rules, (count + 1) * sizeof(storage_retention_t));
+            if (grown == NULL)
+            {
+                break;
+            }
+            *rules = grown;
+            storage_retention_t *rule = &grown[count++];
+            rule->id = sqlite3_column_int64(stmt, 0);
+            snprintf(rule->channel, sizeof(rule->channel), "%s", (const char *)sqlite3_column_text(stmt, 1));
+            rule->max_age_days = sqlite3_column_int(stmt, 2);
+            rule->max_count = (long)sqlite3_column_int64(stmt, 3);
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return count;
+}
+
+void storage_forget_channel(const char *channel)
+{
+    engine->forget_channel(channel);
+}
+
+void storage_clear(void)
+{
+    engine->clear();
+}
+
+void storage_sync(void)
+{
+    if (engine->sync != NULL)
+    {
+        engine->sync();
+    }
+}
+
+void storage_format_stats(char *buffer, size_t size)
+{
+    engine->format_stats(buffer, size);
+}
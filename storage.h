@@ -0,0 +1,160 @@
+/**
+ * @file storage.h
+ * @brief Persistence of the channel messages, with a choice of storage engine.
+ *
+ * The server writes its message batches, reads the last sequence number of
+ * a channel, replays the missed messages and searches the channels through
+ * this interface only;
+ * the engine is chosen at startup (`--storage`):
+ *
+ * - STORAGE_SQLITE: the SQLite archive split into daily partitions
+ *   (archive.h), which keeps the messages queryable with SQL;
+ * - STORAGE_LOG: an append-only log per channel made of memory-mapped
+ *   segments (msglog.h), for write-heavy workloads: appending a message is
+ *   a copy into the mapping, and the data is synced to disk by a background
+ *   thread for all the batches of an interval at once (group commit).
+ *
+ * The retention of each channel is kept in the channel registry
+ * (database.db) whatever the engine, and applied by the engine.
+ */
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "history.h"
+
+#define STORAGE_SQLITE 0               /**< SQLite archive in daily partitions */
+#define STORAGE_LOG 1                  /**< Append-only log of memory-mapped segments */
+
+#define STORAGE_MESSAGE_SIZE 1024      /**< Size of a message, as BUFFER_SIZE */
+
+/**
+ * @brief Structure representing a message to store.
+ */
+typedef struct
+{
+    char channel[50];                   /**< Channel of the message */
+    char username[50];                  /**< Sender of the message */
+    char message[STORAGE_MESSAGE_SIZE]; /**< Content of the message */
+    char *text;                         /**< Content of a long message (longmsg.h) that does not fit in message, or NULL */
+    uint64_t seq;                       /**< Sequence number of the message in its channel */
+    time_t timestamp;                   /**< Time at which the message was sent */
+} storage_message_t;
+
+/**
+ * @brief Retention of a channel, as read from the registry.
+ */
+typedef struct
+{
+    int64_t id;        /**< Identifier of the channel in database.db */
+    char channel[50];  /**< Name of the channel */
+    int max_age_days;  /**< Age in days after which its messages are removed, 0 for no limit */
+    long max_count;    /**< Number of its most recent messages kept, 0 for no limit */
+} storage_retention_t;
+
+/**
+ * @brief Opens the storage engine and starts its background thread.
+ *
+ * @param[in] backend STORAGE_SQLITE or STORAGE_LOG.
+ * @param[in] retention_days Age in days after which messages are removed from every channel, 0 to keep them forever.
+ * @return 0 on success, -1 on error.
+ */
+int storage_init(int backend, int retention_days);
+
+/**
+ * @brief Returns the name of the engine in use.
+ *
+ * @return "sqlite" or "log".
+ */
+const char *storage_backend(void);
+
+/**
+ * @brief Writes a batch of messages.
+ *
+ * @param[in] messages The messages.
+ * @param[in] count The number of messages.
+ * @return 0 on success, -1 on error.
+ */
+int storage_write(const storage_message_t *messages, int count);
+
+/**
+ * @brief Returns the last sequence number of a channel stored.
+ *
+ * @param[in] channel The channel.
+ * @return The number of its last message, 0 if it has none.
+ */
+uint64_t storage_last_seq(const char *channel);
+
+/**
+ * @brief Sends the stored messages of a channel that follow a sequence number, in order.
+ *
+ * @param[in] channel The channel.
+ * @param[in] after The last number seen by the client.
+ * @param[in] emit The function receiving each message.
+ * @param[in] context The argument given to emit.
+ * @return The number of messages sent.
+ */
+int storage_replay(const char *channel, uint64_t after, history_emit_fn emit, void *context);
+
+/**
+ * @brief Sends the most recent stored messages of a channel that contain a text, from the most recent.
+ *
+ * The text is searched without regard to the case of ASCII letters, in the
+ * message with its "username: " prefix.
+ *
+ * @param[in] channel The channel.
+ * @param[in] pattern The text searched.
+ * @param[in] max The largest number of messages sent.
+ * @param[in] emit The function receiving each message.
+ * @param[in] context The argument given to emit.
+ * @return The number of messages sent.
+ */
+int storage_search(const char *channel, const char *pattern, int max, history_emit_fn emit, void *context);
+
+/**
+ * @brief Sets the retention of a channel in the registry and applies it.
+ *
+ * @param[in] channel The channel.
+ * @param[in] max_age_days Age in days after which its messages are removed, 0 for no limit.
+ * @param[in] max_count Number of its most recent messages kept, 0 for no limit.
+ * @return 0 on success, -1 if the channel does not exist.
+ */
+int storage_set_retention(const char *channel, int max_age_days, long max_count);
+
+/**
+ * @brief Reads the channels that have a retention, for the engines.
+ *
+ * @param[out] rules The array of the rules, to free with free().
+ * @return The number of rules.
+ */
+int storage_load_retention(storage_retention_t **rules);
+
+/**
+ * @brief Forgets the messages of a deleted channel; they are removed in the background.
+ *
+ * @param[in] channel The channel.
+ */
+void storage_forget_channel(const char *channel);
+
+/**
+ * @brief Removes all the stored messages.
+ */
+void storage_clear(void);
+
+/**
+ * @brief Waits until the messages written are on disk (before the server stops or restarts).
+ */
+void storage_sync(void);
+
+/**
+ * @brief Writes the statistics of the engine in use.
+ *
+ * @param[out] buffer The buffer receiving the text (one line).
+ * @param[in] size The size of the buffer.
+ */
+void storage_format_stats(char *buffer, size_t size);
+
+#endif
@@ -0,0 +1,215 @@
+/*
+ * Compare les deux moteurs de storage.h : débit d'écriture des messages, par
+ * lots comme le serveur, et latence de lecture de l'historique.
+ *
+ * Chaque moteur écrit les mêmes messages, répartis dans plusieurs salons, par
+ * lots de MESSAGE_BATCH_SIZE ; la synchronisation sur disque qui suit est
+ * mesurée à part. Les lectures rejouent les REPLAY_MAX derniers messages
+ * d'un salon tiré au hasard, comme pour un client qui revient après une
+ * longue absence.
+ *
+ * Le banc travaille dans un dossier temporaire, avec sa propre database.db,
+ * supprimé à la fin.
+ *
+ * Usage : storage_bench.exe [--messages n] [--channels n] [--reads n] [--seed n]
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <sqlite3.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "storage.h"
+
+#define BATCH_SIZE 64   // MESSAGE_BATCH_SIZE du serveur
+#define REPLAY_COUNT 200 // REPLAY_MAX du serveur
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Taille d'un message : 60 % de 5 à 40 octets, 30 % jusqu'à 200, 9 % jusqu'à 600, 1 % jusqu'à 1000
+static size_t message_size(void)
+{
+    int r = rand() % 100;
+    if (r < 60)
+    {
+        return 5 + rand() % 36;
+    }
+    if (r < 90)
+    {
+        return 40 + rand() % 161;
+    }
+    if (r < 99)
+    {
+        return 200 + rand() % 401;
+    }
+    return 600 + rand() % 401;
+}
+
+static storage_message_t *generate_messages(int count, int channels)
+{
+    static const char words[] = "bonjour salut le salon fichier message serveur demain merci voila ";
+    storage_message_t *messages = calloc(count, sizeof(storage_message_t));
+    uint64_t *seqs = calloc(channels, sizeof(uint64_t));
+    time_t now = time(NULL);
+    for (int i = 0; i < count; i++)
+    {
+        int channel = rand() % channels;
+        storage_message_t *message = &messages[i];
+        snprintf(message->channel, sizeof(message->channel), "salon%d", channel);
+        snprintf(message->username, sizeof(message->username), "user%d", rand() % 100);
+        int header = snprintf(message->message, sizeof(message->message), "%s: ", message->username);
+        size_t size = message_size();
+        for (size_t j = 0; j < size; j++)
+        {
+            message->message[header + j] = words[(i + j) % (sizeof(words) - 1)];
+        }
+        message->message[header + size] = '\n';
+        message->seq = ++seqs[channel];
+        message->timestamp = now;
+    }
+    free(seqs);
+    return messages;
+}
+
+static void count_message(void *context, uint64_t seq, const char *message, size_t len)
+{
+    (void)seq;
+    (void)message;
+    (void)len;
+    (*(int *)context)++;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int measure(int backend, const storage_message_t *messages, int count, int channels, int reads)
+{
+    if (storage_init(backend, 0) < 0)
+    {
+        return -1;
+    }
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < count; i += BATCH_SIZE)
+    {
+        if (storage_write(messages + i, count - i < BATCH_SIZE ? count - i : BATCH_SIZE) < 0)
+        {
+            fprintf(stderr, "%s : échec de l'écriture.\n", storage_backend());
+            return -1;
+        }
+    }
+    uint64_t written = now_ns();
+    storage_sync();
+    uint64_t synced = now_ns();
+
+    uint64_t *latencies = malloc(reads * sizeof(uint64_t));
+    long replayed = 0;
+    for (int r = 0; r < reads; r++)
+    {
+        char channel[50];
+        snprintf(channel, sizeof(channel), "salon%d", rand() % channels);
+        uint64_t last = storage_last_seq(channel);
+        uint64_t after = last > REPLAY_COUNT ? last - REPLAY_COUNT : 0;
+        int received = 0;
+        uint64_t before = now_ns();
+        storage_replay(channel, after, count_message, &received);
+        latencies[r] = now_ns() - before;
+        replayed += received;
+    }
+    qsort(latencies, reads, sizeof(uint64_t), compare_u64);
+
+    printf("%-8s %10.0f messages/s  synchronisation %7.1f ms  lecture : médiane %7.1f µs, p99 %7.1f µs (%.0f messages par lecture)\n",
+           storage_backend(), count / ((written - start) / 1e9), (synced - written) / 1e6, latencies[reads / 2] / 1e3,
+           latencies[reads * 99 / 100] / 1e3, (double)replayed / reads);
+    free(latencies);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int messages = 200000;
+    int channels = 20;
+    int reads = 500;
+    unsigned seed = 1;
+
+    static struct option long_options[] = {
+        {"messages", required_argument, 0, 'm'},
+        {"channels", required_argument, 0, 'c'},
+        {"reads", required_argument, 0, 'r'},
+        {"seed", required_argument, 0, 's'},
+        {0, 0, 0, 0}};
+    int opt;
+    while ((opt = getopt_long(argc, argv, "m:c:r:s:", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            messages = atoi(optarg);
+            break;
+        case 'c':
+            channels = atoi(optarg);
+            break;
+        case 'r':
+            reads = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage : %s [--messages n] [--channels n] [--reads n] [--seed n]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (messages <= 0 || channels <= 0 || reads <= 0)
+    {
+        fprintf(stderr, "Usage : %s [--messages n] [--channels n] [--reads n] [--seed n]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Dossier de travail avec un registre des salons vide
+    char directory[] = "/tmp/storage_bench.XXXXXX";
+    if (mkdtemp(directory) == NULL || chdir(directory) < 0)
+    {
+        perror("Erreur lors de la création du dossier de travail");
+        return EXIT_FAILURE;
+    }
+    sqlite3 *db;
+    if (sqlite3_open("database.db", &db) != SQLITE_OK ||
+        sqlite3_exec(db, "CREATE TABLE salons (id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT UNIQUE NOT NULL);", 0, 0, 0) != SQLITE_OK)
+    {
+        fprintf(stderr, "Erreur lors de la création du registre : %s\n", sqlite3_errmsg(db));
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < channels; i++)
+    {
+        char sql[128];
+        snprintf(sql, sizeof(sql), "INSERT INTO salons (name) VALUES ('salon%d');", i);
+        sqlite3_exec(db, sql, 0, 0, 0);
+    }
+    sqlite3_close(db);
+
+    srand(seed);
+    storage_message_t *batch = generate_messages(messages, channels);
+    printf("%d messages dans %d salons, lots de %d, %d lectures de %d messages, dans %s :\n", messages, channels, BATCH_SIZE,
+           reads, REPLAY_COUNT, directory);
+
+    int status = measure(STORAGE_SQLITE, batch, messages, channels, reads) == 0 && measure(STORAGE_LOG, batch, messages, channels, reads) == 0;
+    free(batch);
+
+    char command[128];
+    snprintf(command, sizeof(command), "rm -rf %s", directory);
+    system(command);
+    return status ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,175 @@
+#include "timer_wheel.h"
+
+#include <stddef.h>
+
+#define SLOT_MASK (TIMER_SLOTS - 1)
+
+static int is_scheduled(const wheel_timer_t *timer)
+{
+    return timer->next != NULL;
+}
+
+static void unlink_timer(wheel_timer_t *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+// Place le minuteur au niveau le plus bas dont la fenêtre contient son échéance.
+// `earliest` est le premier tick encore à traiter.
+static void insert_timer(timer_wheel_t *wheel, wheel_timer_t *timer, uint64_t earliest)
+{
+    uint64_t expires = timer->expires;
+    if (expires < earliest)
+    {
+        expires = earliest; // Déjà échu : il sera exécuté dès que possible
+    }
+
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 &&
+           (expires >> (level * TIMER_SLOT_BITS)) - (wheel->current >> (level * TIMER_SLOT_BITS)) >= TIMER_SLOTS)
+    {
+        level++;
+    }
+
+    // Au-delà du dernier niveau, l'échéance est ramenée à la fin de la roue
+    uint64_t index = expires >> (level * TIMER_SLOT_BITS);
+    uint64_t current_index = wheel->current >> (level * TIMER_SLOT_BITS);
+    if (index - current_index >= TIMER_SLOTS)
+    {
+        index = current_index + TIMER_SLOTS - 1;
+    }
+
+    wheel_timer_t *head = &wheel->slots[level][index & SLOT_MASK];
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+void timer_wheel_init(timer_wheel_t *wheel, uint64_t now_ms)
+{
+    for (int level = 0; level < TIMER_LEVELS; level++)
+    {
+        for (int slot = 0; slot < TIMER_SLOTS; slot++)
+        {
+            wheel->slots[level][slot].next = &wheel->slots[level][slot];
+            wheel->slots[level][slot].prev = &wheel->slots[level][slot];
+        }
+    }
+    wheel->current = now_ms / TIMER_TICK_MS;
+    wheel->count = 0;
+}
+
+void timer_init(wheel_timer_t *timer, void (*callback)(wheel_timer_t *), void *data)
+{
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->expires = 0;
+    timer->callback = callback;
+    timer->data = data;
+}
+
+void timer_schedule(timer_wheel_t *wheel, wheel_timer_t *timer, uint64_t expires_ms)
+{
+    if (is_scheduled(timer))
+    {
+        unlink_timer(timer);
+    }
+    else
+    {
+        wheel->count++;
+    }
+    timer->expires = (expires_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS; // Arrondi au tick supérieur
+    insert_timer(wheel, timer, wheel->current + 1);
+}
+
+void timer_cancel(timer_wheel_t *wheel, wheel_timer_t *timer)
+{
+    if (is_scheduled(timer))
+    {
+        unlink_timer(timer);
+        wheel->count--;
+    }
+}
+
+// Redistribue les minuteurs d'un emplacement vers les niveaux inférieurs
+static void cascade(timer_wheel_t *wheel, int level)
+{
+    int slot = (wheel->current >> (level * TIMER_SLOT_BITS)) & SLOT_MASK;
+    wheel_timer_t *head = &wheel->slots[level][slot];
+    if (head->next == head)
+    {
+        return;
+    }
+
+    // Détacher la liste entière avant de la réinsérer
+    wheel_timer_t *timer = head->next;
+    head->prev->next = NULL;
+    head->next = head;
+    head->prev = head;
+
+    while (timer != NULL)
+    {
+        wheel_timer_t *next = timer->next;
+        insert_timer(wheel, timer, wheel->current); // Le tick courant n'a pas encore été traité
+        timer = next;
+    }
+}
+
+void timer_wheel_advance(timer_wheel_t *wheel, uint64_t now_ms)
+{
+    uint64_t target = now_ms / TIMER_TICK_MS;
+
+    while (wheel->current < target)
+    {
+        wheel->current++;
+
+        // Les niveaux supérieurs sont redescendus lorsque le niveau du dessous fait un tour complet
+        int level = 1;
+        while (level < TIMER_LEVELS &&
+               ((wheel->current >> ((level - 1) * TIMER_SLOT_BITS)) & SLOT_MASK) == 0)
+        {
+            level++;
+        }
+        for (int l = level - 1; l >= 1; l--)
+        {
+            cascade(wheel, l);
+        }
+
+        // Exécuter les minuteurs échus
+        wheel_timer_t *head = &wheel->slots[0][wheel->current & SLOT_MASK];
+        while (head->next != head)
+        {
+            wheel_timer_t *timer = head->next;
+            unlink_timer(timer);
+            wheel->count--;
+            timer->callback(timer); // Le rappel peut reprogrammer le minuteur
+        }
+    }
+}
+
+int timer_wheel_timeout(const timer_wheel_t *wheel, uint64_t now_ms)
+{
+    if (wheel->count == 0)
+    {
+        return -1;
+    }
+
+    // Chercher le prochain emplacement occupé du premier niveau
+    uint64_t ticks = TIMER_SLOTS - (wheel->current & SLOT_MASK); // Au pire, jusqu'à la prochaine redescente
+    for (uint64_t i = 1; i < TIMER_SLOTS; i++)
+    {
+        const wheel_timer_t *head = &wheel->slots[0][(wheel->current + i) & SLOT_MASK];
+        if (head->next != head)
+        {
+            ticks = i < ticks ? i : ticks;
+            break;
+        }
+    }
+
+    uint64_t deadline_ms = (wheel->current + ticks) * TIMER_TICK_MS;
+    return deadline_ms > now_ms ? (int)(deadline_ms - now_ms) : 0;
+}
@@ -0,0 +1,98 @@
+/**
+ * @file timer_wheel.h
+ * @brief Hierarchical timing wheel driven by the server event loop.
+ *
+ * Timers are kept in 4 levels of 64 slots. Scheduling and cancelling a timer
+ * cost O(1), and each tick only looks at one slot of the first level; the
+ * timers of the upper levels are moved down ("cascaded") when the lower
+ * level wraps around. With a tick of TIMER_TICK_MS milliseconds, the first
+ * level covers 6.4 seconds and the last one about 19 days.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+#define TIMER_TICK_MS 100   /**< Duration of a tick in milliseconds */
+#define TIMER_LEVELS 4      /**< Number of levels of the wheel */
+#define TIMER_SLOT_BITS 6   /**< Number of bits of the slot index */
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS) /**< Number of slots per level */
+
+/**
+ * @brief Structure representing a timer.
+ *
+ * The structure is meant to be embedded in the object it belongs to, so the
+ * wheel never allocates memory.
+ */
+typedef struct wheel_timer
+{
+    struct wheel_timer *next;                   /**< Next timer in the slot */
+    struct wheel_timer *prev;                   /**< Previous timer in the slot */
+    uint64_t expires;                           /**< Expiration time in ticks */
+    void (*callback)(struct wheel_timer *timer); /**< Function called when the timer expires */
+    void *data;                                 /**< User data of the callback */
+} wheel_timer_t;
+
+/**
+ * @brief Structure representing the timing wheel.
+ */
+typedef struct
+{
+    wheel_timer_t slots[TIMER_LEVELS][TIMER_SLOTS]; /**< Sentinels of the slot lists */
+    uint64_t current;                               /**< Current time in ticks */
+    int count;                                      /**< Number of scheduled timers */
+} timer_wheel_t;
+
+/**
+ * @brief Initializes a timing wheel.
+ *
+ * @param[out] wheel The wheel to initialize.
+ * @param[in] now_ms The current monotonic time in milliseconds.
+ */
+void timer_wheel_init(timer_wheel_t *wheel, uint64_t now_ms);
+
+/**
+ * @brief Initializes a timer, not scheduled.
+ *
+ * @param[out] timer The timer to initialize.
+ * @param[in] callback The function called when the timer expires.
+ * @param[in] data The user data of the callback.
+ */
+void timer_init(wheel_timer_t *timer, void (*callback)(wheel_timer_t *), void *data);
+
+/**
+ * @brief Schedules (or reschedules) a timer.
+ *
+ * @param[in,out] wheel The wheel.
+ * @param[in,out] timer The timer.
+ * @param[in] expires_ms The monotonic time of expiration in milliseconds.
+ */
+void timer_schedule(timer_wheel_t *wheel, wheel_timer_t *timer, uint64_t expires_ms);
+
+/**
+ * @brief Cancels a timer. Cancelling a timer that is not scheduled does nothing.
+ *
+ * @param[in,out] wheel The wheel.
+ * @param[in,out] timer The timer.
+ */
+void timer_cancel(timer_wheel_t *wheel, wheel_timer_t *timer);
+
+/**
+ * @brief Advances the wheel and runs the expired timers.
+ *
+ * @param[in,out] wheel The wheel.
+ * @param[in] now_ms The current monotonic time in milliseconds.
+ */
+void timer_wheel_advance(timer_wheel_t *wheel, uint64_t now_ms);
+
+/**
+ * @brief Computes how long the event loop can sleep before the next tick with work.
+ *
+ * @param[in] wheel The wheel.
+ * @param[in] now_ms The current monotonic time in milliseconds.
+ * @return The delay in milliseconds, or -1 if no timer is scheduled.
+ */
+int timer_wheel_timeout(const timer_wheel_t *wheel, uint64_t now_ms);
+
+#endif
@@ -0,0 +1,466 @@
+#include "transport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+static SSL_CTX *tls_ctx = NULL;           // Contexte TLS (client ou serveur)
+static SSL **sessions = NULL;             // Session TLS associée à chaque descripteur
+static int sessions_size = 0;             // Taille du tableau des sessions
+static SSL_SESSION *saved_session = NULL; // Dernier ticket de session reçu (client)
+static const char *session_path = NULL;   // Fichier de sauvegarde du ticket (client)
+
+static SSL *session_of(int fd)
+{
+    if (fd < 0 || fd >= sessions_size)
+    {
+        return NULL;
+    }
+    return sessions[fd];
+}
+
+static int attach_session(int fd, SSL *ssl)
+{
+    if (fd >= sessions_size)
+    {
+        int new_size = sessions_size > 0 ? sessions_size : 64;
+        while (new_size <= fd)
+        {
+            new_size *= 2;
+        }
+        SSL **grown = realloc(sessions, new_size * sizeof(SSL *));
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        memset(grown + sessions_size, 0, (new_size - sessions_size) * sizeof(SSL *));
+        sessions = grown;
+        sessions_size = new_size;
+    }
+    sessions[fd] = ssl;
+    return 0;
+}
+
+static void print_tls_errors(const char *context)
+{
+    unsigned long err;
+    fprintf(stderr, "%s\n", context);
+    while ((err = ERR_get_error()) != 0)
+    {
+        char message[256];
+        ERR_error_string_n(err, message, sizeof(message));
+        fprintf(stderr, "  %s\n", message);
+    }
+}
+
+// Appelée par OpenSSL à chaque ticket de session reçu du serveur
+static int on_new_session(SSL *ssl, SSL_SESSION *session)
+{
+    (void)ssl;
+    if (saved_session != NULL)
+    {
+        SSL_SESSION_free(saved_session);
+    }
+    saved_session = session; // On garde la référence transmise par OpenSSL
+
+    if (session_path != NULL)
+    {
+        FILE *file = fopen(session_path, "w");
+        if (file != NULL)
+        {
+            PEM_write_SSL_SESSION(file, session);
+            fclose(file);
+        }
+    }
+    return 1;
+}
+
+int transport_server_init(const char *cert_file, const char *key_file)
+{
+    tls_ctx = SSL_CTX_new(TLS_server_method());
+    if (tls_ctx == NULL)
+    {
+        print_tls_errors("Impossible de créer le contexte TLS");
+        return -1;
+    }
+
+    SSL_CTX_set_min_proto_version(tls_ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(tls_ctx, SSL_OP_ENABLE_KTLS | SSL_OP_IGNORE_UNEXPECTED_EOF);
+
+    // Sockets non bloquants : écritures partielles, reprises depuis la file d'envoi du client
+    SSL_CTX_set_mode(tls_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    // Tickets de session : la reprise évite un échange de clés complet à la reconnexion
+    SSL_CTX_set_session_cache_mode(tls_ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_session_id_context(tls_ctx, (const unsigned char *)"slime", 5);
+    SSL_CTX_set_num_tickets(tls_ctx, 1);
+
+    if (SSL_CTX_use_certificate_chain_file(tls_ctx, cert_file) != 1 ||
+        SSL_CTX_use_PrivateKey_file(tls_ctx, key_file, SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(tls_ctx) != 1)
+    {
+        print_tls_errors("Impossible de charger le certificat ou la clé du serveur");
+        SSL_CTX_free(tls_ctx);
+        tls_ctx = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+int transport_client_init(const char *ca_file, const char *session_file)
+{
+    tls_ctx = SSL_CTX_new(TLS_client_method());
+    if (tls_ctx == NULL)
+    {
+        print_tls_errors("Impossible de créer le contexte TLS");
+        return -1;
+    }
+
+    SSL_CTX_set_min_proto_version(tls_ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(tls_ctx, SSL_OP_ENABLE_KTLS | SSL_OP_IGNORE_UNEXPECTED_EOF);
+
+    // Le mode batch écrit sur un socket non bloquant, comme le serveur
+    SSL_CTX_set_mode(tls_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    if (ca_file != NULL)
+    {
+        if (SSL_CTX_load_verify_locations(tls_ctx, ca_file, NULL) != 1)
+        {
+            print_tls_errors("Impossible de charger le certificat de confiance");
+            SSL_CTX_free(tls_ctx);
+            tls_ctx = NULL;
+            return -1;
+        }
+        SSL_CTX_set_verify(tls_ctx, SSL_VERIFY_PEER, NULL);
+    }
+    else
+    {
+        fprintf(stderr, "Attention : le certificat du serveur ne sera pas vérifié.\n");
+        SSL_CTX_set_verify(tls_ctx, SSL_VERIFY_NONE, NULL);
+    }
+
+    // Conserver les tickets de session côté client pour les reconnexions
+    SSL_CTX_set_session_cache_mode(tls_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(tls_ctx, on_new_session);
+
+    session_path = session_file;
+    if (session_path != NULL)
+    {
+        FILE *file = fopen(session_path, "r");
+        if (file != NULL)
+        {
+            saved_session = PEM_read_SSL_SESSION(file, NULL, NULL, NULL);
+            fclose(file);
+        }
+    }
+
+    return 0;
+}
+
+bool transport_enabled(void)
+{
+    return tls_ctx != NULL;
+}
+
+// Traduit une erreur OpenSSL en errno : EAGAIN si l'opération doit être réessayée
+static void set_errno_from_ssl(SSL *ssl, int ret)
+{
+    int err = SSL_get_error(ssl, ret);
+    errno = (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) ? EAGAIN : EIO;
+}
+
+int transport_accept(int fd)
+{
+    if (tls_ctx == NULL)
+    {
+        return 0;
+    }
+
+    SSL *ssl = SSL_new(tls_ctx);
+    if (ssl == NULL || SSL_set_fd(ssl, fd) != 1)
+    {
+        print_tls_errors("Impossible de créer la session TLS");
+        SSL_free(ssl);
+        return -1;
+    }
+
+    if (attach_session(fd, ssl) < 0)
+    {
+        SSL_free(ssl);
+        return -1;
+    }
+
+    return transport_handshake(fd);
+}
+
+int transport_handshake(int fd)
+{
+    SSL *ssl = session_of(fd);
+    if (ssl == NULL)
+    {
+        return 0;
+    }
+
+    int ret = SSL_accept(ssl);
+    if (ret != 1)
+    {
+        int err = SSL_get_error(ssl, ret);
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+        {
+            return 1; // Le client n'a pas encore tout envoyé : on reprendra plus tard
+        }
+        print_tls_errors("Échec de la négociation TLS");
+        return -1;
+    }
+
+    printf("Connexion TLS établie (%s%s%s).\n", SSL_get_version(ssl),
+           SSL_session_reused(ssl) ? ", session reprise" : "",
+           transport_is_ktls(fd) ? ", kTLS" : "");
+    return 0;
+}
+
+int transport_connect(int fd, const char *host)
+{
+    if (tls_ctx == NULL)
+    {
+        return 0;
+    }
+
+    SSL *ssl = SSL_new(tls_ctx);
+    if (ssl == NULL || SSL_set_fd(ssl, fd) != 1)
+    {
+        print_tls_errors("Impossible de créer la session TLS");
+        SSL_free(ssl);
+        return -1;
+    }
+
+    // Vérifier que le certificat correspond bien au serveur contacté
+    struct in_addr addr;
+    if (inet_pton(AF_INET, host, &addr) == 1)
+    {
+        X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), host);
+    }
+    else
+    {
+        SSL_set_tlsext_host_name(ssl, host);
+        SSL_set1_host(ssl, host);
+    }
+
+    if (saved_session != NULL)
+    {
+        SSL_set_session(ssl, saved_session);
+    }
+
+    if (SSL_connect(ssl) != 1)
+    {
+        print_tls_errors("Échec de la négociation TLS");
+        SSL_free(ssl);
+        return -1;
+    }
+
+    if (attach_session(fd, ssl) < 0)
+    {
+        SSL_free(ssl);
+        return -1;
+    }
+
+    printf("Connexion TLS établie (%s%s).\n", SSL_get_version(ssl),
+           SSL_session_reused(ssl) ? ", session reprise" : "");
+    return 0;
+}
+
+ssize_t transport_send(int fd, const void *buf, size_t len)
+{
+    SSL *ssl = session_of(fd);
+    if (ssl == NULL)
+    {
+        return send(fd, buf, len, MSG_NOSIGNAL);
+    }
+
+    size_t written = 0;
+    int ret = SSL_write_ex(ssl, buf, len, &written);
+    if (ret != 1)
+    {
+        set_errno_from_ssl(ssl, ret);
+        return -1;
+    }
+    return written;
+}
+
+ssize_t transport_sendv(int fd, const struct iovec *iov, int count)
+{
+    SSL *ssl = session_of(fd);
+    if (ssl == NULL)
+    {
+        struct msghdr msg = {.msg_iov = (struct iovec *)iov, .msg_iovlen = count};
+        return sendmsg(fd, &msg, MSG_NOSIGNAL);
+    }
+
+    // TLS : un enregistrement par tampon, jusqu'à ce que le socket soit plein
+    ssize_t total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        ssize_t written = transport_send(fd, iov[i].iov_base, iov[i].iov_len);
+        if (written < 0)
+        {
+            return total > 0 ? total : -1;
+        }
+        total += written;
+        if ((size_t)written < iov[i].iov_len)
+        {
+            break;
+        }
+    }
+    return total;
+}
+
+ssize_t transport_recvv(int fd, const struct iovec *iov, int count)
+{
+    if (session_of(fd) != NULL || count == 1)
+    {
+        return transport_recv(fd, iov[0].iov_base, iov[0].iov_len);
+    }
+    return readv(fd, iov, count);
+}
+
+ssize_t transport_recv(int fd, void *buf, size_t len)
+{
+    SSL *ssl = session_of(fd);
+    if (ssl == NULL)
+    {
+        return recv(fd, buf, len, 0);
+    }
+
+    size_t received = 0;
+    int ret = SSL_read_ex(ssl, buf, len, &received);
+    if (ret != 1)
+    {
+        int err = SSL_get_error(ssl, ret);
+        if (err == SSL_ERROR_ZERO_RETURN)
+        {
+            return 0; // Le pair a fermé proprement la session
+        }
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+        {
+            errno = EAGAIN; // Enregistrement TLS incomplet (socket non bloquant)
+            return -1;
+        }
+        // Une fermeture brutale est traitée comme une déconnexion, comme avec recv
+        return err == SSL_ERROR_SYSCALL && errno == 0 ? 0 : -1;
+    }
+    return received;
+}
+
+ssize_t transport_sendfile(int fd, int file_fd, off_t offset, size_t len)
+{
+    SSL *ssl = session_of(fd);
+    size_t sent = 0;
+
+    if (ssl == NULL)
+    {
+        // Copie directe du cache de pages vers le socket
+        while (sent < len)
+        {
+            ssize_t n = sendfile(fd, file_fd, &offset, len - sent);
+            if (n <= 0)
+            {
+                if (n == 0)
+                {
+                    errno = EIO; // Le fichier est plus court que prévu
+                }
+                return sent > 0 ? (ssize_t)sent : -1;
+            }
+            sent += n;
+        }
+        return sent;
+    }
+
+    if (transport_is_ktls(fd))
+    {
+        // Le noyau chiffre lui-même : sendfile reste possible
+        while (sent < len)
+        {
+            ossl_ssize_t n = SSL_sendfile(ssl, file_fd, offset, len - sent, 0);
+            if (n <= 0)
+            {
+                set_errno_from_ssl(ssl, n);
+                return sent > 0 ? (ssize_t)sent : -1;
+            }
+            offset += n;
+            sent += n;
+        }
+        return sent;
+    }
+
+    // Sans kTLS, lecture par blocs et chiffrement en espace utilisateur
+    char *chunk = malloc(TRANSPORT_CHUNK_SIZE);
+    if (chunk == NULL)
+    {
+        return -1;
+    }
+    while (sent < len)
+    {
+        size_t to_read = len - sent < TRANSPORT_CHUNK_SIZE ? len - sent : TRANSPORT_CHUNK_SIZE;
+        ssize_t n = pread(file_fd, chunk, to_read, offset);
+        if (n <= 0)
+        {
+            if (n == 0)
+            {
+                errno = EIO; // Le fichier est plus court que prévu
+            }
+            break;
+        }
+        ssize_t written = transport_send(fd, chunk, n);
+        if (written <= 0)
+        {
+            break;
+        }
+        offset += written;
+        sent += written;
+        if (written < n)
+        {
+            break; // Écriture partielle : le socket est plein
+        }
+    }
+    free(chunk);
+    return sent > 0 || len == 0 ? (ssize_t)sent : -1;
+}
+
+bool transport_is_ktls(int fd)
+{
+    SSL *ssl = session_of(fd);
+    return ssl != NULL && BIO_get_ktls_send(SSL_get_wbio(ssl));
+}
+
+bool transport_copies_files(int fd)
+{
+    return session_of(fd) != NULL && !transport_is_ktls(fd);
+}
+
+bool transport_pending(int fd)
+{
+    SSL *ssl = session_of(fd);
+    return ssl != NULL && SSL_pending(ssl) > 0;
+}
+
+void transport_close(int fd)
+{
+    SSL *ssl = session_of(fd);
+    if (ssl != NULL)
+    {
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+        sessions[fd] = NULL;
+    }
+    close(fd);
+}
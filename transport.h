@@ -0,0 +1,189 @@
+/**
+ * @file transport.h
+ * @brief Optional TLS transport shared by the client and the server.
+ *
+ * This file contains the prototypes of the transport layer. Every socket
+ * read or write goes through these functions: when TLS is enabled on a
+ * socket the data is encrypted with OpenSSL, otherwise the plain `send` and
+ * `recv` system calls are used. Session tickets allow cheap reconnections
+ * and kernel TLS (kTLS) is used when available so that file transfers keep
+ * the `sendfile` zero-copy path under encryption.
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define TRANSPORT_CHUNK_SIZE 65536 /**< Chunk size used when a file cannot be sent with sendfile */
+
+/**
+ * @brief Initializes the server TLS context.
+ *
+ * This function loads the certificate and private key of the server and
+ * enables session tickets and kTLS. Once called, every socket passed to
+ * transport_accept() is protected by TLS.
+ *
+ * @param[in] cert_file The PEM certificate of the server.
+ * @param[in] key_file The PEM private key of the server.
+ * @return 0 on success, -1 on error.
+ */
+int transport_server_init(const char *cert_file, const char *key_file);
+
+/**
+ * @brief Initializes the client TLS context.
+ *
+ * This function prepares the client TLS context. If a CA file is given, the
+ * server certificate is verified against it (a self-signed certificate can
+ * be used as its own CA). If a session file is given, the session ticket
+ * received from the server is saved in it and reused on the next connection.
+ *
+ * @param[in] ca_file The PEM file of the trusted certificates, or NULL to skip verification.
+ * @param[in] session_file The file in which the session ticket is kept, or NULL.
+ * @return 0 on success, -1 on error.
+ */
+int transport_client_init(const char *ca_file, const char *session_file);
+
+/**
+ * @brief Checks if TLS has been initialized.
+ *
+ * @return true if transport_server_init() or transport_client_init() succeeded.
+ */
+bool transport_enabled(void);
+
+/**
+ * @brief Starts the server side of the TLS handshake on an accepted socket.
+ *
+ * This function does nothing if TLS is not enabled. On a non-blocking socket 
+ * the handshake may not complete at once; it is then continued with 
+ * transport_handshake() when the socket becomes readable.
+ *
+ * @param[in] fd The accepted socket.
+ * @return 0 if the handshake is complete, 1 if it is in progress, -1 if it failed.
+ */
+int transport_accept(int fd);
+
+/**
+ * @brief Continues the server side of the TLS handshake.
+ *
+ * @param[in] fd The accepted socket.
+ * @return 0 if the handshake is complete, 1 if it is still in progress, -1 if it failed.
+ */
+int transport_handshake(int fd);
+
+/**
+ * @brief Performs the client side of the TLS handshake on a connected socket.
+ *
+ * This function does nothing if TLS is not enabled. The saved session, if
+ * any, is offered to the server to resume the previous session.
+ *
+ * @param[in] fd The connected socket.
+ * @param[in] host The name or address of the server, used to verify its certificate.
+ * @return 0 on success, -1 if the handshake failed.
+ */
+int transport_connect(int fd, const char *host);
+
+/**
+ * @brief Sends data on a socket.
+ *
+ * @param[in] fd The socket.
+ * @param[in] buf The data to send.
+ * @param[in] len The length of the data.
+ * @return The number of bytes sent, or -1 on error (errno is set to EAGAIN 
+ *         if a non-blocking socket is full).
+ */
+ssize_t transport_send(int fd, const void *buf, size_t len);
+
+/**
+ * @brief Receives data from a socket.
+ *
+ * @param[in] fd The socket.
+ * @param[out] buf The buffer receiving the data.
+ * @param[in] len The size of the buffer.
+ * @return The number of bytes received, 0 if the peer closed the connection, or -1 on error 
+ *         (errno is set to EAGAIN if no data is available on a non-blocking socket).
+ */
+ssize_t transport_recv(int fd, void *buf, size_t len);
+
+/**
+ * @brief Sends several buffers on a socket, in order.
+ *
+ * This function uses a single `sendmsg` (gather write) on plain sockets; on 
+ * TLS sockets the buffers are encrypted one after the other, until the 
+ * socket is full.
+ *
+ * @param[in] fd The socket.
+ * @param[in] iov The buffers.
+ * @param[in] count The number of buffers.
+ * @return The number of bytes sent, which is less than the total if a non-blocking 
+ *         socket is full, or -1 on error (errno is set to EAGAIN if nothing was sent).
+ */
+ssize_t transport_sendv(int fd, const struct iovec *iov, int count);
+
+/**
+ * @brief Receives data from a socket into several buffers, in order.
+ *
+ * This function uses a single `readv` (scatter read) on plain sockets; on 
+ * TLS sockets only the first buffer is filled.
+ *
+ * @param[in] fd The socket.
+ * @param[out] iov The buffers.
+ * @param[in] count The number of buffers.
+ * @return The number of bytes received, 0 if the peer closed the connection, or -1 on error 
+ *         (errno is set to EAGAIN if no data is available on a non-blocking socket).
+ */
+ssize_t transport_recvv(int fd, const struct iovec *iov, int count);
+
+/**
+ * @brief Sends a part of a file on a socket.
+ *
+ * This function uses `sendfile` on plain sockets and `SSL_sendfile` on TLS
+ * sockets offloaded to the kernel. Otherwise the file is read by chunks and
+ * encrypted in user space.
+ *
+ * @param[in] fd The socket.
+ * @param[in] file_fd The file to send.
+ * @param[in] offset The offset of the first byte to send.
+ * @param[in] len The number of bytes to send.
+ * @return The number of bytes sent, which is less than len if a non-blocking 
+ *         socket is full, or -1 on error.
+ */
+ssize_t transport_sendfile(int fd, int file_fd, off_t offset, size_t len);
+
+/**
+ * @brief Checks if the sending side of a socket is offloaded to kernel TLS.
+ *
+ * @param[in] fd The socket.
+ * @return true if kTLS is used for sending on this socket.
+ */
+bool transport_is_ktls(int fd);
+
+/**
+ * @brief Checks if files sent on a socket go through user space (TLS without kTLS).
+ *
+ * @param[in] fd The socket.
+ * @return true if transport_sendfile() reads and encrypts the file in user space.
+ */
+bool transport_copies_files(int fd);
+
+/**
+ * @brief Checks if decrypted data is waiting in the TLS session of a socket.
+ *
+ * Such data was already read from the socket, so poll() does not report it.
+ *
+ * @param[in] fd The socket.
+ * @return true if transport_recv() can return data without reading the socket.
+ */
+bool transport_pending(int fd);
+
+/**
+ * @brief Closes a socket and releases its TLS session.
+ *
+ * @param[in] fd The socket to close.
+ */
+void transport_close(int fd);
+
+#endif
@@ -0,0 +1,26 @@
+#include "util.h"
+
+#include <time.h>
+
+uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t monotonic_ms(void)
+{
+    return monotonic_ns() / 1000000;
+}
+
+unsigned int hash_string(const char *text)
+{
+    // FNV-1a
+    unsigned int hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++)
+    {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,33 @@
+/**
+ * @file util.h
+ * @brief Small helpers shared by the modules: monotonic clock and string hash.
+ */
+
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stdint.h>
+
+/**
+ * @brief Returns the time of the monotonic clock.
+ *
+ * @return The current time in nanoseconds.
+ */
+uint64_t monotonic_ns(void);
+
+/**
+ * @brief Returns the time of the monotonic clock in milliseconds.
+ *
+ * @return The current time in milliseconds.
+ */
+uint64_t monotonic_ms(void);
+
+/**
+ * @brief Hashes a string with FNV-1a, for the hash tables keyed by a name.
+ *
+ * @param[in] text The string.
+ * @return The hash; the caller reduces it to the size of its table.
+ */
+unsigned int hash_string(const char *text);
+
+#endif
@@ -0,0 +1,191 @@
+#define _GNU_SOURCE
+#include "workpool.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// Réveille la boucle d'événements : des résultats l'attendent
+static void notify(workpool_t *pool)
+{
+    uint64_t one = 1;
+    if (write(pool->event_fd, &one, sizeof(one)) < 0)
+    {
+        fprintf(stderr, "%s : erreur lors de la notification d'un résultat : %s\n", pool->name, strerror(errno));
+    }
+}
+
+static void *worker(void *arg)
+{
+    workpool_t *pool = arg;
+    if (pool->priority != 0)
+    {
+        // Priorité réduite : les tâches ne doivent pas priver la boucle d'événements de CPU
+        setpriority(PRIO_PROCESS, syscall(SYS_gettid), pool->priority);
+    }
+
+    // Copies de la tâche et du résultat, propres au thread
+    char *job = malloc(pool->job_size);
+    char *result = malloc(pool->result_size);
+    if (job == NULL || result == NULL)
+    {
+        perror("malloc failed");
+        free(job);
+        free(result);
+        return NULL;
+    }
+
+    while (1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->jobs_count == 0)
+        {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        char *slot = pool->jobs + (size_t)pool->jobs_head * pool->job_size;
+        memcpy(job, slot, pool->job_size);
+        explicit_bzero(slot, pool->job_size);
+        unsigned int ticket = pool->tickets[pool->jobs_head];
+        pool->jobs_head = (pool->jobs_head + 1) % pool->capacity;
+        pool->jobs_count--;
+        pool->busy++;
+        pthread_mutex_unlock(&pool->lock);
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        memset(result, 0, pool->result_size);
+        pool->run(job, ticket, result);
+        explicit_bzero(job, pool->job_size);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double elapsed = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+        pthread_mutex_lock(&pool->lock);
+        memcpy(pool->results + (size_t)((pool->results_head + pool->results_count) % pool->capacity) * pool->result_size, result,
+               pool->result_size);
+        pool->results_count++;
+        pool->busy--;
+        pool->done++;
+        pool->total_ms += elapsed;
+        if (elapsed > pool->max_ms)
+        {
+            pool->max_ms = elapsed;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        notify(pool);
+    }
+    return NULL;
+}
+
+int workpool_start(workpool_t *pool, const char *name, workpool_run_fn run, size_t job_size, size_t result_size,
+                   int workers, int capacity, int priority)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->name = name;
+    pool->run = run;
+    pool->job_size = job_size;
+    pool->result_size = result_size;
+    pool->workers = workers;
+    pool->capacity = capacity;
+    pool->priority = priority;
+    pool->next_ticket = 1;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    pool->jobs = calloc(capacity, job_size);
+    pool->tickets = calloc(capacity, sizeof(unsigned int));
+    pool->results = calloc(capacity, result_size);
+    if (pool->jobs == NULL || pool->tickets == NULL || pool->results == NULL)
+    {
+        perror("calloc failed");
+        return -1;
+    }
+
+    pool->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pool->event_fd < 0)
+    {
+        perror("eventfd failed");
+        return -1;
+    }
+
+    for (int i = 0; i < workers; i++)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker, pool) != 0)
+        {
+            perror("pthread_create failed");
+            return -1;
+        }
+        pthread_detach(thread);
+    }
+    return pool->event_fd;
+}
+
+int workpool_submit(workpool_t *pool, const void *job, unsigned int *ticket)
+{
+    pthread_mutex_lock(&pool->lock);
+
+    // File pleine : on refuse plutôt que de laisser grossir l'attente
+    if (pool->outstanding >= pool->capacity)
+    {
+        pool->rejected++;
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+
+    int slot = (pool->jobs_head + pool->jobs_count) % pool->capacity;
+    memcpy(pool->jobs + (size_t)slot * pool->job_size, job, pool->job_size);
+    pool->tickets[slot] = pool->next_ticket++;
+    if (pool->next_ticket == 0)
+    {
+        pool->next_ticket = 1; // 0 veut dire « aucune tâche » pour l'appelant
+    }
+    *ticket = pool->tickets[slot];
+
+    pool->jobs_count++;
+    pool->outstanding++;
+    if (pool->jobs_count > pool->max_queued)
+    {
+        pool->max_queued = pool->jobs_count;
+    }
+
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+int workpool_collect(workpool_t *pool, void *results, int max)
+{
+    uint64_t count;
+    if (read(pool->event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    {
+        fprintf(stderr, "%s : erreur lors de la lecture des résultats : %s\n", pool->name, strerror(errno));
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    int n = 0;
+    while (n < max && pool->results_count > 0)
+    {
+        memcpy((char *)results + (size_t)n * pool->result_size, pool->results + (size_t)pool->results_head * pool->result_size,
+               pool->result_size);
+        n++;
+        pool->results_head = (pool->results_head + 1) % pool->capacity;
+        pool->results_count--;
+        pool->outstanding--;
+    }
+    int more = pool->results_count > 0;
+    pthread_mutex_unlock(&pool->lock);
+
+    // Il reste des résultats : garder l'eventfd lisible pour le prochain tour
+    if (more)
+    {
+        notify(pool);
+    }
+    return n;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file workpool.h
+ * @brief Pool of worker threads running jobs for the event loop.
+ *
+ * The event loop must never wait: a slow job (hashing a password, reading
+ * the stored history) is copied into a bounded queue and run by one of the
+ * worker threads. The result is put in a second queue, and the event loop
+ * is woken up through an eventfd to collect it. When `capacity` jobs are
+ * already accepted and not collected yet, a new one is refused instead of
+ * letting the wait grow.
+ *
+ * Jobs and results are fixed-size structures copied by value; each job gets
+ * a ticket, never 0, that the event loop keeps to recognize its result. The
+ * copies of a job are wiped once it has run, as it can hold a password.
+ */
+
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/**
+ * @brief Function run by a worker for each job.
+ *
+ * @param[in,out] job The job (a copy owned by the worker).
+ * @param[in] ticket The ticket of the job.
+ * @param[out] result The result, zeroed before the call.
+ */
+typedef void (*workpool_run_fn)(void *job, unsigned int ticket, void *result);
+
+/**
+ * @brief Structure representing a pool of worker threads.
+ */
+typedef struct
+{
+    const char *name;         /**< Name shown in the error messages */
+    workpool_run_fn run;      /**< Function running a job */
+    size_t job_size;          /**< Size of a job */
+    size_t result_size;       /**< Size of a result */
+    int workers;              /**< Number of threads */
+    int capacity;             /**< Jobs accepted and not collected yet, at most */
+    int priority;             /**< Niceness of the threads, 0 for the one of the process */
+    pthread_mutex_t lock;     /**< Lock of the queues and of the statistics */
+    pthread_cond_t cond;      /**< Signaled when a job is queued */
+    int event_fd;             /**< eventfd readable when results are waiting */
+    char *jobs;               /**< Queued jobs (ring of capacity jobs) */
+    unsigned int *tickets;    /**< Tickets of the queued jobs */
+    int jobs_head;            /**< Oldest queued job */
+    int jobs_count;           /**< Number of queued jobs */
+    char *results;            /**< Results waiting for the event loop (ring of capacity results) */
+    int results_head;         /**< Oldest result */
+    int results_count;        /**< Number of results */
+    int outstanding;          /**< Jobs accepted and not collected yet (queued, running or done) */
+    unsigned int next_ticket; /**< Ticket of the next job */
+    int busy;                 /**< Threads running a job */
+    int max_queued;           /**< Highest number of queued jobs */
+    unsigned long done;       /**< Jobs run */
+    unsigned long rejected;   /**< Jobs refused because the pool was full */
+    double total_ms;          /**< Time spent running the jobs */
+    double max_ms;            /**< Longest job */
+} workpool_t;
+
+/**
+ * @brief Starts the threads of a pool.
+ *
+ * @param[out] pool The pool.
+ * @param[in] name The name shown in the error messages.
+ * @param[in] run The function running a job.
+ * @param[in] job_size The size of a job.
+ * @param[in] result_size The size of a result.
+ * @param[in] workers The number of threads.
+ * @param[in] capacity The maximum number of jobs accepted and not collected yet.
+ * @param[in] priority The niceness of the threads (higher is lower priority), 0 to keep the one of the process.
+ * @return The eventfd to watch for results, or -1 on error.
+ */
+int workpool_start(workpool_t *pool, const char *name, workpool_run_fn run, size_t job_size, size_t result_size,
+                   int workers, int capacity, int priority);
+
+/**
+ * @brief Queues a job.
+ *
+ * @param[in,out] pool The pool.
+ * @param[in] job The job, copied.
+ * @param[out] ticket The ticket of the job, never 0.
+ * @return 0 on success, -1 if the pool is full.
+ */
+int workpool_submit(workpool_t *pool, const void *job, unsigned int *ticket);
+
+/**
+ * @brief Collects the results of the finished jobs.
+ *
+ * This function must be called when the eventfd returned by
+ * workpool_start() is readable. If more than max results are waiting, the
+ * eventfd stays readable.
+ *
+ * @param[in,out] pool The pool.
+ * @param[out] results The array receiving the results.
+ * @param[in] max The number of results the array can hold.
+ * @return The number of results written.
+ */
+int workpool_collect(workpool_t *pool, void *results, int max);
+
+#endif
@@ -0,0 +1,336 @@
+#include "zcache.h"
+#include "compress.h"
+#include "checksum.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ZCACHE_PATH_SIZE 512
+
+// Une compression en arrière-plan
+typedef struct
+{
+    char source_path[ZCACHE_PATH_SIZE];
+    char cache_dir[ZCACHE_PATH_SIZE];
+    char cache_path[ZCACHE_PATH_SIZE];
+    char checksum_path[ZCACHE_PATH_SIZE];
+    struct stat source; // État du fichier au moment de la demande
+    int build_copy;     // 0 : seulement la somme de contrôle
+} zcache_job_t;
+
+// Partagé avec les threads de compression
+static pthread_mutex_t zcache_lock = PTHREAD_MUTEX_INITIALIZER;
+static int running_jobs = 0;
+static int max_running_jobs = ZCACHE_MAX_JOBS;
+static unsigned long copies_built = 0;
+static unsigned long copies_incompressible = 0;
+static unsigned long copies_failed = 0;
+static unsigned long checksums_computed = 0;
+
+// Mis à jour par la boucle principale uniquement
+static unsigned long files_sent = 0;
+static unsigned long long bytes_saved_sent = 0;
+static unsigned long files_received = 0;
+static unsigned long long bytes_saved_received = 0;
+static unsigned long misses = 0;
+
+static void cache_paths(const char *channel, const char *filename, char *dir, char *path)
+{
+    snprintf(dir, ZCACHE_PATH_SIZE, "server/%s/.cache", channel);
+    snprintf(path, ZCACHE_PATH_SIZE, "server/%s/.cache/%s.z", channel, filename);
+}
+
+static void checksum_path(const char *channel, const char *filename, char *path)
+{
+    snprintf(path, ZCACHE_PATH_SIZE, "server/%s/.cache/%s.crc32c", channel, filename);
+}
+
+// Le fichier n'a pas changé depuis la demande (même date de modification, même taille)
+static int same_file(const struct stat *a, const struct stat *b)
+{
+    return a->st_ino == b->st_ino && a->st_size == b->st_size &&
+           a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+static int newer_or_same(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec > b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec >= b->tv_nsec);
+}
+
+// Crée le fichier temporaire de la copie ; il sert aussi de verrou entre deux demandes du même fichier
+static int create_temporary(const char *tmp_path)
+{
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd >= 0 || errno != EEXIST)
+    {
+        return fd;
+    }
+
+    // Copie abandonnée par un serveur arrêté en pleine compression
+    struct stat st;
+    if (stat(tmp_path, &st) == 0 && time(NULL) - st.st_mtime > ZCACHE_STALE_SECONDS)
+    {
+        unlink(tmp_path);
+        return open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    }
+    return -1; // Une autre compression du fichier est en cours
+}
+
+// "<crc> <taille>" : la taille évite de servir la somme d'un fichier remplacé dans la même milliseconde
+static int write_checksum(const char *dir, const char *path, uint32_t crc, long size)
+{
+    char tmp_path[ZCACHE_PATH_SIZE + 8], text[64];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    int len = snprintf(text, sizeof(text), "%08x %ld\n", crc, size);
+
+    mkdir(dir, 0755);
+    int fd = create_temporary(tmp_path);
+    if (fd < 0)
+    {
+        return -1; // Une autre écriture de la même somme est en cours
+    }
+    int written = write(fd, text, len) == len;
+    close(fd);
+    if (!written || rename(tmp_path, path) < 0)
+    {
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// La compression calcule la somme de contrôle au passage, sans relire le fichier
+static int build_copy(zcache_job_t *job, uint32_t *crc)
+{
+    char tmp_path[ZCACHE_PATH_SIZE + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", job->cache_path);
+    int built = 0, compressible = 0, summed = 0;
+
+    mkdir(job->cache_dir, 0755);
+    int out_fd = create_temporary(tmp_path);
+    int in_fd = out_fd >= 0 ? open(job->source_path, O_RDONLY | O_CLOEXEC) : -1;
+    struct stat st;
+    if (in_fd >= 0 && fstat(in_fd, &st) == 0 && same_file(&st, &job->source))
+    {
+        long compressed_size;
+        if (compress_file(in_fd, out_fd, &compressed_size, crc) == 0)
+        {
+            summed = 1;
+            // Une copie vide note que le fichier ne gagne rien à être compressé
+            compressible = compress_worthwhile(st.st_size, compressed_size);
+            built = compressible || ftruncate(out_fd, 0) == 0;
+        }
+    }
+    if (in_fd >= 0)
+    {
+        close(in_fd);
+    }
+    if (out_fd >= 0)
+    {
+        close(out_fd);
+
+        // Le fichier a pu être remplacé pendant la compression : la copie ne vaut plus rien
+        if (!built || stat(job->source_path, &st) < 0 || !same_file(&st, &job->source) || rename(tmp_path, job->cache_path) < 0)
+        {
+            unlink(tmp_path);
+            built = 0;
+        }
+    }
+
+    pthread_mutex_lock(&zcache_lock);
+    if (built)
+    {
+        copies_built += compressible;
+        copies_incompressible += !compressible;
+    }
+    else if (out_fd >= 0)
+    {
+        copies_failed++;
+    }
+    pthread_mutex_unlock(&zcache_lock);
+    return summed;
+}
+
+static int build_checksum(zcache_job_t *job, uint32_t *crc)
+{
+    int fd = open(job->source_path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    int summed = fd >= 0 && fstat(fd, &st) == 0 && same_file(&st, &job->source) && crc32c_file(fd, st.st_size, crc) == 0;
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    return summed;
+}
+
+static void *zcache_worker(void *arg)
+{
+    zcache_job_t *job = arg;
+    uint32_t crc;
+    int summed = job->build_copy ? build_copy(job, &crc) : build_checksum(job, &crc);
+
+    // Une somme calculée sur un fichier remplacé entre-temps ne vaut rien
+    struct stat st;
+    summed = summed && stat(job->source_path, &st) == 0 && same_file(&st, &job->source) &&
+             write_checksum(job->cache_dir, job->checksum_path, crc, st.st_size) == 0;
+
+    pthread_mutex_lock(&zcache_lock);
+    running_jobs--;
+    checksums_computed += summed;
+    pthread_mutex_unlock(&zcache_lock);
+
+    free(job);
+    return NULL;
+}
+
+static void start_job(const char *channel, const char *filename, const struct stat *source, int build_copy)
+{
+    pthread_mutex_lock(&zcache_lock);
+    int busy = running_jobs >= max_running_jobs;
+    if (!busy)
+    {
+        running_jobs++;
+    }
+    pthread_mutex_unlock(&zcache_lock);
+    if (busy)
+    {
+        return; // Le travail sera refait lors d'un prochain téléchargement
+    }
+
+    zcache_job_t *job = malloc(sizeof(zcache_job_t));
+    pthread_t thread;
+    if (job != NULL)
+    {
+        snprintf(job->source_path, sizeof(job->source_path), "server/%s/%s", channel, filename);
+        cache_paths(channel, filename, job->cache_dir, job->cache_path);
+        checksum_path(channel, filename, job->checksum_path);
+        job->source = *source;
+        job->build_copy = build_copy;
+    }
+    if (job == NULL || pthread_create(&thread, NULL, zcache_worker, job) != 0)
+    {
+        perror("Erreur lors du démarrage de la compression");
+        free(job);
+        pthread_mutex_lock(&zcache_lock);
+        running_jobs--;
+        pthread_mutex_unlock(&zcache_lock);
+        return;
+    }
+    pthread_detach(thread);
+}
+
+void zcache_set_max_jobs(int max_jobs)
+{
+    pthread_mutex_lock(&zcache_lock);
+    max_running_jobs = max_jobs;
+    pthread_mutex_unlock(&zcache_lock);
+}
+
+int zcache_open(const char *channel, const char *filename, const struct stat *source, long *compressed_size)
+{
+    if (source->st_size < COMPRESS_MIN_SIZE)
+    {
+        return -1;
+    }
+
+    char dir[ZCACHE_PATH_SIZE], path[ZCACHE_PATH_SIZE];
+    cache_paths(channel, filename, dir, path);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && newer_or_same(&st.st_mtim, &source->st_mtim))
+    {
+        if (st.st_size == 0)
+        {
+            close(fd); // Fichier incompressible : l'original part tel quel
+            return -1;
+        }
+        *compressed_size = st.st_size;
+        return fd;
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    // Pas de copie, ou copie plus ancienne que le fichier
+    misses++;
+    start_job(channel, filename, source, 1);
+    return -1;
+}
+
+int zcache_checksum(const char *channel, const char *filename, const struct stat *source, uint32_t *crc)
+{
+    char path[ZCACHE_PATH_SIZE];
+    checksum_path(channel, filename, path);
+    FILE *file = fopen(path, "re");
+    struct stat st;
+    unsigned int stored_crc;
+    long stored_size;
+    int found = file != NULL && fstat(fileno(file), &st) == 0 && newer_or_same(&st.st_mtim, &source->st_mtim) &&
+                fscanf(file, "%8x %ld", &stored_crc, &stored_size) == 2 && stored_size == source->st_size;
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+    if (found)
+    {
+        *crc = stored_crc;
+        return 0;
+    }
+
+    // Fichier antérieur aux sommes de contrôle : la calculer pour les prochains téléchargements
+    start_job(channel, filename, source, 0);
+    return -1;
+}
+
+void zcache_store_checksum(const char *channel, const char *filename, uint32_t crc)
+{
+    char dir[ZCACHE_PATH_SIZE], path[ZCACHE_PATH_SIZE], file_path[ZCACHE_PATH_SIZE];
+    cache_paths(channel, filename, dir, path);
+    checksum_path(channel, filename, path);
+    snprintf(file_path, sizeof(file_path), "server/%s/%s", channel, filename);
+    struct stat st;
+    if (stat(file_path, &st) == 0)
+    {
+        write_checksum(dir, path, crc, st.st_size);
+    }
+}
+
+void zcache_invalidate(const char *channel, const char *filename)
+{
+    char dir[ZCACHE_PATH_SIZE], path[ZCACHE_PATH_SIZE];
+    cache_paths(channel, filename, dir, path);
+    unlink(path);
+    checksum_path(channel, filename, path);
+    unlink(path);
+}
+
+void zcache_count_sent(long size, long compressed_size)
+{
+    files_sent++;
+    bytes_saved_sent += size - compressed_size;
+}
+
+void zcache_count_received(long size, long compressed_size)
+{
+    files_received++;
+    bytes_saved_received += size - compressed_size;
+}
+
+void zcache_format_stats(char *buffer, size_t size)
+{
+    pthread_mutex_lock(&zcache_lock);
+    snprintf(buffer, size,
+             "Compression : %lu fichiers envoyés compressés (%llu octets économisés), %lu reçus compressés (%llu octets économisés), "
+             "copies compressées %lu créées, %lu incompressibles, %lu échouées, %d en cours, %lu téléchargements sans copie, "
+             "%lu sommes de contrôle calculées en arrière-plan\n",
+             files_sent, bytes_saved_sent, files_received, bytes_saved_received,
+             copies_built, copies_incompressible, copies_failed, running_jobs, misses, checksums_computed);
+    pthread_mutex_unlock(&zcache_lock);
+}
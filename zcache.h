@@ -0,0 +1,103 @@
+/**
+ * @file zcache.h
+ * @brief Compressed copies and checksums of the channel files.
+ *
+ * A file is compressed once, in the background, the first time a client that
+ * negotiated compression downloads it: this download (and the others until
+ * the copy is ready) gets the raw file, the next ones get the compressed copy
+ * with the same zero-copy path. The copy of `server/<channel>/<name>` is
+ * `server/<channel>/.cache/<name>.z`; the channel files cannot start with a
+ * dot, so the cache directory never shows up as a file of the channel.
+ *
+ * A copy is used only if it is newer than the file. An empty copy records
+ * that the file does not compress well enough, so it is not compressed
+ * again on each download.
+ *
+ * The CRC-32C of the file (see checksum.h) is kept next to the copy, in
+ * `server/<channel>/.cache/<name>.crc32c`, with the size of the file. It is
+ * stored when an upload is checked, computed while the copy is built, or
+ * computed in the background the first time a file without checksum is
+ * downloaded, so a download never reads the file twice.
+ */
+
+#ifndef ZCACHE_H
+#define ZCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define ZCACHE_MAX_JOBS 2          /**< Default number of files compressed at the same time in the background */
+#define ZCACHE_STALE_SECONDS 300   /**< Age after which an unfinished copy (crash) is removed */
+
+/**
+ * @brief Sets the number of files compressed or summed at the same time in the background.
+ *
+ * @param[in] max_jobs The number of background jobs.
+ */
+void zcache_set_max_jobs(int max_jobs);
+
+/**
+ * @brief Opens the compressed copy of a file, or starts building it.
+ *
+ * @param[in] channel The channel of the file.
+ * @param[in] filename The name of the file.
+ * @param[in] source The status of the file (fstat of the opened file).
+ * @param[out] compressed_size The size of the compressed copy.
+ * @return A descriptor of the compressed copy, or -1 if the raw file must be sent.
+ */
+int zcache_open(const char *channel, const char *filename, const struct stat *source, long *compressed_size);
+
+/**
+ * @brief Reads the stored checksum of a file, or starts computing it.
+ *
+ * @param[in] channel The channel of the file.
+ * @param[in] filename The name of the file.
+ * @param[in] source The status of the file (fstat of the opened file).
+ * @param[out] crc The CRC-32C of the file.
+ * @return 0 if the checksum is known, -1 if it is being computed for the next downloads.
+ */
+int zcache_checksum(const char *channel, const char *filename, const struct stat *source, uint32_t *crc);
+
+/**
+ * @brief Stores the checksum of a file that has just been received and checked.
+ *
+ * @param[in] channel The channel of the file.
+ * @param[in] filename The name of the file.
+ * @param[in] crc The CRC-32C of the file.
+ */
+void zcache_store_checksum(const char *channel, const char *filename, uint32_t crc);
+
+/**
+ * @brief Removes the compressed copy and the checksum of a file that is being replaced.
+ *
+ * @param[in] channel The channel of the file.
+ * @param[in] filename The name of the file.
+ */
+void zcache_invalidate(const char *channel, const char *filename);
+
+/**
+ * @brief Counts a file sent compressed.
+ *
+ * @param[in] size The size of the file.
+ * @param[in] compressed_size The number of bytes actually sent.
+ */
+void zcache_count_sent(long size, long compressed_size);
+
+/**
+ * @brief Counts a file received compressed.
+ *
+ * @param[in] size The size of the file.
+ * @param[in] compressed_size The number of bytes actually received.
+ */
+void zcache_count_received(long size, long compressed_size);
+
+/**
+ * @brief Writes the statistics of the compression.
+ *
+ * @param[out] buffer The buffer receiving the text (one line).
+ * @param[in] size The size of the buffer.
+ */
+void zcache_format_stats(char *buffer, size_t size);
+
+#endif